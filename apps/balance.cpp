@@ -0,0 +1,166 @@
+#include "balance.h"
+#include "format.h"
+
+#include <cmath>
+
+namespace LM50 {
+
+// The fraction of the threshold below which an event is cleared
+static const double clearRatio( 0.8 );
+
+BalanceCheck::BalanceCheck() : \
+	_options( nullptr ), \
+	_feeds(), \
+	_children(), \
+	_lastPulses(), \
+	_delta(), \
+	_ringEnergy(), \
+	_ringTime(), \
+	_ringResidual(), \
+	_window( 1 ), \
+	_ringPos( 0 ), \
+	_alpha( 0.0 ), \
+	_threshold( 0.0 ), \
+	_time( 0.0 ) {
+}
+
+void BalanceCheck::configure( const ProgramOptions& po ) {
+	_options = &po;
+	const ProgramOptions::BalanceTree& tree( po.balanceTree() );
+	_feeds.clear();
+	_children.clear();
+	for( size_t i( 0 ); i != tree.size(); ++i ) {
+		Feed f;
+		f.channel = tree[i].feed;
+		f.firstChild = _children.size();
+		f.childCount = tree[i].subMeters.size();
+		f.residual = f.ewma = 0.0;
+		f.windowEnergy = f.windowTime = f.windowSum = f.windowSquares = 0.0;
+		f.windowFill = 0;
+		f.state = OK;
+		_feeds.push_back( f );
+		_children.insert( _children.end(), tree[i].subMeters.begin(), tree[i].subMeters.end() );
+	}
+	_window = po.balanceWindow();
+	_alpha = po.balanceAlpha();
+	_threshold = po.balanceThreshold();
+	_lastPulses.assign( LM50Device::countChannels, 0 );
+	_delta.assign( LM50Device::countChannels, 0.0 );
+	_ringEnergy.assign( _feeds.size() * _window, 0.0 );
+	_ringTime.assign( _feeds.size() * _window, 0.0 );
+	_ringResidual.assign( _feeds.size() * _window, 0.0 );
+	_ringPos = 0;
+	_time = 0.0;
+}
+
+void BalanceCheck::update( const LM50Energy& energy, const struct timespec& time, LogSink& log, LogSink& events ) {
+	if( _feeds.empty() ) return;
+	const double t( time.tv_sec + time.tv_nsec * 1.0e-9 );
+	const double dt( t - _time );
+	const bool isBaseline( _time == 0.0 );
+	_time = t;
+
+	// The energy of each channel since the last update in Ws. The pulses are
+	// taken over in any case, such that a skipped update is not counted twice.
+	double* delta( &_delta[0] );
+	for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) {
+		delta[ i ] = ( energy.pulses( i ) - _lastPulses[ i ] ) * energy.kWhPerImp( i ) * 3600000.0;
+		_lastPulses[ i ] = energy.pulses( i );
+	}
+	if( isBaseline || dt <= 0.0 ) return;
+
+	// Recompute the sums from the ring once per round, such that rounding
+	// errors of the incremental updates do not accumulate
+	const bool isRoundStart( _ringPos == 0 );
+	for( size_t k( 0 ); k != _feeds.size(); ++k ) {
+		Feed& f( _feeds[k] );
+		double residualEnergy( delta[ f.channel ] );
+		for( size_t c( f.firstChild ); c != f.firstChild + f.childCount; ++c ) residualEnergy -= delta[ _children[c] ];
+		f.residual = residualEnergy / dt;
+		f.ewma = f.windowFill == 0 ? f.residual : _alpha * f.residual + ( 1.0 - _alpha ) * f.ewma;
+
+		const size_t slot( k * _window + _ringPos );
+		if( f.windowFill == _window ) {
+			f.windowEnergy -= _ringEnergy[ slot ];
+			f.windowTime -= _ringTime[ slot ];
+			f.windowSum -= _ringResidual[ slot ];
+			f.windowSquares -= _ringResidual[ slot ] * _ringResidual[ slot ];
+		} else {
+			++f.windowFill;
+		}
+		_ringEnergy[ slot ] = residualEnergy;
+		_ringTime[ slot ] = dt;
+		_ringResidual[ slot ] = f.residual;
+		if( isRoundStart ) {
+			f.windowEnergy = f.windowTime = f.windowSum = f.windowSquares = 0.0;
+			for( size_t i( 0 ); i != f.windowFill; ++i ) {
+				const size_t s( k * _window + i );
+				f.windowEnergy += _ringEnergy[ s ];
+				f.windowTime += _ringTime[ s ];
+				f.windowSum += _ringResidual[ s ];
+				f.windowSquares += _ringResidual[ s ] * _ringResidual[ s ];
+			}
+		} else {
+			f.windowEnergy += residualEnergy;
+			f.windowTime += dt;
+			f.windowSum += f.residual;
+			f.windowSquares += f.residual * f.residual;
+		}
+
+		// Only a full window is judged
+		if( f.windowFill != _window ) continue;
+		const double mean( f.windowEnergy / f.windowTime );
+		State s( f.state );
+		if( mean > _threshold ) s = ABOVE;
+		else if( mean < -_threshold ) s = BELOW;
+		else if( std::fabs( mean ) < clearRatio * _threshold ) s = OK;
+		if( s == f.state ) continue;
+		f.state = s;
+		emit( f, mean, log, events );
+	}
+	_ringPos = ( _ringPos + 1 ) % _window;
+}
+
+void BalanceCheck::emit( const Feed& f, double mean, LogSink& log, LogSink& events ) const {
+	LogLine line;
+	line.appendNow().append( "Balance of feed " ).appendUInt( f.channel + 1, 2, '0' ).append( " (" ).append( _options->channelMeta( f.channel ).name ).append( "): " );
+	switch( f.state ) {
+		case OK:
+			line.append( "ok" );
+			break;
+		case ABOVE:
+			line.append( "unmetered load or failed sub-meter" );
+			break;
+		case BELOW:
+			line.append( "sub-meters exceed feed, failed feed meter or wrong meter tree" );
+			break;
+	}
+	char buf[ Format::maxIntLength + 8 ];
+	line.append( ", residual " ).append( buf, Format::appendFixed( buf, mean, 1 ) - buf ).append( " W" );
+	log.write( line );
+	events.write( line );
+}
+
+void BalanceCheck::dump( std::ostream& os ) const {
+	char buf[ 5 * ( Format::maxIntLength + 8 ) ];
+	for( size_t k( 0 ); k != _feeds.size(); ++k ) {
+		const Feed& f( _feeds[k] );
+		const double mean( f.windowTime > 0.0 ? f.windowEnergy / f.windowTime : 0.0 );
+		const double n( f.windowFill );
+		const double variance( n > 1 ? ( f.windowSquares - f.windowSum * f.windowSum / n ) / ( n - 1 ) : 0.0 );
+		char* p( Format::appendUInt( buf, f.channel + 1, 2, '0' ) );
+		*p++ = '\t';
+		p = Format::appendFixed( p, f.residual, 1 );
+		*p++ = '\t';
+		p = Format::appendFixed( p, f.ewma, 1 );
+		*p++ = '\t';
+		p = Format::appendFixed( p, mean, 1 );
+		*p++ = '\t';
+		p = Format::appendFixed( p, variance > 0.0 ? std::sqrt( variance ) : 0.0, 1 );
+		*p++ = '\t';
+		os.write( buf, p - buf );
+		os << ( f.state == OK ? "ok" : "alarm" ) << '\n';
+	}
+}
+
+}
@@ -0,0 +1,105 @@
+#ifndef _BALANCE_H_
+#define _BALANCE_H_
+
+#include <ctime>
+#include <ostream>
+#include <sys/types.h>
+#include <vector>
+
+#include "program_options.h"
+#include "core/lm50energy.h"
+#include "log_sink.h"
+
+namespace LM50 {
+
+/**
+ * Checks the balance of feeds and their sub-meters online, see option
+ * "balance". For each feed the residual power, i.e. the power of the feed
+ * minus the sum of the power of its sub-meters, is computed on every update
+ * from the counter deltas of LM50Energy.
+ *
+ * The residual of a single update is noisy, because a meter only counts
+ * whole pulses. Hence, the residual is tracked by an exponentially weighted
+ * moving average and by the mean and standard deviation over a window of
+ * the last updates. The window mean is exact, because it is the energy
+ * difference over the window divided by its duration.
+ *
+ * If the window mean exceeds the threshold, an event is written to the
+ * given sinks: a positive residual indicates unmetered load or a failed
+ * sub-meter, a negative residual a failed feed meter or a wrong meter tree.
+ * The event is cleared, if the mean falls below 80% of the threshold.
+ *
+ * All memory is allocated by configure(), update() neither allocates nor
+ * throws. The object is not thread-safe, the daemon protects it by the
+ * device mutex.
+ */
+class BalanceCheck {
+	public:
+		BalanceCheck();
+		virtual ~BalanceCheck() {}
+
+	public:
+		/**
+		 * Sets up the feeds, the window and the threshold and resets all
+		 * statistics
+		 */
+		void configure( const ProgramOptions& po );
+
+		/**
+		 * Processes an update of the energy engine
+		 * @param energy The engine, after it processed the update
+		 * @param time The time of the update
+		 * @param log The sink for events, e.g. the daemon log
+		 * @param events An additional sink for events, e.g. a file
+		 */
+		void update( const LM50Energy& energy, const struct timespec& time, LogSink& log, LogSink& events );
+
+		/**
+		 * Writes one line per feed with the channel of the feed, the last
+		 * residual, the moving average, the window mean and standard
+		 * deviation in W and the state of the event (ok or alarm)
+		 */
+		void dump( std::ostream& os ) const;
+
+	protected:
+		enum State { OK, ABOVE, BELOW };
+
+		/**
+		 * The state of a single feed. The window is a ring of the residual
+		 * energy and the duration of the last updates.
+		 */
+		struct Feed {
+			LM50Device::ChIdx channel;
+			size_t firstChild;
+			size_t childCount;
+			double residual;     // in W
+			double ewma;         // in W
+			double windowEnergy; // in Ws
+			double windowTime;   // in s
+			double windowSum;    // of the residuals in W
+			double windowSquares;
+			size_t windowFill;
+			State state;
+		};
+
+		void emit( const Feed& f, double mean, LogSink& log, LogSink& events ) const;
+
+	protected:
+		const ProgramOptions* _options;
+		std::vector< Feed > _feeds;
+		std::vector< LM50Device::ChIdx > _children;
+		std::vector< u_int64_t > _lastPulses;
+		std::vector< double > _delta;
+		std::vector< double > _ringEnergy;
+		std::vector< double > _ringTime;
+		std::vector< double > _ringResidual;
+		size_t _window;
+		size_t _ringPos;
+		double _alpha;
+		double _threshold;
+		double _time;
+};
+
+}
+
+#endif
@@ -0,0 +1,83 @@
+#include "format.h"
+
+#include <cstring>
+
+namespace LM50 {
+namespace Format {
+
+char* appendUInt( char* dest, u_int64_t value ) {
+	char digits[ maxIntLength ];
+	size_t n( 0 );
+	do {
+		digits[ n++ ] = static_cast< char >( '0' + value % 10 );
+		value /= 10;
+	} while( value != 0 );
+	while( n != 0 ) *dest++ = digits[ --n ];
+	return dest;
+}
+
+char* appendUInt( char* dest, u_int64_t value, size_t width, char fill ) {
+	char digits[ maxIntLength ];
+	char* end( appendUInt( digits, value ) );
+	size_t n( end - digits );
+	for( ; width > n; --width ) *dest++ = fill;
+	memcpy( dest, digits, n );
+	return dest + n;
+}
+
+char* appendInt( char* dest, int64_t value ) {
+	if( value >= 0 ) return appendUInt( dest, value );
+	*dest++ = '-';
+	// Negate in unsigned arithmetic, such that the smallest value does not
+	// overflow
+	return appendUInt( dest, ~static_cast< u_int64_t >( value ) + 1 );
+}
+
+char* appendMicros( char* dest, u_int64_t ns ) {
+	dest = appendUInt( dest, ns / 1000 );
+	*dest++ = '.';
+	return appendUInt( dest, ns % 1000, 3, '0' );
+}
+
+char* appendFixed( char* dest, double value, unsigned int decimals ) {
+	u_int64_t scale( 1 );
+	for( unsigned int i( 0 ); i != decimals; ++i ) scale *= 10;
+	if( value < 0.0 ) {
+		*dest++ = '-';
+		value = -value;
+	}
+	const u_int64_t scaled( static_cast< u_int64_t >( value * scale + 0.5 ) );
+	dest = appendUInt( dest, scaled / scale );
+	if( decimals == 0 ) return dest;
+	*dest++ = '.';
+	return appendUInt( dest, scaled % scale, decimals, '0' );
+}
+
+char* appendTime( char* dest, const struct timespec& ts ) {
+	struct tm t;
+	gmtime_r( &(ts.tv_sec), &t );
+	dest = appendUInt( dest, 1900 + t.tm_year, 4, '0' );
+	*dest++ = '-';
+	dest = appendUInt( dest, 1 + t.tm_mon, 2, '0' );
+	*dest++ = '-';
+	dest = appendUInt( dest, t.tm_mday, 2, '0' );
+	*dest++ = 'T';
+	dest = appendUInt( dest, t.tm_hour, 2, '0' );
+	*dest++ = ':';
+	dest = appendUInt( dest, t.tm_min, 2, '0' );
+	*dest++ = ':';
+	dest = appendUInt( dest, t.tm_sec, 2, '0' );
+	*dest++ = '.';
+	dest = appendUInt( dest, ts.tv_nsec, 9, '0' );
+	*dest++ = 'Z';
+	return dest;
+}
+
+char* appendString( char* dest, const char* s ) {
+	const size_t l( strlen( s ) );
+	memcpy( dest, s, l );
+	return dest + l;
+}
+
+}
+}
@@ -0,0 +1,78 @@
+#ifndef _FORMAT_H_
+#define _FORMAT_H_
+
+#include <ctime>
+#include <sys/types.h>
+
+namespace LM50 {
+
+/**
+ * Formatting of numbers and time stamps into caller-provided buffers.
+ *
+ * All output of the program (Cacti and human readable output, the RRD
+ * update argument, CSV records, metrics and the timeline) is formatted by
+ * these functions. They neither depend on the locale nor allocate memory,
+ * hence they are safe to be called from the polling thread and produce the
+ * same output regardless of the environment.
+ *
+ * Each function writes to dest and returns a pointer behind the last
+ * written character. No terminating null character is written. The caller
+ * must provide enough space, see the constants below.
+ */
+namespace Format {
+
+/**
+ * The maximum number of characters of a 64bit integer including the sign
+ */
+static const size_t maxIntLength = 20;
+
+/**
+ * The number of characters of a time stamp, see appendTime
+ */
+static const size_t timeLength = 30;
+
+/**
+ * Appends the decimal representation of the value
+ */
+char* appendUInt( char* dest, u_int64_t value );
+
+/**
+ * Appends the decimal representation of the value, padded to the left with
+ * the fill character to at least the given width
+ */
+char* appendUInt( char* dest, u_int64_t value, size_t width, char fill );
+
+/**
+ * Appends the decimal representation of the value with a leading minus sign
+ * for negative values
+ */
+char* appendInt( char* dest, int64_t value );
+
+/**
+ * Appends nanoseconds as microseconds with three decimal places, e.g.
+ * 1234.567
+ */
+char* appendMicros( char* dest, u_int64_t ns );
+
+/**
+ * Appends the value in fixed-point notation with the given number of
+ * decimal places (at most 9), rounded to nearest, e.g. 1234.57. The
+ * integral part must fit into 64 bits.
+ */
+char* appendFixed( char* dest, double value, unsigned int decimals );
+
+/**
+ * Appends the time in ISO-8601 format (UTC) with nanoseconds, e.g.
+ * 2016-03-01T12:00:00.000000000Z
+ */
+char* appendTime( char* dest, const struct timespec& ts );
+
+/**
+ * Appends the null-terminated string without the null character
+ */
+char* appendString( char* dest, const char* s );
+
+}
+}
+
+#endif
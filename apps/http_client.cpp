@@ -0,0 +1,264 @@
+#include "http_client.h"
+#include "format.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace LM50 {
+
+using boost::system::error_code;
+using boost::system::system_category;
+
+// The maximum size of the status line and the headers of a response
+static const size_t maxHeaderLength( 16384 );
+
+HttpClient::HttpClient() : \
+	_host(), \
+	_port(), \
+	_socket( -1 ), \
+	_request(), \
+	_in() {
+}
+
+HttpClient::~HttpClient() {
+	close();
+}
+
+void HttpClient::server( const std::string& host, const std::string& port ) {
+	close();
+	_host = host;
+	_port = port;
+}
+
+void HttpClient::close() {
+	if( _socket >= 0 ) ::close( _socket );
+	_socket = -1;
+	_in.clear();
+}
+
+/**
+ * Resolves the server and tries each address. The socket is non-blocking,
+ * such that the connect and all later reads and writes can be bounded by
+ * poll.
+ */
+void HttpClient::open( int timeout, error_code& ec ) {
+	close();
+	ec.clear();
+	struct addrinfo hints;
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo* addrs( NULL );
+	if( getaddrinfo( _host.c_str(), _port.c_str(), &hints, &addrs ) != 0 ) {
+		ec = boost::system::errc::make_error_code( boost::system::errc::host_unreachable );
+		return;
+	}
+	for( struct addrinfo* a( addrs ); a != NULL && _socket < 0; a = a->ai_next ) {
+		int fd( socket( a->ai_family, a->ai_socktype, a->ai_protocol ) );
+		if( fd < 0 ) continue;
+		fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+		int res( connect( fd, a->ai_addr, a->ai_addrlen ) );
+		if( res < 0 && errno == EINPROGRESS ) {
+			struct pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			int err( ETIMEDOUT );
+			socklen_t len( sizeof( err ) );
+			if( poll( &pfd, 1, timeout ) == 1 ) getsockopt( fd, SOL_SOCKET, SO_ERROR, &err, &len );
+			res = err == 0 ? 0 : -1;
+			errno = err;
+		}
+		if( res == 0 ) {
+			_socket = fd;
+		} else {
+			ec = error_code( errno, system_category() );
+			::close( fd );
+		}
+	}
+	freeaddrinfo( addrs );
+	if( _socket >= 0 ) ec.clear();
+}
+
+/**
+ * A request on a kept-alive connection may fail, because the server closed
+ * the idle connection in the meantime. Hence, such a request is sent once
+ * more on a new connection, if no part of the response has been received.
+ */
+unsigned int HttpClient::post( const std::string& path, const std::string& headers, const char* body, size_t length, int timeout, error_code& ec ) {
+	char contentLength[ Format::maxIntLength ];
+	const char* end( Format::appendUInt( contentLength, length ) );
+	_request.assign( "POST " ).append( path ).append( " HTTP/1.1\r\nHost: " ).append( _host );
+	_request.append( "\r\nContent-Length: " ).append( contentLength, end - contentLength );
+	_request.append( "\r\n" ).append( headers ).append( "\r\n" );
+
+	for( unsigned int attempt( 0 ); attempt != 2; ++attempt ) {
+		const bool isReused( isOpen() );
+		ec.clear();
+		if( !isReused ) open( timeout, ec );
+		if( ec ) return 0;
+		send( _request.data(), _request.size(), timeout, ec );
+		if( !ec ) send( body, length, timeout, ec );
+		unsigned int status( 0 );
+		if( !ec ) status = readResponse( timeout, ec );
+		if( !ec ) return status;
+		const bool isRetried( isReused && _in.empty() );
+		close();
+		if( !isRetried ) return 0;
+	}
+	return 0;
+}
+
+void HttpClient::send( const char* data, size_t length, int timeout, error_code& ec ) {
+	size_t sent( 0 );
+	while( sent < length ) {
+		ssize_t n( ::send( _socket, data + sent, length - sent, MSG_NOSIGNAL ) );
+		if( n > 0 ) {
+			sent += n;
+			continue;
+		}
+		if( n < 0 && errno == EINTR ) continue;
+		if( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) {
+			if( wait( POLLOUT, timeout, ec ) ) continue;
+		} else {
+			ec = error_code( n < 0 ? errno : EPIPE, system_category() );
+		}
+		return;
+	}
+}
+
+/**
+ * Waits for the socket to become readable or writable
+ * @return False, if the time out elapsed, ec is set then
+ */
+bool HttpClient::wait( short events, int timeout, error_code& ec ) {
+	struct pollfd pfd;
+	pfd.fd = _socket;
+	pfd.events = events;
+	pfd.revents = 0;
+	int res;
+	do res = poll( &pfd, 1, timeout ); while( res < 0 && errno == EINTR );
+	if( res > 0 ) return true;
+	ec = boost::system::errc::make_error_code( boost::system::errc::timed_out );
+	return false;
+}
+
+/**
+ * Skips the complete chunks of a body in chunked transfer encoding
+ * @param in The received bytes
+ * @param pos The offset of the next chunk size line, advanced past each
+ * complete chunk
+ * @return True, if the last chunk and the trailer have been received
+ */
+static bool skipChunks( const std::string& in, size_t& pos, error_code& ec ) {
+	while( true ) {
+		const size_t lineEnd( in.find( "\r\n", pos ) );
+		if( lineEnd == std::string::npos ) {
+			if( in.size() - pos > maxHeaderLength ) ec = boost::system::errc::make_error_code( boost::system::errc::protocol_error );
+			return false;
+		}
+		// The size may be followed by chunk extensions, which are ignored
+		const char* sizeBegin( in.c_str() + pos );
+		char* sizeEnd( NULL );
+		const unsigned long size( std::strtoul( sizeBegin, &sizeEnd, 16 ) );
+		if( sizeEnd == sizeBegin ) {
+			ec = boost::system::errc::make_error_code( boost::system::errc::protocol_error );
+			return false;
+		}
+		if( size == 0 ) {
+			// The last chunk is followed by optional trailers and an empty line
+			if( in.compare( lineEnd + 2, 2, "\r\n" ) == 0 ) return true;
+			return in.find( "\r\n\r\n", lineEnd ) != std::string::npos;
+		}
+		if( in.size() < lineEnd + 2 + size + 2 ) return false;
+		pos = lineEnd + 2 + size + 2;
+	}
+}
+
+/**
+ * Reads the status line, the headers and the body of the response. The body
+ * is discarded. A body in chunked transfer encoding ends with its last
+ * chunk, a body with neither a length nor chunks with the close of the
+ * connection.
+ * @return The status code, 0 if the response is incomplete or malformed
+ */
+unsigned int HttpClient::readResponse( int timeout, error_code& ec ) {
+	_in.clear();
+	size_t headerEnd( std::string::npos );
+	size_t bodyLength( 0 );
+	bool hasLength( false );
+	bool isChunked( false );
+	size_t chunkPos( 0 );
+	bool isClosing( false );
+	unsigned int status( 0 );
+	while( true ) {
+		if( headerEnd == std::string::npos ) {
+			headerEnd = _in.find( "\r\n\r\n" );
+			if( headerEnd == std::string::npos && _in.size() > maxHeaderLength ) {
+				ec = boost::system::errc::make_error_code( boost::system::errc::protocol_error );
+				return 0;
+			}
+			if( headerEnd != std::string::npos ) {
+				headerEnd += 4;
+				if( _in.compare( 0, 5, "HTTP/" ) != 0 || _in.size() < 12 ) {
+					ec = boost::system::errc::make_error_code( boost::system::errc::protocol_error );
+					return 0;
+				}
+				status = std::strtoul( _in.c_str() + _in.find( ' ' ), NULL, 10 );
+				std::string header( _in, 0, headerEnd );
+				std::transform( header.begin(), header.end(), header.begin(), ::tolower );
+				size_t pos( header.find( "\r\ncontent-length:" ) );
+				if( pos != std::string::npos ) {
+					hasLength = true;
+					bodyLength = std::strtoul( header.c_str() + pos + 17, NULL, 10 );
+				}
+				pos = header.find( "\r\ntransfer-encoding:" );
+				if( pos != std::string::npos ) {
+					const size_t lineEnd( header.find( "\r\n", pos + 2 ) );
+					isChunked = header.find( "chunked", pos ) < lineEnd;
+					chunkPos = headerEnd;
+				}
+				isClosing = header.find( "\r\nconnection: close" ) != std::string::npos;
+				// Responses without a body by definition
+				if( status == 204 || status == 304 || status < 200 ) {
+					hasLength = true;
+					isChunked = false;
+				}
+				if( !hasLength && !isChunked ) isClosing = true;
+			}
+		}
+		if( headerEnd != std::string::npos && isChunked ) {
+			if( skipChunks( _in, chunkPos, ec ) ) break;
+			if( ec ) return 0;
+		} else if( headerEnd != std::string::npos && hasLength && _in.size() >= headerEnd + bodyLength ) break;
+
+		if( !wait( POLLIN, timeout, ec ) ) return 0;
+		char buf[ 4096 ];
+		ssize_t n( recv( _socket, buf, sizeof( buf ), 0 ) );
+		if( n < 0 && ( errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK ) ) continue;
+		if( n < 0 ) {
+			ec = error_code( errno, system_category() );
+			return 0;
+		}
+		if( n == 0 ) {
+			// The end of a body without length is marked by the close
+			if( headerEnd != std::string::npos && !hasLength && !isChunked ) break;
+			ec = boost::system::errc::make_error_code( boost::system::errc::connection_reset );
+			return 0;
+		}
+		_in.append( buf, n );
+	}
+	if( isClosing ) close();
+	_in.clear();
+	return status;
+}
+
+}
@@ -0,0 +1,71 @@
+#ifndef _HTTP_CLIENT_H_
+#define _HTTP_CLIENT_H_
+
+#include <string>
+#include <boost/system/error_code.hpp>
+
+namespace LM50 {
+
+/**
+ * A minimal HTTP/1.1 client for POST requests over a persistent TCP
+ * connection.
+ *
+ * The connection is kept open between requests (keep-alive) and is opened
+ * again by post(), if the server closed it. Responses are expected to carry
+ * a Content-Length or a chunked body, otherwise the connection is closed
+ * after the response.
+ * The body of a response is read but discarded, only the status code is
+ * returned.
+ *
+ * Errors of the connection are reported by error codes, such that the
+ * endless retries during an outage of the server do not throw.
+ */
+class HttpClient {
+	public:
+		HttpClient();
+		virtual ~HttpClient();
+
+	private:
+		HttpClient( const HttpClient& );
+		HttpClient& operator=( const HttpClient& );
+
+	public:
+		/**
+		 * Sets the server for all following requests and closes the current
+		 * connection
+		 */
+		void server( const std::string& host, const std::string& port );
+
+		void close();
+
+		bool isOpen() const { return _socket >= 0; }
+
+		/**
+		 * Sends a POST request and waits for the response
+		 * @param path The path including the query, e.g. "/write?db=lm50"
+		 * @param headers Additional header lines, each terminated by "\r\n"
+		 * @param body The body of the request
+		 * @param length The length of the body in bytes
+		 * @param timeout The time in milliseconds after which the server is
+		 * taken as unavailable, if it neither accepts nor sends any data
+		 * @return The status code of the response or 0 on error
+		 */
+		unsigned int post( const std::string& path, const std::string& headers, const char* body, size_t length, int timeout, boost::system::error_code& ec );
+
+	protected:
+		void open( int timeout, boost::system::error_code& ec );
+		void send( const char* data, size_t length, int timeout, boost::system::error_code& ec );
+		bool wait( short events, int timeout, boost::system::error_code& ec );
+		unsigned int readResponse( int timeout, boost::system::error_code& ec );
+
+	protected:
+		std::string _host;
+		std::string _port;
+		int _socket;
+		std::string _request;
+		std::string _in;
+};
+
+}
+
+#endif
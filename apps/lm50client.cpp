@@ -38,14 +38,16 @@ void LM50ClientApp::destroy() const {
 	_me = nullptr;
 }
 
+/**
+ * Only messages (e.g. of strerror) follow the locale of the environment. All
+ * numbers are formatted by the functions of format.h, which do not depend on
+ * the locale. In particular, LC_NUMERIC must remain "C", because librrd
+ * switches the numeric locale back and forth on each update, which is not
+ * thread-safe (see patches/rrdtool/locale-fix), and the C++ streams keep the
+ * classic locale.
+ */
 void LM50ClientApp::init() {
-	setlocale( LC_ALL, "" ); // old C locale
-	std::locale loc( "" );
-	std::locale::global( loc );
-	std::cout.imbue( loc );
-	std::cerr.imbue( loc );
-	std::clog.imbue( loc );
-	std::cin.imbue( loc );
+	setlocale( LC_MESSAGES, "" );
 }
 
 void LM50ClientApp::run() {
@@ -73,25 +75,3 @@ void LM50ClientApp::run() {
 }
 
 }
-
-int main( int argc, char* argv[] ) {
-	try {
-		LM50::ProgramOptions po;
-		po.parse( argc, argv );
-		LM50::LM50ClientApp& app( LM50::LM50ClientApp::create( po ) );
-		app.init();
-		app.run();
-		app.destroy();
-	} catch ( std::exception& e ) {
-		std::cerr << "Error: " << e.what() << std::endl;
-		return -1;
-	} catch ( boost::system::error_code& e ) {
-		std::cerr << "Error: " << e.message() << std::endl;
-		return e.value();
-	} catch ( ... ) {
-		std::cerr << "Unknown exception thrown" << std::endl;
-		return -1;
-	}
-	
-	return 0;
-}
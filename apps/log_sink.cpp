@@ -0,0 +1,258 @@
+#include "log_sink.h"
+#include "format.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace LM50 {
+
+// The time the background thread sleeps if the ring buffer is empty
+static const long idleSleepNs( 20000000 );
+
+LogLine& LogLine::append( const char* s ) {
+	return append( s, strlen( s ) );
+}
+
+LogLine& LogLine::append( const char* s, size_t length ) {
+	if( length > capacity - _length ) length = capacity - _length;
+	memcpy( _buf + _length, s, length );
+	_length += length;
+	return *this;
+}
+
+LogLine& LogLine::appendUInt( u_int64_t value, size_t width, char fill ) {
+	char buf[ Format::maxIntLength ];
+	const char* end( Format::appendUInt( buf, value ) );
+	for( size_t n( end - buf ); width > n; --width ) append( fill );
+	return append( buf, end - buf );
+}
+
+LogLine& LogLine::appendTime( const struct timespec& ts ) {
+	char buf[ Format::timeLength ];
+	return append( buf, Format::appendTime( buf, ts ) - buf );
+}
+
+LogLine& LogLine::appendNow() {
+	struct timespec ts;
+	clock_gettime( CLOCK_REALTIME, &ts );
+	return appendTime( ts ).append( ' ' );
+}
+
+
+std::string rotatedFileName( const std::string& path, unsigned int i ) {
+	if( i == 0 ) return path;
+	std::ostringstream name;
+	const size_t l( path.size() );
+	if( l > 3 && path.compare( l - 3, 3, ".gz" ) == 0 ) name << path.substr( 0, l - 3 ) << '.' << i << ".gz";
+	else name << path << '.' << i;
+	return name.str();
+}
+
+void rotateFiles( const std::string& path, unsigned int files ) {
+	if( files == 0 ) {
+		unlink( path.c_str() );
+		return;
+	}
+	for( unsigned int i( files ); i > 0; --i ) {
+		rename( rotatedFileName( path, i - 1 ).c_str(), rotatedFileName( path, i ).c_str() );
+	}
+}
+
+
+LogSink::LogSink() : \
+	_slots( new Slot[ slotCount ] ), \
+	_head( 0 ), \
+	_tail( 0 ), \
+	_dropped( 0 ), \
+	_isOpen( false ), \
+	_isStopping( false ), \
+	_thread(), \
+	_fd( -1 ), \
+	_ownsFd( false ), \
+	_gz( NULL ), \
+	_path(), \
+	_maxBytes( 0 ), \
+	_files( 0 ), \
+	_gzip( false ), \
+	_header(), \
+	_written( 0 ) {
+	for( size_t i( 0 ); i != slotCount; ++i ) _slots[ i ].sequence = i;
+}
+
+LogSink::~LogSink() {
+	close();
+	delete[] _slots;
+}
+
+void LogSink::openStream( int fd ) {
+	close();
+	_fd = fd;
+	_ownsFd = false;
+	_maxBytes = 0;
+	start();
+}
+
+void LogSink::openFile( const std::string& path, size_t maxBytes, unsigned int files, bool gzip, const std::string& header ) {
+	close();
+	_path = path;
+	_maxBytes = maxBytes;
+	_files = files;
+	_gzip = gzip;
+	_header = header;
+	openCurrent();
+	if( _fd < 0 && !_gz ) throw std::runtime_error( std::string( "Could not open file " ).append( path ).append( ": " ).append( strerror( errno ) ) );
+	start();
+}
+
+void LogSink::start() {
+	_isStopping = false;
+	_isOpen = true;
+	if( pthread_create( &_thread, NULL, main, this ) ) {
+		_isOpen = false;
+		closeCurrent();
+		throw std::runtime_error( "Could not start thread of log sink" );
+	}
+}
+
+void LogSink::close() {
+	if( !_isOpen ) return;
+	_isStopping = true;
+	pthread_join( _thread, NULL );
+	_isOpen = false;
+	closeCurrent();
+}
+
+/**
+ * Claims the next slot of the ring buffer by compare-and-swap on _head and
+ * publishes it by its sequence number. A slot is free for position pos, if
+ * its sequence equals pos. See D. Vyukov's bounded MPMC queue.
+ */
+bool LogSink::write( const LogLine& line ) {
+	if( !_isOpen ) return false;
+	u_int64_t pos( _head );
+	Slot* slot;
+	for( ;; ) {
+		slot = &_slots[ pos % slotCount ];
+		const u_int64_t seq( slot->sequence );
+		if( seq == pos ) {
+			if( __sync_bool_compare_and_swap( &_head, pos, pos + 1 ) ) break;
+			pos = _head;
+		} else if( seq < pos ) {
+			// The consumer has not yet read the slot of the previous round
+			__sync_fetch_and_add( &_dropped, 1 );
+			return false;
+		} else {
+			pos = _head;
+		}
+	}
+	memcpy( slot->text, line.data(), line.length() );
+	slot->text[ line.length() ] = '\n';
+	slot->length = line.length() + 1;
+	__sync_synchronize();
+	slot->sequence = pos + 1;
+	return true;
+}
+
+void* LogSink::main( void* me ) {
+	// The sink must not receive any signals, they are handled by the main
+	// thread
+	sigset_t mask;
+	sigfillset( &mask );
+	pthread_sigmask( SIG_SETMASK, &mask, NULL );
+
+	LogSink* self( static_cast< LogSink* >( me ) );
+	char buf[ 64 * 1024 ];
+	for( ;; ) {
+		const bool stopping( self->_isStopping );
+		size_t n( self->drain( buf, sizeof( buf ) ) );
+		if( n != 0 ) {
+			self->output( buf, n );
+			continue;
+		}
+		if( stopping ) break;
+		if( self->_gz ) gzflush( self->_gz, Z_SYNC_FLUSH );
+		struct timespec ts;
+		ts.tv_sec = 0;
+		ts.tv_nsec = idleSleepNs;
+		nanosleep( &ts, NULL );
+	}
+	return NULL;
+}
+
+/**
+ * Moves as many complete lines as fit into the buffer out of the ring
+ * @return The number of bytes copied to buf
+ */
+size_t LogSink::drain( char* buf, size_t size ) {
+	size_t n( 0 );
+	for( ;; ) {
+		Slot& slot( _slots[ _tail % slotCount ] );
+		if( slot.sequence != _tail + 1 ) break;
+		__sync_synchronize();
+		if( n + slot.length > size ) break;
+		memcpy( buf + n, slot.text, slot.length );
+		n += slot.length;
+		__sync_synchronize();
+		slot.sequence = _tail + slotCount;
+		++_tail;
+	}
+	return n;
+}
+
+void LogSink::output( const char* buf, size_t length ) {
+	if( _gz ) {
+		gzwrite( _gz, buf, length );
+	} else {
+		size_t done( 0 );
+		while( done < length ) {
+			ssize_t res( ::write( _fd, buf + done, length - done ) );
+			if( res < 0 && errno == EINTR ) continue;
+			if( res <= 0 ) break;
+			done += res;
+		}
+	}
+	_written += length;
+	if( _maxBytes != 0 && _written >= _maxBytes ) rotate();
+}
+
+void LogSink::openCurrent() {
+	struct stat st;
+	const bool isNew( stat( _path.c_str(), &st ) != 0 || st.st_size == 0 );
+	_written = isNew ? 0 : st.st_size;
+	if( _gzip ) {
+		_gz = gzopen( _path.c_str(), "ab" );
+	} else {
+		_fd = ::open( _path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644 );
+		_ownsFd = true;
+	}
+	if( isNew && !_header.empty() && ( _gz || _fd >= 0 ) ) {
+		std::string header( _header );
+		header.append( 1, '\n' );
+		output( header.data(), header.size() );
+	}
+}
+
+void LogSink::closeCurrent() {
+	if( _gz ) {
+		gzclose( _gz );
+		_gz = NULL;
+	}
+	if( _fd >= 0 && _ownsFd ) ::close( _fd );
+	_fd = -1;
+	_ownsFd = false;
+}
+
+void LogSink::rotate() {
+	closeCurrent();
+	rotateFiles( _path, _files );
+	openCurrent();
+}
+
+}
@@ -0,0 +1,180 @@
+#ifndef _LOG_SINK_H_
+#define _LOG_SINK_H_
+
+#include <ctime>
+#include <pthread.h>
+#include <string>
+#include <sys/types.h>
+#include <zlib.h>
+
+namespace LM50 {
+
+/**
+ * A single line of text that is formatted on the stack. The appenders use
+ * the functions of format.h, hence they are independent of the locale and
+ * never allocate memory. If the line exceeds
+ * its capacity, it is truncated silently.
+ */
+class LogLine {
+	public:
+		LogLine() : _length( 0 ) {}
+
+	public:
+		LogLine& append( const char* s );
+
+		LogLine& append( const std::string& s ) { return append( s.data(), s.size() ); }
+
+		LogLine& append( const char* s, size_t length );
+
+		LogLine& append( char c ) {
+			if( _length < capacity ) _buf[ _length++ ] = c;
+			return *this;
+		}
+
+		/**
+		 * Appends the decimal representation of the value, padded to the left
+		 * with the fill character to at least the given width
+		 */
+		LogLine& appendUInt( u_int64_t value, size_t width = 0, char fill = ' ' );
+
+		/**
+		 * Appends the time in ISO-8601 format (UTC) with nanoseconds, e.g.
+		 * 2016-03-01T12:00:00.000000000Z
+		 */
+		LogLine& appendTime( const struct timespec& ts );
+
+		/**
+		 * Appends the current time (see appendTime) followed by a blank, i.e.
+		 * the prefix of a log message
+		 */
+		LogLine& appendNow();
+
+		const char* data() const { return _buf; }
+
+		size_t length() const { return _length; }
+
+	public:
+		static const size_t capacity = 1024;
+
+	protected:
+		char _buf[ capacity ];
+		size_t _length;
+};
+
+
+/**
+ * An asynchronous sink for lines of text, e.g. log messages or CSV records.
+ *
+ * Producers copy lines into a bounded lock-free ring buffer and return
+ * immediately. A background thread drains the ring and writes the lines
+ * either to a file descriptor (e.g. standard error) or to a file. Hence,
+ * threads with timing constraints never block on I/O. If the ring is full,
+ * the line is dropped and counted.
+ *
+ * Files are optionally gzip-compressed and rotated when the number of bytes
+ * written exceeds the configured size: "file" is renamed to "file.1",
+ * "file.1" to "file.2" and so on (for "file.gz" the names are "file.1.gz"
+ * etc.). The oldest file is dropped. An optional header (e.g. the column
+ * names of a CSV file) is written at the beginning of each new file.
+ *
+ * The background thread is started by the open functions. As threads do not
+ * survive fork(), the sink must be opened after the daemon has forked.
+ */
+class LogSink {
+	public:
+		LogSink();
+		virtual ~LogSink();
+
+	private:
+		LogSink( const LogSink& );
+		LogSink& operator=( const LogSink& );
+
+	public:
+		/**
+		 * Writes to the given file descriptor, which is not closed by the sink
+		 */
+		void openStream( int fd );
+
+		/**
+		 * Writes to the given file. New lines are appended, if the file exists.
+		 * Throws a std::runtime_error, if the file cannot be opened.
+		 * @param path The path of the file
+		 * @param maxBytes The number of (uncompressed) bytes after which the
+		 * file is rotated. Zero disables rotation.
+		 * @param files The number of rotated files to keep
+		 * @param gzip If true, the file is gzip compressed
+		 * @param header Written at the beginning of each new file, if not empty
+		 */
+		void openFile( const std::string& path, size_t maxBytes, unsigned int files, bool gzip, const std::string& header );
+
+		/**
+		 * Writes all pending lines, stops the background thread and closes the
+		 * file
+		 */
+		void close();
+
+		bool isOpen() const { return _isOpen; }
+
+		/**
+		 * Queues the line. A line break is appended by the sink.
+		 * @return False, if the sink is not open or the line has been dropped
+		 * because the ring buffer is full
+		 */
+		bool write( const LogLine& line );
+
+		u_int64_t dropped() const { return _dropped; }
+
+	protected:
+		static void* main( void* me );
+		void start();
+		size_t drain( char* buf, size_t size );
+		void output( const char* buf, size_t length );
+		void openCurrent();
+		void closeCurrent();
+		void rotate();
+
+	protected:
+		struct Slot {
+			volatile u_int64_t sequence;
+			size_t length;
+			char text[ LogLine::capacity + 1 ];
+		};
+
+		static const size_t slotCount = 256;
+
+		Slot* _slots;
+		u_int64_t _head;     // next position to be claimed by producers
+		u_int64_t _tail;     // next position to be read by the consumer
+		u_int64_t _dropped;
+
+		volatile bool _isOpen;
+		volatile bool _isStopping;
+		pthread_t _thread;
+
+		int _fd;
+		bool _ownsFd;
+		gzFile _gz;
+		std::string _path;
+		size_t _maxBytes;
+		unsigned int _files;
+		bool _gzip;
+		std::string _header;
+		size_t _written;
+};
+
+
+/**
+ * @return The name of the i-th rotated file of path, i.e. "path.i", or
+ * "stem.i.gz", if path ends with ".gz". For i equal to zero path is returned.
+ */
+std::string rotatedFileName( const std::string& path, unsigned int i );
+
+/**
+ * Shifts the rotated files of path by one, i.e. "path" becomes "path.1" and
+ * so on. Only the given number of rotated files is kept.
+ */
+void rotateFiles( const std::string& path, unsigned int files );
+
+}
+
+#endif
@@ -0,0 +1,25 @@
+#include "lm50client.h"
+
+#include <iostream>
+
+int main( int argc, char* argv[] ) {
+	try {
+		LM50::ProgramOptions po;
+		po.parse( argc, argv );
+		LM50::LM50ClientApp& app( LM50::LM50ClientApp::create( po ) );
+		app.init();
+		app.run();
+		app.destroy();
+	} catch ( std::exception& e ) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return -1;
+	} catch ( boost::system::error_code& e ) {
+		std::cerr << "Error: " << e.message() << std::endl;
+		return e.value();
+	} catch ( ... ) {
+		std::cerr << "Unknown exception thrown" << std::endl;
+		return -1;
+	}
+	
+	return 0;
+}
@@ -0,0 +1,160 @@
+#include "metrics.h"
+#include "format.h"
+
+namespace LM50 {
+
+Histogram::Histogram() : _buckets(), _count( 0 ), _sum( 0 ), _max( 0 ) {
+	for( size_t i( 0 ); i != bucketCount; ++i ) _buckets[ i ] = 0;
+}
+
+
+/**
+ * Values below subBucketCount are mapped to the bucket of the same index.
+ * For larger values the position of the highest bit selects the group of
+ * buckets and the next subBucketBits bits select the bucket within the group.
+ */
+size_t Histogram::bucketIndex( u_int64_t value ) {
+	if( value < subBucketCount ) return static_cast< size_t >( value );
+	const size_t msb( 63 - __builtin_clzll( value ) );
+	const size_t group( msb - subBucketBits + 1 );
+	const size_t sub( static_cast< size_t >( value >> ( msb - subBucketBits ) ) & ( subBucketCount - 1 ) );
+	return group * subBucketCount + sub;
+}
+
+
+u_int64_t Histogram::bucketUpperBound( size_t index ) {
+	if( index < subBucketCount ) return index;
+	const size_t group( index / subBucketCount );
+	const u_int64_t sub( index % subBucketCount );
+	const u_int64_t width( static_cast< u_int64_t >( 1 ) << ( group - 1 ) );
+	return ( ( subBucketCount + sub ) << ( group - 1 ) ) + ( width - 1 );
+}
+
+
+void Histogram::record( u_int64_t value ) {
+	__sync_fetch_and_add( &_buckets[ bucketIndex( value ) ], 1 );
+	__sync_fetch_and_add( &_count, 1 );
+	__sync_fetch_and_add( &_sum, value );
+	u_int64_t m( _max );
+	while( value > m ) {
+		const u_int64_t prev( __sync_val_compare_and_swap( &_max, m, value ) );
+		if( prev == m ) break;
+		m = prev;
+	}
+}
+
+
+double Histogram::mean() const {
+	const u_int64_t n( _count );
+	return n ? static_cast< double >( _sum ) / n : 0.0;
+}
+
+
+u_int64_t Histogram::quantile( double p ) const {
+	const u_int64_t n( _count );
+	if( n == 0 ) return 0;
+	u_int64_t rank( static_cast< u_int64_t >( p * n + 0.999999 ) );
+	if( rank == 0 ) rank = 1;
+	u_int64_t seen( 0 );
+	for( size_t i( 0 ); i != bucketCount; ++i ) {
+		seen += _buckets[ i ];
+		if( seen >= rank ) {
+			// The bucket bound might exceed the largest value ever recorded
+			const u_int64_t bound( bucketUpperBound( i ) );
+			return bound < _max ? bound : _max;
+		}
+	}
+	return _max;
+}
+
+
+Metrics::Metrics() : \
+	deviceRtt(), \
+	connectTime(), \
+	rrdUpdate(), \
+	beatPhaseError(), \
+	mutexWait(), \
+	mutexQueueDepth(), \
+	updates(), \
+	timeouts(), \
+	exceptions(), \
+	errors(), \
+	reconnects(), \
+	reconnectAttempts(), \
+	skippedBeats(), \
+	anomalies(), \
+	changedChannels(), \
+	mqttPublished(), \
+	mqttDropped(), \
+	influxWritten(), \
+	influxDropped(), \
+	proxyRequests(), \
+	proxyForwarded(), \
+	proxyFailed(), \
+	proxyRejected(), \
+	httpRequests(), \
+	httpDropped(), \
+	_start( now() ) {
+}
+
+
+/**
+ * The lines are formatted by the functions of format.h and written
+ * unformatted, hence the output does not depend on the locale of the stream.
+ */
+void Metrics::dump( std::ostream& os ) const {
+	dump( os, "uptime_s", ( now() - _start ) / 1000000000 );
+	dump( os, "device_rtt_ns", deviceRtt );
+	dump( os, "connect_time_ns", connectTime );
+	dump( os, "rrd_update_ns", rrdUpdate );
+	dump( os, "beat_phase_error_ns", beatPhaseError );
+	dump( os, "mutex_wait_ns", mutexWait );
+	dump( os, "mutex_queue_depth", mutexQueueDepth );
+	dump( os, "updates", updates.value() );
+	dump( os, "timeouts", timeouts.value() );
+	dump( os, "exceptions", exceptions.value() );
+	dump( os, "errors", errors.value() );
+	dump( os, "reconnects", reconnects.value() );
+	dump( os, "reconnect_attempts", reconnectAttempts.value() );
+	dump( os, "skipped_beats", skippedBeats.value() );
+	dump( os, "anomalies", anomalies.value() );
+	dump( os, "changed_channels", changedChannels.value() );
+	dump( os, "mqtt_published", mqttPublished.value() );
+	dump( os, "mqtt_dropped", mqttDropped.value() );
+	dump( os, "influx_written", influxWritten.value() );
+	dump( os, "influx_dropped", influxDropped.value() );
+	dump( os, "proxy_requests", proxyRequests.value() );
+	dump( os, "proxy_forwarded", proxyForwarded.value() );
+	dump( os, "proxy_failed", proxyFailed.value() );
+	dump( os, "proxy_rejected", proxyRejected.value() );
+	dump( os, "http_requests", httpRequests.value() );
+	dump( os, "http_dropped", httpDropped.value() );
+	os.flush();
+}
+
+
+void Metrics::dump( std::ostream& os, const char* name, const Histogram& h ) {
+	char line[ 128 + 7 * Format::maxIntLength ];
+	char* p( Format::appendString( line, name ) );
+	p = Format::appendUInt( Format::appendString( p, " count=" ), h.count() );
+	p = Format::appendUInt( Format::appendString( p, " mean=" ), static_cast< u_int64_t >( h.mean() ) );
+	p = Format::appendUInt( Format::appendString( p, " p50=" ), h.quantile( 0.5 ) );
+	p = Format::appendUInt( Format::appendString( p, " p90=" ), h.quantile( 0.9 ) );
+	p = Format::appendUInt( Format::appendString( p, " p99=" ), h.quantile( 0.99 ) );
+	p = Format::appendUInt( Format::appendString( p, " p999=" ), h.quantile( 0.999 ) );
+	p = Format::appendUInt( Format::appendString( p, " max=" ), h.max() );
+	*p++ = '\n';
+	os.write( line, p - line );
+}
+
+
+void Metrics::dump( std::ostream& os, const char* name, u_int64_t value ) {
+	char line[ 64 + Format::maxIntLength ];
+	char* p( Format::appendString( line, name ) );
+	*p++ = ' ';
+	p = Format::appendUInt( p, value );
+	*p++ = '\n';
+	os.write( line, p - line );
+}
+
+}
@@ -0,0 +1,156 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <ostream>
+#include <ctime>
+#include <sys/types.h>
+
+namespace LM50 {
+
+/**
+ * A lock-free histogram of non-negative integer values (e.g. durations in
+ * nanoseconds) with a bounded relative error.
+ *
+ * The buckets follow the idea of HDR histograms: Values below 16 have a
+ * bucket of their own, above that each power of two is divided into 16
+ * linear sub-buckets. Hence, each recorded value is represented by its
+ * bucket with a relative error of at most 1/16 over the whole 64-bit range,
+ * but the histogram only needs 976 counters.
+ *
+ * Recording a value is wait-free and can be done by any thread. Reading the
+ * histogram while other threads record values gives a consistent-enough
+ * approximation for monitoring purposes.
+ */
+class Histogram {
+	public:
+		Histogram();
+
+	private:
+		Histogram( const Histogram& );
+		Histogram& operator=( const Histogram& );
+
+	public:
+		void record( u_int64_t value );
+
+		u_int64_t count() const { return _count; }
+
+		u_int64_t max() const { return _max; }
+
+		double mean() const;
+
+		/**
+		 * @return The highest value that is equivalent to the p-quantile
+		 * (0 <= p <= 1), i.e. the upper bound of the bucket that contains the
+		 * quantile. Zero, if the histogram is empty.
+		 */
+		u_int64_t quantile( double p ) const;
+
+	protected:
+		static size_t bucketIndex( u_int64_t value );
+		static u_int64_t bucketUpperBound( size_t index );
+
+	public:
+		static const size_t subBucketBits = 4;
+		static const size_t subBucketCount = 1 << subBucketBits;
+		static const size_t bucketCount = ( 64 - subBucketBits + 1 ) * subBucketCount;
+
+	protected:
+		u_int64_t _buckets[ bucketCount ];
+		u_int64_t _count;
+		u_int64_t _sum;
+		u_int64_t _max;
+};
+
+
+/**
+ * A lock-free monotonic counter
+ */
+class Counter {
+	public:
+		Counter() : _value( 0 ) {}
+
+	private:
+		Counter( const Counter& );
+		Counter& operator=( const Counter& );
+
+	public:
+		void increment() { __sync_fetch_and_add( &_value, 1 ); }
+
+		void add( u_int64_t n ) { __sync_fetch_and_add( &_value, n ); }
+
+		u_int64_t value() const { return _value; }
+
+	protected:
+		u_int64_t _value;
+};
+
+
+/**
+ * The self-metrics of the daemon. There is exactly one object per daemon
+ * which is owned by ModeDaemon. All members are lock-free and can be
+ * updated by any thread. The durations are recorded in nanoseconds.
+ */
+class Metrics {
+	public:
+		Metrics();
+
+	private:
+		Metrics( const Metrics& );
+		Metrics& operator=( const Metrics& );
+
+	public:
+		/**
+		 * Writes all metrics in a line-based text format to the stream. Each
+		 * line consists of the name of the metric followed by its value or, for
+		 * histograms, by key=value pairs.
+		 */
+		void dump( std::ostream& os ) const;
+
+		/**
+		 * @return The current time of the monotonic clock in nanoseconds
+		 */
+		static u_int64_t now() {
+			struct timespec ts;
+			clock_gettime( CLOCK_MONOTONIC, &ts );
+			return static_cast< u_int64_t >( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
+		}
+
+	protected:
+		static void dump( std::ostream& os, const char* name, const Histogram& h );
+		static void dump( std::ostream& os, const char* name, u_int64_t value );
+
+	public:
+		Histogram deviceRtt;        // one successful update of the device values
+		Histogram connectTime;      // one connection attempt, successful or not
+		Histogram rrdUpdate;        // one call of rrd_update_r
+		Histogram beatPhaseError;   // delay between the nominal beat and the wake up
+		Histogram mutexWait;        // time spent waiting for the device mutex
+		Histogram mutexQueueDepth;  // threads waiting for the device mutex, sampled on each lock
+
+		Counter updates;
+		Counter timeouts;
+		Counter exceptions;
+		Counter errors;             // all other failed updates
+		Counter reconnects;         // successful reconnects
+		Counter reconnectAttempts;
+		Counter skippedBeats;
+		Counter anomalies;          // flagged samples of single channels, see LM50Anomaly
+		Counter changedChannels;    // channels that changed, summed over all updates
+		Counter mqttPublished;      // messages sent (QoS 0) or acknowledged (QoS 1)
+		Counter mqttDropped;        // messages dropped from the full backlog
+		Counter influxWritten;      // points accepted by the InfluxDB
+		Counter influxDropped;      // points rejected or dropped from the full retry buffer
+		Counter proxyRequests;      // requests of ModBus proxy clients
+		Counter proxyForwarded;     // rounds with the device on behalf of proxy clients
+		Counter proxyFailed;        // forwarded requests the device did not answer
+		Counter proxyRejected;      // requests of functions the read-only proxy refuses
+		Counter httpRequests;       // requests of HTTP clients
+		Counter httpDropped;        // subscribers of /stream dropped for falling behind
+
+	protected:
+		const u_int64_t _start;
+};
+
+}
+
+#endif
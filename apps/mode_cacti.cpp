@@ -2,8 +2,10 @@
 #include "lm50client.h"
 #include "core/lm50device.h"
 
+#include "format.h"
+
 #include <iostream>
-#include <iomanip>
+#include <string>
 
 namespace LM50 {
 
@@ -13,12 +15,9 @@ namespace LM50 {
  * Cacti.
  */
 void ModeCacti::run() {
-	// Save old locale and set locale to C locale
-	std::ostringstream cactiOutput;
-	cactiOutput.imbue( std::locale( "C" ) );
-	cactiOutput.fill( '0' );
-	
 	LM50Device dev( _app.programOptions().host(), _app.programOptions().port() );
+	dev.transport( _app.programOptions().transport() );
+	dev.unitId( _app.programOptions().unitId() );
 	dev.connect();
 	dev.updateVolatileValues();
 	dev.disconnect();
@@ -39,17 +38,27 @@ void ModeCacti::run() {
 	// spaces between the a value and the following field identifier.
 	// If there are more spaces in between or trailing spaces at the end
 	// the string is split in a false way.
-	
-	if( _app.programOptions().channels().size() == 1 ) {
-		cactiOutput << dev.channel( _app.programOptions().channels().front() );
+	//
+	// Each field is formatted into a stack buffer and collected in
+	// cactiOutput, which is written unformatted, i.e. independent of the
+	// locale.
+	const ProgramOptions::ChList& channels( _app.programOptions().channels() );
+	std::string cactiOutput;
+	char field[ 16 + 2 * Format::maxIntLength ];
+	if( channels.size() == 1 ) {
+		cactiOutput.append( field, Format::appendUInt( field, dev.channel( channels.front() ) ) - field );
 	} else {
-		ProgramOptions::ChList::const_iterator it( _app.programOptions().channels().begin() );
-		cactiOutput << "meter" << std::setw( 2 ) << (*it+1) << ':' << dev.channel( *it );
-		for( ++it; it != _app.programOptions().channels().end(); it++ ) {
-			cactiOutput<< " meter" << std::setw( 2 ) << (*it+1) << ':' << dev.channel( *it );
+		for( ProgramOptions::ChList::const_iterator it( channels.begin() ); it != channels.end(); it++ ) {
+			char* p( Format::appendString( field, it == channels.begin() ? "meter" : " meter" ) );
+			p = Format::appendUInt( p, *it+1, 2, '0' );
+			*p++ = ':';
+			p = Format::appendUInt( p, dev.channel( *it ) );
+			cactiOutput.append( field, p - field );
 		}
 	}
-	std::cout << cactiOutput.str() << std::endl;
+	cactiOutput.append( 1, '\n' );
+	std::cout.write( cactiOutput.data(), cactiOutput.size() );
+	std::cout.flush();
 }
 
 }
@@ -1,16 +1,55 @@
 #include "mode_daemon.h"
 #include "lm50client.h"
 #include "worker_rrd.h"
+#include "worker_report.h"
+#include "worker_control.h"
+#include "worker_mqtt.h"
+#include "worker_influx.h"
+#include "worker_modbus_proxy.h"
+#include "worker_http.h"
+#include "lib/probes.h"
 #include <unistd.h>
+#include <cerrno>
+#include <fstream>
 #include <iostream>
+#include <ctime>
 
 namespace LM50 {
 
+// The number of times an update is repeated, after the device refused it
+// with a ModBus exception, and the pause in milliseconds before the first
+// repetition. The pause doubles with each repetition.
+static const unsigned int maxRefusals( 3 );
+static const long refusalPause( 50 );
+
 #ifdef DEBUG
 ModeDaemon::ModeDaemon( const LM50ClientApp& app ) : \
 	ProgramMode( app ), \
 	_isCancelled( true ), \
+	_options( &app.programOptions() ), \
+	_reloadedOptions(), \
 	_dev( app.programOptions().host(), app.programOptions().port() ), \
+	_energy(), \
+	_balance(), \
+	_anomaly(), \
+	_rollup(), \
+	_meterOptions( nullptr ), \
+	_generation( 0 ), \
+	_changedAt( new u_int64_t[ LM50Device::countChannels ] ), \
+	_recorder(), \
+	_metrics(), \
+	_timeline(), \
+	_roundSpans( _timeline ), \
+	_log(), \
+	_balanceEvents(), \
+	_workerRrd(), \
+	_workerReport(), \
+	_workerControl(), \
+	_workerMqtt(), \
+	_workerInflux(), \
+	_workerModbusProxy(), \
+	_workerHttp(), \
+	_mutexWaiters( 0 ), \
 	_mutex(), \
 	_mutex_attr(), \
 	_mutex_owner() {
@@ -18,7 +57,30 @@ ModeDaemon::ModeDaemon( const LM50ClientApp& app ) : \
 ModeDaemon::ModeDaemon( const LM50ClientApp& app ) : \
 	ProgramMode( app ), \
 	_isCancelled( true ), \
+	_options( &app.programOptions() ), \
+	_reloadedOptions(), \
 	_dev( app.programOptions().host(), app.programOptions().port() ), \
+	_energy(), \
+	_balance(), \
+	_anomaly(), \
+	_rollup(), \
+	_meterOptions( nullptr ), \
+	_generation( 0 ), \
+	_changedAt( new u_int64_t[ LM50Device::countChannels ] ), \
+	_recorder(), \
+	_metrics(), \
+	_timeline(), \
+	_roundSpans( _timeline ), \
+	_log(), \
+	_balanceEvents(), \
+	_workerRrd(), \
+	_workerReport(), \
+	_workerControl(), \
+	_workerMqtt(), \
+	_workerInflux(), \
+	_workerModbusProxy(), \
+	_workerHttp(), \
+	_mutexWaiters( 0 ), \
 	_mutex(), \
 	_mutex_attr() {
 #endif
@@ -26,15 +88,32 @@ ModeDaemon::ModeDaemon( const LM50ClientApp& app ) : \
 	assert( pthread_mutexattr_setprotocol( &_mutex_attr, PTHREAD_PRIO_INHERIT ) == 0 );
 	assert( pthread_mutexattr_settype( &_mutex_attr, PTHREAD_MUTEX_RECURSIVE ) == 0 );
 	assert( pthread_mutex_init( &_mutex, &_mutex_attr ) == 0 );
+	for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) _changedAt[ i ] = 0;
 }
 
 ModeDaemon::~ModeDaemon() {
+	_workerRrd.reset();
+	_workerReport.reset();
+	_workerControl.reset();
+	_workerMqtt.reset();
+	_workerInflux.reset();
+	_workerModbusProxy.reset();
+	_workerHttp.reset();
+	for( size_t i( 0 ); i != _reloadedOptions.size(); ++i ) delete _reloadedOptions[i];
+	delete[] _changedAt;
 	assert( pthread_mutex_destroy( &_mutex ) == 0 );
 	assert( pthread_mutexattr_destroy( &_mutex_attr ) == 0 );
 }
 
 void ModeDaemon::lockDevice() {
+	const u_int64_t waiters( __sync_fetch_and_add( &_mutexWaiters, 1 ) );
+	const u_int64_t t0( Metrics::now() );
 	pthread_mutex_lock( &_mutex );
+	const u_int64_t t1( Metrics::now() );
+	_metrics.mutexWait.record( t1 - t0 );
+	_timeline.span( "lock", t0, t1 );
+	_metrics.mutexQueueDepth.record( waiters );
+	__sync_fetch_and_sub( &_mutexWaiters, 1 );
 #ifdef DEBUG
 	_mutex_owner = pthread_self();
 #endif
@@ -48,13 +127,28 @@ void ModeDaemon::unlockDevice() {
 	pthread_mutex_unlock( &_mutex );
 }
 
+bool ModeDaemon::tryLockDevice() {
+	if( pthread_mutex_trylock( &_mutex ) != 0 ) return false;
+#ifdef DEBUG
+	_mutex_owner = pthread_self();
+#endif
+	return true;
+}
+
 /**
  * Requests the device object to update its internal attributes with the
  * values from the real physical device.
  * 
- * If a runtime_error is catched this is most likely due a time out. Probabbly
- * the physical device became unavailable. This function tries to reconnect
- * in an endless loop but keeps the device mutex locked. Please note:
+ * The update is performed by the non-throwing functions of the device, such
+ * that a long outage does not put exception handling on every retry. If the
+ * device replied with a ModBus exception, the connection is still intact and
+ * the request is repeated after a short pause, which doubles each time. If
+ * the device still refuses, the update is given up and the caller skips its
+ * beat, such that a device that keeps refusing is neither flooded with
+ * requests nor starves the other workers of the mutex. Any other error (most likely a time out)
+ * indicates that the physical device became unavailable. In that case this
+ * function tries to reconnect in an endless loop but keeps the device mutex
+ * locked. Please note:
  * 
  * (1) This function is executed in the context of the calling thread. Hence,
  *     the main thread is still actively waiting for an termination signal
@@ -68,34 +162,119 @@ void ModeDaemon::unlockDevice() {
  *     this function will continue, unlock the mutex and all other child threads
  *     will be waked up again, too.
  */
-void ModeDaemon::deviceUpdate() {
+bool ModeDaemon::deviceUpdate() {
 #ifdef DEBUG
 	assert( pthread_equal( pthread_self(), _mutex_owner ) );
 #endif
-	bool verb( _app.programOptions().beVerbose() );
+	bool verb( options().beVerbose() );
+	boost::system::error_code ec;
+	unsigned int refusals( 0 );
 	
 	// Try "endlessly" until main thread is cancelled
 	while( !isCancelled() ) {
-		try {
-			_dev.updateVolatileValues();
-			return; // if the line above did not throw an exception, it's done
-		} catch( std::runtime_error& e ) {
-			if( verb ) std::cerr << "Connection to device lost" << std::endl;
-			// If update failed, the device probably became unavailable. Disconnect
-			// first to get back into a clean state
+		// If the host, port, transport or unit id has been changed by a reload,
+		// switch to the new device. The device is only accessed by the thread
+		// that owns the mutex, hence the switch is done here and not by the
+		// main thread.
+		if( _dev.host() != options().host() || _dev.port() != options().port() || _dev.transport() != options().transport() || _dev.unitId() != options().unitId() ) {
+			_log.write( LogLine().appendNow().append( "Switching to device " ).append( options().host() ).append( ':' ).append( options().port() ) );
 			_dev.disconnect();
-			// Try "endlessly" to connect again until main thread is cancelled
-			while( !isCancelled() ) {
-				try {
-					if( verb ) std::cerr << "Try to reconnect ... " << std::flush;
-					_dev.connect();
-					if( verb ) std::cerr << "success" << std::endl;
-					break; // if the line above did not throw an exception, connection is re-established
-				} catch( std::runtime_error& e ) {
-					if( verb ) std::cerr << "failed" << std::endl;
-				}
+			reconnect( verb );
+			continue;
+		}
+		
+		const u_int64_t t0( Metrics::now() );
+		_dev.updateVolatileValues( ec );
+		const u_int64_t t1( Metrics::now() );
+		_timeline.span( "update", t0, t1 );
+		if( !ec ) {
+			// If the line above did not report an error, it's done
+			_metrics.deviceRtt.record( t1 - t0 );
+			if( _roundSpans.replyComplete() ) _timeline.span( "decode", _roundSpans.replyComplete(), t1 );
+			_metrics.updates.increment();
+			++_generation;
+			for( u_int64_t changed( _dev.changed() ); changed != 0; changed &= changed - 1 ) {
+				_changedAt[ __builtin_ctzll( changed ) ] = _generation;
 			}
+			_metrics.changedChannels.add( __builtin_popcountll( _dev.changed() ) );
+			if( _meterOptions != &options() ) configureMeters( options() );
+			_energy.update( _dev.channels(), _dev.lastUpdate() );
+			if( _energy.hasPower() ) _rollup.update( _energy.powers(), _dev.lastUpdate() );
+			const u_int64_t anomalies( _anomaly.count() );
+			_anomaly.update( _dev.channels(), _dev.lastUpdate() );
+			if( _anomaly.count() != anomalies ) _metrics.anomalies.add( _anomaly.count() - anomalies );
+			_balance.update( _energy, _dev.lastUpdate(), _log, _balanceEvents );
+			LM50_PROBE2( snapshot__publish, _dev.lastUpdate().tv_sec, _dev.lastUpdate().tv_nsec );
+			return true;
+		}
+		
+		if( ec == ModBus::Error::TimeOut ) {
+			_metrics.timeouts.increment();
+			_timeline.instant( "timeout", t1 );
+		} else if( ModBus::isDeviceException( ec ) ) {
+			_metrics.exceptions.increment();
+			_timeline.instant( "exception", t1 );
+		} else {
+			_metrics.errors.increment();
+			_timeline.instant( "error", t1 );
+		}
+		
+		if( ModBus::isDeviceException( ec ) ) {
+			if( verb ) _log.write( LogLine().appendNow().append( "Device refused update: " ).append( ec.message() ) );
+			if( refusals == maxRefusals ) {
+				if( verb ) _log.write( LogLine().appendNow().append( "Skipping update" ) );
+				return false;
+			}
+			const long ms( refusalPause << refusals++ );
+			const struct timespec pause = { ms / 1000, ( ms % 1000 ) * 1000000 };
+			nanosleep( &pause, NULL );
+			continue;
+		}
+		
+		// Without a connection there is nothing to re-establish, the transport
+		// has already retransmitted the request
+		if( ec == ModBus::Error::TimeOut && !_dev.isConnectionOriented() ) {
+			if( verb ) _log.write( LogLine().appendNow().append( "Device did not answer: " ).append( ec.message() ) );
+			continue;
+		}
+		
+		if( verb ) _log.write( LogLine().appendNow().append( "Connection to device lost: " ).append( ec.message() ) );
+		// If update failed, the device probably became unavailable. Disconnect
+		// first to get back into a clean state
+		_dev.disconnect();
+		reconnect( verb );
+	}
+	return false;
+}
+
+/**
+ * Tries "endlessly" to connect to the device until the main thread is
+ * cancelled. Before each attempt the host and port are taken from the
+ * current options, such that a reload can redirect a daemon that waits for
+ * an unavailable device.
+ */
+void ModeDaemon::reconnect( bool verb ) {
+	boost::system::error_code ec;
+	while( !isCancelled() ) {
+		const ProgramOptions& po( options() );
+		if( _dev.host() != po.host() ) _dev.host( po.host() );
+		if( _dev.port() != po.port() ) _dev.port( po.port() );
+		_dev.transport( po.transport() );
+		_dev.unitId( po.unitId() );
+		LM50_PROBE0( reconnect__start );
+		_metrics.reconnectAttempts.increment();
+		const u_int64_t t2( Metrics::now() );
+		_dev.connect( ec );
+		const u_int64_t t3( Metrics::now() );
+		_metrics.connectTime.record( t3 - t2 );
+		_timeline.span( "connect", t2, t3 );
+		LM50_PROBE1( reconnect__end, !ec );
+		if( !ec ) {
+			_metrics.reconnects.increment();
+			if( verb ) _log.write( LogLine().appendNow().append( "Reconnected to device" ) );
+			return; // connection is re-established
 		}
+		if( verb ) _log.write( LogLine().appendNow().append( "Reconnect failed: " ).append( ec.message() ) );
 	}
 }
 
@@ -113,6 +292,136 @@ unsigned int ModeDaemon::deviceChannel( LM50Device::ChIdx ch ) {
 	return _dev.channel( ch );
 }
 
+double ModeDaemon::devicePower( LM50Device::ChIdx ch ) {
+#ifdef DEBUG
+	assert( pthread_equal( pthread_self(), _mutex_owner ) );
+#endif
+	return _energy.power( ch );
+}
+
+double ModeDaemon::deviceEnergy( LM50Device::ChIdx ch ) {
+#ifdef DEBUG
+	assert( pthread_equal( pthread_self(), _mutex_owner ) );
+#endif
+	return _energy.energy( ch );
+}
+
+unsigned int ModeDaemon::deviceFlags( LM50Device::ChIdx ch ) {
+#ifdef DEBUG
+	assert( pthread_equal( pthread_self(), _mutex_owner ) );
+#endif
+	return _anomaly.flags( ch );
+}
+
+void ModeDaemon::deviceReadSteadyValues( boost::system::error_code& ec ) {
+#ifdef DEBUG
+	assert( pthread_equal( pthread_self(), _mutex_owner ) );
+#endif
+	_dev.readSteadyValues( ec );
+}
+
+const std::string& ModeDaemon::deviceRevision() {
+#ifdef DEBUG
+	assert( pthread_equal( pthread_self(), _mutex_owner ) );
+#endif
+	return _dev.revision();
+}
+
+unsigned int ModeDaemon::deviceSerialNumber() {
+#ifdef DEBUG
+	assert( pthread_equal( pthread_self(), _mutex_owner ) );
+#endif
+	return _dev.serialNumber();
+}
+
+/**
+ * The round is accounted like an update, i.e. its time is recorded as
+ * device RTT and failures are counted. A failed round does not trigger a
+ * reconnect, which is left to the next update.
+ */
+size_t ModeDaemon::deviceTransact( ModBus::Datagram::Base& request, char* reply, boost::system::error_code& ec ) {
+#ifdef DEBUG
+	assert( pthread_equal( pthread_self(), _mutex_owner ) );
+#endif
+	const u_int64_t t0( Metrics::now() );
+	size_t length( 0 );
+	const char* raw( _dev.transact( request, length, ec ) );
+	const u_int64_t t1( Metrics::now() );
+	_timeline.span( "forward", t0, t1 );
+	if( ec ) {
+		if( ec == ModBus::Error::TimeOut ) _metrics.timeouts.increment();
+		else _metrics.errors.increment();
+		return 0;
+	}
+	_metrics.deviceRtt.record( t1 - t0 );
+	memcpy( reply, raw, length );
+	return length;
+}
+
+u_int64_t ModeDaemon::deviceGeneration() {
+#ifdef DEBUG
+	assert( pthread_equal( pthread_self(), _mutex_owner ) );
+#endif
+	return _generation;
+}
+
+u_int64_t ModeDaemon::deviceChangedSince( u_int64_t generation ) {
+#ifdef DEBUG
+	assert( pthread_equal( pthread_self(), _mutex_owner ) );
+#endif
+	if( generation == _generation ) return 0;
+	u_int64_t mask( 0 );
+	for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) {
+		mask |= static_cast< u_int64_t >( _changedAt[ i ] > generation ) << i;
+	}
+	return mask;
+}
+
+void ModeDaemon::dumpBalance( std::ostream& os ) {
+#ifdef DEBUG
+	assert( pthread_equal( pthread_self(), _mutex_owner ) );
+#endif
+	_balance.dump( os );
+}
+
+size_t ModeDaemon::deviceHistory( LM50Rollup::Level level, LM50Device::ChIdx ch, time_t from, time_t to, LM50Rollup::Bucket* buckets, size_t maxCount ) {
+#ifdef DEBUG
+	assert( pthread_equal( pthread_self(), _mutex_owner ) );
+#endif
+	return _rollup.fetch( level, ch, from, to, buckets, maxCount );
+}
+
+/**
+ * Passes the meter descriptions of the channels to the energy engine and
+ * the anomaly checks and the meter tree to the balance check. Like the
+ * switch of the device, this is done by deviceUpdate(), i.e. by the thread
+ * that owns the mutex, such that a reload never waits for the mutex.
+ */
+void ModeDaemon::configureMeters( const ProgramOptions& po ) {
+	_meterOptions = &po;
+	for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) {
+		const ProgramOptions::ChannelMeta& meta( po.channelMeta( i ) );
+		_energy.meter( i, meta.impPerKWh, meta.maxPower() );
+		_anomaly.meter( i, meta.impPerKWh, meta.maxPower() );
+	}
+	_anomaly.limits( po.anomalyAlpha(), po.anomalyZ(), po.anomalyStuck() );
+	_balance.configure( po );
+}
+
+/**
+ * Opens the file of balance events, if requested by the options. Failures
+ * are logged only, the balance is still checked.
+ */
+void ModeDaemon::openBalanceEvents() {
+	_balanceEvents.close();
+	if( options().balanceEvents().empty() ) return;
+	try {
+		_balanceEvents.openFile( options().balanceEvents(), 0, 0, false, std::string() );
+	} catch( std::exception& e ) {
+		_log.write( LogLine().appendNow().append( "Could not open balance events: " ).append( e.what() ) );
+	}
+}
+
 
 /**
  * Forks the process in order to become a daemon if necessary, i.e. if
@@ -128,7 +437,7 @@ unsigned int ModeDaemon::deviceChannel( LM50Device::ChIdx ch ) {
 bool ModeDaemon::daemonize() {
 	// If we are supposed to stay in foreground, do nothing and return true
 	// to make the caller to go on
-	if( _app.programOptions().stayInForeground() ) return true;
+	if( options().stayInForeground() ) return true;
 	
 	pid_t pid = fork();
 	if( pid < 0 ) {
@@ -176,11 +485,177 @@ bool ModeDaemon::daemonize() {
 }
 
 void ModeDaemon::init() {
+	if( !options().traceFile().empty() ) {
+		_recorder.open( options().traceFile() );
+		_dev.record( &_recorder );
+	}
+	const ProgramOptions& po( options() );
+	if( !po.timelineFile().empty() ) {
+		_timeline.open( po.timelineFile(), po.timelineSize() * 1024 * 1024, po.timelineFiles() );
+		_dev.observe( &_roundSpans );
+	}
+	_dev.transport( po.transport() );
+	_dev.unitId( po.unitId() );
+	const u_int64_t t0( Metrics::now() );
 	_dev.connect();
+	_metrics.connectTime.record( Metrics::now() - t0 );
 }
 
 void ModeDaemon::deinit() {
 	_dev.disconnect();
+	_dev.record( nullptr );
+	_recorder.close();
+	_dev.observe( nullptr );
+	_timeline.close();
+}
+
+/**
+ * Writes the metrics to the file given by program options or to standard
+ * error, if no file is given
+ */
+void ModeDaemon::dumpMetrics() const {
+	const std::string& file( options().metricsFile() );
+	if( file.empty() ) {
+		_metrics.dump( std::cerr );
+		return;
+	}
+	std::ofstream os( file.c_str(), std::ios::out | std::ios::trunc );
+	if( os ) _metrics.dump( os );
+}
+
+void ModeDaemon::startWorkers() {
+	const ProgramOptions& po( options() );
+	if( po.rrdEnabled() && !_workerRrd ) {
+		_workerRrd.reset( new WorkerRrd( *this ) );
+		_workerRrd->start();
+	}
+	if( po.reportEnabled() && !_workerReport ) {
+		_workerReport.reset( new WorkerReport( *this ) );
+		_workerReport->start();
+	}
+	if( po.controlEnabled() && !_workerControl ) {
+		_workerControl.reset( new WorkerControl( *this ) );
+		_workerControl->listen();
+		_workerControl->start();
+	}
+	if( po.mqttEnabled() && !_workerMqtt ) {
+		_workerMqtt.reset( new WorkerMqtt( *this ) );
+		_workerMqtt->start();
+	}
+	if( po.influxEnabled() && !_workerInflux ) {
+		_workerInflux.reset( new WorkerInflux( *this ) );
+		_workerInflux->start();
+	}
+	if( po.modbusProxyEnabled() && !_workerModbusProxy ) {
+		_workerModbusProxy.reset( new WorkerModbusProxy( *this ) );
+		_workerModbusProxy->listen();
+		_workerModbusProxy->start();
+	}
+	if( po.httpEnabled() && !_workerHttp ) {
+		_workerHttp.reset( new WorkerHttp( *this ) );
+		_workerHttp->listen();
+		_workerHttp->start();
+	}
+}
+
+void ModeDaemon::stopWorkers() {
+	if( _workerRrd ) _workerRrd->terminate();
+	_workerRrd.reset();
+	if( _workerReport ) _workerReport->terminate();
+	_workerReport.reset();
+	if( _workerControl ) _workerControl->terminate();
+	_workerControl.reset();
+	if( _workerMqtt ) _workerMqtt->terminate();
+	_workerMqtt.reset();
+	if( _workerInflux ) _workerInflux->terminate();
+	_workerInflux.reset();
+	if( _workerModbusProxy ) _workerModbusProxy->terminate();
+	_workerModbusProxy.reset();
+	if( _workerHttp ) _workerHttp->terminate();
+	_workerHttp.reset();
+}
+
+/**
+ * Re-reads the configuration and applies the differences to the running
+ * daemon without a restart:
+ *
+ * (1) If the host or port changed, the device is reconnected by the next
+ *     update, see deviceUpdate(). Otherwise the connection is kept. New
+ *     impulse constants and meter trees take effect from the next update.
+ * (2) Workers that have been enabled or disabled are started or stopped.
+ * (3) The RRD worker applies changes of its channels, period and files by
+ *     itself at its next beat, hence no beat is lost.
+ * (4) The report worker is restarted, if any of its options changed. Its
+ *     aggregates are kept in the state file, hence nothing is lost.
+ * (5) The control worker is restarted, if its socket changed.
+ * (6) The MQTT worker is restarted, if any of its options changed. Its
+ *     backlog is lost.
+ * (7) The InfluxDB worker is restarted, if any of its options changed. It
+ *     tries once to write its pending batches before.
+ * (8) The ModBus proxy is restarted, if its address or port changed. The
+ *     connections of its clients are closed.
+ * (9) The HTTP worker is restarted, if any of its options changed. Its
+ *     recent samples are lost and the connections of its clients are
+ *     closed, subscribers resume by their last event id.
+ *
+ * If the configuration is invalid, the daemon continues with the old one.
+ * Changes of the trace and timeline options require a restart.
+ */
+void ModeDaemon::reload() {
+	const ProgramOptions& old( options() );
+	ProgramOptions* po( nullptr );
+	try {
+		po = old.reload();
+	} catch( std::exception& e ) {
+		_log.write( LogLine().appendNow().append( "Could not reload configuration: " ).append( e.what() ) );
+		return;
+	}
+	_reloadedOptions.push_back( po );
+	// Publish the new options to the workers only after they have been
+	// completely written
+	__sync_synchronize();
+	_options = po;
+	
+	try {
+		if( !po->rrdEnabled() && _workerRrd ) {
+			_workerRrd->terminate();
+			_workerRrd.reset();
+		}
+		if( _workerReport && ( !po->reportEnabled() || po->reportFile() != old.reportFile() || po->reportPeriod() != old.reportPeriod() || po->reportRecipient() != old.reportRecipient() || po->reportInterval() != old.reportInterval() || po->reportSpool() != old.reportSpool() || po->reportSendmail() != old.reportSendmail() ) ) {
+			_workerReport->terminate();
+			_workerReport.reset();
+		}
+		if( _workerControl && ( !po->controlEnabled() || po->controlSocket() != old.controlSocket() ) ) {
+			_workerControl->terminate();
+			_workerControl.reset();
+		}
+		if( _workerMqtt && ( !po->mqttEnabled() || po->mqttHost() != old.mqttHost() || po->mqttPort() != old.mqttPort() || po->mqttClientId() != old.mqttClientId() || po->mqttUser() != old.mqttUser() || po->mqttPassword() != old.mqttPassword() || po->mqttPrefix() != old.mqttPrefix() || po->mqttDevice() != old.mqttDevice() || po->mqttQos() != old.mqttQos() || po->mqttKeepAlive() != old.mqttKeepAlive() || po->mqttBacklog() != old.mqttBacklog() ) ) {
+			_workerMqtt->terminate();
+			_workerMqtt.reset();
+		}
+		if( _workerInflux && ( !po->influxEnabled() || po->influxHost() != old.influxHost() || po->influxPort() != old.influxPort() || po->influxDatabase() != old.influxDatabase() || po->influxToken() != old.influxToken() || po->influxBatchSize() != old.influxBatchSize() || po->influxFlushInterval() != old.influxFlushInterval() || po->influxRetryBuffer() != old.influxRetryBuffer() ) ) {
+			_workerInflux->terminate();
+			_workerInflux.reset();
+		}
+		if( _workerModbusProxy && ( !po->modbusProxyEnabled() || po->modbusProxyAddress() != old.modbusProxyAddress() || po->modbusProxyPort() != old.modbusProxyPort() ) ) {
+			_workerModbusProxy->terminate();
+			_workerModbusProxy.reset();
+		}
+		if( _workerHttp && ( !po->httpEnabled() || po->httpAddress() != old.httpAddress() || po->httpPort() != old.httpPort() || po->httpHistory() != old.httpHistory() ) ) {
+			_workerHttp->terminate();
+			_workerHttp.reset();
+		}
+		startWorkers();
+	} catch( std::exception& e ) {
+		_log.write( LogLine().appendNow().append( "Could not start worker: " ).append( e.what() ) );
+	}
+	
+	if( po->balanceEvents() != old.balanceEvents() ) openBalanceEvents();
+	
+	if( po->traceFile() != old.traceFile() || po->timelineFile() != old.timelineFile() ) {
+		_log.write( LogLine().appendNow().append( "Changes of the trace and timeline options take effect after a restart" ) );
+	}
+	_log.write( LogLine().appendNow().append( "Configuration reloaded" ) );
 }
 
 void ModeDaemon::run() {
@@ -195,11 +670,18 @@ void ModeDaemon::run() {
 	int err( pthread_sigmask( SIG_SETMASK, &allSig, NULL ) );
 	if( err ) return throw std::runtime_error( "Could not block signals" );
 	
+	// The log thread must be started after the fork and inherits the blocked
+	// signals
+	if( options().stayInForeground() ) _log.openStream( STDERR_FILENO );
+	openBalanceEvents();
+	
 	// Start the worker threads that are requested by program options
-	WorkerRrd workerRrd( *this );
-	if( _app.programOptions().rrdEnabled() ) workerRrd.start();
+	startWorkers();
 	
-	// Synchronously wait for any termination related signal
+	// Synchronously wait for any termination related signal. SIGUSR1 only
+	// requests a dump of the metrics and SIGHUP a reload of the configuration,
+	// hence wait again afterwards. In between the spans of all workers are
+	// written to the timeline, no matter which workers poll the device.
 	sigset_t termSig;
 	sigemptyset( &termSig );
 	sigaddset( &termSig, SIGHUP );
@@ -207,18 +689,32 @@ void ModeDaemon::run() {
 	sigaddset( &termSig, SIGQUIT );
 	sigaddset( &termSig, SIGTERM );
 	sigaddset( &termSig, SIGTSTP );
+	sigaddset( &termSig, SIGUSR1 );
+	const struct timespec flushInterval = { 1, 0 };
 	int sigNo(0);
-	err = sigwait( &termSig, &sigNo );
+	while( true ) {
+		sigNo = sigtimedwait( &termSig, NULL, &flushInterval );
+		if( sigNo < 0 && ( errno == EAGAIN || errno == EINTR ) ) {
+			_timeline.flush();
+			continue;
+		}
+		if( sigNo < 0 ) err = errno;
+		if( sigNo == SIGUSR1 ) dumpMetrics();
+		else if( sigNo == SIGHUP ) reload();
+		else break;
+	}
 	
 	// After a signal arrived terminate enabled workers and deinit.
 	_isCancelled = true;
-	if( _app.programOptions().rrdEnabled() ) workerRrd.terminate();
+	stopWorkers();
 	deinit();
+	_balanceEvents.close();
+	_log.close();
 	
 	// As a final step, check if the arrived signal was really a termination
 	// signal or if something else went wrong
 	if(err) throw std::runtime_error( "Could not wait for signals" );
-	if( sigNo != SIGHUP && sigNo != SIGINT && sigNo != SIGQUIT && sigNo != SIGTERM && sigNo != SIGTSTP )
+	if( sigNo != SIGINT && sigNo != SIGQUIT && sigNo != SIGTERM && sigNo != SIGTSTP )
 		throw std::runtime_error( "Unexpected signal arrived" );
 }
 
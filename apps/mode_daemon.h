@@ -2,10 +2,29 @@
 #define _MODE_DAEMON_H_
 
 #include "program_mode.h"
+#include "program_options.h"
 #include "core/lm50device.h"
+#include "core/lm50energy.h"
+#include "core/lm50anomaly.h"
+#include "core/lm50rollup.h"
+#include "metrics.h"
+#include "timeline.h"
+#include "log_sink.h"
+#include "balance.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <vector>
 
 namespace LM50 {
 
+class WorkerRrd;
+class WorkerReport;
+class WorkerControl;
+class WorkerMqtt;
+class WorkerInflux;
+class WorkerModbusProxy;
+class WorkerHttp;
+
 class ModeDaemon : public ProgramMode {
 	public:
 		ModeDaemon( const LM50ClientApp& app );
@@ -28,12 +47,22 @@ class ModeDaemon : public ProgramMode {
 		 */
 		void unlockDevice();
 		
+		/**
+		 * Locks the mutex like lockDevice(), if it is free, but does not block
+		 * @return True, if the mutex has been locked
+		 */
+		bool tryLockDevice();
+		
 		/**
 		 * Updates the volatile values of the device. N.b.: There is no function
 		 * that directly returns the device object, because all function calls to
 		 * the device must be secured by a mutex
+		 * @return False, if the device refused the update with a ModBus
+		 * exception several times in a row or the daemon is cancelled. The
+		 * values are those of the last successful update then and the caller
+		 * should skip its beat.
 		 */
-		void deviceUpdate();
+		bool deviceUpdate();
 		
 		/**
 		 * Gets the time of the last update of the device's values. N.b.: There is
@@ -50,13 +79,132 @@ class ModeDaemon : public ProgramMode {
 		 */
 		unsigned int deviceChannel( LM50Device::ChIdx ch );
 		
+		/**
+		 * Returns the power of the channel in W as derived from the device's
+		 * counters by the last update, see LM50Energy. The device mutex must be
+		 * locked.
+		 */
+		double devicePower( LM50Device::ChIdx ch );
+		
+		/**
+		 * Returns the energy of the channel in kWh, i.e. the counter extended
+		 * to 64 bits divided by the impulse constant of the channel. The device
+		 * mutex must be locked.
+		 */
+		double deviceEnergy( LM50Device::ChIdx ch );
+		
+		/**
+		 * Returns the anomaly flags of the channel for the last update, see
+		 * LM50Anomaly. The flags describe the change since the previous update
+		 * of the device, no matter which worker triggered it. The device mutex
+		 * must be locked.
+		 */
+		unsigned int deviceFlags( LM50Device::ChIdx ch );
+		
+		/**
+		 * Returns the number of successful updates of the device so far. A
+		 * consumer keeps the generation of the values it processed last and
+		 * passes it to deviceChangedSince() on its next turn. The device mutex
+		 * must be locked.
+		 */
+		u_int64_t deviceGeneration();
+		
+		/**
+		 * Returns the channels that changed after the given generation, bit i
+		 * corresponds to channel index i. Hence, a consumer can skip unchanged
+		 * channels, no matter how many updates other workers triggered in the
+		 * meantime. The device mutex must be locked.
+		 */
+		u_int64_t deviceChangedSince( u_int64_t generation );
+		
+		/**
+		 * Returns the same value as deviceGeneration() but does not require the
+		 * device mutex. A worker that only consumes the values polled by others
+		 * checks it in order to lock the device only if there is anything new.
+		 */
+		u_int64_t generation() const { return __sync_add_and_fetch( const_cast< u_int64_t* >( &_generation ), 0 ); }
+		
+		/**
+		 * Reads the revision and the serial number of the device, which are not
+		 * read by the updates. The device mutex must be locked.
+		 */
+		void deviceReadSteadyValues( boost::system::error_code& ec );
+		
+		/**
+		 * The device mutex must be locked and deviceReadSteadyValues() must
+		 * have been successful.
+		 */
+		const std::string& deviceRevision();
+		
+		unsigned int deviceSerialNumber();
+		
+		/**
+		 * Forwards a request of a foreign client to the device over the
+		 * connection of the daemon. The device mutex must be locked.
+		 * @param reply The buffer for the raw reply, at least
+		 * ModBus::Datagram::Base::maxDatagramLength bytes
+		 * @return The length of the reply, whose transaction id is the one of
+		 * the daemon
+		 */
+		size_t deviceTransact( ModBus::Datagram::Base& request, char* reply, boost::system::error_code& ec );
+		
+		/**
+		 * Writes the state of the balance checks, see BalanceCheck::dump. The
+		 * device mutex must be locked.
+		 */
+		void dumpBalance( std::ostream& os );
+		
+		/**
+		 * Copies the consolidated power of the channel in W, see
+		 * LM50Rollup::fetch. The device mutex must be locked.
+		 */
+		size_t deviceHistory( LM50Rollup::Level level, LM50Device::ChIdx ch, time_t from, time_t to, LM50Rollup::Bucket* buckets, size_t maxCount );
+		
 		
 		bool isCancelled() const { return _isCancelled; }
 		
+		/**
+		 * The program options that are currently in effect. Initially these are
+		 * the options of the application. After a reload (see SIGHUP) the
+		 * reloaded options are returned. Workers must use these options instead
+		 * of LM50ClientApp::programOptions() and compare the address in order
+		 * to detect a reload. The returned object remains valid until the
+		 * daemon is destroyed.
+		 */
+		const ProgramOptions& options() const { return *_options; }
+		
+		/**
+		 * The self-metrics of the daemon. The metrics are lock-free and can be
+		 * updated by any thread without locking the device.
+		 */
+		Metrics& metrics() { return _metrics; }
+		
+		const Metrics& metrics() const { return _metrics; }
+		
+		/**
+		 * The timeline of spans per beat. The timeline is thread-safe and
+		 * ignores all spans, if it is not enabled by program options.
+		 */
+		Timeline& timeline() { return _timeline; }
+		
+		/**
+		 * The log of the daemon. The log is only open, if the daemon stays in
+		 * foreground, and writes to standard error asynchronously. Writing to
+		 * a closed log does nothing.
+		 */
+		LogSink& log() { return _log; }
+		
 	protected:
 		bool daemonize();
 		void init();
 		void deinit();
+		void reconnect( bool verb );
+		void dumpMetrics() const;
+		void startWorkers();
+		void stopWorkers();
+		void reload();
+		void configureMeters( const ProgramOptions& po );
+		void openBalanceEvents();
 		
 	protected:
 		/**
@@ -67,8 +215,97 @@ class ModeDaemon : public ProgramMode {
 		 */
 		bool _isCancelled;
 		
+		/**
+		 * See options()
+		 */
+		const ProgramOptions* volatile _options;
+		
+		/**
+		 * All options that have been reloaded. They are kept until the daemon is
+		 * destroyed, because workers might still refer to older options.
+		 */
+		std::vector< ProgramOptions* > _reloadedOptions;
+		
 		LM50Device _dev;
 		
+		/**
+		 * Derives power and energy from the counters on each update of _dev.
+		 * Protected by _mutex like _dev.
+		 */
+		LM50Energy _energy;
+		
+		/**
+		 * Checks the balance of feeds and sub-meters on each update of _energy.
+		 * Protected by _mutex like _dev.
+		 */
+		BalanceCheck _balance;
+		
+		/**
+		 * Checks each update of _dev for anomalies. Protected by _mutex like
+		 * _dev.
+		 */
+		LM50Anomaly _anomaly;
+		
+		/**
+		 * Consolidates the power of each update of _energy for the queries of
+		 * the control socket and the http worker. Protected by _mutex like
+		 * _dev.
+		 */
+		LM50Rollup _rollup;
+		
+		/**
+		 * The options _energy, _balance and _anomaly have been configured by
+		 */
+		const ProgramOptions* _meterOptions;
+		
+		/**
+		 * See deviceGeneration(). Protected by _mutex like _dev.
+		 */
+		u_int64_t _generation;
+		
+		/**
+		 * The generation at which each channel changed last. Protected by
+		 * _mutex like _dev.
+		 */
+		u_int64_t* _changedAt;
+		
+		/**
+		 * Records the traffic with the device, if requested by program options
+		 */
+		ModBus::TraceRecorder _recorder;
+		
+		Metrics _metrics;
+		
+		Timeline _timeline;
+		
+		/**
+		 * Adds the stages of each ModBus round to _timeline
+		 */
+		RoundSpans _roundSpans;
+		
+		LogSink _log;
+		
+		/**
+		 * The file of balance events, if enabled by program options
+		 */
+		LogSink _balanceEvents;
+		
+		/**
+		 * The workers, if they are enabled by the current options
+		 */
+		boost::scoped_ptr< WorkerRrd > _workerRrd;
+		boost::scoped_ptr< WorkerReport > _workerReport;
+		boost::scoped_ptr< WorkerControl > _workerControl;
+		boost::scoped_ptr< WorkerMqtt > _workerMqtt;
+		boost::scoped_ptr< WorkerInflux > _workerInflux;
+		boost::scoped_ptr< WorkerModbusProxy > _workerModbusProxy;
+		boost::scoped_ptr< WorkerHttp > _workerHttp;
+		
+		/**
+		 * The number of threads that are currently waiting for _mutex
+		 */
+		u_int64_t _mutexWaiters;
+		
 		/**
 		 * This mutex is used to protect against parallel access to _dev
 		 */
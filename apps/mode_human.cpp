@@ -2,8 +2,9 @@
 #include "lm50client.h"
 #include "core/lm50device.h"
 
+#include "format.h"
+
 #include <iostream>
-#include <iomanip>
 
 namespace LM50 {
 
@@ -18,18 +19,30 @@ void ModeHuman::run() {
 	std::cout << "Port    :  " << _app.programOptions().port() << std::endl;
 	
 	LM50Device dev( _app.programOptions().host(), _app.programOptions().port() );
+	dev.transport( _app.programOptions().transport() );
+	dev.unitId( _app.programOptions().unitId() );
 	dev.connect();
 	
 	dev.readSteadyValues();
 	std::cout << "Version :  " << dev.revision() << std::endl;
-	std::cout << "Serial  :  " << dev.serialNumber() << std::endl;
+	
+	// Numbers are formatted into a stack buffer and written unformatted,
+	// i.e. independent of the locale
+	char line[ 32 + 2 * Format::maxIntLength ];
+	char* p( Format::appendString( line, "Serial  :  " ) );
+	p = Format::appendUInt( p, dev.serialNumber() );
+	std::cout.write( line, p - line ) << std::endl;
 	
 	std::cout << "Reading channels ... " << std::flush;
 	dev.updateVolatileValues();
 	std::cout << "done" << std::endl;
 	
 	for( ProgramOptions::ChList::const_iterator it( _app.programOptions().channels().begin() ); it != _app.programOptions().channels().end(); it++ ) {
-		std::cout << "Channel " << std::setw( 2 ) << (*it+1) << ":   " << std::setw(12) << dev.channel(*it) << std::endl;
+		p = Format::appendString( line, "Channel " );
+		p = Format::appendUInt( p, *it+1, 2, ' ' );
+		p = Format::appendString( p, ":   " );
+		p = Format::appendUInt( p, dev.channel(*it), 12, ' ' );
+		std::cout.write( line, p - line ) << std::endl;
 	}
 	
 	dev.disconnect();
@@ -0,0 +1,254 @@
+#include "mqtt_client.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace LM50 {
+
+using boost::system::error_code;
+using boost::system::system_category;
+
+// The packet types of MQTT 3.1.1 in the upper nibble of the fixed header
+static const unsigned char CONNECT( 0x10 );
+static const unsigned char CONNACK( 0x20 );
+static const unsigned char PUBLISH( 0x30 );
+static const unsigned char PUBACK( 0x40 );
+static const unsigned char PINGREQ( 0xc0 );
+static const unsigned char PINGRESP( 0xd0 );
+static const unsigned char DISCONNECT( 0xe0 );
+
+// The time in milliseconds to wait for the TCP handshake and the CONNACK
+static const int connectTimeout( 5000 );
+
+MqttClient::MqttClient() : \
+	_socket( -1 ), \
+	_keepAlive( 60 ), \
+	_lastSent( 0 ), \
+	_isConnected( false ), \
+	_out(), \
+	_in(), \
+	_acknowledged() {
+}
+
+MqttClient::~MqttClient() {
+	close();
+}
+
+time_t MqttClient::now() {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec;
+}
+
+/**
+ * Resolves the broker and tries each address. The socket is non-blocking,
+ * such that the connect and all later writes can be bounded by poll.
+ */
+void MqttClient::open( const std::string& host, const std::string& port, const std::string& clientId, unsigned int keepAlive, const std::string& user, const std::string& password, const std::string& willTopic, const std::string& willPayload, error_code& ec ) {
+	close();
+	ec.clear();
+	struct addrinfo hints;
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo* addrs( NULL );
+	if( getaddrinfo( host.c_str(), port.c_str(), &hints, &addrs ) != 0 ) {
+		ec = boost::system::errc::make_error_code( boost::system::errc::host_unreachable );
+		return;
+	}
+	for( struct addrinfo* a( addrs ); a != NULL && _socket < 0; a = a->ai_next ) {
+		int fd( socket( a->ai_family, a->ai_socktype, a->ai_protocol ) );
+		if( fd < 0 ) continue;
+		fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+		int res( connect( fd, a->ai_addr, a->ai_addrlen ) );
+		if( res < 0 && errno == EINPROGRESS ) {
+			struct pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			int err( ETIMEDOUT );
+			socklen_t len( sizeof( err ) );
+			if( poll( &pfd, 1, connectTimeout ) == 1 ) getsockopt( fd, SOL_SOCKET, SO_ERROR, &err, &len );
+			res = err == 0 ? 0 : -1;
+			errno = err;
+		}
+		if( res == 0 ) {
+			_socket = fd;
+		} else {
+			ec = error_code( errno, system_category() );
+			::close( fd );
+		}
+	}
+	freeaddrinfo( addrs );
+	if( _socket < 0 ) return;
+	ec.clear();
+
+	// The CONNECT packet with a clean session. The session state is kept by
+	// the caller, which sends unacknowledged messages again.
+	_keepAlive = keepAlive;
+	std::string body;
+	appendString( body, "MQTT" );
+	body.push_back( 4 ); // protocol level 3.1.1
+	unsigned char flags( 0x02 );
+	if( !willTopic.empty() ) flags |= 0x04 | 0x08 | 0x20; // will with QoS 1 and retained
+	if( !user.empty() ) flags |= 0x80;
+	if( !user.empty() && !password.empty() ) flags |= 0x40;
+	body.push_back( flags );
+	body.push_back( static_cast< char >( keepAlive >> 8 ) );
+	body.push_back( static_cast< char >( keepAlive & 0xff ) );
+	appendString( body, clientId );
+	if( !willTopic.empty() ) {
+		appendString( body, willTopic );
+		appendString( body, willPayload );
+	}
+	if( !user.empty() ) appendString( body, user );
+	if( !user.empty() && !password.empty() ) appendString( body, password );
+	_out.push_back( CONNECT );
+	appendLength( _out, body.size() );
+	_out.append( body );
+	flush( connectTimeout, ec );
+	if( ec ) return;
+
+	// Wait for the CONNACK
+	const time_t deadline( now() + connectTimeout / 1000 );
+	while( !_isConnected && !ec && now() <= deadline ) receive( 500, ec );
+	if( !ec && !_isConnected ) ec = boost::system::errc::make_error_code( boost::system::errc::timed_out );
+}
+
+void MqttClient::close() {
+	if( _socket >= 0 ) ::close( _socket );
+	_socket = -1;
+	_isConnected = false;
+	_out.clear();
+	_in.clear();
+}
+
+void MqttClient::publish( const std::string& topic, const std::string& payload, unsigned int qos, bool retain, PacketId id, bool dup ) {
+	_out.push_back( static_cast< char >( PUBLISH | ( dup ? 0x08 : 0 ) | ( qos << 1 ) | ( retain ? 0x01 : 0 ) ) );
+	appendLength( _out, 2 + topic.size() + ( qos ? 2 : 0 ) + payload.size() );
+	appendString( _out, topic );
+	if( qos ) {
+		_out.push_back( static_cast< char >( id >> 8 ) );
+		_out.push_back( static_cast< char >( id & 0xff ) );
+	}
+	_out.append( payload );
+}
+
+void MqttClient::ping() {
+	if( _keepAlive == 0 || !_out.empty() || now() - _lastSent < static_cast< time_t >( _keepAlive / 2 ) ) return;
+	_out.push_back( PINGREQ );
+	_out.push_back( 0 );
+}
+
+void MqttClient::disconnect() {
+	_out.push_back( DISCONNECT );
+	_out.push_back( 0 );
+}
+
+void MqttClient::flush( int timeout, error_code& ec ) {
+	size_t sent( 0 );
+	while( sent < _out.size() ) {
+		ssize_t n( send( _socket, _out.data() + sent, _out.size() - sent, MSG_NOSIGNAL ) );
+		if( n > 0 ) {
+			sent += n;
+			continue;
+		}
+		if( n < 0 && errno == EINTR ) continue;
+		if( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) {
+			struct pollfd pfd;
+			pfd.fd = _socket;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			if( poll( &pfd, 1, timeout ) > 0 ) continue;
+			ec = boost::system::errc::make_error_code( boost::system::errc::timed_out );
+		} else {
+			ec = error_code( n < 0 ? errno : EPIPE, system_category() );
+		}
+		break;
+	}
+	_out.erase( 0, sent );
+	if( sent ) _lastSent = now();
+}
+
+void MqttClient::receive( int timeout, error_code& ec ) {
+	struct pollfd pfd;
+	pfd.fd = _socket;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	int res( poll( &pfd, 1, timeout ) );
+	if( res <= 0 ) return;
+	unsigned char buf[ 4096 ];
+	ssize_t n( recv( _socket, buf, sizeof( buf ), 0 ) );
+	if( n < 0 && ( errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK ) ) return;
+	if( n <= 0 ) {
+		ec = n == 0 ? boost::system::errc::make_error_code( boost::system::errc::connection_reset ) : error_code( errno, system_category() );
+		return;
+	}
+	_in.insert( _in.end(), buf, buf + n );
+
+	// Process all complete packets, the rest stays in the buffer
+	size_t pos( 0 );
+	while( !ec && _in.size() - pos >= 2 ) {
+		size_t length( 0 ), shift( 0 ), i( pos + 1 );
+		bool complete( false );
+		for( ; i != _in.size() && shift <= 21; ++i, shift += 7 ) {
+			length |= static_cast< size_t >( _in[i] & 0x7f ) << shift;
+			if( !( _in[i] & 0x80 ) ) {
+				complete = true;
+				++i;
+				break;
+			}
+		}
+		if( !complete || _in.size() - i < length ) break;
+		processPacket( _in[pos], &_in[0] + i, length, ec );
+		pos = i + length;
+	}
+	_in.erase( _in.begin(), _in.begin() + pos );
+}
+
+void MqttClient::processPacket( unsigned char header, const unsigned char* body, size_t length, error_code& ec ) {
+	switch( header & 0xf0 ) {
+		case CONNACK:
+			if( length != 2 || body[1] != 0 ) ec = boost::system::errc::make_error_code( boost::system::errc::connection_refused );
+			else _isConnected = true;
+			break;
+		case PUBACK:
+			if( length == 2 ) _acknowledged.push_back( static_cast< PacketId >( body[0] << 8 | body[1] ) );
+			break;
+		case PINGRESP:
+			break;
+		default:
+			// A publishing client does not subscribe, hence nothing else is
+			// expected
+			ec = boost::system::errc::make_error_code( boost::system::errc::protocol_error );
+			break;
+	}
+}
+
+/**
+ * Appends the remaining length in the variable length encoding of MQTT
+ */
+void MqttClient::appendLength( std::string& dest, size_t length ) {
+	do {
+		unsigned char byte( length & 0x7f );
+		length >>= 7;
+		if( length ) byte |= 0x80;
+		dest.push_back( static_cast< char >( byte ) );
+	} while( length );
+}
+
+/**
+ * Appends a string with its 16-bit length prefix
+ */
+void MqttClient::appendString( std::string& dest, const std::string& s ) {
+	dest.push_back( static_cast< char >( ( s.size() >> 8 ) & 0xff ) );
+	dest.push_back( static_cast< char >( s.size() & 0xff ) );
+	dest.append( s, 0, 0xffff );
+}
+
+}
@@ -0,0 +1,110 @@
+#ifndef _MQTT_CLIENT_H_
+#define _MQTT_CLIENT_H_
+
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#include <boost/system/error_code.hpp>
+
+namespace LM50 {
+
+/**
+ * A minimal MQTT 3.1.1 client for publishing over a single persistent TCP
+ * connection.
+ *
+ * Packets are only appended to an output buffer by publish() and are
+ * written by flush(), i.e. the caller batches any number of messages into
+ * a few large writes and does not wait for an acknowledgement before the
+ * next message is sent (pipelining). The packet identifiers of the PUBACK
+ * packets that arrived are collected by receive() and can be taken by the
+ * caller with acknowledged().
+ *
+ * Errors are reported by error codes, such that the endless retries during
+ * an outage of the broker do not throw. After an error the caller must
+ * close() the connection.
+ */
+class MqttClient {
+	public:
+		typedef u_int16_t PacketId;
+
+	public:
+		MqttClient();
+		virtual ~MqttClient();
+
+	private:
+		MqttClient( const MqttClient& );
+		MqttClient& operator=( const MqttClient& );
+
+	public:
+		/**
+		 * Connects to the broker and waits for its CONNACK
+		 * @param keepAlive The keep alive interval in seconds, see ping()
+		 * @param willTopic The topic of the last will, which the broker
+		 * publishes retained, if the connection breaks. Empty for none.
+		 */
+		void open( const std::string& host, const std::string& port, const std::string& clientId, unsigned int keepAlive, const std::string& user, const std::string& password, const std::string& willTopic, const std::string& willPayload, boost::system::error_code& ec );
+
+		void close();
+
+		bool isOpen() const { return _socket >= 0; }
+
+		/**
+		 * Appends a PUBLISH packet to the output buffer
+		 * @param id The packet identifier, ignored for QoS 0
+		 * @param dup True, if the packet is sent again after a reconnect
+		 */
+		void publish( const std::string& topic, const std::string& payload, unsigned int qos, bool retain, PacketId id, bool dup );
+
+		/**
+		 * Appends a PINGREQ, if nothing has been sent for half of the keep
+		 * alive interval
+		 */
+		void ping();
+
+		/**
+		 * Appends a DISCONNECT packet
+		 */
+		void disconnect();
+
+		/**
+		 * Writes the output buffer to the broker
+		 * @param timeout The time in milliseconds after which the broker is
+		 * taken as unavailable, if it does not accept any data
+		 */
+		void flush( int timeout, boost::system::error_code& ec );
+
+		/**
+		 * Waits up to timeout milliseconds for packets from the broker and
+		 * processes them
+		 */
+		void receive( int timeout, boost::system::error_code& ec );
+
+		/**
+		 * @return The identifiers of the acknowledged packets since the last
+		 * call of clearAcknowledged()
+		 */
+		const std::vector< PacketId >& acknowledged() const { return _acknowledged; }
+
+		void clearAcknowledged() { _acknowledged.clear(); }
+
+		size_t pending() const { return _out.size(); }
+
+	protected:
+		static void appendLength( std::string& dest, size_t length );
+		static void appendString( std::string& dest, const std::string& s );
+		void processPacket( unsigned char header, const unsigned char* body, size_t length, boost::system::error_code& ec );
+		static time_t now();
+
+	protected:
+		int _socket;
+		unsigned int _keepAlive;
+		time_t _lastSent;
+		bool _isConnected;      // CONNACK received
+		std::string _out;
+		std::vector< unsigned char > _in;
+		std::vector< PacketId > _acknowledged;
+};
+
+}
+
+#endif
@@ -1,6 +1,8 @@
 #include "program_options.h"
 
+#include <cstdlib>
 #include <fstream>
+#include <sstream>
 
 namespace LM50 {
 
@@ -14,29 +16,100 @@ ProgramOptions::ProgramOptions() : \
 	_commonOptions( "Common options" ),\
 	_commonOptionsRRD( "Common options - \"RRD\" module" ),\
 	_commonOptionsReport( "Common options - \"Report\" module" ),\
+	_commonOptionsControl( "Common options - \"Control\" module" ),\
+	_commonOptionsMqtt( "Common options - \"MQTT\" module" ),\
+	_commonOptionsInflux( "Common options - \"InfluxDB\" module" ),\
+	_commonOptionsModbusProxy( "Common options - \"ModBus proxy\" module" ),\
+	_commonOptionsHttp( "Common options - \"HTTP\" module" ),\
 	_cmdLineOnlyOptions( "Command line only options" ),\
 	_preOptionVMap(),\
 	_commonOptionVMap(),\
 	_rrdOptionVMap(),\
 	_reportOptionVMap(),\
+	_controlOptionVMap(),\
+	_mqttOptionVMap(),\
+	_influxOptionVMap(),\
+	_modbusProxyOptionVMap(),\
+	_httpOptionVMap(),\
+	_argCount( 0 ),\
+	_argVals( nullptr ),\
 	_operationMode( UNKNOWN ),\
 	_hasOptionHelp( false ),\
 	_configFile(),\
 	_host(),\
 	_port(),\
+	_transport( "tcp" ),\
+	_unitId( 1 ),\
 	_foreground( false ),\
 	_verbose( false ),\
 	_channels(),
+	_channelMeta( LM50Device::countChannels ),
+	_balanceTree(),
+	_balanceThreshold( 500.0 ),
+	_balanceWindow( 60 ),
+	_balanceAlpha( 0.1 ),
+	_balanceEvents(),
+	_anomalyZ( 8.0 ),
+	_anomalyStuck( 20.0 ),
+	_anomalyAlpha( 0.05 ),
+	_traceFile(),
+	_metricsFile(),
+	_timelineFile(),
+	_timelineSize( 16 ),
+	_timelineFiles( 4 ),
 	_rrd( false ),
 	_rrdFile(),
 	_rrdPeriod( 30 ),
+	_rrdCsvFile(),
+	_rrdCsvSize( 64 ),
+	_rrdCsvFiles( 8 ),
+	_rrdCsvGzip( false ),
 	_report( false ),
 	_reportFile(),
 	_reportPeriod( MONTHLY ),
-	_reportRecipient() {
+	_reportRecipient(),
+	_reportInterval( 300 ),
+	_reportSpool(),
+	_reportSendmail( "/usr/sbin/sendmail -t -i" ),
+	_control( false ),
+	_controlSocket( "/run/lm50client.sock" ),
+	_mqtt( false ),
+	_mqttHost( "localhost" ),
+	_mqttPort( "1883" ),
+	_mqttClientId( "lm50client" ),
+	_mqttUser(),
+	_mqttPassword(),
+	_mqttPrefix( "lm50" ),
+	_mqttDevice(),
+	_mqttQos( 0 ),
+	_mqttKeepAlive( 60 ),
+	_mqttBacklog( 100000 ),
+	_influx( false ),
+	_influxHost( "localhost" ),
+	_influxPort( "8086" ),
+	_influxDatabase( "lm50" ),
+	_influxMeasurement( "lm50" ),
+	_influxDevice(),
+	_influxToken(),
+	_influxBatchSize( 65536 ),
+	_influxFlushInterval( 10 ),
+	_influxRetryBuffer( 16 * 1024 * 1024 ),
+	_modbusProxy( false ),
+	_modbusProxyAddress( "0.0.0.0" ),
+	_modbusProxyPort( "502" ),
+	_http( false ),
+	_httpAddress( "0.0.0.0" ),
+	_httpPort( "8080" ),
+	_httpHistory( 3600 ) {
 	
 	_channels.reserve( LM50Device::countChannels );
 	for( ChIdx i( 0 ); i < LM50Device::countChannels; i++ ) _channels.push_back(i+1);
+	for( ChIdx i( 0 ); i < LM50Device::countChannels; i++ ) {
+		char name[] = "Channel 00";
+		name[8] = '0' + (i+1) / 10;
+		name[9] = '0' + (i+1) % 10;
+		_channelMeta[i].name = name;
+	}
 	
 	_cmdLineOnlyOptions.add_options()
 		( "help", po::bool_switch( &_hasOptionHelp ), "Prints this help message and exits." )
@@ -45,20 +118,81 @@ ProgramOptions::ProgramOptions() : \
 	_commonOptions.add_options()
 		( "host,h", po::value< string >( &_host )->required(), "The DNS name of the LM50TCP+ to connect to." )
 		( "port,p", po::value< string >( &_port )->default_value( string( "502") ), "The port on that the LM50TCP+ listens (default 502). The port can either be given as an integer or as a well-known servive name. E.g. \"http\" is identical to \"80\"." )
+		( "transport", po::value< string >( &_transport )->default_value( _transport ), "The transport to the device. Must be one out of the following values:\ntcp       \tModBus/TCP, e.g. the LM50TCP+ itself.\nrtu-tcp   \tModBus RTU frames tunneled through TCP by a serial device server.\nrtu-serial\tModBus RTU on a local serial port. The host is the path of the port (e.g. /dev/ttyUSB0) and the port is the baud rate optionally followed by the framing, e.g. \"9600\" or \"19200:8N1\" (default 8E1).\nudp       \tModBus/UDP, one datagram per request without a connection. Lost datagrams are retransmitted." )
+		( "unit-id", po::value< unsigned int >( &_unitId )->default_value( _unitId ), "The unit id the device is addressed by, between 1 and 247 (default 1, which the LM50TCP+ answers to). Only needed, if several devices share a RTU line." )
 		( "mode,m", po::value< string >()->required(), "The operation mode of the program. Must be one out of the following values:\nhuman,h   \tWrites results to standard output in a nice readable layout.\ncacti,c   \tWrite results to standard output such that they can be parsed by cacti.\ndaemon,d  \tForks into background and polls the LM50TCP+ periodically." )
-		( "workers,w", po::value< str_vector >()->multitoken()->default_value( str_vector(), "" ), "In daemon mode only: A list of workers (i.e. components) that are scheduled by the daemon and perform a specific task. Each worker has its own set of configuration options. The following workers are available:\nrrd     \tThis worker queries the device periodically and writes the results into a RRDTool file.\nreport  \tThis worker queries the device periodically and sends a report of the changes since the last query per email." )
+		( "workers,w", po::value< str_vector >()->multitoken()->default_value( str_vector(), "" ), "In daemon mode only: A list of workers (i.e. components) that are scheduled by the daemon and perform a specific task. Each worker has its own set of configuration options. The following workers are available:\nrrd     \tThis worker queries the device periodically and writes the results into a RRDTool file.\nreport  \tThis worker samples the device periodically and sends a report of the consumption per channel at the end of each day, week or month.\ncontrol \tThis worker serves a local control socket to query the state of the daemon.\nmqtt    \tThis worker publishes the values polled by the other workers to a MQTT broker.\ninflux  \tThis worker writes the values polled by the other workers to an InfluxDB.\nmodbus-proxy\tThis worker serves the registers of the device to other ModBus/TCP clients.\nhttp    \tThis worker serves the values polled by the other workers as JSON and Server-Sent Events over HTTP." )
 		( "foreground,f", po::bool_switch( &_foreground ), "In daemon mode only: Do not fork into background but write operational log to standard output for debugging purpose" )
 		( "verbose,v", po::bool_switch( &_verbose ), "In daemon mode only: Do not fork into background but write verbose log to standard output for debugging purpose" )
-		( "channels,C", po::value< ChList >( &_channels )->multitoken()->default_value( _channels, "<all>" ), "Specifies the channels whose values are polled and processed. Multiple channel numbers must be seperated by white spaces. If the option is specified more than once, the lists of channels are joined. The channels are sorted increasingly and duplicates are skipped. E.g. \"-C 6 11 9 6 -C 11\" is equivalent to \"-C 6 9 11\". If the option is omitted, all available channels are polled." );
+		( "channels,C", po::value< ChList >( &_channels )->multitoken()->default_value( _channels, "<all>" ), "Specifies the channels whose values are polled and processed. Multiple channel numbers must be seperated by white spaces. If the option is specified more than once, the lists of channels are joined. The channels are sorted increasingly and duplicates are skipped. E.g. \"-C 6 11 9 6 -C 11\" is equivalent to \"-C 6 9 11\". If the option is omitted, all available channels are polled." )
+		( "channel-name", po::value< str_vector >()->composing(), "The name of a channel, given as <channel>:<name>, e.g. \"10:Main\". The option can be specified once per channel. By default a channel is named \"Channel NN\"." )
+		( "channel-imp", po::value< str_vector >()->composing(), "The impulse constant of the meter of a channel in pulses per kWh, given as <channel>:<imp>, e.g. \"10:10000\". The default is 1000." )
+		( "channel-phase", po::value< str_vector >()->composing(), "The phase the meter of a channel measures, given as <channel>:<phase>. The phase is one out of L1, L2, L3 or 3 for a three-phase meter, which is the default." )
+		( "channel-max-current", po::value< str_vector >()->composing(), "The rated current of the circuit of a channel in A, given as <channel>:<current>. The default is 63. Together with the phase it bounds the plausible power, see README.txt." )
+		( "balance", po::value< str_vector >()->composing(), "In daemon mode only: Checks that a feed and its sub-meters balance, given as <feed>:<sub-meter> <sub-meter> ..., e.g. \"10:11 12 17\". The option can be specified once per feed, a sub-meter can be the feed of another check. The residual power (feed minus sub-meters) is computed on every update and an event is logged, if its mean over the window exceeds the threshold." )
+		( "balance-threshold", po::value< double >( &_balanceThreshold )->default_value( _balanceThreshold ), "In daemon mode only: The residual power in W at which a balance event is raised." )
+		( "balance-window", po::value< unsigned int >( &_balanceWindow )->default_value( _balanceWindow ), "In daemon mode only: The number of updates the mean and standard deviation of the residual power are computed over." )
+		( "balance-alpha", po::value< double >( &_balanceAlpha )->default_value( _balanceAlpha ), "In daemon mode only: The weight of the newest residual in its moving average, between 0 and 1." )
+		( "balance-events", po::value< string >( &_balanceEvents ), "In daemon mode only: Appends balance events to this file in addition to the log." )
+		( "anomaly-z", po::value< double >( &_anomalyZ )->default_value( _anomalyZ ), "In daemon mode only: The deviation of the rate of a channel from its moving average in standard deviations, above which a sample is flagged as an outlier. Zero disables the check." )
+		( "anomaly-stuck", po::value< double >( &_anomalyStuck )->default_value( _anomalyStuck ), "In daemon mode only: The number of pulses a channel is expected to produce according to its moving average rate, after which an unchanged counter is taken as stuck and its samples are dropped. Zero disables the check." )
+		( "anomaly-alpha", po::value< double >( &_anomalyAlpha )->default_value( _anomalyAlpha ), "In daemon mode only: The weight of the newest rate in the moving average and variance of the anomaly checks, between 0 and 1." )
+		( "trace", po::value< string >( &_traceFile ), "In daemon mode only: Appends every ModBus datagram exchanged with the LM50TCP+ to this binary trace file. The trace can be replayed by lm50bench in order to reproduce the traffic offline." )
+		( "metrics", po::value< string >( &_metricsFile ), "In daemon mode only: The file to write the self-metrics of the daemon to when SIGUSR1 is received. If omitted, the metrics are written to standard error, which is only visible in foreground mode." )
+		( "timeline", po::value< string >( &_timelineFile ), "In daemon mode only: Writes a timeline of each beat (wake up, lock, connect, send, device, receive, decode, RRD update) to this file in the Chrome trace event format. The file can be opened by chrome://tracing or ui.perfetto.dev." )
+		( "timeline-size", po::value< size_t >( &_timelineSize )->default_value( _timelineSize ), "In daemon mode only: The size of the timeline file in MiB at which it is rotated." )
+		( "timeline-files", po::value< unsigned int >( &_timelineFiles )->default_value( _timelineFiles ), "In daemon mode only: The number of rotated timeline files to keep." );
 		
 	_commonOptionsRRD.add_options()
 		( "rrd.file", po::value< string >( &_rrdFile )->required(), "The path of the RRDTool file" )
-		( "rrd.period", po::value< unsigned long >( &_rrdPeriod )->default_value( _rrdPeriod ), "Number of seconds between polling new values from device" );
+		( "rrd.period", po::value< unsigned long >( &_rrdPeriod )->default_value( _rrdPeriod ), "Number of seconds between polling new values from device" )
+		( "rrd.csv", po::value< string >( &_rrdCsvFile ), "Additionally archives the polled values to this CSV file. The file is written by a background thread and does not delay polling." )
+		( "rrd.csv-size", po::value< size_t >( &_rrdCsvSize )->default_value( _rrdCsvSize ), "The size of the CSV file in MiB (uncompressed) at which it is rotated" )
+		( "rrd.csv-files", po::value< unsigned int >( &_rrdCsvFiles )->default_value( _rrdCsvFiles ), "The number of rotated CSV files to keep" )
+		( "rrd.csv-gzip", po::bool_switch( &_rrdCsvGzip ), "Compresses the CSV file with gzip" );
 		
 	_commonOptionsReport.add_options()
-		( "report.file", po::value< string >( &_reportFile )->required(), "The path to a (temporary) file in order to store the values between two consecutive reports" )
+		( "report.file", po::value< string >( &_reportFile )->required(), "The path to a file in order to store the running aggregates between two consecutive reports. The file is small, updated on each sample and survives restarts of the daemon." )
 		( "report.period", po::value< string >()->default_value( "monthly" ), "The interval between two reports. Must be one out of the following values:\ndaily,d    \tCreates a report every midnight.\nweekly,w   \tCreates a report every midnight between sunday and monday.\nmonthly,m  \tCreates a report every midnight before the 1st of each month." )
-		( "report.recipient", po::value< string >( &_reportRecipient )->required(), "The email address to send the report to" );
+		( "report.recipient", po::value< string >( &_reportRecipient )->required(), "The email address to send the report to" )
+		( "report.interval", po::value< unsigned long >( &_reportInterval )->default_value( _reportInterval ), "Number of seconds between two samples of the report" )
+		( "report.spool", po::value< string >( &_reportSpool ), "Writes each report as a mail message into this directory instead of sending it" )
+		( "report.sendmail", po::value< string >( &_reportSendmail )->default_value( _reportSendmail ), "The sendmail compatible command that the report is piped to. The command must take the recipient from the message header." );
+		
+	_commonOptionsControl.add_options()
+		( "control.socket", po::value< string >( &_controlSocket )->default_value( _controlSocket ), "The path of the Unix domain socket. Send \"help\" to the socket for a list of commands." );
+		
+	_commonOptionsMqtt.add_options()
+		( "mqtt.host", po::value< string >( &_mqttHost )->default_value( _mqttHost ), "The DNS name of the MQTT broker" )
+		( "mqtt.port", po::value< string >( &_mqttPort )->default_value( _mqttPort ), "The port of the MQTT broker" )
+		( "mqtt.client-id", po::value< string >( &_mqttClientId )->default_value( _mqttClientId ), "The client identifier, must be unique at the broker" )
+		( "mqtt.user", po::value< string >( &_mqttUser ), "The user name to log in at the broker" )
+		( "mqtt.password", po::value< string >( &_mqttPassword ), "The password to log in at the broker" )
+		( "mqtt.prefix", po::value< string >( &_mqttPrefix )->default_value( _mqttPrefix ), "The first level of all topics. The values of a channel are published retained to <prefix>/<device>/<channel>, the state of the daemon to <prefix>/<device>/status." )
+		( "mqtt.device", po::value< string >( &_mqttDevice ), "The second level of all topics. By default the host of the LM50TCP+." )
+		( "mqtt.qos", po::value< unsigned int >( &_mqttQos )->default_value( _mqttQos ), "The quality of service of all messages, 0 (at most once) or 1 (at least once)" )
+		( "mqtt.keepalive", po::value< unsigned int >( &_mqttKeepAlive )->default_value( _mqttKeepAlive ), "The keep alive interval in seconds" )
+		( "mqtt.backlog", po::value< size_t >( &_mqttBacklog )->default_value( _mqttBacklog ), "The number of messages that are kept in memory while the broker is unavailable. If the backlog is full, the oldest messages are dropped." );
+		
+	_commonOptionsInflux.add_options()
+		( "influx.host", po::value< string >( &_influxHost )->default_value( _influxHost ), "The DNS name of the InfluxDB server" )
+		( "influx.port", po::value< string >( &_influxPort )->default_value( _influxPort ), "The HTTP port of the InfluxDB server" )
+		( "influx.database", po::value< string >( &_influxDatabase )->default_value( _influxDatabase ), "The database (or bucket) to write to" )
+		( "influx.measurement", po::value< string >( &_influxMeasurement )->default_value( _influxMeasurement ), "The measurement of all points" )
+		( "influx.device", po::value< string >( &_influxDevice ), "The value of the tag \"device\". By default the host of the LM50TCP+." )
+		( "influx.token", po::value< string >( &_influxToken ), "The token to authenticate at the server, if required" )
+		( "influx.batch-size", po::value< size_t >( &_influxBatchSize )->default_value( _influxBatchSize ), "The number of bytes of line protocol after which a batch is written" )
+		( "influx.flush-interval", po::value< unsigned int >( &_influxFlushInterval )->default_value( _influxFlushInterval ), "The number of seconds after which a batch is written at the latest" )
+		( "influx.retry-buffer", po::value< size_t >( &_influxRetryBuffer )->default_value( _influxRetryBuffer ), "The number of bytes of compressed batches that are kept in memory while the server is unavailable. If the buffer is full, the oldest batches are dropped." );
+		
+	_commonOptionsModbusProxy.add_options()
+		( "modbus-proxy.address", po::value< string >( &_modbusProxyAddress )->default_value( _modbusProxyAddress ), "The local address to listen on for ModBus/TCP clients" )
+		( "modbus-proxy.port", po::value< string >( &_modbusProxyPort )->default_value( _modbusProxyPort ), "The port to listen on for ModBus/TCP clients" );
+		
+	_commonOptionsHttp.add_options()
+		( "http.address", po::value< string >( &_httpAddress )->default_value( _httpAddress ), "The local address to listen on for HTTP clients" )
+		( "http.port", po::value< string >( &_httpPort )->default_value( _httpPort ), "The port to listen on for HTTP clients" )
+		( "http.history", po::value< size_t >( &_httpHistory )->default_value( _httpHistory ), "The number of recent samples that are kept in memory for /recent and for clients of /stream that resume" );
 }
 
 
@@ -69,6 +203,16 @@ void ProgramOptions::print( std::ostream &s ) const {
 	s << std::endl;
 	_commonOptionsReport.print( s );
 	s << std::endl;
+	_commonOptionsControl.print( s );
+	s << std::endl;
+	_commonOptionsMqtt.print( s );
+	s << std::endl;
+	_commonOptionsInflux.print( s );
+	s << std::endl;
+	_commonOptionsModbusProxy.print( s );
+	s << std::endl;
+	_commonOptionsHttp.print( s );
+	s << std::endl;
 	_cmdLineOnlyOptions.print(s);
 	s << std::endl;
 }
@@ -82,6 +226,9 @@ void ProgramOptions::print( std::ostream &s ) const {
  * appropriate. In all other cases the return value is false.
  */
 void ProgramOptions::parse( int argCount, char* argVals[] )  {
+	_argCount = argCount;
+	_argVals = argVals;
+	
 	// The config file in case it is needed
 	std::ifstream file;
 	
@@ -117,6 +264,9 @@ void ProgramOptions::parse( int argCount, char* argVals[] )  {
 	// in case "foreground" is not enabled.
 	if( !_foreground ) _verbose = false;
 	
+	if( _transport != "tcp" && _transport != "rtu-tcp" && _transport != "rtu-serial" && _transport != "udp" ) throw std::invalid_argument( "The transport must be one out of \"tcp\", \"rtu-tcp\", \"rtu-serial\" or \"udp\"" );
+	if( _unitId < 1 || _unitId > 247 ) throw std::invalid_argument( "The unit id must be between 1 and 247" );
+	
 	
 	// Sort list of channels and remove duplicates
 	std::sort< ChList::iterator >( _channels.begin(), _channels.end() );
@@ -132,6 +282,11 @@ void ProgramOptions::parse( int argCount, char* argVals[] )  {
 		if( --(*it) >= LM50Device::countChannels ) throw std::domain_error( msg.str() );
 	}
 	
+	parseChannelMeta();
+	parseBalanceTree();
+	if( !( _anomalyAlpha > 0.0 && _anomalyAlpha <= 1.0 ) ) throw std::invalid_argument( "The anomaly alpha must be greater than 0 and at most 1" );
+	if( _anomalyZ < 0.0 || _anomalyStuck < 0.0 ) throw std::invalid_argument( "The anomaly limits must not be negative" );
+	
 	// Obtain list of workers
 	str_vector workers( _commonOptionVMap[ "workers" ].as< str_vector >() );
 	while( ! workers.empty() ) {
@@ -139,40 +294,168 @@ void ProgramOptions::parse( int argCount, char* argVals[] )  {
 		workers.pop_back();
 		if( w.compare( "rrd" ) == 0 ) _rrd = true;
 		else if ( w.compare( "report" ) == 0 ) _report = true;
+		else if ( w.compare( "control" ) == 0 ) _control = true;
+		else if ( w.compare( "mqtt" ) == 0 ) _mqtt = true;
+		else if ( w.compare( "influx" ) == 0 ) _influx = true;
+		else if ( w.compare( "modbus-proxy" ) == 0 ) _modbusProxy = true;
+		else if ( w.compare( "http" ) == 0 ) _http = true;
 		else throw std::invalid_argument( string( "Unknown worker \"" ).append(w).append( "\"" ) );
 	}
 	
 	// Parse options for worker "rrd"
-	if( _rrd ) {
-		po::store( po::command_line_parser( argCount, argVals ).options( _commonOptionsRRD ).allow_unregistered().run(), _rrdOptionVMap );
-		if( file.is_open() ) {
-			file.clear();
-			file.seekg(0);
-			if( file.fail() ) throw std::invalid_argument( "Could seek in config file" );
-			po::store( po::parse_config_file( file, _commonOptionsRRD, true ), _rrdOptionVMap );
-		}
-		po::notify( _rrdOptionVMap );
-	}
+	if( _rrd ) parseModuleOptions( argCount, argVals, file, _commonOptionsRRD, _rrdOptionVMap );
 	
 	// Parse options for worker "report"
 	if( _report ) {
-		po::store( po::command_line_parser( argCount, argVals ).options( _commonOptionsReport ).allow_unregistered().run(), _reportOptionVMap );
-		if( file.is_open() ) {
-			file.clear();
-			file.seekg(0);
-			if( file.fail() ) throw std::invalid_argument( "Could seek in config file" );
-			po::store( po::parse_config_file( file, _commonOptionsReport, true ), _reportOptionVMap );
-		}
-		po::notify( _reportOptionVMap );
+		parseModuleOptions( argCount, argVals, file, _commonOptionsReport, _reportOptionVMap );
 		
 		string period( _reportOptionVMap[ "report.period" ].as< string >() );
-		if( period.compare( "daily" ) == 0 || mode.compare( "d" ) == 0 ) _reportPeriod = DAILY;
-		else if( period.compare( "weekly" ) == 0 || mode.compare( "w" ) == 0 ) _reportPeriod = WEEKLY;
-		else if( period.compare( "monthly" ) == 0 || mode.compare( "m" ) == 0 ) _reportPeriod = MONTHLY;
+		if( period.compare( "daily" ) == 0 || period.compare( "d" ) == 0 ) _reportPeriod = DAILY;
+		else if( period.compare( "weekly" ) == 0 || period.compare( "w" ) == 0 ) _reportPeriod = WEEKLY;
+		else if( period.compare( "monthly" ) == 0 || period.compare( "m" ) == 0 ) _reportPeriod = MONTHLY;
 		else throw std::invalid_argument( "The report period must be one out of \"daily\", \"weekly\" or \"monthly\"" );
+		if( _reportInterval == 0 ) throw std::invalid_argument( "The report interval must be positive" );
+	}
+	
+	// Parse options for worker "control"
+	if( _control ) parseModuleOptions( argCount, argVals, file, _commonOptionsControl, _controlOptionVMap );
+	
+	// Parse options for worker "mqtt". The worker does not poll the device
+	// by itself but publishes the values the other workers polled.
+	if( _mqtt ) {
+		parseModuleOptions( argCount, argVals, file, _commonOptionsMqtt, _mqttOptionVMap );
+		if( !_rrd && !_report ) throw std::invalid_argument( "The worker \"mqtt\" publishes the values polled by the workers \"rrd\" or \"report\", hence one of them must be enabled" );
+		if( _mqttQos > 1 ) throw std::invalid_argument( "The MQTT quality of service must be 0 or 1" );
+		const string topic( _mqttPrefix + mqttDevice() );
+		if( topic.find_first_of( "+#" ) != string::npos ) throw std::invalid_argument( "The MQTT prefix and device must not contain the wildcards + or #" );
+	}
+	
+	// Parse options for worker "influx", which depends on the other workers
+	// like "mqtt"
+	if( _influx ) {
+		parseModuleOptions( argCount, argVals, file, _commonOptionsInflux, _influxOptionVMap );
+		if( !_rrd && !_report ) throw std::invalid_argument( "The worker \"influx\" writes the values polled by the workers \"rrd\" or \"report\", hence one of them must be enabled" );
+		if( _influxMeasurement.empty() ) throw std::invalid_argument( "The InfluxDB measurement must not be empty" );
+		if( _influxBatchSize == 0 ) throw std::invalid_argument( "The InfluxDB batch size must be positive" );
+	}
+	
+	// Parse options for worker "modbus-proxy". The channels are served from
+	// the values polled by the other workers.
+	if( _modbusProxy ) {
+		parseModuleOptions( argCount, argVals, file, _commonOptionsModbusProxy, _modbusProxyOptionVMap );
+		if( !_rrd && !_report ) throw std::invalid_argument( "The worker \"modbus-proxy\" serves the values polled by the workers \"rrd\" or \"report\", hence one of them must be enabled" );
+	}
+	
+	// Parse options for worker "http", which serves the values polled by the
+	// other workers like "modbus-proxy"
+	if( _http ) {
+		parseModuleOptions( argCount, argVals, file, _commonOptionsHttp, _httpOptionVMap );
+		if( !_rrd && !_report ) throw std::invalid_argument( "The worker \"http\" serves the values polled by the workers \"rrd\" or \"report\", hence one of them must be enabled" );
+		if( _httpHistory == 0 ) throw std::invalid_argument( "The HTTP history must keep at least one sample" );
+	}
+}
+
+/**
+ * Stores the per channel options "channel-*" in _channelMeta. Each value has
+ * the form <channel>:<value>.
+ */
+void ProgramOptions::parseChannelMeta() {
+	static const char* const keys[] = { "channel-name", "channel-imp", "channel-phase", "channel-max-current" };
+	for( size_t k( 0 ); k != sizeof( keys ) / sizeof( keys[0] ); ++k ) {
+		if( !_commonOptionVMap.count( keys[k] ) ) continue;
+		const str_vector& values( _commonOptionVMap[ keys[k] ].as< str_vector >() );
+		for( str_vector::const_iterator it( values.begin() ); it != values.end(); ++it ) {
+			const size_t colon( it->find( ':' ) );
+			char* end( nullptr );
+			const unsigned long ch( colon == string::npos ? 0 : strtoul( it->c_str(), &end, 10 ) );
+			if( ch < 1 || ch > LM50Device::countChannels || end != it->c_str() + colon ) {
+				throw std::invalid_argument( string( "The value of option \"" ).append( keys[k] ).append( "\" must have the form <channel>:<value>, got \"" ).append( *it ).append( "\"" ) );
+			}
+			const string value( it->substr( colon + 1 ) );
+			ChannelMeta& meta( _channelMeta[ ch - 1 ] );
+			if( k == 0 ) {
+				meta.name = value;
+				continue;
+			}
+			if( k == 2 ) {
+				if( value == "L1" ) meta.phase = L1;
+				else if( value == "L2" ) meta.phase = L2;
+				else if( value == "L3" ) meta.phase = L3;
+				else if( value == "3" ) meta.phase = THREE_PHASE;
+				else throw std::invalid_argument( string( "The phase must be one out of L1, L2, L3 or 3, got \"" ).append( value ).append( "\"" ) );
+				continue;
+			}
+			const unsigned long number( strtoul( value.c_str(), &end, 10 ) );
+			if( value.empty() || *end != '\0' || number == 0 ) throw std::invalid_argument( string( "The value of option \"" ).append( keys[k] ).append( "\" must be a positive integer, got \"" ).append( value ).append( "\"" ) );
+			if( k == 1 ) meta.impPerKWh = number;
+			else meta.maxCurrent = number;
+		}
+	}
+}
+
+/**
+ * Stores the option "balance" in _balanceTree. Each value has the form
+ * <feed>:<sub-meter> <sub-meter> ...
+ */
+void ProgramOptions::parseBalanceTree() {
+	if( _balanceWindow == 0 ) throw std::invalid_argument( "The balance window must be positive" );
+	if( !( _balanceAlpha > 0.0 && _balanceAlpha <= 1.0 ) ) throw std::invalid_argument( "The balance alpha must be greater than 0 and at most 1" );
+	if( !_commonOptionVMap.count( "balance" ) ) return;
+	const str_vector& values( _commonOptionVMap[ "balance" ].as< str_vector >() );
+	for( str_vector::const_iterator it( values.begin() ); it != values.end(); ++it ) {
+		const string msg( string( "The value of option \"balance\" must have the form <feed>:<sub-meter> <sub-meter> ... with channels between 1 and 50, got \"" ).append( *it ).append( "\"" ) );
+		std::istringstream is( *it );
+		BalanceNode node;
+		char colon( 0 );
+		if( !( is >> node.feed >> colon ) || colon != ':' ) throw std::invalid_argument( msg );
+		ChIdx ch;
+		while( is >> ch ) {
+			if( ch < 1 || ch > LM50Device::countChannels || ch == node.feed ) throw std::invalid_argument( msg );
+			node.subMeters.push_back( ch - 1 );
+		}
+		if( !is.eof() || node.feed < 1 || node.feed > LM50Device::countChannels || node.subMeters.empty() ) throw std::invalid_argument( msg );
+		--node.feed;
+		_balanceTree.push_back( node );
 	}
 }
 
+ProgramOptions* ProgramOptions::reload() const {
+	ProgramOptions* po( new ProgramOptions() );
+	try {
+		po->parse( _argCount, _argVals );
+	} catch( ... ) {
+		delete po;
+		throw;
+	}
+	return po;
+}
+
+/**
+ * Parses the options of a single module (i.e. worker) from the command line
+ * and from the config file, if one is open.
+ */
+void ProgramOptions::parseModuleOptions( int argCount, char* argVals[], std::ifstream& file, const po::options_description& options, po::variables_map& vmap ) {
+	po::store( po::command_line_parser( argCount, argVals ).options( options ).allow_unregistered().run(), vmap );
+	if( file.is_open() ) {
+		file.clear();
+		file.seekg(0);
+		if( file.fail() ) throw std::invalid_argument( "Could seek in config file" );
+		po::store( po::parse_config_file( file, options, true ), vmap );
+	}
+	po::notify( vmap );
+}
+
+ProgramOptions::ChannelMeta::ChannelMeta() : \
+	name(), \
+	impPerKWh( 1000 ), \
+	phase( THREE_PHASE ), \
+	maxCurrent( 63 ) {
+}
+
+double ProgramOptions::ChannelMeta::maxPower() const {
+	return ( phase == THREE_PHASE ? 3.0 : 1.0 ) * 230.0 * maxCurrent;
+}
+
 void ProgramOptions::operationMode( OperationMode m ) {
 	assert( m != UNKNOWN );
 	// Check that the operation mode has not been set before
@@ -2,6 +2,7 @@
 #define _PROGRAM_OPTIONS_H_
 
 #include <boost/program_options.hpp>
+#include <fstream>
 #include <string>
 #include "core/lm50device.h"
 
@@ -13,6 +14,35 @@ class ProgramOptions {
 		typedef std::vector< ChIdx > ChList;
 		enum OperationMode { UNKNOWN, HUMAN, CACTI, DAEMON };
 		enum ReportPeriod { DAILY, WEEKLY, MONTHLY };
+		enum Phase { THREE_PHASE, L1, L2, L3 };
+		
+		/**
+		 * The description of the meter that is connected to a channel
+		 */
+		struct ChannelMeta {
+			ChannelMeta();
+			
+			/**
+			 * @return The maximum power in W the meter is rated for, i.e. the
+			 * maximum current times 230V times the number of phases
+			 */
+			double maxPower() const;
+			
+			std::string name;
+			unsigned int impPerKWh;
+			Phase phase;
+			unsigned int maxCurrent; // in A
+		};
+		typedef std::vector< ChannelMeta > ChMetaList;
+		
+		/**
+		 * A feed and the sub-meters behind it, see option "balance"
+		 */
+		struct BalanceNode {
+			ChIdx feed;
+			ChList subMeters;
+		};
+		typedef std::vector< BalanceNode > BalanceTree;
 	
 	public:
 		ProgramOptions();
@@ -21,6 +51,15 @@ class ProgramOptions {
 	public:
 		void parse( int argCount, char* argVals[] );
 		
+		/**
+		 * Parses the command line of the last call of parse() once more into a
+		 * new object, i.e. re-reads the config file. The command line must still
+		 * be valid, which holds for the arguments of main().
+		 * @return The new object, the caller takes the ownership
+		 * @throws std::exception& See parse()
+		 */
+		ProgramOptions* reload() const;
+		
 		void print( std::ostream &s ) const;
 		
 		OperationMode operationMode() const { return _operationMode; }
@@ -31,18 +70,68 @@ class ProgramOptions {
 		
 		const std::string& port() const { return _port; }
 		
+		/**
+		 * The transport to the device: "tcp", "rtu-tcp", "rtu-serial" or "udp"
+		 */
+		const std::string& transport() const { return _transport; }
+		
+		/**
+		 * The unit id the device is addressed by
+		 */
+		unsigned int unitId() const { return _unitId; }
+		
 		bool stayInForeground() const { return _foreground; }
 		
 		bool beVerbose() const { return _verbose; }
 		
 		const ChList& channels() const { return _channels; }
 		
+		/**
+		 * @return The meter description of the channel
+		 * @param ch The channel index between 0 and LM50Device::countChannels
+		 */
+		const ChannelMeta& channelMeta( ChIdx ch ) const { return _channelMeta[ ch ]; }
+		
+		const BalanceTree& balanceTree() const { return _balanceTree; }
+		
+		double balanceThreshold() const { return _balanceThreshold; }
+		
+		unsigned int balanceWindow() const { return _balanceWindow; }
+		
+		double balanceAlpha() const { return _balanceAlpha; }
+		
+		const std::string& balanceEvents() const { return _balanceEvents; }
+		
+		double anomalyZ() const { return _anomalyZ; }
+		
+		double anomalyStuck() const { return _anomalyStuck; }
+		
+		double anomalyAlpha() const { return _anomalyAlpha; }
+		
+		const std::string& traceFile() const { return _traceFile; }
+		
+		const std::string& metricsFile() const { return _metricsFile; }
+		
+		const std::string& timelineFile() const { return _timelineFile; }
+		
+		size_t timelineSize() const { return _timelineSize; }
+		
+		unsigned int timelineFiles() const { return _timelineFiles; }
+		
 		bool rrdEnabled() const { return _rrd; }
 		
 		const std::string& rrdFile() const { return _rrdFile; }
 		
 		unsigned long rrdPeriod() const { return _rrdPeriod; }
 		
+		const std::string& rrdCsvFile() const { return _rrdCsvFile; }
+		
+		size_t rrdCsvSize() const { return _rrdCsvSize; }
+		
+		unsigned int rrdCsvFiles() const { return _rrdCsvFiles; }
+		
+		bool rrdCsvGzip() const { return _rrdCsvGzip; }
+		
 		bool reportEnabled() const { return _report; }
 		
 		const std::string& reportFile() const { return _reportFile; }
@@ -51,33 +140,176 @@ class ProgramOptions {
 		
 		const std::string& reportRecipient() const { return _reportRecipient; }
 		
+		unsigned long reportInterval() const { return _reportInterval; }
+		
+		const std::string& reportSpool() const { return _reportSpool; }
+		
+		const std::string& reportSendmail() const { return _reportSendmail; }
+		
+		bool controlEnabled() const { return _control; }
+		
+		const std::string& controlSocket() const { return _controlSocket; }
+		
+		bool mqttEnabled() const { return _mqtt; }
+		
+		const std::string& mqttHost() const { return _mqttHost; }
+		
+		const std::string& mqttPort() const { return _mqttPort; }
+		
+		const std::string& mqttClientId() const { return _mqttClientId; }
+		
+		const std::string& mqttUser() const { return _mqttUser; }
+		
+		const std::string& mqttPassword() const { return _mqttPassword; }
+		
+		const std::string& mqttPrefix() const { return _mqttPrefix; }
+		
+		/**
+		 * The device part of the topics, the host of the LM50TCP+ by default
+		 */
+		const std::string& mqttDevice() const { return _mqttDevice.empty() ? _host : _mqttDevice; }
+		
+		unsigned int mqttQos() const { return _mqttQos; }
+		
+		unsigned int mqttKeepAlive() const { return _mqttKeepAlive; }
+		
+		size_t mqttBacklog() const { return _mqttBacklog; }
+		
+		bool influxEnabled() const { return _influx; }
+		
+		const std::string& influxHost() const { return _influxHost; }
+		
+		const std::string& influxPort() const { return _influxPort; }
+		
+		const std::string& influxDatabase() const { return _influxDatabase; }
+		
+		const std::string& influxMeasurement() const { return _influxMeasurement; }
+		
+		/**
+		 * The value of the tag "device", the host of the LM50TCP+ by default
+		 */
+		const std::string& influxDevice() const { return _influxDevice.empty() ? _host : _influxDevice; }
+		
+		const std::string& influxToken() const { return _influxToken; }
+		
+		size_t influxBatchSize() const { return _influxBatchSize; }
+		
+		unsigned int influxFlushInterval() const { return _influxFlushInterval; }
+		
+		size_t influxRetryBuffer() const { return _influxRetryBuffer; }
+		
+		bool modbusProxyEnabled() const { return _modbusProxy; }
+		
+		const std::string& modbusProxyAddress() const { return _modbusProxyAddress; }
+		
+		const std::string& modbusProxyPort() const { return _modbusProxyPort; }
+		
+		bool httpEnabled() const { return _http; }
+		
+		const std::string& httpAddress() const { return _httpAddress; }
+		
+		const std::string& httpPort() const { return _httpPort; }
+		
+		size_t httpHistory() const { return _httpHistory; }
+		
 	protected:
 		void operationMode( OperationMode m );
 		
+		void parseChannelMeta();
+		
+		void parseBalanceTree();
+		
+		void parseModuleOptions( int argCount, char* argVals[], std::ifstream& file, const boost::program_options::options_description& options, boost::program_options::variables_map& vmap );
+		
 	private:
 		boost::program_options::options_description _commonOptions;
 		boost::program_options::options_description _commonOptionsRRD;
 		boost::program_options::options_description _commonOptionsReport;
+		boost::program_options::options_description _commonOptionsControl;
+		boost::program_options::options_description _commonOptionsMqtt;
+		boost::program_options::options_description _commonOptionsInflux;
+		boost::program_options::options_description _commonOptionsModbusProxy;
+		boost::program_options::options_description _commonOptionsHttp;
 		boost::program_options::options_description _cmdLineOnlyOptions;
 		boost::program_options::variables_map _preOptionVMap;
 		boost::program_options::variables_map _commonOptionVMap;
 		boost::program_options::variables_map _rrdOptionVMap;
 		boost::program_options::variables_map _reportOptionVMap;
+		boost::program_options::variables_map _controlOptionVMap;
+		boost::program_options::variables_map _mqttOptionVMap;
+		boost::program_options::variables_map _influxOptionVMap;
+		boost::program_options::variables_map _modbusProxyOptionVMap;
+		boost::program_options::variables_map _httpOptionVMap;
+		int _argCount;
+		char** _argVals;
 		OperationMode _operationMode;
 		bool _hasOptionHelp;
 		std::string _configFile;
 		std::string _host;
 		std::string _port; // port is a string, because telling name (i.e. 'http' insted of 80) are valid, too
+		std::string _transport;
+		unsigned int _unitId;
 		bool _foreground;
 		bool _verbose;
 		ChList _channels;
+		ChMetaList _channelMeta;
+		BalanceTree _balanceTree;
+		double _balanceThreshold; // in W
+		unsigned int _balanceWindow; // in updates
+		double _balanceAlpha;
+		std::string _balanceEvents;
+		double _anomalyZ;
+		double _anomalyStuck; // in pulses
+		double _anomalyAlpha;
+		std::string _traceFile;
+		std::string _metricsFile;
+		std::string _timelineFile;
+		size_t _timelineSize; // in MiB
+		unsigned int _timelineFiles;
 		bool _rrd;
 		std::string _rrdFile;
 		unsigned long _rrdPeriod; // polling period in seconds
+		std::string _rrdCsvFile;
+		size_t _rrdCsvSize; // in MiB
+		unsigned int _rrdCsvFiles;
+		bool _rrdCsvGzip;
 		bool _report;
 		std::string _reportFile;
 		ReportPeriod _reportPeriod;
 		std::string _reportRecipient;
+		unsigned long _reportInterval; // sampling period in seconds
+		std::string _reportSpool;
+		std::string _reportSendmail;
+		bool _control;
+		std::string _controlSocket;
+		bool _mqtt;
+		std::string _mqttHost;
+		std::string _mqttPort;
+		std::string _mqttClientId;
+		std::string _mqttUser;
+		std::string _mqttPassword;
+		std::string _mqttPrefix;
+		std::string _mqttDevice;
+		unsigned int _mqttQos;
+		unsigned int _mqttKeepAlive; // in seconds
+		size_t _mqttBacklog; // in messages
+		bool _influx;
+		std::string _influxHost;
+		std::string _influxPort;
+		std::string _influxDatabase;
+		std::string _influxMeasurement;
+		std::string _influxDevice;
+		std::string _influxToken;
+		size_t _influxBatchSize; // in bytes of line protocol
+		unsigned int _influxFlushInterval; // in seconds
+		size_t _influxRetryBuffer; // in bytes of compressed batches
+		bool _modbusProxy;
+		std::string _modbusProxyAddress;
+		std::string _modbusProxyPort;
+		bool _http;
+		std::string _httpAddress;
+		std::string _httpPort;
+		size_t _httpHistory; // in samples
 };
 
 }
@@ -0,0 +1,207 @@
+#include "report_state.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace LM50 {
+
+static const char stateMagic[ 8 ] = { 'L', 'M', '5', '0', 'R', 'P', 'T', '\0' };
+
+// Must be increased whenever the layout of the state file changes
+static const u_int32_t stateVersion( 1 );
+
+ReportState::ReportState() : \
+	_state( nullptr ), \
+	_fd( -1 ), \
+	_period( ProgramOptions::MONTHLY ) {
+}
+
+ReportState::~ReportState() {
+	close();
+}
+
+void ReportState::open( const std::string& path, ReportPeriod period, time_t now ) {
+	close();
+	assert( LM50Device::countChannels <= maxChannels );
+	_period = period;
+	_fd = ::open( path.c_str(), O_RDWR | O_CREAT, 0644 );
+	if( _fd < 0 ) throw std::runtime_error( std::string( "Could not open report state " ).append( path ).append( ": " ).append( strerror( errno ) ) );
+	struct stat st;
+	if( fstat( _fd, &st ) != 0 || ( st.st_size != sizeof( Layout ) && ftruncate( _fd, sizeof( Layout ) ) != 0 ) ) {
+		std::string msg( std::string( "Could not resize report state: " ).append( strerror( errno ) ) );
+		close();
+		throw std::runtime_error( msg );
+	}
+	void* p( mmap( NULL, sizeof( Layout ), PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0 ) );
+	if( p == MAP_FAILED ) {
+		std::string msg( std::string( "Could not map report state: " ).append( strerror( errno ) ) );
+		close();
+		throw std::runtime_error( msg );
+	}
+	_state = static_cast< Layout* >( p );
+
+	if( memcmp( _state->magic, stateMagic, sizeof( stateMagic ) ) != 0 || _state->version != stateVersion || _state->size != sizeof( Layout ) ) {
+		// A new or foreign file, nothing to be reported
+		memset( _state, 0, sizeof( Layout ) );
+		memcpy( _state->magic, stateMagic, sizeof( stateMagic ) );
+		_state->version = stateVersion;
+		_state->size = sizeof( Layout );
+		_state->period = period;
+		startPeriod( now );
+	} else if( _state->period != static_cast< u_int32_t >( period ) ) {
+		// The kind of period changed, report what has been collected so far
+		_state->period = period;
+		finish();
+		startPeriod( now );
+	}
+	sync();
+}
+
+void ReportState::close() {
+	if( _state ) {
+		msync( _state, sizeof( Layout ), MS_SYNC );
+		munmap( _state, sizeof( Layout ) );
+		_state = nullptr;
+	}
+	if( _fd >= 0 ) ::close( _fd );
+	_fd = -1;
+}
+
+void ReportState::sync() {
+	if( _state ) msync( _state, sizeof( Layout ), MS_ASYNC );
+}
+
+bool ReportState::add( time_t time, const ProgramOptions::ChList& channels, const LM50Device::ChVal* values, time_t maxGap ) {
+	fold( _state->current, time, channels, values, maxGap );
+	if( time < _state->current.end ) return false;
+	// The sample closes the current period and is the baseline of the next
+	// one. Channels are taken over lazily by the next sample.
+	finish();
+	startPeriod( time );
+	fold( _state->current, time, channels, values, maxGap );
+	return true;
+}
+
+void ReportState::fold( Period& p, time_t time, const ProgramOptions::ChList& channels, const LM50Device::ChVal* values, time_t maxGap ) {
+	const int64_t dt( time - p.lastSample );
+	const bool isGap( p.lastSample == 0 || dt <= 0 || dt > maxGap );
+	ProgramOptions::ChList::const_iterator i( channels.begin() );
+	for( ; i != channels.end(); (++i,++values) ) {
+		Channel& c( p.channels[ *i ] );
+		const u_int32_t v( *values );
+		if( c.samples == 0 ) {
+			c.startCounter = c.endCounter = v;
+			c.minRate = ~0u;
+			c.samples = 1;
+			continue;
+		}
+		++c.samples;
+		if( v < c.endCounter ) {
+			++c.gaps;
+		} else if( isGap ) {
+			++c.gaps;
+			c.consumption += v - c.endCounter;
+		} else {
+			const u_int64_t delta( v - c.endCounter );
+			const u_int32_t rate( delta * 3600 / dt );
+			if( rate < c.minRate ) c.minRate = rate;
+			if( rate > c.maxRate ) c.maxRate = rate;
+			c.consumption += delta;
+		}
+		c.endCounter = v;
+	}
+	p.lastSample = time;
+}
+
+/**
+ * Moves the current period to the finished slot and marks it as pending.
+ * A period without any samples is dropped silently.
+ *
+ * If the report of the finished slot has not been delivered yet (e.g. the
+ * mail command failed for the whole period), the current period is merged
+ * into it instead, i.e. the pending report grows until it is delivered and
+ * no consumption gets lost.
+ */
+void ReportState::finish() {
+	bool hasSamples( false );
+	for( size_t i( 0 ); i != maxChannels && !hasSamples; ++i ) hasSamples = _state->current.channels[ i ].samples != 0;
+	if( !hasSamples ) return;
+	if( !_state->pending ) {
+		_state->finished = _state->current;
+		_state->pending = 1;
+		return;
+	}
+
+	Period& f( _state->finished );
+	const Period& p( _state->current );
+	for( size_t i( 0 ); i != maxChannels; ++i ) {
+		Channel& fc( f.channels[ i ] );
+		const Channel& c( p.channels[ i ] );
+		if( c.samples == 0 ) continue;
+		if( fc.samples == 0 ) {
+			fc = c;
+			continue;
+		}
+		// Usually the later period starts where the earlier one ended
+		if( c.startCounter < fc.endCounter ) ++fc.gaps;
+		else fc.consumption += c.startCounter - fc.endCounter;
+		fc.endCounter = c.endCounter;
+		fc.consumption += c.consumption;
+		if( c.minRate < fc.minRate ) fc.minRate = c.minRate;
+		if( c.maxRate > fc.maxRate ) fc.maxRate = c.maxRate;
+		fc.samples += c.samples;
+		fc.gaps += c.gaps;
+	}
+	f.end = p.end;
+	f.lastSample = p.lastSample;
+}
+
+void ReportState::startPeriod( time_t time ) {
+	memset( &_state->current, 0, sizeof( Period ) );
+	_state->current.start = periodStart( time, _period );
+	_state->current.end = periodEnd( _state->current.start, _period );
+}
+
+time_t ReportState::periodStart( time_t time, ReportPeriod period ) {
+	struct tm t;
+	localtime_r( &time, &t );
+	t.tm_hour = t.tm_min = t.tm_sec = 0;
+	t.tm_isdst = -1;
+	switch( period ) {
+		case ProgramOptions::DAILY:
+			break;
+		case ProgramOptions::WEEKLY:
+			t.tm_mday -= ( t.tm_wday + 6 ) % 7;
+			break;
+		case ProgramOptions::MONTHLY:
+			t.tm_mday = 1;
+			break;
+	}
+	return mktime( &t );
+}
+
+time_t ReportState::periodEnd( time_t start, ReportPeriod period ) {
+	struct tm t;
+	localtime_r( &start, &t );
+	t.tm_isdst = -1;
+	switch( period ) {
+		case ProgramOptions::DAILY:
+			t.tm_mday += 1;
+			break;
+		case ProgramOptions::WEEKLY:
+			t.tm_mday += 7;
+			break;
+		case ProgramOptions::MONTHLY:
+			t.tm_mon += 1;
+			break;
+	}
+	return mktime( &t );
+}
+
+}
@@ -0,0 +1,157 @@
+#ifndef _REPORT_STATE_H_
+#define _REPORT_STATE_H_
+
+#include <ctime>
+#include <string>
+#include <sys/types.h>
+
+#include "program_options.h"
+
+namespace LM50 {
+
+/**
+ * The running aggregates of the report worker, kept in a small file that is
+ * mapped into memory (see report.file).
+ *
+ * Each beat folds one sample of the polled channels into the aggregates of
+ * the current period, i.e. the state is updated incrementally and no
+ * history is ever re-read. When a sample passes the end of the current
+ * period, the period is moved to the finished slot and marked as pending
+ * until its report has been delivered. Hence a report neither gets lost
+ * nor needs the RRD file, if the daemon is restarted in between. A period
+ * that finishes while the report of the previous one is still pending is
+ * merged into the pending report.
+ *
+ * The file has a fixed size of a few KiB. It is written by the kernel in
+ * the background and flushed explicitly by sync() after each beat.
+ */
+class ReportState {
+	public:
+		typedef ProgramOptions::ReportPeriod ReportPeriod;
+
+		/**
+		 * The number of channels the file has room for, at least
+		 * LM50Device::countChannels
+		 */
+		static const size_t maxChannels = 50;
+
+		/**
+		 * The aggregates of a single channel during a period. Rates are given
+		 * in counts per hour and only computed between consecutive samples
+		 * without a gap.
+		 */
+		struct Channel {
+			u_int32_t startCounter;
+			u_int32_t endCounter;
+			u_int64_t consumption;
+			u_int32_t minRate;
+			u_int32_t maxRate;
+			u_int32_t samples;
+			u_int32_t gaps;
+		};
+
+		/**
+		 * A period, its boundaries and the time of its last sample are in
+		 * seconds since the epoch
+		 */
+		struct Period {
+			int64_t start;
+			int64_t end;
+			int64_t lastSample;
+			Channel channels[ maxChannels ];
+		};
+
+	public:
+		ReportState();
+		virtual ~ReportState();
+
+	private:
+		ReportState( const ReportState& );
+		ReportState& operator=( const ReportState& );
+
+	public:
+		/**
+		 * Maps the state file into memory. The file is created, if it does not
+		 * exist. If it is invalid (e.g. of an older version) or has been
+		 * written for another kind of period, the old aggregates are finished
+		 * and a new period is started at now. Throws a std::runtime_error, if
+		 * the file cannot be opened or mapped.
+		 */
+		void open( const std::string& path, ReportPeriod period, time_t now );
+
+		void close();
+
+		bool isOpen() const { return _state != nullptr; }
+
+		/**
+		 * Schedules the write back of the mapped file
+		 */
+		void sync();
+
+		/**
+		 * Folds a sample into the current period. A channel that has not been
+		 * sampled during the period yet takes the sample as its start counter.
+		 * A gap is counted if more than maxGap seconds passed since the last
+		 * sample or the counter decreased (e.g. the device has been reset).
+		 * The consumption across a time gap is still added, because the
+		 * counters are cumulative, only the rate is unknown.
+		 *
+		 * If the sample passes the end of the current period, it is folded
+		 * into the current period, the period becomes the finished (pending)
+		 * one or is merged into it, if it is still pending, and a new period
+		 * is started with the sample as baseline.
+		 * @return True, if a period has been finished
+		 */
+		bool add( time_t time, const ProgramOptions::ChList& channels, const LM50Device::ChVal* values, time_t maxGap );
+
+		const Period& current() const { return _state->current; }
+
+		const Period& finished() const { return _state->finished; }
+
+		/**
+		 * True, if the report of the finished period has not been delivered yet
+		 */
+		bool isPending() const { return _state->pending != 0; }
+
+		void delivered() { _state->pending = 0; }
+
+		/**
+		 * @return The beginning of the period that contains the given time,
+		 * i.e. the local midnight, the midnight before the monday or the
+		 * midnight before the 1st of the month
+		 */
+		static time_t periodStart( time_t time, ReportPeriod period );
+
+		/**
+		 * @return The beginning of the period that follows the period that
+		 * begins at start
+		 */
+		static time_t periodEnd( time_t start, ReportPeriod period );
+
+	protected:
+		void startPeriod( time_t time );
+		void fold( Period& p, time_t time, const ProgramOptions::ChList& channels, const LM50Device::ChVal* values, time_t maxGap );
+		void finish();
+
+	protected:
+		/**
+		 * The layout of the state file
+		 */
+		struct Layout {
+			char magic[ 8 ];
+			u_int32_t version;
+			u_int32_t size;
+			u_int32_t period;
+			u_int32_t pending;
+			Period current;
+			Period finished;
+		};
+
+		Layout* _state;
+		int _fd;
+		ReportPeriod _period;
+};
+
+}
+
+#endif
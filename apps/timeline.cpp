@@ -0,0 +1,174 @@
+#include "timeline.h"
+#include "metrics.h"
+#include "log_sink.h"
+#include "format.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace LM50 {
+
+Timeline::Timeline() : \
+	_mutex(), \
+	_file( NULL ), \
+	_path(), \
+	_maxBytes( 0 ), \
+	_files( 0 ), \
+	_written( 0 ), \
+	_isEmpty( true ), \
+	_buffer(), \
+	_pid( getpid() ) {
+	pthread_mutex_init( &_mutex, NULL );
+}
+
+Timeline::~Timeline() {
+	close();
+	pthread_mutex_destroy( &_mutex );
+}
+
+void Timeline::open( const std::string& path, size_t maxBytes, unsigned int files ) {
+	close();
+	pthread_mutex_lock( &_mutex );
+	_path = path;
+	_maxBytes = maxBytes;
+	_files = files;
+	_file = fopen( _path.c_str(), "w" );
+	if( !_file ) {
+		pthread_mutex_unlock( &_mutex );
+		throw std::runtime_error( std::string( "Could not open timeline file: " ).append( strerror( errno ) ) );
+	}
+	_buffer.reserve( 64 * 1024 );
+	writeHeader();
+	pthread_mutex_unlock( &_mutex );
+}
+
+void Timeline::close() {
+	flush();
+	pthread_mutex_lock( &_mutex );
+	if( _file ) {
+		fputs( "\n]\n", _file );
+		fclose( _file );
+		_file = NULL;
+	}
+	pthread_mutex_unlock( &_mutex );
+}
+
+void Timeline::span( const char* name, u_int64_t start, u_int64_t end ) {
+	if( !_file ) return;
+	char event[ 256 ];
+	char* p( event );
+	p = Format::appendString( p, "{\"name\":\"" );
+	p = Format::appendString( p, name );
+	p = Format::appendString( p, "\",\"ph\":\"X\",\"pid\":" );
+	p = Format::appendUInt( p, _pid );
+	p = Format::appendString( p, ",\"tid\":" );
+	p = Format::appendUInt( p, syscall( SYS_gettid ) );
+	p = Format::appendString( p, ",\"ts\":" );
+	p = Format::appendMicros( p, start );
+	p = Format::appendString( p, ",\"dur\":" );
+	p = Format::appendMicros( p, end > start ? end - start : 0 );
+	*p++ = '}';
+	append( event, p - event );
+}
+
+void Timeline::instant( const char* name, u_int64_t time ) {
+	if( !_file ) return;
+	char event[ 256 ];
+	char* p( event );
+	p = Format::appendString( p, "{\"name\":\"" );
+	p = Format::appendString( p, name );
+	p = Format::appendString( p, "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":" );
+	p = Format::appendUInt( p, _pid );
+	p = Format::appendString( p, ",\"tid\":" );
+	p = Format::appendUInt( p, syscall( SYS_gettid ) );
+	p = Format::appendString( p, ",\"ts\":" );
+	p = Format::appendMicros( p, time );
+	*p++ = '}';
+	append( event, p - event );
+}
+
+void Timeline::append( const char* event, size_t length ) {
+	pthread_mutex_lock( &_mutex );
+	if( _file ) {
+		if( !_isEmpty ) _buffer.append( ",\n" );
+		_buffer.append( event, length );
+		_isEmpty = false;
+	}
+	pthread_mutex_unlock( &_mutex );
+}
+
+void Timeline::flush() {
+	pthread_mutex_lock( &_mutex );
+	if( _file && !_buffer.empty() ) {
+		fwrite( _buffer.data(), _buffer.size(), 1, _file );
+		fflush( _file );
+		_written += _buffer.size();
+		_buffer.clear();
+		if( _written >= _maxBytes ) rotate();
+	}
+	pthread_mutex_unlock( &_mutex );
+}
+
+/**
+ * Starts a new file of the JSON array format. Must be called with the
+ * mutex being locked.
+ */
+void Timeline::writeHeader() {
+	fputs( "[\n", _file );
+	_written = 2;
+	_isEmpty = true;
+}
+
+/**
+ * Closes the current file, shifts the names of the older files and opens a
+ * new file. Must be called with the mutex being locked. If the new file
+ * cannot be opened, the timeline is closed silently.
+ */
+void Timeline::rotate() {
+	fputs( "\n]\n", _file );
+	fclose( _file );
+	_file = NULL;
+	rotateFiles( _path, _files );
+	_file = fopen( _path.c_str(), "w" );
+	if( _file ) writeHeader();
+}
+
+
+RoundSpans::RoundSpans( Timeline& timeline ) : \
+	_timeline( timeline ), \
+	_sendStart( 0 ), \
+	_sendComplete( 0 ), \
+	_firstByte( 0 ), \
+	_replyComplete( 0 ) {
+}
+
+void RoundSpans::roundEvent( Event e ) {
+	if( !_timeline.isOpen() ) return;
+	const u_int64_t now( Metrics::now() );
+	switch( e ) {
+		case SendStart:
+			_sendStart = now;
+			_sendComplete = _firstByte = _replyComplete = 0;
+			break;
+		case SendComplete:
+			_sendComplete = now;
+			_timeline.span( "send", _sendStart, now );
+			break;
+		case FirstByte:
+			_firstByte = now;
+			_timeline.span( "device", _sendComplete ? _sendComplete : _sendStart, now );
+			break;
+		case ReplyComplete:
+			_replyComplete = now;
+			_timeline.span( "receive", _firstByte, now );
+			break;
+		case Failure:
+			_timeline.instant( "round failed", now );
+			break;
+	}
+}
+
+}
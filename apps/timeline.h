@@ -0,0 +1,119 @@
+#ifndef _TIMELINE_H_
+#define _TIMELINE_H_
+
+#include <cstdio>
+#include <pthread.h>
+#include <string>
+#include <sys/types.h>
+
+#include "lib/modbus.h"
+
+namespace LM50 {
+
+/**
+ * Writes spans (i.e. named time intervals) to a file in the Chrome trace
+ * event format (JSON array format), which can be loaded by chrome://tracing
+ * and Perfetto (ui.perfetto.dev). Each span becomes a complete event ("X")
+ * of the calling thread. The viewers nest the spans of a thread by their
+ * time intervals, hence the spans of a beat form a tree without any
+ * bookkeeping here.
+ *
+ * The events are collected in a memory buffer and only written to the file
+ * by Timeline::flush(), which the main thread of the daemon calls once per
+ * second. If the file exceeds the configured size, it is rotated: "file" is
+ * renamed to "file.1", "file.1" to "file.2" and so on. The oldest file is
+ * dropped.
+ *
+ * All functions are thread-safe. If the timeline is not open, they return
+ * immediately.
+ */
+class Timeline {
+	public:
+		Timeline();
+		virtual ~Timeline();
+
+	private:
+		Timeline( const Timeline& );
+		Timeline& operator=( const Timeline& );
+
+	public:
+		/**
+		 * Opens the file for writing. Throws a std::runtime_error, if the file
+		 * cannot be opened.
+		 * @param path The path of the trace file
+		 * @param maxBytes The size at which the file is rotated
+		 * @param files The number of rotated files to keep
+		 */
+		void open( const std::string& path, size_t maxBytes, unsigned int files );
+
+		void close();
+
+		bool isOpen() const { return _file != NULL; }
+
+		/**
+		 * Adds a span
+		 * @param name The name of the span, must not contain quotation marks
+		 * @param start The start on the monotonic clock in nanoseconds, see
+		 * Metrics::now()
+		 * @param end The end on the monotonic clock in nanoseconds
+		 */
+		void span( const char* name, u_int64_t start, u_int64_t end );
+
+		/**
+		 * Adds an instant event ("i"), e.g. a time out or a skipped beat
+		 */
+		void instant( const char* name, u_int64_t time );
+
+		/**
+		 * Writes the buffered events to the file and rotates it, if necessary
+		 */
+		void flush();
+
+	protected:
+		void append( const char* event, size_t length );
+		void writeHeader();
+		void rotate();
+
+	protected:
+		pthread_mutex_t _mutex;
+		FILE* _file;
+		std::string _path;
+		size_t _maxBytes;
+		unsigned int _files;
+		size_t _written;
+		bool _isEmpty;
+		std::string _buffer;
+		const pid_t _pid;
+};
+
+
+/**
+ * Turns the events of a ModBus round into the spans "send" (the request is
+ * being transmitted), "device" (waiting for the first byte of the reply) and
+ * "receive" (the reply is being received).
+ */
+class RoundSpans : public ModBus::RoundObserver {
+	public:
+		RoundSpans( Timeline& timeline );
+		virtual ~RoundSpans() {}
+
+	public:
+		virtual void roundEvent( Event e );
+
+		/**
+		 * @return The time the last reply has been completed, zero if the last
+		 * round failed
+		 */
+		u_int64_t replyComplete() const { return _replyComplete; }
+
+	protected:
+		Timeline& _timeline;
+		u_int64_t _sendStart;
+		u_int64_t _sendComplete;
+		u_int64_t _firstByte;
+		u_int64_t _replyComplete;
+};
+
+}
+
+#endif
@@ -0,0 +1,214 @@
+#include "worker_control.h"
+#include "lm50client.h"
+#include "format.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace LM50 {
+
+// The time in milliseconds the worker blocks in poll before it checks for
+// cancellation again
+static const int pollInterval( 500 );
+
+// The time in milliseconds a client has to send its command
+static const int clientTimeout( 2000 );
+
+// The number of buckets the history command chooses its resolution for
+static const size_t maxHistoryLength( 3600 );
+
+WorkerControl::WorkerControl( ModeDaemon &parent ) : DaemonWorker( parent ),\
+	_path( parent.options().controlSocket() ),\
+	_socket( -1 ) {
+}
+
+WorkerControl::~WorkerControl() {
+	close();
+}
+
+void WorkerControl::listen() {
+	struct sockaddr_un addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	if( _path.size() >= sizeof( addr.sun_path ) ) throw std::runtime_error( "Path of control socket is too long" );
+	strncpy( addr.sun_path, _path.c_str(), sizeof( addr.sun_path ) - 1 );
+
+	_socket = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( _socket < 0 ) throw std::runtime_error( std::string( "Could not create control socket: " ).append( strerror( errno ) ) );
+	// Remove a stale socket of a former run
+	unlink( _path.c_str() );
+	if( bind( _socket, reinterpret_cast< struct sockaddr* >( &addr ), sizeof( addr ) ) < 0 || ::listen( _socket, 4 ) < 0 ) {
+		std::string msg( std::string( "Could not bind control socket: " ).append( strerror( errno ) ) );
+		close();
+		throw std::runtime_error( msg );
+	}
+}
+
+void WorkerControl::close() {
+	if( _socket < 0 ) return;
+	::close( _socket );
+	_socket = -1;
+	unlink( _path.c_str() );
+}
+
+/**
+ * The main loop of the thread. The thread waits for connections with a
+ * time out, because the blocking functions are only interrupted by
+ * DaemonWorker::terminate in debug builds.
+ */
+int WorkerControl::run() {
+	if( _socket < 0 ) return EBADF;
+	while( !isCancelled() ) {
+		struct pollfd pfd;
+		pfd.fd = _socket;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int res( poll( &pfd, 1, pollInterval ) );
+		if( res < 0 && errno != EINTR ) return errno;
+		if( res <= 0 ) continue;
+
+		int client( accept( _socket, NULL, NULL ) );
+		if( client < 0 ) continue;
+		serve( client );
+		::close( client );
+	}
+	return 0;
+}
+
+/**
+ * Reads one command from the client and writes the answer
+ */
+void WorkerControl::serve( int fd ) {
+	std::string cmd( readCommand( fd ) );
+	std::ostringstream answer;
+	if( cmd == "metrics" ) {
+		_parent.metrics().dump( answer );
+	} else if( cmd == "power" ) {
+		writePower( answer );
+	} else if( cmd == "balance" ) {
+		_parent.lockDevice();
+		_parent.dumpBalance( answer );
+		_parent.unlockDevice();
+	} else if( cmd == "history" || cmd.compare( 0, 8, "history " ) == 0 ) {
+		writeHistory( answer, cmd.substr( 7 ) );
+	} else if( cmd == "help" ) {
+		answer << "metrics\tpower\tbalance\thistory <channel> <seconds> [<resolution>]\thelp\n";
+	} else {
+		answer << "error: unknown command \"" << cmd << "\"\n";
+	}
+	writeAll( fd, answer.str() );
+}
+
+/**
+ * Writes one line per polled channel with its number, power in W, energy in
+ * kWh and name, separated by tabulators
+ */
+void WorkerControl::writePower( std::ostream& os ) {
+	const ProgramOptions& po( _parent.options() );
+	const ProgramOptions::ChList& channels( po.channels() );
+	std::vector< double > power( channels.size() ), energy( channels.size() );
+	_parent.lockDevice();
+	for( size_t i( 0 ); i != channels.size(); ++i ) {
+		power[i] = _parent.devicePower( channels[i] );
+		energy[i] = _parent.deviceEnergy( channels[i] );
+	}
+	_parent.unlockDevice();
+	char buf[ 2 * Format::maxIntLength + 16 ];
+	for( size_t i( 0 ); i != channels.size(); ++i ) {
+		char* p( Format::appendUInt( buf, channels[i] + 1, 2, '0' ) );
+		*p++ = '\t';
+		p = Format::appendFixed( p, power[i], 1 );
+		*p++ = '\t';
+		p = Format::appendFixed( p, energy[i], 3 );
+		*p++ = '\t';
+		os.write( buf, p - buf );
+		os << po.channelMeta( channels[i] ).name << '\n';
+	}
+}
+
+/**
+ * Writes one line per bucket of the channel's power over the last seconds
+ * with the start of the bucket in unix time and the minimum, average,
+ * maximum and last power in W, separated by tabulators. Without a
+ * resolution the finest one that spans the seconds is taken, see
+ * LM50Rollup::levelFor.
+ * @param args The channel number, the number of seconds and optionally the
+ * resolution in seconds, separated by spaces
+ */
+void WorkerControl::writeHistory( std::ostream& os, const std::string& args ) {
+	std::istringstream is( args );
+	unsigned int channel( 0 ), resolution( 0 );
+	time_t span( 0 );
+	is >> channel >> span;
+	if( !is || channel == 0 || channel > LM50Device::countChannels || span <= 0 ) {
+		os << "error: usage is \"history <channel> <seconds> [<resolution>]\"\n";
+		return;
+	}
+	LM50Rollup::Level level( LM50Rollup::levelFor( span, maxHistoryLength ) );
+	if( is >> resolution && !LM50Rollup::levelOf( resolution, level ) ) {
+		os << "error: resolution must be 1, 60, 900 or 3600\n";
+		return;
+	}
+	const time_t now( time( nullptr ) );
+	std::vector< LM50Rollup::Bucket > buckets( LM50Rollup::length( level ) );
+	_parent.lockDevice();
+	const size_t count( _parent.deviceHistory( level, channel - 1, now - span, now, &buckets[0], buckets.size() ) );
+	_parent.unlockDevice();
+	char buf[ 5 * Format::maxIntLength + 16 ];
+	for( size_t i( 0 ); i != count; ++i ) {
+		char* p( Format::appendUInt( buf, buckets[i].time ) );
+		*p++ = '\t';
+		p = Format::appendFixed( p, buckets[i].min, 1 );
+		*p++ = '\t';
+		p = Format::appendFixed( p, buckets[i].avg, 1 );
+		*p++ = '\t';
+		p = Format::appendFixed( p, buckets[i].max, 1 );
+		*p++ = '\t';
+		p = Format::appendFixed( p, buckets[i].last, 1 );
+		*p++ = '\n';
+		os.write( buf, p - buf );
+	}
+}
+
+/**
+ * @return The first line sent by the client without the line break and
+ * trailing white space. Empty, if the client did not send a complete line
+ * in time.
+ */
+std::string WorkerControl::readCommand( int fd ) const {
+	std::string line;
+	char buf[ 128 ];
+	while( line.size() < 1024 ) {
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if( poll( &pfd, 1, clientTimeout ) <= 0 ) return std::string();
+		ssize_t n( read( fd, buf, sizeof( buf ) ) );
+		if( n <= 0 ) break;
+		line.append( buf, n );
+		if( line.find( '\n' ) != std::string::npos ) break;
+	}
+	line = line.substr( 0, line.find( '\n' ) );
+	size_t end( line.find_last_not_of( " \t\r" ) );
+	return end == std::string::npos ? std::string() : line.substr( 0, end + 1 );
+}
+
+void WorkerControl::writeAll( int fd, const std::string& s ) const {
+	size_t sent( 0 );
+	while( sent < s.size() ) {
+		ssize_t n( send( fd, s.data() + sent, s.size() - sent, MSG_NOSIGNAL ) );
+		if( n < 0 && errno == EINTR ) continue;
+		if( n <= 0 ) return;
+		sent += n;
+	}
+}
+
+}
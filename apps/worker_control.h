@@ -0,0 +1,58 @@
+#ifndef _WORKER_CONTROL_H_
+#define _WORKER_CONTROL_H_
+
+#include "daemon_worker.h"
+
+#include <ostream>
+#include <string>
+
+namespace LM50 {
+
+/**
+ * This worker serves a local control socket (a Unix domain stream socket).
+ * A client connects, sends one command terminated by a newline and receives
+ * the answer until the connection is closed by the daemon, e.g.
+ *
+ *   echo metrics | socat - UNIX-CONNECT:/run/lm50client.sock
+ *
+ * Supported commands:
+ *   metrics   Writes the self-metrics of the daemon, see Metrics::dump
+ *   power     Writes the power and energy of the polled channels
+ *   balance   Writes the residual power of each balance check, see
+ *             BalanceCheck::dump
+ *   history <channel> <seconds> [<resolution>]
+ *             Writes the minimum, average, maximum and last power of the
+ *             channel over the last seconds from memory, see LM50Rollup
+ *   help      Lists the supported commands
+ */
+class WorkerControl : public DaemonWorker {
+	public:
+		WorkerControl( ModeDaemon &parent );
+		virtual ~WorkerControl();
+
+	public:
+		/**
+		 * Creates the socket and binds it to the path given by program options.
+		 * Must be called before start(). Throws a std::runtime_error if the
+		 * socket cannot be created.
+		 */
+		void listen();
+
+		virtual int run();
+
+	protected:
+		void serve( int fd );
+		void writePower( std::ostream& os );
+		void writeHistory( std::ostream& os, const std::string& args );
+		std::string readCommand( int fd ) const;
+		void writeAll( int fd, const std::string& s ) const;
+		void close();
+
+	protected:
+		std::string _path;
+		int _socket;
+};
+
+}
+
+#endif
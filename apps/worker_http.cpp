@@ -0,0 +1,609 @@
+#include "worker_http.h"
+#include "lm50client.h"
+#include "format.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <cerrno>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace LM50 {
+
+// The time in milliseconds after which the worker checks for new values and
+// cancellation
+static const long checkInterval( 50 );
+
+// The number of ticks after which an idle subscriber gets a comment, such
+// that proxies do not close the connection
+static const unsigned long keepAliveTicks( 15000 / checkInterval );
+
+// The maximum size of the header of a request
+static const size_t maxRequestLength( 8192 );
+
+// The number of writes a subscriber may fall behind before it is dropped
+static const size_t maxBacklog( 64 );
+
+// The size of a formatted channel, see WorkerHttp::serialize
+static const size_t maxChannelLength( 80 + 5 * Format::maxIntLength );
+
+// The number of buckets /history chooses its resolution for
+static const size_t maxHistoryLength( 3600 );
+
+// The size of a formatted bucket, see WorkerHttp::respondHistory
+static const size_t maxBucketLength( 8 + 5 * Format::maxIntLength );
+
+static const char commonHeaders[] = "Access-Control-Allow-Origin: *\r\nCache-Control: no-cache\r\n";
+static const char keepAlive[] = ":\n\n";
+
+
+/**
+ * One connection of a HTTP client. Requests are served one after the other.
+ * After a request for /stream the session only writes the events and reads
+ * nothing but the end of the connection. Like a ModBus::TcpServerSession the
+ * object is destroyed as soon as the connection is closed and no handler
+ * refers to it anymore.
+ */
+class WorkerHttp::Session : public boost::enable_shared_from_this< WorkerHttp::Session > {
+	public:
+		Session( WorkerHttp& worker ) : \
+			_worker( worker ), \
+			_socket( worker._ioService ), \
+			_input( maxRequestLength ), \
+			_output(), \
+			_isWriting( false ), \
+			_isStreaming( false ), \
+			_keepAlive( true ) {
+		}
+
+	private:
+		Session( const Session& );
+		Session& operator=( const Session& );
+
+	public:
+		boost::asio::ip::tcp::socket& socket() { return _socket; }
+
+		bool isOpen() const { return _socket.is_open(); }
+
+		void start() { readRequest(); }
+
+		/**
+		 * Sends a response with the given status, headers and body. The body
+		 * consists of the parts of the buffers, which must stay valid until
+		 * they are sent, i.e. they are static or owned by a Buffer of owners.
+		 */
+		void respond( const char* status, const std::string& headers, const std::vector< Buffer >& owners, const std::vector< boost::asio::const_buffer >& body ) {
+			size_t length( 0 );
+			for( size_t i( 0 ); i != body.size(); ++i ) length += boost::asio::buffer_size( body[i] );
+			char number[ Format::maxIntLength ];
+			std::string* header( new std::string( "HTTP/1.1 " ) );
+			header->append( status ).append( "\r\n" ).append( commonHeaders ).append( headers );
+			header->append( "Content-Length: " ).append( number, Format::appendUInt( number, length ) - number ).append( "\r\n" );
+			if( !_keepAlive ) header->append( "Connection: close\r\n" );
+			header->append( "\r\n" );
+			_output.push_back( Chunk() );
+			Chunk& chunk( _output.back() );
+			chunk.owners = owners;
+			chunk.owners.push_back( Buffer( header ) );
+			chunk.buffers.push_back( boost::asio::buffer( *header ) );
+			chunk.buffers.insert( chunk.buffers.end(), body.begin(), body.end() );
+			write();
+		}
+
+		void respond( const char* status, const std::string& headers, const char* body ) {
+			std::vector< boost::asio::const_buffer > buffers;
+			if( body ) buffers.push_back( boost::asio::buffer( body, strlen( body ) ) );
+			respond( status, headers, std::vector< Buffer >(), buffers );
+		}
+
+		/**
+		 * Sends the header of an event stream. The session does not read any
+		 * further requests afterwards.
+		 */
+		void beginStream() {
+			_isStreaming = true;
+			static const char header[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nConnection: keep-alive\r\n";
+			std::string* s( new std::string( header ) );
+			s->append( commonHeaders ).append( "\r\n" );
+			_output.push_back( Chunk() );
+			_output.back().owners.push_back( Buffer( s ) );
+			_output.back().buffers.push_back( boost::asio::buffer( *s ) );
+			write();
+			watchClose();
+		}
+
+		/**
+		 * Queues a part of a shared buffer, e.g. a sample, for an event stream
+		 * @return False, if the subscriber fell behind and has been closed
+		 */
+		bool push( const Buffer& buffer, size_t offset, size_t length ) {
+			if( !isOpen() ) return false;
+			if( _output.size() >= maxBacklog ) {
+				close();
+				return false;
+			}
+			_output.push_back( Chunk() );
+			_output.back().owners.push_back( buffer );
+			_output.back().buffers.push_back( boost::asio::buffer( buffer->data() + offset, length ) );
+			write();
+			return true;
+		}
+
+		bool push( const char* s ) {
+			if( !isOpen() ) return false;
+			if( !_output.empty() ) return true;
+			_output.push_back( Chunk() );
+			_output.back().buffers.push_back( boost::asio::buffer( s, strlen( s ) ) );
+			write();
+			return true;
+		}
+
+		void close() {
+			boost::system::error_code ec;
+			_socket.shutdown( boost::asio::ip::tcp::socket::shutdown_both, ec );
+			_socket.close( ec );
+		}
+
+	protected:
+		struct Chunk {
+			std::vector< Buffer > owners;
+			std::vector< boost::asio::const_buffer > buffers;
+		};
+
+		void readRequest() {
+			boost::asio::async_read_until( _socket, _input, "\r\n\r\n", boost::bind( &Session::handleRequest, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
+		}
+
+		/**
+		 * Parses the request line and the headers the worker is interested in.
+		 * The body of a request is not supported.
+		 */
+		void handleRequest( const boost::system::error_code& error, std::size_t nBytes ) {
+			if( error ) {
+				// A request that exceeds the input buffer is not found
+				close();
+				return;
+			}
+			std::string header( boost::asio::buffers_begin( _input.data() ), boost::asio::buffers_begin( _input.data() ) + nBytes );
+			_input.consume( nBytes );
+
+			const size_t lineEnd( header.find( "\r\n" ) );
+			const std::string line( header, 0, lineEnd );
+			const size_t sp1( line.find( ' ' ) );
+			const size_t sp2( line.find( ' ', sp1 + 1 ) );
+			if( sp1 == std::string::npos || sp2 == std::string::npos ) {
+				_keepAlive = false;
+				respond( "400 Bad Request", std::string(), nullptr );
+				return;
+			}
+			const std::string method( line, 0, sp1 );
+			const std::string target( line, sp1 + 1, sp2 - sp1 - 1 );
+			_keepAlive = line.compare( sp2 + 1, std::string::npos, "HTTP/1.0" ) != 0;
+
+			std::string ifNoneMatch, lastEventId;
+			for( size_t pos( lineEnd + 2 ); pos < header.size(); ) {
+				const size_t end( header.find( "\r\n", pos ) );
+				const size_t colon( header.find( ':', pos ) );
+				if( end == std::string::npos ) break;
+				if( colon < end ) {
+					std::string name( header, pos, colon - pos );
+					for( size_t i( 0 ); i != name.size(); ++i ) name[i] = tolower( name[i] );
+					const size_t valueBegin( header.find_first_not_of( " \t", colon + 1 ) );
+					const std::string value( valueBegin < end ? header.substr( valueBegin, end - valueBegin ) : std::string() );
+					if( name == "if-none-match" ) ifNoneMatch = value;
+					else if( name == "last-event-id" ) lastEventId = value;
+					else if( name == "connection" ) {
+						std::string v( value );
+						for( size_t i( 0 ); i != v.size(); ++i ) v[i] = tolower( v[i] );
+						if( v == "close" ) _keepAlive = false;
+						else if( v == "keep-alive" ) _keepAlive = true;
+					}
+				}
+				pos = end + 2;
+			}
+			_worker.handleRequest( shared_from_this(), method, target, ifNoneMatch, lastEventId );
+		}
+
+		/**
+		 * Reads and drops anything the subscriber sends in order to notice the
+		 * end of the connection
+		 */
+		void watchClose() {
+			_socket.async_read_some( boost::asio::buffer( _discard ), boost::bind( &Session::handleWatch, shared_from_this(), boost::asio::placeholders::error ) );
+		}
+
+		void handleWatch( const boost::system::error_code& error ) {
+			if( error ) {
+				close();
+				return;
+			}
+			watchClose();
+		}
+
+		void write() {
+			if( _isWriting || _output.empty() || !isOpen() ) return;
+			_isWriting = true;
+			boost::asio::async_write( _socket, _output.front().buffers, boost::bind( &Session::handleWrite, shared_from_this(), boost::asio::placeholders::error ) );
+		}
+
+		/**
+		 * Continues with the next chunk. When a response has been sent
+		 * completely, the next request is read.
+		 */
+		void handleWrite( const boost::system::error_code& error ) {
+			_isWriting = false;
+			if( error ) {
+				_output.clear();
+				close();
+				return;
+			}
+			_output.pop_front();
+			if( !_output.empty() ) {
+				write();
+				return;
+			}
+			if( _isStreaming ) return;
+			if( _keepAlive ) readRequest();
+			else close();
+		}
+
+	protected:
+		WorkerHttp& _worker;
+		boost::asio::ip::tcp::socket _socket;
+		boost::asio::streambuf _input;
+		std::deque< Chunk > _output;
+		bool _isWriting;
+		bool _isStreaming;
+		bool _keepAlive;
+		char _discard[ 256 ];
+};
+
+
+WorkerHttp::WorkerHttp( ModeDaemon &parent ) : DaemonWorker( parent ),\
+	_ioService(),\
+	_timer( _ioService ),\
+	_acceptor( _ioService ),\
+	_ring( parent.options().httpHistory() ),\
+	_ringHead( 0 ),\
+	_ringCount( 0 ),\
+	_subscribers(),\
+	_generation( 0 ),\
+	_timeUpdate(),\
+	_chIdx(),\
+	_chValues( LM50Device::countChannels ),\
+	_chPower( LM50Device::countChannels ),\
+	_chEnergy( LM50Device::countChannels ),\
+	_chFlags( LM50Device::countChannels ),\
+	_scratch( 128 + LM50Device::countChannels * maxChannelLength ),\
+	_history( maxHistoryLength ),\
+	_ticks( 0 ),\
+	_isAcceptFailed( false ) {
+}
+
+WorkerHttp::~WorkerHttp() {
+	_subscribers.clear();
+}
+
+void WorkerHttp::listen() {
+	const ProgramOptions& po( _parent.options() );
+	boost::asio::ip::tcp::resolver resolver( _ioService );
+	boost::asio::ip::tcp::resolver::query query( po.httpAddress(), po.httpPort(), boost::asio::ip::tcp::resolver::query::passive | boost::asio::ip::tcp::resolver::query::numeric_service );
+	const boost::asio::ip::tcp::endpoint endpoint( *resolver.resolve( query ) );
+	_acceptor.open( endpoint.protocol() );
+	_acceptor.set_option( boost::asio::ip::tcp::acceptor::reuse_address( true ) );
+	_acceptor.bind( endpoint );
+	_acceptor.listen();
+}
+
+/**
+ * The main loop of the thread runs the I/O service. A timer checks for new
+ * values and for cancellation, because the I/O service is only interrupted
+ * by DaemonWorker::terminate in debug builds.
+ */
+int WorkerHttp::run() {
+	if( !_acceptor.is_open() ) return EBADF;
+	accept();
+	_timer.expires_from_now( boost::posix_time::milliseconds( checkInterval ) );
+	_timer.async_wait( boost::bind( &WorkerHttp::tick, this, boost::asio::placeholders::error ) );
+	boost::system::error_code ec;
+	_ioService.run( ec );
+	return 0;
+}
+
+void WorkerHttp::accept() {
+	SessionPtr session( new Session( *this ) );
+	_acceptor.async_accept( session->socket(), boost::bind( &WorkerHttp::handleAccept, this, session, boost::asio::placeholders::error ) );
+}
+
+/**
+ * After a failed accept, e.g. if the process ran out of file descriptors,
+ * the connection is still pending. Hence the worker accepts again at the
+ * next tick instead of failing over and over.
+ */
+void WorkerHttp::handleAccept( SessionPtr session, const boost::system::error_code& error ) {
+	if( error == boost::asio::error::operation_aborted ) return;
+	if( error ) {
+		_isAcceptFailed = true;
+		return;
+	}
+	session->start();
+	accept();
+}
+
+/**
+ * Publishes a new sample, if another worker updated the values, and keeps
+ * idle subscribers alive
+ */
+void WorkerHttp::tick( const boost::system::error_code& error ) {
+	if( error == boost::asio::error::operation_aborted ) return;
+	if( isCancelled() ) {
+		boost::system::error_code ec;
+		_acceptor.close( ec );
+		for( size_t i( 0 ); i != _subscribers.size(); ++i ) _subscribers[i]->close();
+		_ioService.stop();
+		return;
+	}
+	if( _isAcceptFailed ) {
+		_isAcceptFailed = false;
+		accept();
+	}
+	if( obtainSample() ) serialize();
+	if( ++_ticks % keepAliveTicks == 0 ) {
+		for( size_t i( 0 ); i != _subscribers.size(); ++i ) _subscribers[i]->push( keepAlive );
+	}
+	_timer.expires_from_now( boost::posix_time::milliseconds( checkInterval ) );
+	_timer.async_wait( boost::bind( &WorkerHttp::tick, this, boost::asio::placeholders::error ) );
+}
+
+/**
+ * Copies the values of the last update. If another thread holds the device
+ * mutex, e.g. during an update, the values are copied at the next tick
+ * instead of waiting.
+ * @return True, if there are new values
+ */
+bool WorkerHttp::obtainSample() {
+	if( _parent.generation() == _generation ) return false;
+	if( !_parent.tryLockDevice() ) return false;
+	_chIdx = _parent.options().channels();
+	_generation = _parent.deviceGeneration();
+	_timeUpdate = _parent.deviceLastUpdate();
+	for( ProgramOptions::ChList::const_iterator i( _chIdx.begin() ); i != _chIdx.end(); ++i ) {
+		_chValues[ *i ] = _parent.deviceChannel( *i );
+		_chPower[ *i ] = _parent.devicePower( *i );
+		_chEnergy[ *i ] = _parent.deviceEnergy( *i );
+		_chFlags[ *i ] = _parent.deviceFlags( *i );
+	}
+	_parent.unlockDevice();
+	return true;
+}
+
+/**
+ * Formats the values as Server-Sent Event, appends it to the ring and pushes
+ * it to the subscribers
+ */
+void WorkerHttp::serialize() {
+	char* const begin( &_scratch[0] );
+	char* p( Format::appendUInt( Format::appendString( begin, "id: " ), _generation ) );
+	p = Format::appendString( p, "\ndata: " );
+	const size_t jsonOffset( p - begin );
+	p = Format::appendUInt( Format::appendString( p, "{\"generation\":" ), _generation );
+	p = Format::appendUInt( Format::appendString( p, ",\"time\":" ), _timeUpdate.tv_sec );
+	*p++ = '.';
+	p = Format::appendUInt( p, _timeUpdate.tv_nsec / 1000000, 3, '0' );
+	p = Format::appendString( p, ",\"channels\":[" );
+	for( ProgramOptions::ChList::const_iterator i( _chIdx.begin() ); i != _chIdx.end(); ++i ) {
+		const LM50Device::ChIdx ch( *i );
+		if( i != _chIdx.begin() ) *p++ = ',';
+		p = Format::appendUInt( Format::appendString( p, "{\"channel\":" ), ch + 1 );
+		p = Format::appendUInt( Format::appendString( p, ",\"counter\":" ), _chValues[ ch ] );
+		p = Format::appendFixed( Format::appendString( p, ",\"power\":" ), _chPower[ ch ], 1 );
+		p = Format::appendFixed( Format::appendString( p, ",\"energy\":" ), _chEnergy[ ch ], 3 );
+		p = Format::appendUInt( Format::appendString( p, ",\"flags\":" ), _chFlags[ ch ] );
+		*p++ = '}';
+	}
+	p = Format::appendString( p, "]}" );
+	const size_t jsonLength( p - begin - jsonOffset );
+	p = Format::appendString( p, "\n\n" );
+
+	Sample& sample( _ring[ ( _ringHead + _ringCount ) % _ring.size() ] );
+	sample.generation = _generation;
+	sample.time = _timeUpdate.tv_sec + _timeUpdate.tv_nsec * 1e-9;
+	sample.event.reset( new std::string( begin, p ) );
+	sample.jsonOffset = jsonOffset;
+	sample.jsonLength = jsonLength;
+	if( _ringCount == _ring.size() ) _ringHead = ( _ringHead + 1 ) % _ring.size();
+	else ++_ringCount;
+	publish( sample );
+}
+
+/**
+ * Pushes the sample to all subscribers and forgets those that are gone or
+ * fell behind
+ */
+void WorkerHttp::publish( const Sample& sample ) {
+	size_t n( 0 );
+	for( size_t i( 0 ); i != _subscribers.size(); ++i ) {
+		if( !_subscribers[i]->isOpen() ) continue;
+		if( _subscribers[i]->push( sample.event, 0, sample.event->size() ) ) _subscribers[n++] = _subscribers[i];
+		else _parent.metrics().httpDropped.increment();
+	}
+	_subscribers.resize( n );
+}
+
+void WorkerHttp::handleRequest( SessionPtr session, const std::string& method, const std::string& target, const std::string& ifNoneMatch, const std::string& lastEventId ) {
+	_parent.metrics().httpRequests.increment();
+	if( method != "GET" ) {
+		session->respond( "405 Method Not Allowed", "Allow: GET\r\n", nullptr );
+		return;
+	}
+	const size_t q( target.find( '?' ) );
+	const std::string path( target, 0, q );
+	const std::string query( q == std::string::npos ? std::string() : target.substr( q + 1 ) );
+	if( path == "/current" ) respondCurrent( session, ifNoneMatch );
+	else if( path == "/recent" ) respondRecent( session, query );
+	else if( path == "/history" ) respondHistory( session, query );
+	else if( path == "/stream" ) subscribe( session, lastEventId );
+	else session->respond( "404 Not Found", "Content-Type: application/json\r\n", "{\"error\":\"unknown resource\"}" );
+}
+
+/**
+ * The ETag is the generation of the sample
+ */
+void WorkerHttp::respondCurrent( SessionPtr session, const std::string& ifNoneMatch ) {
+	if( _ringCount == 0 ) {
+		session->respond( "503 Service Unavailable", "Content-Type: application/json\r\n", "{\"error\":\"no sample yet\"}" );
+		return;
+	}
+	const Sample& sample( sampleAt( _ringCount - 1 ) );
+	char number[ Format::maxIntLength ];
+	const std::string etag( std::string( "\"" ).append( number, Format::appendUInt( number, sample.generation ) - number ).append( "\"" ) );
+	const std::string headers( std::string( "ETag: " ).append( etag ).append( "\r\n" ) );
+	if( ifNoneMatch == etag || ifNoneMatch == "*" ) {
+		session->respond( "304 Not Modified", headers, nullptr );
+		return;
+	}
+	std::vector< Buffer > owners( 1, sample.event );
+	std::vector< boost::asio::const_buffer > body( 1, boost::asio::buffer( sample.event->data() + sample.jsonOffset, sample.jsonLength ) );
+	session->respond( "200 OK", headers + "Content-Type: application/json\r\n", owners, body );
+}
+
+/**
+ * The body is gathered from the buffers of the samples without copying them
+ */
+void WorkerHttp::respondRecent( SessionPtr session, const std::string& query ) {
+	double since( -1.0 );
+	std::string value;
+	if( queryValue( query, "since", value ) ) {
+		char* end( nullptr );
+		since = strtod( value.c_str(), &end );
+		if( value.empty() || *end != '\0' ) {
+			session->respond( "400 Bad Request", "Content-Type: application/json\r\n", "{\"error\":\"since must be a unix time\"}" );
+			return;
+		}
+	}
+	std::vector< Buffer > owners;
+	std::vector< boost::asio::const_buffer > body;
+	body.push_back( boost::asio::buffer( "[", 1 ) );
+	for( size_t i( firstAfter( since ) ); i != _ringCount; ++i ) {
+		const Sample& sample( sampleAt( i ) );
+		if( owners.size() != 0 ) body.push_back( boost::asio::buffer( ",", 1 ) );
+		owners.push_back( sample.event );
+		body.push_back( boost::asio::buffer( sample.event->data() + sample.jsonOffset, sample.jsonLength ) );
+	}
+	body.push_back( boost::asio::buffer( "]", 1 ) );
+	session->respond( "200 OK", "Content-Type: application/json\r\n", owners, body );
+}
+
+/**
+ * Answers from the consolidated power of the daemon, see LM50Rollup. The
+ * query selects the channel number, the number of seconds up to now and
+ * optionally the resolution in seconds, e.g. channel=21&span=3600. Without a
+ * resolution the finest one that spans the seconds is taken. Each bucket is
+ * an array of its start in unix time and the minimum, average, maximum and
+ * last power in W. If another thread holds the device mutex, e.g. while the
+ * daemon reconnects, the worker does not wait but asks the client to retry.
+ */
+void WorkerHttp::respondHistory( SessionPtr session, const std::string& query ) {
+	std::string value;
+	unsigned long channel( 0 ), span( 0 ), resolution( 0 );
+	if( queryValue( query, "channel", value ) ) channel = strtoul( value.c_str(), nullptr, 10 );
+	if( queryValue( query, "span", value ) ) span = strtoul( value.c_str(), nullptr, 10 );
+	if( channel == 0 || channel > LM50Device::countChannels || span == 0 ) {
+		session->respond( "400 Bad Request", "Content-Type: application/json\r\n", "{\"error\":\"channel and span are required\"}" );
+		return;
+	}
+	LM50Rollup::Level level( LM50Rollup::levelFor( span, maxHistoryLength ) );
+	if( queryValue( query, "resolution", value ) ) {
+		resolution = strtoul( value.c_str(), nullptr, 10 );
+		if( !LM50Rollup::levelOf( resolution, level ) ) {
+			session->respond( "400 Bad Request", "Content-Type: application/json\r\n", "{\"error\":\"resolution must be 1, 60, 900 or 3600\"}" );
+			return;
+		}
+	}
+	if( !_parent.tryLockDevice() ) {
+		session->respond( "503 Service Unavailable", "Retry-After: 1\r\nContent-Type: application/json\r\n", "{\"error\":\"device busy\"}" );
+		return;
+	}
+	const time_t now( time( nullptr ) );
+	const size_t count( _parent.deviceHistory( level, channel - 1, now - span, now, &_history[0], _history.size() ) );
+	_parent.unlockDevice();
+
+	std::string* json( new std::string() );
+	json->reserve( 64 + count * maxBucketLength );
+	char buf[ maxBucketLength ];
+	char* p( Format::appendUInt( Format::appendString( buf, "{\"channel\":" ), channel ) );
+	p = Format::appendUInt( Format::appendString( p, ",\"resolution\":" ), LM50Rollup::resolution( level ) );
+	p = Format::appendString( p, ",\"buckets\":[" );
+	json->append( buf, p - buf );
+	for( size_t i( 0 ); i != count; ++i ) {
+		p = buf;
+		if( i != 0 ) *p++ = ',';
+		*p++ = '[';
+		p = Format::appendUInt( p, _history[i].time );
+		*p++ = ',';
+		p = Format::appendFixed( p, _history[i].min, 1 );
+		*p++ = ',';
+		p = Format::appendFixed( p, _history[i].avg, 1 );
+		*p++ = ',';
+		p = Format::appendFixed( p, _history[i].max, 1 );
+		*p++ = ',';
+		p = Format::appendFixed( p, _history[i].last, 1 );
+		*p++ = ']';
+		json->append( buf, p - buf );
+	}
+	json->append( "]}" );
+	std::vector< Buffer > owners( 1, Buffer( json ) );
+	std::vector< boost::asio::const_buffer > body( 1, boost::asio::buffer( *json ) );
+	session->respond( "200 OK", "Content-Type: application/json\r\n", owners, body );
+}
+
+/**
+ * Looks up a parameter of the query string. Values are not decoded, as the
+ * parameters are plain numbers.
+ * @return True, if the parameter is present
+ */
+bool WorkerHttp::queryValue( const std::string& query, const char* name, std::string& value ) {
+	const size_t length( strlen( name ) );
+	for( size_t i( 0 ); i < query.size(); ) {
+		const size_t end( std::min( query.find( '&', i ), query.size() ) );
+		if( end - i >= length && query.compare( i, length, name ) == 0 && ( end - i == length || query[ i + length ] == '=' ) ) {
+			value.assign( query, std::min( i + length + 1, end ), end - std::min( i + length + 1, end ) );
+			return true;
+		}
+		i = end + 1;
+	}
+	return false;
+}
+
+/**
+ * @return The index of the oldest sample after the given unix time, found by
+ * a binary search, as the samples are ordered by time
+ */
+size_t WorkerHttp::firstAfter( double time ) const {
+	size_t first( 0 ), last( _ringCount );
+	while( first != last ) {
+		const size_t mid( first + ( last - first ) / 2 );
+		if( sampleAt( mid ).time > time ) last = mid;
+		else first = mid + 1;
+	}
+	return first;
+}
+
+/**
+ * A subscriber that resumes gets the samples after its last event id first
+ */
+void WorkerHttp::subscribe( SessionPtr session, const std::string& lastEventId ) {
+	session->beginStream();
+	if( !lastEventId.empty() ) {
+		const u_int64_t last( strtoull( lastEventId.c_str(), nullptr, 10 ) );
+		size_t i( 0 );
+		while( i != _ringCount && sampleAt( i ).generation <= last ) ++i;
+		// Do not flood the subscriber beyond its backlog
+		if( _ringCount - i > maxBacklog / 2 ) i = _ringCount - maxBacklog / 2;
+		for( ; i != _ringCount; ++i ) session->push( sampleAt( i ).event, 0, sampleAt( i ).event->size() );
+	}
+	_subscribers.push_back( session );
+}
+
+}
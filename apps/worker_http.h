@@ -0,0 +1,143 @@
+#ifndef _WORKER_HTTP_H_
+#define _WORKER_HTTP_H_
+
+#include "daemon_worker.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace LM50 {
+
+/**
+ * This worker serves the values of the polled channels to HTTP clients,
+ * e.g. dashboards in a browser. It offers three resources:
+ *
+ *   /current        The last sample as JSON. The ETag is the generation of
+ *                   the sample, hence a client that sends If-None-Match
+ *                   gets "304 Not Modified" until the next update.
+ *   /recent?since=t The samples after the unix time t (all, if omitted) as
+ *                   a JSON array, oldest first.
+ *   /history?channel=c&span=s[&resolution=r]
+ *                   The minimum, average, maximum and last power of the
+ *                   channel over the last s seconds from the consolidated
+ *                   values of the daemon, see LM50Rollup.
+ *   /stream         A Server-Sent Events feed that pushes every new sample.
+ *                   A client that resumes with Last-Event-ID first gets the
+ *                   samples it missed, as far as they are still kept.
+ *
+ * A sample looks like
+ *
+ *   {"generation":42,"time":1456833600.123,"channels":[{"channel":10,"counter":123456,"power":1234.5,"energy":123.456,"flags":0},...]}
+ *
+ * Like the MQTT worker this worker does not update the device by itself. It
+ * watches the generation of the daemon's values (see ModeDaemon::generation)
+ * and copies the values whenever another worker (rrd or report) updated
+ * them. Each sample is serialized once into a buffer that already carries
+ * the framing of a Server-Sent Event. All responses and all subscribers
+ * share this buffer, the last samples are kept in a ring of buffers.
+ *
+ * The sessions are served by the thread of the worker. A subscriber that
+ * does not keep up with the samples is disconnected.
+ */
+class WorkerHttp : public DaemonWorker {
+	public:
+		WorkerHttp( ModeDaemon &parent );
+		virtual ~WorkerHttp();
+
+	public:
+		/**
+		 * Opens the listening socket. Throws a boost::system::system_error, if
+		 * the address is invalid or in use.
+		 */
+		void listen();
+
+		virtual int run();
+
+	protected:
+		typedef boost::shared_ptr< const std::string > Buffer;
+
+		/**
+		 * A serialized sample. The buffer holds the Server-Sent Event, the JSON
+		 * object is the part at jsonOffset.
+		 */
+		struct Sample {
+			u_int64_t generation;
+			double time;
+			Buffer event;
+			size_t jsonOffset;
+			size_t jsonLength;
+		};
+
+		class Session;
+		typedef boost::shared_ptr< Session > SessionPtr;
+
+		void accept();
+		void handleAccept( SessionPtr session, const boost::system::error_code& error );
+		void tick( const boost::system::error_code& error );
+		bool obtainSample();
+		void serialize();
+		void publish( const Sample& sample );
+		void handleRequest( SessionPtr session, const std::string& method, const std::string& target, const std::string& ifNoneMatch, const std::string& lastEventId );
+		void respondCurrent( SessionPtr session, const std::string& ifNoneMatch );
+		void respondRecent( SessionPtr session, const std::string& query );
+		void respondHistory( SessionPtr session, const std::string& query );
+		void subscribe( SessionPtr session, const std::string& lastEventId );
+		size_t firstAfter( double time ) const;
+		static bool queryValue( const std::string& query, const char* name, std::string& value );
+		const Sample& sampleAt( size_t i ) const { return _ring[ ( _ringHead + i ) % _ring.size() ]; }
+
+	protected:
+		boost::asio::io_service _ioService;
+		boost::asio::deadline_timer _timer;
+		boost::asio::ip::tcp::acceptor _acceptor;
+
+		/**
+		 * The last samples, oldest first from _ringHead on. _ringCount of them
+		 * are valid.
+		 */
+		std::vector< Sample > _ring;
+		size_t _ringHead;
+		size_t _ringCount;
+
+		std::vector< SessionPtr > _subscribers;
+
+		/**
+		 * The generation and the values of the last sample, see
+		 * ModeDaemon::deviceGeneration
+		 */
+		u_int64_t _generation;
+		struct timespec _timeUpdate;
+		ProgramOptions::ChList _chIdx;
+		std::vector< LM50Device::ChVal > _chValues;
+		std::vector< double > _chPower;
+		std::vector< double > _chEnergy;
+		std::vector< unsigned char > _chFlags;
+
+		/**
+		 * The buffer the samples are formatted into
+		 */
+		std::vector< char > _scratch;
+
+		/**
+		 * The buckets of a request for /history
+		 */
+		std::vector< LM50Rollup::Bucket > _history;
+
+		/**
+		 * The number of timer ticks, see WorkerHttp::tick
+		 */
+		unsigned long _ticks;
+
+		/**
+		 * The last accept failed and is repeated at the next tick
+		 */
+		bool _isAcceptFailed;
+};
+
+}
+
+#endif
@@ -0,0 +1,296 @@
+#include "worker_influx.h"
+#include "lm50client.h"
+#include "format.h"
+
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+namespace LM50 {
+
+// The time in milliseconds the worker sleeps, before it checks for new
+// values and cancellation again
+static const int pollInterval( 100 );
+
+// The time in milliseconds the server must accept or answer a request,
+// before it is taken as unavailable
+static const int requestTimeout( 5000 );
+
+// The upper bound of the delay between two attempts to write in seconds
+static const time_t maxRetryDelay( 60 );
+
+// The maximum length of the fields and time stamp of a line
+static const size_t fieldsLength( 32 + 5 * Format::maxIntLength );
+
+static time_t monotonicNow() {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec;
+}
+
+/**
+ * Appends s to dest with a backslash in front of each special character
+ */
+static void appendEscaped( std::string& dest, const std::string& s, const char* special ) {
+	for( std::string::const_iterator i( s.begin() ); i != s.end(); ++i ) {
+		if( strchr( special, *i ) ) dest.push_back( '\\' );
+		dest.push_back( *i );
+	}
+}
+
+/**
+ * Appends s to dest in percent-encoding, except for unreserved characters
+ */
+static void appendUrlEncoded( std::string& dest, const std::string& s ) {
+	static const char hex[] = "0123456789ABCDEF";
+	for( std::string::const_iterator i( s.begin() ); i != s.end(); ++i ) {
+		const unsigned char c( *i );
+		if( isalnum( c ) || c == '-' || c == '_' || c == '.' || c == '~' ) {
+			dest.push_back( c );
+		} else {
+			dest.push_back( '%' );
+			dest.push_back( hex[ c >> 4 ] );
+			dest.push_back( hex[ c & 0x0f ] );
+		}
+	}
+}
+
+WorkerInflux::WorkerInflux( ModeDaemon &parent ) : DaemonWorker( parent ),\
+	_options( nullptr ),\
+	_http(),\
+	_path(),\
+	_headers(),\
+	_chTags( LM50Device::countChannels ),\
+	_generation( 0 ),\
+	_timeUpdate(),\
+	_chIdx(),\
+	_chValues( new LM50Device::ChVal[ LM50Device::countChannels ] ),\
+	_chPower( new double[ LM50Device::countChannels ] ),\
+	_chEnergy( new double[ LM50Device::countChannels ] ),\
+	_chFlags( new unsigned char[ LM50Device::countChannels ] ),\
+	_batch( nullptr ),\
+	_batchCapacity( 0 ),\
+	_batchLength( 0 ),\
+	_batchPoints( 0 ),\
+	_batchStart( 0 ),\
+	_zstream(),\
+	_compressed( nullptr ),\
+	_compressedCapacity( 0 ),\
+	_pending(),\
+	_pendingBytes( 0 ),\
+	_retryAt( 0 ),\
+	_retryDelay( 1 ),\
+	_isAvailable( true ) {
+	// A window of 15 bits plus 16 selects the gzip format
+	if( deflateInit2( &_zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK ) {
+		throw std::runtime_error( "Could not initialize zlib" );
+	}
+	configure();
+}
+
+WorkerInflux::~WorkerInflux() {
+	deflateEnd( &_zstream );
+	delete[] _chValues;
+	delete[] _chPower;
+	delete[] _chEnergy;
+	delete[] _chFlags;
+	delete[] _batch;
+	delete[] _compressed;
+}
+
+/**
+ * The main loop of the thread. Pending batches are written in the same
+ * thread, the time of a request is bounded by requestTimeout.
+ */
+int WorkerInflux::run() {
+	while( !isCancelled() ) {
+		if( obtainValues() ) appendLines();
+		if( _batchPoints != 0 && ( _batchLength >= _options->influxBatchSize() || monotonicNow() - _batchStart >= static_cast< time_t >( _options->influxFlushInterval() ) ) ) {
+			compressBatch();
+		}
+		if( !_pending.empty() && monotonicNow() >= _retryAt ) {
+			sendPending( requestTimeout );
+		} else {
+			struct timespec slice = { 0, pollInterval * 1000000l };
+			nanosleep( &slice, NULL );
+		}
+	}
+
+	// Try once to write everything, such that a restart loses nothing
+	if( _batchPoints != 0 ) compressBatch();
+	if( !_pending.empty() ) sendPending( pollInterval * 10 );
+	if( !_pending.empty() ) {
+		size_t points( 0 );
+		for( std::deque< Batch >::const_iterator b( _pending.begin() ); b != _pending.end(); ++b ) points += b->points;
+		_parent.log().write( LogLine().appendNow().append( "Discarded " ).appendUInt( points ).append( " point(s) not written to InfluxDB" ) );
+		drop( points );
+	}
+	return 0;
+}
+
+/**
+ * Renders the tags of all channels and the request for the current options
+ * of the daemon. The buffers are enlarged, if the tags became longer.
+ */
+void WorkerInflux::configure() {
+	const ProgramOptions& po( _parent.options() );
+	_options = &po;
+	_http.server( po.influxHost(), po.influxPort() );
+	_path.assign( "/write?db=" );
+	appendUrlEncoded( _path, po.influxDatabase() );
+	_path.append( "&precision=ns" );
+	_headers.assign( "Content-Type: text/plain; charset=utf-8\r\nContent-Encoding: gzip\r\n" );
+	if( !po.influxToken().empty() ) _headers.append( "Authorization: Token " ).append( po.influxToken() ).append( "\r\n" );
+
+	size_t updateLength( 0 );
+	for( LM50Device::ChIdx ch( 0 ); ch != LM50Device::countChannels; ++ch ) {
+		std::string& tags( _chTags[ ch ] );
+		char number[ Format::maxIntLength ];
+		const char* end( Format::appendUInt( number, ch + 1, 2, '0' ) );
+		tags.clear();
+		appendEscaped( tags, po.influxMeasurement(), ", " );
+		tags.append( ",device=" );
+		appendEscaped( tags, po.influxDevice(), ",= " );
+		tags.append( ",channel=" ).append( number, end - number );
+		if( !po.channelMeta( ch ).name.empty() ) {
+			tags.append( ",name=" );
+			appendEscaped( tags, po.channelMeta( ch ).name, ",= " );
+		}
+		tags.push_back( ' ' );
+		updateLength += tags.size() + fieldsLength;
+	}
+
+	const size_t capacity( po.influxBatchSize() + updateLength );
+	if( capacity <= _batchCapacity ) return;
+	if( _batchPoints != 0 ) compressBatch();
+	delete[] _batch;
+	delete[] _compressed;
+	_batch = nullptr;
+	_compressed = nullptr;
+	_batchCapacity = capacity;
+	_batch = new char[ _batchCapacity ];
+	_compressedCapacity = deflateBound( &_zstream, _batchCapacity );
+	_compressed = new char[ _compressedCapacity ];
+}
+
+/**
+ * Copies the values of the polled channels, if another worker updated the
+ * device since the last call. The device is locked only if the generation
+ * changed, which is checked without the lock.
+ * @return True, if new values have been copied
+ */
+bool WorkerInflux::obtainValues() {
+	if( _parent.generation() == _generation ) return false;
+	if( _options != &_parent.options() ) configure();
+	_chIdx = _options->channels();
+	_parent.lockDevice();
+	_generation = _parent.deviceGeneration();
+	_timeUpdate = _parent.deviceLastUpdate();
+	for( ProgramOptions::ChList::const_iterator i( _chIdx.begin() ); i != _chIdx.end(); ++i ) {
+		_chValues[ *i ] = _parent.deviceChannel( *i );
+		_chPower[ *i ] = _parent.devicePower( *i );
+		_chEnergy[ *i ] = _parent.deviceEnergy( *i );
+		_chFlags[ *i ] = _parent.deviceFlags( *i );
+	}
+	_parent.unlockDevice();
+	return true;
+}
+
+/**
+ * Appends one line per polled channel to the batch. Invalid values (see
+ * LM50Anomaly::INVALID) are not written.
+ */
+void WorkerInflux::appendLines() {
+	const u_int64_t time( static_cast< u_int64_t >( _timeUpdate.tv_sec ) * 1000000000 + _timeUpdate.tv_nsec );
+	if( _batchPoints == 0 ) _batchStart = monotonicNow();
+	char* p( _batch + _batchLength );
+	for( ProgramOptions::ChList::const_iterator i( _chIdx.begin() ); i != _chIdx.end(); ++i ) {
+		const LM50Device::ChIdx ch( *i );
+		if( _chFlags[ ch ] & LM50Anomaly::INVALID ) continue;
+		const std::string& tags( _chTags[ ch ] );
+		memcpy( p, tags.data(), tags.size() );
+		p = Format::appendString( p + tags.size(), "counter=" );
+		p = Format::appendUInt( p, _chValues[ ch ] );
+		p = Format::appendFixed( Format::appendString( p, "i,power=" ), _chPower[ ch ], 1 );
+		p = Format::appendFixed( Format::appendString( p, ",energy=" ), _chEnergy[ ch ], 3 );
+		*p++ = ' ';
+		p = Format::appendUInt( p, time );
+		*p++ = '\n';
+		++_batchPoints;
+	}
+	_batchLength = p - _batch;
+}
+
+/**
+ * Compresses the current batch into a new entry of the retry buffer. If the
+ * retry buffer exceeds its size, the oldest batches are dropped.
+ */
+void WorkerInflux::compressBatch() {
+	deflateReset( &_zstream );
+	_zstream.next_in = reinterpret_cast< Bytef* >( _batch );
+	_zstream.avail_in = _batchLength;
+	_zstream.next_out = reinterpret_cast< Bytef* >( _compressed );
+	_zstream.avail_out = _compressedCapacity;
+	const int res( deflate( &_zstream, Z_FINISH ) );
+	const size_t points( _batchPoints );
+	_batchLength = 0;
+	_batchPoints = 0;
+	if( res != Z_STREAM_END ) {
+		_parent.log().write( LogLine().appendNow().append( "Could not compress batch for InfluxDB" ) );
+		drop( points );
+		return;
+	}
+
+	while( !_pending.empty() && _pendingBytes + _zstream.total_out > _options->influxRetryBuffer() ) {
+		_pendingBytes -= _pending.front().body.size();
+		drop( _pending.front().points );
+		_pending.pop_front();
+	}
+	_pending.push_back( Batch() );
+	_pending.back().body.assign( _compressed, _zstream.total_out );
+	_pending.back().points = points;
+	_pendingBytes += _zstream.total_out;
+}
+
+/**
+ * Writes the pending batches in order until the buffer is empty, the server
+ * is unavailable or the worker is cancelled. InfluxDB answers 204 on
+ * success. Other client errors than 408 (timeout) and 429 (too many
+ * requests) reject the batch for good, e.g. 400 for a malformed line.
+ */
+void WorkerInflux::sendPending( int timeout ) {
+	while( !_pending.empty() ) {
+		const Batch& b( _pending.front() );
+		boost::system::error_code ec;
+		const unsigned int status( _http.post( _path, _headers, b.body.data(), b.body.size(), timeout, ec ) );
+		if( status >= 200 && status < 300 ) {
+			if( !_isAvailable ) _parent.log().write( LogLine().appendNow().append( "InfluxDB is available again" ) );
+			_isAvailable = true;
+			_retryDelay = 1;
+			_parent.metrics().influxWritten.add( b.points );
+		} else if( status >= 400 && status < 500 && status != 408 && status != 429 ) {
+			_parent.log().write( LogLine().appendNow().append( "InfluxDB rejected " ).appendUInt( b.points ).append( " point(s) with status " ).appendUInt( status ) );
+			drop( b.points );
+		} else {
+			if( _isAvailable ) {
+				LogLine line;
+				line.appendNow().append( "InfluxDB unavailable: " );
+				if( ec ) line.append( ec.message() );
+				else line.append( "status " ).appendUInt( status );
+				_parent.log().write( line );
+			}
+			_isAvailable = false;
+			_retryAt = monotonicNow() + _retryDelay;
+			_retryDelay = _retryDelay * 2 > maxRetryDelay ? maxRetryDelay : _retryDelay * 2;
+			return;
+		}
+		_pendingBytes -= b.body.size();
+		_pending.pop_front();
+	}
+}
+
+void WorkerInflux::drop( size_t points ) {
+	_parent.metrics().influxDropped.add( points );
+}
+
+}
@@ -0,0 +1,111 @@
+#ifndef _WORKER_INFLUX_H_
+#define _WORKER_INFLUX_H_
+
+#include "daemon_worker.h"
+#include "http_client.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+namespace LM50 {
+
+/**
+ * This worker writes the values of the polled channels to an InfluxDB in
+ * line protocol.
+ *
+ * Like the MQTT worker it does not update the device by itself, but copies
+ * the values whenever the rrd or report worker updated them (see
+ * ModeDaemon::generation). Each channel becomes one point with the device
+ * and channel as tags, e.g.
+ *
+ *   lm50,device=192.168.1.5,channel=10,name=Main\ feed counter=123456i,power=1234.5,energy=123.456 1456833600123456789
+ *
+ * The time stamp is the time of the update in nanoseconds.
+ *
+ * The lines are collected in a buffer that is allocated once. If the buffer
+ * exceeds the batch size or its oldest line exceeds the flush interval, the
+ * batch is compressed with gzip and queued for a POST to /write. Batches
+ * that could not be written, because the server is unavailable or
+ * overloaded, are kept in a retry buffer of bounded size and are written in
+ * order, after the server is available again. Batches that the server
+ * rejects as invalid are dropped.
+ */
+class WorkerInflux : public DaemonWorker {
+	public:
+		WorkerInflux( ModeDaemon &parent );
+		virtual ~WorkerInflux();
+
+	public:
+		virtual int run();
+
+	protected:
+		struct Batch {
+			std::string body; // gzip compressed
+			size_t points;
+		};
+
+		void configure();
+		bool obtainValues();
+		void appendLines();
+		void compressBatch();
+		void sendPending( int timeout );
+		void drop( size_t points );
+
+	protected:
+		/**
+		 * The options the tags have been rendered for, see configure(). The
+		 * daemon restarts the worker, if an option of the connection or the
+		 * batches changes.
+		 */
+		const ProgramOptions* _options;
+		HttpClient _http;
+		std::string _path;
+		std::string _headers;
+
+		/**
+		 * The measurement and tags of each channel including the separating
+		 * space, e.g. "lm50,device=host,channel=01 "
+		 */
+		std::vector< std::string > _chTags;
+
+		/**
+		 * The generation of the values written last, see
+		 * ModeDaemon::deviceGeneration
+		 */
+		u_int64_t _generation;
+		struct timespec _timeUpdate;
+		ProgramOptions::ChList _chIdx;
+		LM50Device::ChVal* _chValues;
+		double* _chPower;
+		double* _chEnergy;
+		unsigned char* _chFlags;
+
+		/**
+		 * The lines of the current batch. The capacity is the batch size plus
+		 * the lines of one update.
+		 */
+		char* _batch;
+		size_t _batchCapacity;
+		size_t _batchLength;
+		size_t _batchPoints;
+		time_t _batchStart;
+
+		z_stream _zstream;
+		char* _compressed;
+		size_t _compressedCapacity;
+
+		/**
+		 * The compressed batches that have not been written yet, in order
+		 */
+		std::deque< Batch > _pending;
+		size_t _pendingBytes;
+		time_t _retryAt;
+		time_t _retryDelay;
+		bool _isAvailable;
+};
+
+}
+
+#endif
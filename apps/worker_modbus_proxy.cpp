@@ -0,0 +1,299 @@
+#include "worker_modbus_proxy.h"
+#include "lm50client.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+
+namespace LM50 {
+
+using namespace ModBus;
+
+// The time in milliseconds after which the worker checks for cancellation
+static const long checkInterval( 100 );
+
+// The time in seconds between two attempts to read the steady values
+static const time_t steadyRetry( 10 );
+
+WorkerModbusProxy::WorkerModbusProxy( ModeDaemon &parent ) : DaemonWorker( parent ),\
+	_ioService(),\
+	_timer( _ioService ),\
+	_server(),\
+	_generation( 0 ),\
+	_hasSteadyValues( false ),\
+	_jobs(),\
+	_queue(),\
+	_mutex(),\
+	_cond(),\
+	_upstream(),\
+	_isStopping( false ) {
+	memset( _inputImage, 0x00, sizeof( _inputImage ) );
+	memset( _revisionImage, 0x00, sizeof( _revisionImage ) );
+	memset( _serialImage, 0x00, sizeof( _serialImage ) );
+	pthread_mutex_init( &_mutex, NULL );
+	pthread_cond_init( &_cond, NULL );
+}
+
+WorkerModbusProxy::~WorkerModbusProxy() {
+	// The sessions refer to this object as their handler, hence they must go
+	// before
+	_server.reset();
+	_jobs.clear();
+	pthread_cond_destroy( &_cond );
+	pthread_mutex_destroy( &_mutex );
+}
+
+void WorkerModbusProxy::listen() {
+	const ProgramOptions& po( _parent.options() );
+	boost::asio::ip::tcp::resolver resolver( _ioService );
+	boost::asio::ip::tcp::resolver::query query( po.modbusProxyAddress(), po.modbusProxyPort(), boost::asio::ip::tcp::resolver::query::passive | boost::asio::ip::tcp::resolver::query::numeric_service );
+	_server.reset( new TcpServer( _ioService, *resolver.resolve( query ), *this ) );
+}
+
+/**
+ * The main loop of the thread runs the I/O service of the server. A timer
+ * checks for cancellation, because the I/O service is only interrupted by
+ * DaemonWorker::terminate in debug builds.
+ */
+int WorkerModbusProxy::run() {
+	if( !_server ) return EBADF;
+	if( pthread_create( &_upstream, NULL, &WorkerModbusProxy::upstreamMain, this ) != 0 ) return errno;
+	_timer.expires_from_now( boost::posix_time::milliseconds( checkInterval ) );
+	_timer.async_wait( boost::bind( &WorkerModbusProxy::checkCancelled, this, boost::asio::placeholders::error ) );
+	boost::system::error_code ec;
+	_ioService.run( ec );
+
+	pthread_mutex_lock( &_mutex );
+	_isStopping = true;
+	pthread_cond_signal( &_cond );
+	pthread_mutex_unlock( &_mutex );
+	pthread_join( _upstream, NULL );
+	return 0;
+}
+
+void WorkerModbusProxy::checkCancelled( const boost::system::error_code& error ) {
+	if( error == boost::asio::error::operation_aborted ) return;
+	if( isCancelled() ) {
+		_server->close();
+		_ioService.stop();
+		return;
+	}
+	_timer.expires_from_now( boost::posix_time::milliseconds( checkInterval ) );
+	_timer.async_wait( boost::bind( &WorkerModbusProxy::checkCancelled, this, boost::asio::placeholders::error ) );
+}
+
+/**
+ * Answers the request from the images, if the image covers all requested
+ * registers. The ModBus/TCP clients commonly address the device by its unit
+ * id or by 0xff, both are served from the images. The proxy is read-only,
+ * requests of any other than a reading function are refused with an
+ * IllegalFunction exception and never reach the device.
+ */
+void WorkerModbusProxy::request( TcpServerSession& session, const Datagram::Base& req ) {
+	_parent.metrics().proxyRequests.increment();
+	if( !isReading( req ) ) {
+		_parent.metrics().proxyRejected.increment();
+		session.reply( Datagram::ErrorRes( req.transactionID(), req.unitID(), req.funcCode(), Exception::IllegalFunction ) );
+		return;
+	}
+	if( req.unitID() != _parent.options().unitId() && req.unitID() != 0xff ) {
+		forward( session, req );
+		return;
+	}
+
+	const Datagram::ReadInputRegistersReq* ireq( dynamic_cast< const Datagram::ReadInputRegistersReq* >( &req ) );
+	if( ireq ) {
+		refreshImage();
+		const u_int32_t first( ireq->address() ), last( first + ireq->quantity() );
+		if( _generation != 0 && ireq->quantity() != 0 && first >= LM50Device::_hwAddrChannels && last <= static_cast< u_int32_t >( LM50Device::_hwAddrChannels ) + LM50Device::_hwLengthChannels ) {
+			session.reply( Datagram::ReadInputRegistersRes( req.transactionID(), req.unitID(), _inputImage + 2 * ( first - LM50Device::_hwAddrChannels ), 2 * ireq->quantity() ) );
+			return;
+		}
+	}
+
+	const Datagram::ReadHoldingRegistersReq* hreq( dynamic_cast< const Datagram::ReadHoldingRegistersReq* >( &req ) );
+	if( hreq && _hasSteadyValues && hreq->quantity() != 0 ) {
+		const u_int32_t first( hreq->address() ), last( first + hreq->quantity() );
+		const char* image( nullptr );
+		if( first >= LM50Device::_hwAddrRevision && last <= static_cast< u_int32_t >( LM50Device::_hwAddrRevision ) + LM50Device::_hwLengthRevision ) {
+			image = _revisionImage + 2 * ( first - LM50Device::_hwAddrRevision );
+		} else if( first >= LM50Device::_hwAddrSerialNo && last <= static_cast< u_int32_t >( LM50Device::_hwAddrSerialNo ) + LM50Device::_hwLengthSerialNo ) {
+			image = _serialImage + 2 * ( first - LM50Device::_hwAddrSerialNo );
+		}
+		if( image ) {
+			session.reply( Datagram::ReadHoldingRegistersRes( req.transactionID(), req.unitID(), image, 2 * hreq->quantity() ) );
+			return;
+		}
+	}
+
+	forward( session, req );
+}
+
+/**
+ * @return True, if the request only reads from the device, i.e. it reads
+ * coils, discrete inputs or registers, or it reads the device
+ * identification (MEI type 0x0e)
+ */
+bool WorkerModbusProxy::isReading( const Datagram::Base& req ) {
+	switch( req.funcCode() ) {
+		case Function::ReadCoils:
+		case Function::ReadDiscreteInputs:
+		case Function::ReadHoldingRegisters:
+		case Function::ReadInputRegisters:
+			return true;
+		case Function::ReadDeviceIdent:
+			return req.totalLength() > 8 && req.rawDatagram()[8] == 0x0e;
+		default:
+			return false;
+	}
+}
+
+/**
+ * Copies the channels of the last update into the image, if there has been
+ * a new update. If another thread holds the device mutex, e.g. during an
+ * update, the image of the previous update is served instead of waiting.
+ */
+void WorkerModbusProxy::refreshImage() {
+	if( _parent.generation() == _generation ) return;
+	if( !_parent.tryLockDevice() ) return;
+	_generation = _parent.deviceGeneration();
+	for( LM50Device::ChIdx ch( 0 ); ch != LM50Device::countChannels; ++ch ) {
+		const u_int32_t value( htonl( _parent.deviceChannel( ch ) ) );
+		memcpy( _inputImage + 4 * ch, &value, 4 );
+	}
+	_parent.unlockDevice();
+}
+
+/**
+ * Queues the request for the second thread. If an identical request is
+ * already queued, the session only waits for its reply.
+ */
+void WorkerModbusProxy::forward( TcpServerSession& session, const Datagram::Base& req ) {
+	const char* raw( req.rawDatagram() );
+	const std::string key( raw + 6, req.totalLength() - 6 );
+	Waiter w;
+	w.session = session.shared_from_this();
+	w.transactionID = req.transactionID();
+	pthread_mutex_lock( &_mutex );
+	Job& job( _jobs[ key ] );
+	if( job.waiters.empty() ) {
+		job.request.assign( raw, req.totalLength() );
+		_queue.push_back( key );
+	}
+	job.waiters.push_back( w );
+	pthread_cond_signal( &_cond );
+	pthread_mutex_unlock( &_mutex );
+}
+
+/**
+ * Sends the reply of a forwarded request to all waiters with their own
+ * transaction ids. Runs in the thread of the I/O service. An empty reply
+ * means that the device did not answer.
+ */
+void WorkerModbusProxy::answer( const std::vector< Waiter >& waiters, const std::string& reply, Datagram::FuncCode func, Datagram::UnitID unit ) {
+	boost::scoped_ptr< Datagram::Base > res;
+	if( !reply.empty() ) {
+		try {
+			res.reset( Datagram::Base::createObject( reply.data(), reply.size() ) );
+		} catch( std::exception& ) {
+			res.reset();
+		}
+	}
+	if( !res ) {
+		_parent.metrics().proxyFailed.add( waiters.size() );
+		res.reset( new Datagram::ErrorRes( 0, unit, func, Exception::TargetFailure ) );
+	}
+	for( std::vector< Waiter >::const_iterator w( waiters.begin() ); w != waiters.end(); ++w ) {
+		res->transactionID( w->transactionID );
+		w->session->reply( *res );
+	}
+}
+
+void* WorkerModbusProxy::upstreamMain( void* me ) {
+	static_cast< WorkerModbusProxy* >( me )->upstream();
+	return NULL;
+}
+
+/**
+ * The main loop of the second thread. It makes one round with the device
+ * per job. Requests that arrive during the round join the job, hence the
+ * waiters are taken after the round.
+ */
+void WorkerModbusProxy::upstream() {
+	time_t steadyAt( 0 );
+	pthread_mutex_lock( &_mutex );
+	while( !_isStopping ) {
+		if( !_hasSteadyValues && time( NULL ) >= steadyAt ) {
+			pthread_mutex_unlock( &_mutex );
+			readSteadyValues();
+			steadyAt = time( NULL ) + steadyRetry;
+			pthread_mutex_lock( &_mutex );
+			continue;
+		}
+		if( _queue.empty() ) {
+			struct timespec deadline;
+			clock_gettime( CLOCK_REALTIME, &deadline );
+			deadline.tv_sec += 1;
+			pthread_cond_timedwait( &_cond, &_mutex, &deadline );
+			continue;
+		}
+		const std::string key( _queue.front() );
+		const std::string raw( _jobs[ key ].request );
+		_queue.pop_front();
+		pthread_mutex_unlock( &_mutex );
+
+		char reply[ Datagram::Base::maxDatagramLength ];
+		size_t length( 0 );
+		boost::scoped_ptr< Datagram::Base > req;
+		try {
+			req.reset( Datagram::Base::createObject( raw.data(), raw.size() ) );
+		} catch( std::exception& ) {
+			req.reset();
+		}
+		if( req ) {
+			boost::system::error_code ec;
+			_parent.lockDevice();
+			length = _parent.deviceTransact( *req, reply, ec );
+			_parent.unlockDevice();
+			_parent.metrics().proxyForwarded.increment();
+		}
+
+		pthread_mutex_lock( &_mutex );
+		std::vector< Waiter > waiters;
+		JobMap::iterator job( _jobs.find( key ) );
+		waiters.swap( job->second.waiters );
+		_jobs.erase( job );
+		const Datagram::UnitID unit( raw[6] );
+		const Datagram::FuncCode func( raw[7] );
+		_ioService.post( boost::bind( &WorkerModbusProxy::answer, this, waiters, std::string( reply, length ), func, unit ) );
+	}
+	pthread_mutex_unlock( &_mutex );
+}
+
+/**
+ * Fills the images of the holding registers with the same encoding as the
+ * device: The revision as ASCII string padded with zeros and the serial
+ * number as 32-bit integer, high word first.
+ */
+void WorkerModbusProxy::readSteadyValues() {
+	boost::system::error_code ec;
+	std::string revision;
+	unsigned int serialNo( 0 );
+	_parent.lockDevice();
+	_parent.deviceReadSteadyValues( ec );
+	if( !ec ) {
+		revision = _parent.deviceRevision();
+		serialNo = _parent.deviceSerialNumber();
+	}
+	_parent.unlockDevice();
+	if( ec ) return;
+	memcpy( _revisionImage, revision.data(), std::min( revision.size(), sizeof( _revisionImage ) - 1 ) );
+	const u_int32_t serial( htonl( serialNo ) );
+	memcpy( _serialImage, &serial, sizeof( _serialImage ) );
+	__sync_synchronize();
+	_hasSteadyValues = true;
+}
+
+}
@@ -0,0 +1,115 @@
+#ifndef _WORKER_MODBUS_PROXY_H_
+#define _WORKER_MODBUS_PROXY_H_
+
+#include "daemon_worker.h"
+
+#include <deque>
+#include <map>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace LM50 {
+
+/**
+ * This worker serves the registers of the LM50TCP+ to other ModBus/TCP
+ * clients (e.g. SCADA systems), such that the device only sees the
+ * connection of the daemon.
+ *
+ * ReadInputRegisters requests for the channels and ReadHoldingRegisters
+ * requests for the revision and the serial number are answered from a
+ * register image without contacting the device. The image of the channels
+ * is copied from the last update of the rrd or report worker (see
+ * ModeDaemon::generation), the revision and the serial number are read
+ * once. Other reading requests are forwarded to the device over the
+ * connection of the daemon. Identical requests that arrive while another
+ * one is pending are coalesced into one round. The proxy is read-only:
+ * writing and all other functions are refused with an IllegalFunction
+ * exception without contacting the device.
+ *
+ * The sessions are served by a ModBus::TcpServer in the thread of the
+ * worker. The forwarded rounds are made by a second thread, hence a slow or
+ * unavailable device does not delay the answers from the image.
+ */
+class WorkerModbusProxy : public DaemonWorker, public ModBus::TcpServer::Handler {
+	public:
+		WorkerModbusProxy( ModeDaemon &parent );
+		virtual ~WorkerModbusProxy();
+
+	public:
+		/**
+		 * Opens the listening socket. Throws a boost::system::system_error, if
+		 * the address is invalid or in use.
+		 */
+		void listen();
+
+		virtual int run();
+
+		virtual void request( ModBus::TcpServerSession& session, const ModBus::Datagram::Base& request );
+
+	protected:
+		/**
+		 * A client that waits for the reply to a forwarded request
+		 */
+		struct Waiter {
+			boost::shared_ptr< ModBus::TcpServerSession > session;
+			ModBus::Datagram::TransactionID transactionID;
+		};
+
+		/**
+		 * A forwarded request and its waiters. The key of a job is the request
+		 * without the transaction id and the protocol header.
+		 */
+		struct Job {
+			std::string request;
+			std::vector< Waiter > waiters;
+		};
+		typedef std::map< std::string, Job > JobMap;
+
+		static void* upstreamMain( void* me );
+		void upstream();
+		void readSteadyValues();
+		static bool isReading( const ModBus::Datagram::Base& request );
+		void forward( ModBus::TcpServerSession& session, const ModBus::Datagram::Base& request );
+		void answer( const std::vector< Waiter >& waiters, const std::string& reply, ModBus::Datagram::FuncCode func, ModBus::Datagram::UnitID unit );
+		void refreshImage();
+		void checkCancelled( const boost::system::error_code& error );
+
+	protected:
+		boost::asio::io_service _ioService;
+		boost::asio::deadline_timer _timer;
+		boost::scoped_ptr< ModBus::TcpServer > _server;
+
+		/**
+		 * The image of the input registers of the channels and the generation
+		 * it has been copied at, in network byte order
+		 */
+		char _inputImage[ 2 * 100 ];
+		u_int64_t _generation;
+
+		/**
+		 * The images of the holding registers of the revision and the serial
+		 * number, valid if _hasSteadyValues is true
+		 */
+		char _revisionImage[ 2 * 3 ];
+		char _serialImage[ 2 * 2 ];
+		volatile bool _hasSteadyValues;
+
+		/**
+		 * The forwarded requests and their keys in the order of arrival,
+		 * protected by _mutex. The second thread waits on _cond for new jobs.
+		 */
+		JobMap _jobs;
+		std::deque< std::string > _queue;
+		pthread_mutex_t _mutex;
+		pthread_cond_t _cond;
+		pthread_t _upstream;
+		volatile bool _isStopping;
+};
+
+}
+
+#endif
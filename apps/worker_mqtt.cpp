@@ -0,0 +1,228 @@
+#include "worker_mqtt.h"
+#include "lm50client.h"
+#include "format.h"
+
+namespace LM50 {
+
+// The time in milliseconds the worker waits for packets of the broker,
+// before it checks for new values and cancellation again
+static const int pollInterval( 100 );
+
+// The time in milliseconds the broker must accept data, before the
+// connection is taken as broken
+static const int writeTimeout( 5000 );
+
+// The number of unacknowledged messages of QoS 1
+static const size_t maxInflight( 256 );
+
+// The upper bound of the delay between two connection attempts in seconds
+static const time_t maxRetryDelay( 60 );
+
+static time_t monotonicNow() {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec;
+}
+
+WorkerMqtt::WorkerMqtt( ModeDaemon &parent ) : DaemonWorker( parent ),\
+	_options( &parent.options() ),\
+	_client(),\
+	_topicPrefix( _options->mqttPrefix() + '/' + _options->mqttDevice() + '/' ),\
+	_generation( 0 ),\
+	_changed( 0 ),\
+	_timeUpdate(),\
+	_chIdx(),\
+	_chValues( new LM50Device::ChVal[ LM50Device::countChannels ] ),\
+	_chPower( new double[ LM50Device::countChannels ] ),\
+	_chEnergy( new double[ LM50Device::countChannels ] ),\
+	_chFlags( new unsigned char[ LM50Device::countChannels ] ),\
+	_chPublished( new double[ LM50Device::countChannels ] ),\
+	_backlog(),\
+	_inflight(),\
+	_nextId( 1 ),\
+	_retryAt( 0 ),\
+	_retryDelay( 1 ),\
+	_isAvailable( true ) {
+	for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) _chPublished[ i ] = -1.0;
+}
+
+WorkerMqtt::~WorkerMqtt() {
+	_client.close();
+	delete[] _chValues;
+	delete[] _chPower;
+	delete[] _chEnergy;
+	delete[] _chFlags;
+	delete[] _chPublished;
+}
+
+/**
+ * The main loop of the thread. The thread waits for packets of the broker
+ * with a time out, because the blocking functions are only interrupted by
+ * DaemonWorker::terminate in debug builds.
+ */
+int WorkerMqtt::run() {
+	boost::system::error_code ec;
+	while( !isCancelled() ) {
+		if( !_client.isOpen() && monotonicNow() >= _retryAt ) connect();
+		if( obtainValues() ) composeMessages();
+		if( !_client.isOpen() ) {
+			struct timespec slice = { 0, pollInterval * 1000000l };
+			nanosleep( &slice, NULL );
+			continue;
+		}
+		sendBacklog();
+		_client.ping();
+		ec.clear();
+		_client.flush( writeTimeout, ec );
+		if( !ec ) _client.receive( pollInterval, ec );
+		if( !ec ) processAcknowledged();
+		if( ec ) disconnect( ec );
+	}
+
+	// Say good-bye, such that the broker does not publish the last will
+	if( _client.isOpen() ) {
+		_client.publish( _topicPrefix + "status", "offline", _options->mqttQos(), true, _nextId, false );
+		_client.disconnect();
+		ec.clear();
+		_client.flush( pollInterval, ec );
+		_client.close();
+	}
+	return 0;
+}
+
+void WorkerMqtt::connect() {
+	const ProgramOptions& po( *_options );
+	boost::system::error_code ec;
+	_client.open( po.mqttHost(), po.mqttPort(), po.mqttClientId(), po.mqttKeepAlive(), po.mqttUser(), po.mqttPassword(), _topicPrefix + "status", "offline", ec );
+	if( ec ) {
+		if( _isAvailable ) _parent.log().write( LogLine().appendNow().append( "MQTT broker unavailable: " ).append( ec.message() ) );
+		_isAvailable = false;
+		_client.close();
+		_retryAt = monotonicNow() + _retryDelay;
+		_retryDelay = _retryDelay * 2 > maxRetryDelay ? maxRetryDelay : _retryDelay * 2;
+		return;
+	}
+	_parent.log().write( LogLine().appendNow().append( "Connected to MQTT broker " ).append( po.mqttHost() ).append( ':' ).append( po.mqttPort() ) );
+	_isAvailable = true;
+	_retryDelay = 1;
+	// Unacknowledged messages are sent again first, the status goes ahead of
+	// all of them
+	while( !_inflight.empty() ) {
+		_backlog.push_front( _inflight.back() );
+		_backlog.front().dup = true;
+		_inflight.pop_back();
+	}
+	Message status;
+	status.topic = _topicPrefix + "status";
+	status.payload = "online";
+	status.id = 0;
+	status.dup = false;
+	_backlog.push_front( status );
+}
+
+void WorkerMqtt::disconnect( const boost::system::error_code& ec ) {
+	_parent.log().write( LogLine().appendNow().append( "Connection to MQTT broker lost: " ).append( ec.message() ) );
+	_client.close();
+	_retryAt = monotonicNow() + _retryDelay;
+}
+
+/**
+ * Copies the values of the polled channels, if another worker updated the
+ * device since the last call. The device is locked only if the generation
+ * changed, which is checked without the lock.
+ * @return True, if new values have been copied
+ */
+bool WorkerMqtt::obtainValues() {
+	if( _parent.generation() == _generation ) return false;
+	_chIdx = _parent.options().channels();
+	_parent.lockDevice();
+	_changed = _parent.deviceChangedSince( _generation );
+	_generation = _parent.deviceGeneration();
+	_timeUpdate = _parent.deviceLastUpdate();
+	for( ProgramOptions::ChList::const_iterator i( _chIdx.begin() ); i != _chIdx.end(); ++i ) {
+		_chValues[ *i ] = _parent.deviceChannel( *i );
+		_chPower[ *i ] = _parent.devicePower( *i );
+		_chEnergy[ *i ] = _parent.deviceEnergy( *i );
+		_chFlags[ *i ] = _parent.deviceFlags( *i );
+	}
+	_parent.unlockDevice();
+	return true;
+}
+
+/**
+ * Appends a message to the backlog for each channel whose counter or power
+ * changed. Invalid values (see LM50Anomaly::INVALID) are not published.
+ */
+void WorkerMqtt::composeMessages() {
+	const time_t time( _timeUpdate.tv_nsec < 500000000l ? _timeUpdate.tv_sec : _timeUpdate.tv_sec + 1 );
+	char topic[ 8 ];
+	char payload[ 128 + 5 * Format::maxIntLength ];
+	for( ProgramOptions::ChList::const_iterator i( _chIdx.begin() ); i != _chIdx.end(); ++i ) {
+		const LM50Device::ChIdx ch( *i );
+		if( _chFlags[ ch ] & LM50Anomaly::INVALID ) continue;
+		if( !( _changed & ( static_cast< u_int64_t >( 1 ) << ch ) ) && _chPower[ ch ] == _chPublished[ ch ] ) continue;
+		_chPublished[ ch ] = _chPower[ ch ];
+		char* p( Format::appendString( payload, "{\"time\":" ) );
+		p = Format::appendInt( p, time );
+		p = Format::appendUInt( Format::appendString( p, ",\"counter\":" ), _chValues[ ch ] );
+		p = Format::appendFixed( Format::appendString( p, ",\"power\":" ), _chPower[ ch ], 1 );
+		p = Format::appendFixed( Format::appendString( p, ",\"energy\":" ), _chEnergy[ ch ], 3 );
+		p = Format::appendUInt( Format::appendString( p, ",\"flags\":" ), _chFlags[ ch ] );
+		*p++ = '}';
+		char* t( Format::appendUInt( topic, ch + 1, 2, '0' ) );
+		enqueue( std::string( _topicPrefix ).append( topic, t - topic ), std::string( payload, p - payload ) );
+	}
+}
+
+void WorkerMqtt::enqueue( const std::string& topic, const std::string& payload ) {
+	if( _options->mqttBacklog() == 0 ) return;
+	while( _backlog.size() >= _options->mqttBacklog() ) {
+		_backlog.pop_front();
+		_parent.metrics().mqttDropped.increment();
+	}
+	Message m;
+	m.topic = topic;
+	m.payload = payload;
+	m.id = 0;
+	m.dup = false;
+	_backlog.push_back( m );
+}
+
+/**
+ * Moves messages from the backlog into the output buffer of the client. With
+ * QoS 1 at most maxInflight messages are unacknowledged at any time.
+ */
+void WorkerMqtt::sendBacklog() {
+	const unsigned int qos( _options->mqttQos() );
+	while( !_backlog.empty() && ( qos == 0 || _inflight.size() < maxInflight ) ) {
+		Message& m( _backlog.front() );
+		if( qos ) {
+			if( !m.dup ) {
+				m.id = _nextId;
+				_nextId = _nextId == 0xffff ? 1 : _nextId + 1;
+			}
+			_inflight.push_back( m );
+		} else {
+			_parent.metrics().mqttPublished.increment();
+		}
+		_client.publish( m.topic, m.payload, qos, true, m.id, m.dup );
+		_backlog.pop_front();
+	}
+}
+
+void WorkerMqtt::processAcknowledged() {
+	const std::vector< MqttClient::PacketId >& ids( _client.acknowledged() );
+	for( size_t k( 0 ); k != ids.size(); ++k ) {
+		// The broker acknowledges in order, hence the message is usually the
+		// first one
+		for( std::deque< Message >::iterator m( _inflight.begin() ); m != _inflight.end(); ++m ) {
+			if( m->id != ids[k] ) continue;
+			_inflight.erase( m );
+			_parent.metrics().mqttPublished.increment();
+			break;
+		}
+	}
+	_client.clearAcknowledged();
+}
+
+}
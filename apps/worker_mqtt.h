@@ -0,0 +1,104 @@
+#ifndef _WORKER_MQTT_H_
+#define _WORKER_MQTT_H_
+
+#include "daemon_worker.h"
+#include "mqtt_client.h"
+
+#include <deque>
+#include <string>
+
+namespace LM50 {
+
+/**
+ * This worker publishes the values of the polled channels to a MQTT broker.
+ *
+ * The worker does not update the device by itself. It watches the
+ * generation of the daemon's values (see ModeDaemon::generation) and copies
+ * the values whenever another worker (rrd or report) updated them. Only the
+ * channels whose counter or power changed since the last copy are published,
+ * each as a retained message to <prefix>/<device>/<channel> with a small
+ * JSON payload, e.g.
+ *
+ *   lm50/192.168.1.5/10 {"time":1456833600,"counter":123456,"power":1234.5,"energy":123.456,"flags":0}
+ *
+ * The state of the daemon is published retained to <prefix>/<device>/status,
+ * "online" after each connect and "offline" by the last will of the
+ * connection or on termination.
+ *
+ * All messages of a snapshot are written by a single flush without waiting
+ * for the acknowledgements (QoS 1) in between. The worker keeps one
+ * persistent connection. While the broker is unavailable, the messages are
+ * kept in a backlog of bounded size and unacknowledged messages are sent
+ * again after the reconnect.
+ */
+class WorkerMqtt : public DaemonWorker {
+	public:
+		WorkerMqtt( ModeDaemon &parent );
+		virtual ~WorkerMqtt();
+
+	public:
+		virtual int run();
+
+	protected:
+		struct Message {
+			std::string topic;
+			std::string payload;
+			MqttClient::PacketId id;
+			bool dup;
+		};
+
+		void connect();
+		void disconnect( const boost::system::error_code& ec );
+		bool obtainValues();
+		void composeMessages();
+		void enqueue( const std::string& topic, const std::string& payload );
+		void sendBacklog();
+		void processAcknowledged();
+
+	protected:
+		/**
+		 * The options the worker is configured by. The daemon restarts the
+		 * worker, if any MQTT option changes.
+		 */
+		const ProgramOptions* _options;
+		MqttClient _client;
+		std::string _topicPrefix;
+
+		/**
+		 * The generation of the values published last, see
+		 * ModeDaemon::deviceGeneration
+		 */
+		u_int64_t _generation;
+		u_int64_t _changed;
+		struct timespec _timeUpdate;
+		ProgramOptions::ChList _chIdx;
+		LM50Device::ChVal* _chValues;
+		double* _chPower;
+		double* _chEnergy;
+		unsigned char* _chFlags;
+
+		/**
+		 * The power published last per channel, such that a channel whose load
+		 * was switched off is published, too
+		 */
+		double* _chPublished;
+
+		/**
+		 * Messages that have not been sent yet
+		 */
+		std::deque< Message > _backlog;
+
+		/**
+		 * Messages of QoS 1 that have been sent but not acknowledged yet, in
+		 * the order of sending
+		 */
+		std::deque< Message > _inflight;
+		MqttClient::PacketId _nextId;
+		time_t _retryAt;
+		time_t _retryDelay;
+		bool _isAvailable;
+};
+
+}
+
+#endif
@@ -0,0 +1,234 @@
+#include "worker_report.h"
+#include "lm50client.h"
+#include "format.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace LM50 {
+
+// The time in seconds the worker sleeps at most before it checks for
+// cancellation again
+static const time_t sleepSlice( 1 );
+
+/**
+ * Appends the local time in minutes, e.g. 2016-03-01 00:00
+ */
+static LogLine& appendLocalTime( LogLine& line, time_t time ) {
+	struct tm t;
+	localtime_r( &time, &t );
+	line.appendUInt( t.tm_year + 1900, 4, '0' ).append( '-' ).appendUInt( t.tm_mon + 1, 2, '0' ).append( '-' ).appendUInt( t.tm_mday, 2, '0' );
+	return line.append( ' ' ).appendUInt( t.tm_hour, 2, '0' ).append( ':' ).appendUInt( t.tm_min, 2, '0' );
+}
+
+/**
+ * C'tor
+ * The state file is opened here, such that an invalid path is reported
+ * before the thread starts.
+ */
+WorkerReport::WorkerReport( ModeDaemon &parent ) : DaemonWorker( parent ),\
+	_options( &parent.options() ),\
+	_timeBeat(),\
+	_chIdx(),\
+	_chValues(),\
+	_timeUpdate(),\
+	_state() {
+	_state.open( _options->reportFile(), _options->reportPeriod(), time( NULL ) );
+}
+
+WorkerReport::~WorkerReport() {
+	_state.close();
+}
+
+/**
+ * The main loop of the thread
+ */
+int WorkerReport::run() {
+	const unsigned long interval( _options->reportInterval() );
+	// A sample is considered to be consecutive, if at most half a period
+	// passed in excess
+	const time_t maxGap( interval + interval / 2 + 1 );
+
+	// Get time point of first beat, i.e. the next multiple of the interval
+	clock_gettime( CLOCK_REALTIME, &_timeBeat );
+	_timeBeat.tv_sec = static_cast<time_t>(_timeBeat.tv_sec / interval) * interval;
+	_timeBeat.tv_nsec = 0;
+	stepBeat();
+
+	// A report of a former run might still be pending
+	deliverPending();
+
+	do {
+		sleepUntilBeat();
+		if( isCancelled() ) return 0;
+		if( !obtainValues() ) {
+			// The missing sample is counted as a gap by the report
+			stepBeat();
+			continue;
+		}
+		if( isCancelled() ) return 0;
+		const bool wasPending( _state.isPending() );
+		if( _state.add( _timeUpdate.tv_sec, _chIdx, _chValues, maxGap ) ) {
+			if( wasPending ) _parent.log().write( LogLine().appendNow().append( "Report period finished and merged into the undelivered report" ) );
+			else _parent.log().write( LogLine().appendNow().append( "Report period finished" ) );
+		}
+		deliverPending();
+		_state.sync();
+		stepBeat();
+	} while( !isCancelled() );
+	return 0;
+}
+
+/**
+ * Locks the device object, updates it and copies the values of the
+ * requested channels. The channels are taken from the current options, hence
+ * a reload takes effect from the next sample on.
+ * @return False, if the update failed, see ModeDaemon::deviceUpdate
+ */
+bool WorkerReport::obtainValues() {
+	_chIdx = _parent.options().channels();
+	ProgramOptions::ChList::const_iterator i( _chIdx.begin() );
+	LM50Device::ChVal* val( _chValues );
+	_parent.lockDevice();
+	if( !_parent.deviceUpdate() ) {
+		_parent.unlockDevice();
+		return false;
+	}
+	_timeUpdate = _parent.deviceLastUpdate();
+	for( ; i != _chIdx.end(); (++i,++val) ) {
+		*val = _parent.deviceChannel( *i );
+	}
+	_parent.unlockDevice();
+	return true;
+}
+
+/**
+ * Advances _timeBeat to the next multiple of the interval in the future.
+ * Unlike the RRD worker, missed beats are not logged, they are counted as
+ * gaps by the report.
+ */
+void WorkerReport::stepBeat() {
+	const unsigned long interval( _options->reportInterval() );
+	struct timespec timeNow;
+	clock_gettime( CLOCK_REALTIME, &timeNow );
+	do {
+		_timeBeat.tv_sec += interval;
+	} while( _timeBeat.tv_sec <= timeNow.tv_sec );
+}
+
+/**
+ * Blocks until _timeBeat passes by. The thread sleeps in slices, because
+ * the sleep is only interrupted by DaemonWorker::terminate in debug builds.
+ */
+void WorkerReport::sleepUntilBeat() const {
+	while( !isCancelled() ) {
+		struct timespec wakeUp;
+		clock_gettime( CLOCK_REALTIME, &wakeUp );
+		if( wakeUp.tv_sec > _timeBeat.tv_sec || ( wakeUp.tv_sec == _timeBeat.tv_sec && wakeUp.tv_nsec >= _timeBeat.tv_nsec ) ) return;
+		wakeUp.tv_sec += sleepSlice;
+		if( wakeUp.tv_sec > _timeBeat.tv_sec || ( wakeUp.tv_sec == _timeBeat.tv_sec && wakeUp.tv_nsec > _timeBeat.tv_nsec ) ) wakeUp = _timeBeat;
+		clock_nanosleep( CLOCK_REALTIME, TIMER_ABSTIME, &wakeUp, NULL );
+	}
+}
+
+/**
+ * Delivers the report of the finished period, if it is pending. On failure
+ * the report stays pending and is retried on the next beat.
+ */
+void WorkerReport::deliverPending() {
+	if( !_state.isPending() ) return;
+	try {
+		const std::string message( composeReport() );
+		if( _options->reportSpool().empty() ) sendReport( message );
+		else spoolReport( message );
+		_state.delivered();
+		_state.sync();
+		_parent.log().write( LogLine().appendNow().append( "Report delivered" ) );
+	} catch( std::exception& e ) {
+		_parent.log().write( LogLine().appendNow().append( "Could not deliver report: " ).append( e.what() ) );
+	}
+}
+
+/**
+ * Composes the report of the finished period as a mail message including
+ * its header. Counters and the consumption are given in counts of the
+ * meters, the rates in counts per hour. The energy is derived from the
+ * consumption by the impulse constant of the channel.
+ */
+std::string WorkerReport::composeReport() const {
+	const ReportState::Period& p( _state.finished() );
+	std::string msg;
+	LogLine line;
+
+	line.append( "To: " ).append( _options->reportRecipient() );
+	msg.append( line.data(), line.length() ).append( 1, '\n' );
+	line = LogLine();
+	appendLocalTime( line.append( "Subject: LM50 consumption report " ), p.start );
+	appendLocalTime( line.append( " - " ), p.end );
+	msg.append( line.data(), line.length() ).append( 1, '\n' );
+	msg.append( "MIME-Version: 1.0\nContent-Type: text/plain; charset=us-ascii\n\n" );
+
+	line = LogLine();
+	appendLocalTime( line.append( "Consumption from " ), p.start );
+	appendLocalTime( line.append( " to " ), p.end );
+	appendLocalTime( line.append( " (last sample " ), p.lastSample ).append( ')' );
+	msg.append( line.data(), line.length() ).append( "\n\n" );
+
+	msg.append( "Channel  Start counter  End counter  Consumption  Energy/kWh  Min rate/h  Max rate/h  Samples   Gaps  Name\n" );
+	for( size_t i( 0 ); i != ReportState::maxChannels; ++i ) {
+		const ReportState::Channel& c( p.channels[ i ] );
+		if( c.samples == 0 ) continue;
+		line = LogLine();
+		const ProgramOptions::ChannelMeta& meta( _options->channelMeta( i ) );
+		char energy[ Format::maxIntLength + 8 ];
+		const size_t energyLength( Format::appendFixed( energy, static_cast< double >( c.consumption ) / meta.impPerKWh, 3 ) - energy );
+		line.appendUInt( i + 1, 7 ).appendUInt( c.startCounter, 15 ).appendUInt( c.endCounter, 13 ).appendUInt( c.consumption, 13 );
+		line.append( std::string( energyLength < 12 ? 12 - energyLength : 0, ' ' ) ).append( energy, energyLength );
+		if( c.maxRate >= c.minRate ) line.appendUInt( c.minRate, 12 ).appendUInt( c.maxRate, 12 );
+		else line.append( "           -           -" );
+		line.appendUInt( c.samples, 9 ).appendUInt( c.gaps, 7 ).append( "  " ).append( meta.name );
+		msg.append( line.data(), line.length() ).append( 1, '\n' );
+	}
+	return msg;
+}
+
+/**
+ * Writes the message into the spool directory. The file is written under a
+ * temporary name and renamed afterwards, such that a consumer of the spool
+ * never sees an incomplete report.
+ */
+void WorkerReport::spoolReport( const std::string& message ) const {
+	struct tm t;
+	const time_t start( _state.finished().start );
+	localtime_r( &start, &t );
+	LogLine name;
+	name.append( _options->reportSpool() ).append( "/lm50-report-" );
+	name.appendUInt( t.tm_year + 1900, 4, '0' ).appendUInt( t.tm_mon + 1, 2, '0' ).appendUInt( t.tm_mday, 2, '0' ).append( ".eml" );
+	const std::string path( name.data(), name.length() );
+	const std::string tmpPath( path + ".tmp" );
+
+	FILE* file( fopen( tmpPath.c_str(), "w" ) );
+	if( !file ) throw std::runtime_error( std::string( "Could not open " ).append( tmpPath ).append( ": " ).append( strerror( errno ) ) );
+	const bool ok( fwrite( message.data(), message.size(), 1, file ) == 1 );
+	if( fclose( file ) != 0 || !ok ) {
+		unlink( tmpPath.c_str() );
+		throw std::runtime_error( std::string( "Could not write " ).append( tmpPath ) );
+	}
+	if( rename( tmpPath.c_str(), path.c_str() ) != 0 ) throw std::runtime_error( std::string( "Could not rename " ).append( tmpPath ).append( ": " ).append( strerror( errno ) ) );
+}
+
+/**
+ * Pipes the message to the sendmail command
+ */
+void WorkerReport::sendReport( const std::string& message ) const {
+	FILE* pipe( popen( _options->reportSendmail().c_str(), "w" ) );
+	if( !pipe ) throw std::runtime_error( std::string( "Could not run " ).append( _options->reportSendmail() ).append( ": " ).append( strerror( errno ) ) );
+	const bool ok( fwrite( message.data(), message.size(), 1, pipe ) == 1 );
+	const int status( pclose( pipe ) );
+	if( !ok || status != 0 ) throw std::runtime_error( std::string( "Command failed: " ).append( _options->reportSendmail() ) );
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef _WORKER_REPORT_H_
+#define _WORKER_REPORT_H_
+
+#include "daemon_worker.h"
+#include "report_state.h"
+
+#include <string>
+
+namespace LM50 {
+
+/**
+ * This worker samples the channels every report.interval seconds and folds
+ * the samples into the running aggregates of a ReportState. At the end of
+ * each period (daily, weekly or monthly) it composes a report of the
+ * consumption per channel and either writes it into a spool directory or
+ * pipes it to a sendmail compatible command.
+ *
+ * If the delivery fails, the report stays pending in the state file and is
+ * retried on each beat, also after a restart of the daemon.
+ */
+class WorkerReport : public DaemonWorker {
+	public:
+		WorkerReport( ModeDaemon &parent );
+		virtual ~WorkerReport();
+
+	public:
+		virtual int run();
+
+	protected:
+		bool obtainValues();
+		void stepBeat();
+		void sleepUntilBeat() const;
+		void deliverPending();
+		std::string composeReport() const;
+		void spoolReport( const std::string& message ) const;
+		void sendReport( const std::string& message ) const;
+
+	protected:
+		/**
+		 * The options the worker is configured by. The daemon restarts the
+		 * worker, if any report option changes.
+		 */
+		const ProgramOptions* _options;
+		struct timespec _timeBeat;
+		ProgramOptions::ChList _chIdx;
+		LM50Device::ChVal _chValues[ ReportState::maxChannels ];
+		struct timespec _timeUpdate;
+		ReportState _state;
+};
+
+}
+
+#endif
@@ -1,33 +1,22 @@
 #include "worker_rrd.h"
 #include "lm50client.h"
+#include "lib/probes.h"
+#include "format.h"
 
-#include <iostream>
-#include <iomanip>
-#include <locale>
+#include <stdexcept>
 #include <rrd.h>
 
 namespace LM50 {
 
 /**
- * A little helper function to print a POSIX timespec structure as ISO format
- * YYYY-MM-DD HH:MM:ss.nanoseconds
+ * @return The character of the most severe anomaly flag for the CSV records
  */
-static std::ostream& operator<<( std::ostream& os, const struct timespec& ts ) {
-	struct tm t;
-	gmtime_r( &(ts.tv_sec), &t );
-	assert( 0 <= ts.tv_nsec && ts.tv_nsec < 1000000000 );
-	char fc( os.fill( '0' ) );
-	std::locale loc( os.imbue( std::locale( "C" ) ) );
-	os << '"' << (1900 + t.tm_year) << '-';
-	os << std::setw( 2 ) << t.tm_mon << '-';
-	os << std::setw( 2 ) << t.tm_mday << ' ';
-	os << std::setw( 2 ) << t.tm_hour << ':';
-	os << std::setw( 2 ) << t.tm_min << ':';
-	os << std::setw( 2 ) << t.tm_sec << '.';
-	os << std::setw( 9 ) << ts.tv_nsec << "\";";
-	os.fill( fc );
-	os.imbue( loc );
-	return os;
+static char flagChar( unsigned int flags ) {
+	if( flags & LM50Anomaly::BACKWARDS ) return 'b';
+	if( flags & LM50Anomaly::JUMP ) return 'j';
+	if( flags & LM50Anomaly::STUCK ) return 's';
+	if( flags & LM50Anomaly::OUTLIER ) return 'z';
+	return '.';
 }
 
 /**
@@ -43,20 +32,113 @@ static std::ostream& operator<<( std::ostream& os, const struct timespec& ts ) {
  * requested channels. _chValues is an array to hold 4 ChVal values. For example
  * _chValues = { 1000, 42, 11, 0815 }
  * 
+ * If requested by program options, the CSV archive is opened here, such that
+ * an invalid path is reported before the thread starts.
  */
 WorkerRrd::WorkerRrd( ModeDaemon &parent ) : DaemonWorker( parent ),\
-	_pollingPeriod( parent.app().programOptions().rrdPeriod() ),
+	_options( &parent.options() ),\
+	_pollingPeriod( _options->rrdPeriod() ),
 	_timeBeat(),\
 	_chSize( 0 ),\
-	_chIdx( parent.app().programOptions().channels() ),\
+	_chIdx(),\
 	_chValues( nullptr ),\
-	_timeUpdate() {
-	_chSize = _chIdx.size();
-	_chValues = new LM50Device::ChVal[ _chSize ];
+	_chFlags( nullptr ),\
+	_rrdArg( nullptr ),\
+	_timeUpdate(),\
+	_csvHeader(),\
+	_csv() {
+	setChannels( _options->channels() );
+	openCSV();
 }
 
 WorkerRrd::~WorkerRrd() {
+	_csv.close();
+	delete[] _chValues;
+	delete[] _chFlags;
+	delete[] _rrdArg;
+}
+
+/**
+ * Sets the requested channels, (re-)allocates the buffers that depend on
+ * the number of channels and builds the CSV header
+ */
+void WorkerRrd::setChannels( const ProgramOptions::ChList& channels ) {
+	_chIdx = channels;
+	_chSize = _chIdx.size();
 	delete[] _chValues;
+	_chValues = nullptr;
+	delete[] _chFlags;
+	_chFlags = nullptr;
+	delete[] _rrdArg;
+	_rrdArg = nullptr;
+	_chValues = new LM50Device::ChVal[ _chSize ];
+	_chFlags = new unsigned char[ _chSize ];
+	// The timestamp and each value have at most as many digits as a 64bit
+	// integer plus the colon or the terminating null character
+	_rrdArg = new char[ ( _chSize + 1 ) * ( Format::maxIntLength + 1 ) ];
+	
+	// Column captions. A 32bit integer has at most 10 digits, hence the column
+	// width must be at least 11 characters. But due the caption and the
+	// surrounding quotation marks the column width is 12 characters anyway.
+	// The time column is 32 characters including the quotation marks. The
+	// last column holds one anomaly flag per channel.
+	LogLine header;
+	header.append( "\"Time\"" ).append( std::string( 26, ' ' ) ).append( ';' );
+	ProgramOptions::ChList::const_iterator i( _chIdx.begin() );
+	for( ; i != _chIdx.end(); ++i ) {
+		header.append( "\"Channel " ).appendUInt( *i+1, 2, '0' ).append( "\";" );
+	}
+	header.append( "\"Flags\";" );
+	_csvHeader.assign( header.data(), header.length() );
+}
+
+/**
+ * Opens the CSV archive, if requested by the options. Throws, if the file
+ * cannot be opened.
+ */
+void WorkerRrd::openCSV() {
+	_csv.close();
+	if( _options->rrdEnabled() && !_options->rrdCsvFile().empty() ) {
+		_csv.openFile( _options->rrdCsvFile(), _options->rrdCsvSize() * 1024 * 1024, _options->rrdCsvFiles(), _options->rrdCsvGzip(), _csvHeader );
+	}
+}
+
+/**
+ * Applies reloaded options (see ModeDaemon::reload) between two beats, such
+ * that no beat is lost:
+ *
+ * (1) A new period takes effect from the next beat. The next beat is the
+ *     next multiple of the new period.
+ * (2) New channels take effect from the next beat. As the columns of the
+ *     CSV archive change, the archive is rotated.
+ * (3) The CSV archive is re-opened, if any of its options changed.
+ * (4) The RRD file is taken from the options on each update anyway.
+ */
+void WorkerRrd::reconfigure() {
+	const ProgramOptions& po( _parent.options() );
+	if( &po == _options ) return;
+	const ProgramOptions& old( *_options );
+	_options = &po;
+	
+	if( po.rrdPeriod() != _pollingPeriod ) {
+		_pollingPeriod = po.rrdPeriod();
+		_timeBeat.tv_sec = static_cast<time_t>(_timeBeat.tv_sec / _pollingPeriod) * _pollingPeriod;
+	}
+	
+	const bool channelsChanged( po.channels() != _chIdx );
+	if( channelsChanged ) {
+		setChannels( po.channels() );
+		logHeader();
+	}
+	try {
+		if( channelsChanged || po.rrdCsvFile() != old.rrdCsvFile() || po.rrdCsvSize() != old.rrdCsvSize() || po.rrdCsvFiles() != old.rrdCsvFiles() || po.rrdCsvGzip() != old.rrdCsvGzip() ) {
+			_csv.close();
+			if( channelsChanged && !po.rrdCsvFile().empty() ) rotateFiles( po.rrdCsvFile(), po.rrdCsvFiles() );
+			openCSV();
+		}
+	} catch( std::exception& e ) {
+		_parent.log().write( LogLine().appendNow().append( "Could not open CSV archive: " ).append( e.what() ) );
+	}
 }
 
 /**
@@ -65,6 +147,7 @@ WorkerRrd::~WorkerRrd() {
 int WorkerRrd::run() {
 	rrd_get_context();
 	logHeader();
+	Timeline& timeline( _parent.timeline() );
 	
 	// Get time point of first beat, i.e. the next multiple of _pollingPeriod from now on
 	clock_gettime( CLOCK_REALTIME, &_timeBeat );
@@ -76,9 +159,16 @@ int WorkerRrd::run() {
 	do  {
 		sleepUntilBeat();
 		if( isCancelled() ) return 0;
-		obtainValues();
-		logValues();
-		updateRRD();
+		const u_int64_t wakeUp( Metrics::now() );
+		const u_int64_t beatStart( wakeUp - recordPhaseError() );
+		timeline.span( "wakeup", beatStart, wakeUp );
+		// The RRD gets no value for a beat the device refused
+		if( obtainValues() ) {
+			logValues();
+			updateRRD();
+		}
+		timeline.span( "beat", beatStart, Metrics::now() );
+		reconfigure();
 		stepBeat();
 	} while( !isCancelled() );
 	return 0;
@@ -87,19 +177,26 @@ int WorkerRrd::run() {
 /**
  * Locks the device object, requests the device object to update its internal
  * values from the real physical device and copies the values into this 
- * object's own variables _timeUpdate and _chValues. The latter is necessary
- * in order to be able unlock the device object again.
+ * object's own variables _timeUpdate, _chValues and _chFlags. The latter is
+ * necessary in order to be able unlock the device object again.
+ * @return False, if the update failed, see ModeDaemon::deviceUpdate
  */
-void WorkerRrd::obtainValues() {
+bool WorkerRrd::obtainValues() {
 	ProgramOptions::ChList::const_iterator i( _chIdx.begin() );
 	LM50Device::ChVal* val( _chValues );
+	unsigned char* flags( _chFlags );
 	_parent.lockDevice();
-	_parent.deviceUpdate();
+	if( !_parent.deviceUpdate() ) {
+		_parent.unlockDevice();
+		return false;
+	}
 	_timeUpdate = _parent.deviceLastUpdate();
-	for( ; i != _chIdx.end(); (++i,++val) ) {
+	for( ; i != _chIdx.end(); (++i,++val,++flags) ) {
 		*val = _parent.deviceChannel( *i );
+		*flags = _parent.deviceFlags( *i );
 	}
 	_parent.unlockDevice();
+	return true;
 }
 
 /**
@@ -117,10 +214,14 @@ void WorkerRrd::stepBeat() {
 	if( _timeBeat.tv_sec > timeNow.tv_sec ) return;
 	
 	while( timeNow.tv_sec >= _timeBeat.tv_sec ) {
-		std::clog << "Warning: Update step too long for requested polling period. Skipping time point." << std::endl;
+		_parent.log().write( LogLine().appendNow().append( "Warning: Update step too long for requested polling period. Skipping time point." ) );
+		_parent.metrics().skippedBeats.increment();
+		_parent.timeline().instant( "skipped beat", Metrics::now() );
 		_timeBeat.tv_sec += _pollingPeriod;
 	}
-	std::clog << "Warning: Update step too long for requested polling period. Skipping time point." << std::endl;
+	_parent.log().write( LogLine().appendNow().append( "Warning: Update step too long for requested polling period. Skipping time point." ) );
+	_parent.metrics().skippedBeats.increment();
+	_parent.timeline().instant( "skipped beat", Metrics::now() );
 	_timeBeat.tv_sec += _pollingPeriod;
 }
 
@@ -131,83 +232,104 @@ void WorkerRrd::sleepUntilBeat() const {
 	// Wrap the call to sleep into a loop, because clock_nanosleep might be
 	// interrupted by a signal. If that signal does not need any reaction
 	// go to sleep again.
-	bool verb( _parent.app().programOptions().beVerbose() );
+	bool verb( _options->beVerbose() );
 	int ret(1);
 	while( ret != 0 && !isCancelled() ) {
-		if( verb ) std::cerr << "Go to sleep ..." << std::flush;
+		if( verb ) _parent.log().write( LogLine().appendNow().append( "Go to sleep" ) );
 		ret = clock_nanosleep( CLOCK_REALTIME, TIMER_ABSTIME, &_timeBeat, NULL );
-		if( verb ) std::cerr << " and wake up" << std::endl;
 	}
 }
 
 /**
- * Write the object's variables _timeUpdate and _chValues into the RRD file.
+ * Records how late the thread woke up with respect to _timeBeat
+ * @return The delay in nanoseconds
  */
-void WorkerRrd::updateRRD() {
-	// Constructs the argument string for rrd_update_r. The pattern is
-	// <timestamp>:<value 1>:....:<value N>
-	std::ostringstream rrdArg;
-	rrdArg.imbue( std::locale( "C" ) );
-	rrdArg << (_timeUpdate.tv_nsec < 500000000l ? _timeUpdate.tv_sec : _timeUpdate.tv_sec+1l );
+u_int64_t WorkerRrd::recordPhaseError() {
+	struct timespec timeNow;
+	clock_gettime( CLOCK_REALTIME, &timeNow );
+	const int64_t err( static_cast< int64_t >( timeNow.tv_sec - _timeBeat.tv_sec ) * 1000000000 + ( timeNow.tv_nsec - _timeBeat.tv_nsec ) );
+	const u_int64_t delay( err > 0 ? err : 0 );
+	_parent.metrics().beatPhaseError.record( delay );
+	return delay;
+}
+
+/**
+ * Constructs the argument string for rrd_update_r from the object's variables
+ * _timeUpdate and _chValues. The pattern is <timestamp>:<value 1>:....:<value N>.
+ * Invalid values (see LM50Anomaly::INVALID) are written as "U", such that
+ * RRDTool does not derive a rate from them. The buffer _rrdArg has been
+ * allocated by the c'tor.
+ */
+void WorkerRrd::formatRRD() {
+	char* p( Format::appendInt( _rrdArg, _timeUpdate.tv_nsec < 500000000l ? _timeUpdate.tv_sec : _timeUpdate.tv_sec+1l ) );
 	LM50Device::ChIdx i(0);
 	LM50Device::ChVal* val( _chValues );
-	for( ; i != _chSize; (++i,++val) ) {
-		rrdArg << ':' <<  *val;
+	const unsigned char* flags( _chFlags );
+	for( ; i != _chSize; (++i,++val,++flags) ) {
+		*p++ = ':';
+		if( *flags & LM50Anomaly::INVALID ) *p++ = 'U';
+		else p = Format::appendUInt( p, *val );
 	}
-	
-	// ATTENTION: A line as simple as
-	//   const char* argv[2] = { rrdArg.str().c_str(), nullptr };
-	// is invalid although it looks beautiful. rrdArg.str() returns a
-	// new (!) string object and not a const reference to its internal string.
-	// Hence rrdArg.str().c_str() returns a pointer to the internal C char array
-	// but this will be freed immediately because str() is only temporary.
-	// Hence we need to lines:
-	std::string arg( rrdArg.str() );                // Save a copy on stack
-	const char* argv[2] = { arg.c_str(), nullptr }; // Point to C-array safely
+	*p = '\0';
+}
+
+/**
+ * Write the object's variables _timeUpdate and _chValues into the RRD file.
+ */
+void WorkerRrd::updateRRD() {
+	formatRRD();
+	const char* argv[2] = { _rrdArg, nullptr };
 	
 	// If in verbose debugging mode, output the argument string that was passed to
 	// rrd_update_r. I.e. the string with pattern <timestamp>:<value 1>:....:<value N>
-	if( _parent.app().programOptions().beVerbose() ) std::cerr << "rrd_update: " << argv[0] << std::endl;
+	if( _options->beVerbose() ) _parent.log().write( LogLine().appendNow().append( "rrd_update: " ).append( argv[0] ) );
 	
 	// Do the actual update
-	const char* file( _parent.app().programOptions().rrdFile().c_str() );
+	const char* file( _options->rrdFile().c_str() );
 	rrd_clear_error();
+	LM50_PROBE1( sink__write__start, _chSize );
+	const u_int64_t t0( Metrics::now() );
 	int rrd_res( rrd_update_r( file, nullptr, 1, argv ) );
+	const u_int64_t t1( Metrics::now() );
+	_parent.metrics().rrdUpdate.record( t1 - t0 );
+	_parent.timeline().span( "rrd_update", t0, t1 );
+	LM50_PROBE1( sink__write__end, rrd_res );
 	if( rrd_res ) throw std::runtime_error( rrd_get_error() );
 }
 
 /**
- * Write a csv-like header to standard error. Does not do anything, if not in
- * verbose debugging mode
+ * Writes the CSV header to the log. Does not do anything, if not in
+ * foreground. The CSV archive gets its header by the sink for each new file.
  */
-void WorkerRrd::logHeader() const {
-	if( !_parent.app().programOptions().stayInForeground() ) return;
-	// Print header in CSV file. A 32bit integer has at most 10 digets, hence
-	// the column width must be at least 11 characters. But due the caption
-	// and the surrounding quotation marks the column width is 12 characters
-	// anyway. The time column 31 characters including the quotation marks.
-	std::cerr << "\"Time\"                         ;";
-	std::cerr << std::setfill( '0' );
-	ProgramOptions::ChList::const_iterator i( _chIdx.begin() );
-	for( ; i != _chIdx.end(); ++i ) {
-		std::cerr << "\"Channel " << std::setw( 2 ) << (*i+1) << "\";";
-	}
-	std::cerr << std::setfill( ' ' ) << std::endl;
+void WorkerRrd::logHeader() {
+	if( !_options->stayInForeground() ) return;
+	_parent.log().write( LogLine().append( _csvHeader ) );
 }
 
 /**
- * Write a csv-like line to standard error. Does not do anything, if not in
- * verbose debugging mode
+ * Writes a CSV record of the object's variables _timeUpdate and _chValues to
+ * the log, if in foreground, and to the CSV archive, if enabled. The values
+ * are written as read, the last column flags each channel by one character:
+ * '.' for a valid value, 'b' if the counter went backwards, 'j' if it jumped
+ * beyond the maximum rate, 's' if it is stuck and 'z' for an outlier of the
+ * rate. The record is only queued, the actual output is done by the background threads of
+ * the sinks.
  */
-void WorkerRrd::logValues() const {
-	if( !_parent.app().programOptions().stayInForeground() ) return;
+void WorkerRrd::logValues() {
+	const bool foreground( _options->stayInForeground() );
+	if( !foreground && !_csv.isOpen() ) return;
+	LogLine line;
+	line.append( '"' ).appendTime( _timeUpdate ).append( "\";" );
 	LM50Device::ChIdx i(0);
 	LM50Device::ChVal* val( _chValues );
-	std::cerr << _timeUpdate;
 	for( ; i != _chSize; (++i,++val) ) {
-		std::cerr << std::setw( 12 ) << *val << ';';
+		line.appendUInt( *val, 12 ).append( ';' );
 	}
-	std::cerr << std::endl;
+	line.append( '"' );
+	for( i = 0; i != _chSize; ++i ) line.append( flagChar( _chFlags[i] ) );
+	line.append( "\";" );
+	if( foreground ) _parent.log().write( line );
+	_csv.write( line );
 }
 
 }
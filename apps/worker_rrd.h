@@ -3,6 +3,7 @@
 
 #include "daemon_worker.h"
 #include "program_options.h"
+#include "log_sink.h"
 
 namespace LM50 {
 
@@ -14,21 +15,52 @@ class WorkerRrd : public DaemonWorker {
 	public:
 		virtual int run();
 		
-	private:
-		void obtainValues();
+	protected:
+		void setChannels( const ProgramOptions::ChList& channels );
+		void openCSV();
+		void reconfigure();
+		bool obtainValues();
 		void stepBeat();
 		void sleepUntilBeat() const;
+		u_int64_t recordPhaseError();
+		void formatRRD();
 		void updateRRD();
-		void logHeader() const;
-		void logValues() const;
+		void logHeader();
+		void logValues();
 		
-	private:
+	protected:
+		/**
+		 * The options the worker is configured by, see ModeDaemon::options()
+		 */
+		const ProgramOptions* _options;
 		unsigned long _pollingPeriod;
 		struct timespec _timeBeat;
 		LM50Device::ChIdx _chSize;
-		const ProgramOptions::ChList& _chIdx;
+		ProgramOptions::ChList _chIdx;
 		LM50Device::ChVal* _chValues;
+		
+		/**
+		 * The anomaly flags of the requested channels, see LM50Anomaly. An
+		 * invalid value is written as unknown to the RRD file and all flags
+		 * are written to the CSV records.
+		 */
+		unsigned char* _chFlags;
+		
+		/**
+		 * The buffer for the argument of rrd_update_r
+		 */
+		char* _rrdArg;
 		struct timespec _timeUpdate;
+		
+		/**
+		 * The column captions of the CSV records
+		 */
+		std::string _csvHeader;
+		
+		/**
+		 * The CSV archive, if enabled by program options
+		 */
+		LogSink _csv;
 };
 
 }
@@ -0,0 +1,91 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+#include <locale>
+
+namespace LM50 {
+namespace Bench {
+
+static u_int64_t now() {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return static_cast< u_int64_t >( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * @return The p-quantile (0 <= p <= 1) of the sorted samples using the
+ * nearest-rank method
+ */
+static u_int64_t quantile( const std::vector< u_int64_t >& sorted, double p ) {
+	if( sorted.empty() ) return 0;
+	size_t rank( static_cast< size_t >( p * sorted.size() + 0.999999 ) );
+	if( rank == 0 ) rank = 1;
+	if( rank > sorted.size() ) rank = sorted.size();
+	return sorted[ rank - 1 ];
+}
+
+
+Runner::Runner( unsigned long iterations, unsigned long warmup, std::ostream& out ) : \
+	_iterations( iterations ), \
+	_warmup( warmup ), \
+	_out( out ), \
+	_samples() {
+	// Reserve the memory for the samples up front, such that the measurement
+	// itself does not allocate memory
+	_samples.reserve( _iterations );
+}
+
+
+Result Runner::run( Benchmark& bench ) {
+	bench.setUp();
+	for( unsigned long i( 0 ); i < _warmup; ++i ) bench.operation();
+
+	_samples.clear();
+	const unsigned long allocsBefore( allocationCount() );
+	const u_int64_t start( now() );
+	for( unsigned long i( 0 ); i < _iterations; ++i ) {
+		const u_int64_t t0( now() );
+		bench.operation();
+		_samples.push_back( now() - t0 );
+	}
+	const u_int64_t stop( now() );
+	const unsigned long allocsAfter( allocationCount() );
+	bench.tearDown();
+
+	std::sort( _samples.begin(), _samples.end() );
+	Result res;
+	res.name = bench.name();
+	res.iterations = _iterations;
+	res.seconds = ( stop - start ) * 1e-9;
+	res.opsPerSecond = res.seconds > 0.0 ? _iterations / res.seconds : 0.0;
+	res.p50 = quantile( _samples, 0.5 );
+	res.p99 = quantile( _samples, 0.99 );
+	res.p999 = quantile( _samples, 0.999 );
+	res.max = _samples.empty() ? 0 : _samples.back();
+	res.allocsPerOp = _iterations ? static_cast< double >( allocsAfter - allocsBefore ) / _iterations : 0.0;
+	write( _out, res );
+	return res;
+}
+
+
+void Runner::write( std::ostream& out, const Result& res ) {
+	std::locale loc( out.imbue( std::locale( "C" ) ) );
+	out << std::fixed << std::setprecision( 6 );
+	out << "{\"benchmark\":\"" << res.name << '"';
+	out << ",\"iterations\":" << res.iterations;
+	out << ",\"seconds\":" << res.seconds;
+	out << ",\"ops_per_sec\":" << res.opsPerSecond;
+	out << ",\"p50_ns\":" << res.p50;
+	out << ",\"p99_ns\":" << res.p99;
+	out << ",\"p999_ns\":" << res.p999;
+	out << ",\"max_ns\":" << res.max;
+	out << ",\"allocs_per_op\":" << res.allocsPerOp;
+	out << '}' << std::endl;
+	out.imbue( loc );
+}
+
+}
+}
@@ -0,0 +1,113 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace LM50 {
+namespace Bench {
+
+/**
+ * @return The number of heap allocations (malloc, calloc, realloc, operator
+ * new) performed by the calling thread so far. See bench_alloc.cpp.
+ */
+unsigned long allocationCount();
+
+/**
+ * The base class of a single benchmark. The runner calls setUp() once, then
+ * operation() for the warm up and the measured iterations and finally
+ * tearDown(). Each call of operation() is timed individually.
+ */
+class Benchmark {
+	public:
+		Benchmark( const std::string& name ) : _name( name ) {}
+		virtual ~Benchmark() {}
+
+	public:
+		const std::string& name() const { return _name; }
+
+		virtual void setUp() {}
+
+		virtual void operation() = 0;
+
+		virtual void tearDown() {}
+
+		/**
+		 * @return True, if operation() exercises a path that must not allocate
+		 * heap memory after the warm up. See lm50bench --check-allocations.
+		 */
+		virtual bool allocationFree() const { return false; }
+
+	protected:
+		const std::string _name;
+};
+
+
+/**
+ * The outcome of one benchmark
+ */
+struct Result {
+	std::string name;
+	unsigned long iterations;
+	double seconds;
+	double opsPerSecond;
+	u_int64_t p50;   // nanoseconds
+	u_int64_t p99;   // nanoseconds
+	u_int64_t p999;  // nanoseconds
+	u_int64_t max;   // nanoseconds
+	double allocsPerOp;
+};
+
+
+/**
+ * Runs benchmarks and writes one JSON object per benchmark and line to the
+ * output stream, such that the results of two releases can be compared by
+ * a simple diff or script.
+ */
+class Runner {
+	public:
+		/**
+		 * @param iterations The number of measured calls of
+		 * Benchmark::operation()
+		 * @param warmup The number of calls before the measurement starts
+		 * @param out The stream to write the results to
+		 */
+		Runner( unsigned long iterations, unsigned long warmup, std::ostream& out );
+		virtual ~Runner() {}
+
+	public:
+		Result run( Benchmark& bench );
+
+		static void write( std::ostream& out, const Result& result );
+
+	protected:
+		const unsigned long _iterations;
+		const unsigned long _warmup;
+		std::ostream& _out;
+		std::vector< u_int64_t > _samples;
+};
+
+
+/**
+ * The benchmark suites. Each function appends new benchmark objects to the
+ * list, the caller takes the ownership.
+ */
+void addDatagramBenchmarks( std::vector< Benchmark* >& list );
+void addDeviceBenchmarks( std::vector< Benchmark* >& list );
+void addDaemonBenchmarks( std::vector< Benchmark* >& list );
+void addFormatBenchmarks( std::vector< Benchmark* >& list );
+
+/**
+ * Appends benchmarks that replay a recorded trace instead of talking to a
+ * device stand-in.
+ * @param trace The path of the trace file, see ModBus::TraceRecorder
+ * @param realTime If true, the recorded response times are reproduced
+ */
+void addReplayBenchmarks( std::vector< Benchmark* >& list, const std::string& trace, bool realTime );
+
+}
+}
+
+#endif
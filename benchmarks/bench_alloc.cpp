@@ -0,0 +1,66 @@
+#include "bench.h"
+
+#include <cstddef>
+
+/**
+ * Counts the heap allocations of each thread by replacing the allocation
+ * functions of the C library. The replacements forward to the glibc internal
+ * implementations. operator new uses malloc internally, hence C++
+ * allocations are counted, too. The counter is thread local, such that the
+ * allocations of a device stand-in running in another thread do not distort
+ * the numbers of the thread under test.
+ */
+
+extern "C" {
+	void* __libc_malloc( size_t size );
+	void* __libc_calloc( size_t n, size_t size );
+	void* __libc_realloc( void* ptr, size_t size );
+	void* __libc_memalign( size_t alignment, size_t size );
+	void __libc_free( void* ptr );
+}
+
+static __thread unsigned long tlsAllocations = 0;
+
+extern "C" {
+
+void* malloc( size_t size ) {
+	++tlsAllocations;
+	return __libc_malloc( size );
+}
+
+void* calloc( size_t n, size_t size ) {
+	++tlsAllocations;
+	return __libc_calloc( n, size );
+}
+
+void* realloc( void* ptr, size_t size ) {
+	++tlsAllocations;
+	return __libc_realloc( ptr, size );
+}
+
+void* memalign( size_t alignment, size_t size ) {
+	++tlsAllocations;
+	return __libc_memalign( alignment, size );
+}
+
+int posix_memalign( void** ptr, size_t alignment, size_t size ) {
+	++tlsAllocations;
+	*ptr = __libc_memalign( alignment, size );
+	return *ptr ? 0 : 12; // ENOMEM
+}
+
+void free( void* ptr ) {
+	__libc_free( ptr );
+}
+
+}
+
+namespace LM50 {
+namespace Bench {
+
+unsigned long allocationCount() {
+	return tlsAllocations;
+}
+
+}
+}
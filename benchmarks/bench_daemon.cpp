@@ -0,0 +1,180 @@
+#include "bench.h"
+#include "bench_standin.h"
+
+#include "apps/lm50client.h"
+#include "apps/mode_daemon.h"
+#include "apps/worker_rrd.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <rrd.h>
+
+namespace LM50 {
+namespace Bench {
+
+/**
+ * The daemon mode without forking and signal handling. It only connects to
+ * the device such that workers can be driven manually.
+ */
+class BenchDaemon : public ModeDaemon {
+	public:
+		BenchDaemon( const LM50ClientApp& app ) : ModeDaemon( app ) {}
+
+	public:
+		void prepare() {
+			init();
+			_isCancelled = false;
+		}
+
+		void finish() {
+			_isCancelled = true;
+			deinit();
+		}
+};
+
+
+/**
+ * The RRD worker without its own thread and without sleeping until the next
+ * beat
+ */
+class BenchWorkerRrd : public WorkerRrd {
+	public:
+		BenchWorkerRrd( ModeDaemon& parent ) : WorkerRrd( parent ), _timeStart( 0 ), _beats( 0 ) {}
+
+	public:
+		/**
+		 * Executes exactly the steps of one loop of WorkerRrd::run() but the
+		 * sleep. The time stamp of the update is replaced by a synthetic one
+		 * that advances by one second per beat, because RRDTool refuses
+		 * updates that are not strictly monotonic.
+		 */
+		void beat() {
+			obtainValues();
+			_timeUpdate.tv_sec = _timeStart + ( ++_beats );
+			_timeUpdate.tv_nsec = 0;
+			updateRRD();
+		}
+
+		/**
+		 * Executes the steps of one beat that are under control of the daemon,
+		 * i.e. the poll, the decoding, the CSV record and the formatting of the
+		 * RRD update, but not rrd_update_r itself, which allocates memory
+		 * inside librrd on each call.
+		 */
+		void poll() {
+			obtainValues();
+			logValues();
+			formatRRD();
+		}
+
+		void timeStart( time_t t ) { _timeStart = t; }
+
+		virtual int run() { return 0; }
+
+	protected:
+		time_t _timeStart;
+		time_t _beats;
+};
+
+
+/**
+ * One beat of the daemon, i.e. the poll of the device by the RRD worker and
+ * the update of a RRD file in a temporary directory.
+ *
+ * As "daemon.poll" only the part of the beat that is supposed to be
+ * allocation-free is executed, see BenchWorkerRrd::poll(). In that case the
+ * worker additionally archives the records to a CSV file. Both include the
+ * derivation of power and energy and a balance check.
+ */
+class DaemonBeat : public Benchmark {
+	public:
+		DaemonBeat( bool pollOnly ) : Benchmark( pollOnly ? "daemon.poll" : "daemon.beat" ), _pollOnly( pollOnly ), _stand(), _dir(), _file(), _csvFile(), _app( nullptr ), _daemon(), _worker() {}
+
+		virtual bool allocationFree() const { return _pollOnly; }
+
+		virtual void setUp() {
+			_stand.reset( new LoopbackDevice() );
+
+			char dir[] = "/tmp/lm50bench.XXXXXX";
+			if( !mkdtemp( dir ) ) throw std::runtime_error( "Could not create temporary directory" );
+			_dir = dir;
+			_file = _dir + "/bench.rrd";
+			_csvFile = _dir + "/bench.csv";
+
+			time_t t0( time( NULL ) );
+			createRRD( t0 );
+
+			std::string port( _stand->port() );
+			const char* argv[] = { "lm50bench", "--host", _stand->host().c_str(), "--port", port.c_str(), "--mode", "daemon", "--workers", "rrd", "--balance", "10:11 12 17", "--rrd.file", _file.c_str(), "--rrd.csv", _csvFile.c_str() };
+			const int argc( sizeof( argv ) / sizeof( argv[0] ) );
+			ProgramOptions po;
+			po.parse( _pollOnly ? argc : argc - 2, const_cast< char** >( argv ) );
+			_app = &LM50ClientApp::create( po );
+
+			_daemon.reset( new BenchDaemon( *_app ) );
+			_daemon->prepare();
+			_worker.reset( new BenchWorkerRrd( *_daemon ) );
+			_worker->timeStart( t0 );
+			rrd_get_context();
+		}
+
+		virtual void operation() {
+			if( _pollOnly ) _worker->poll();
+			else _worker->beat();
+		}
+
+		virtual void tearDown() {
+			_worker.reset();
+			_daemon->finish();
+			_daemon.reset();
+			_app->destroy();
+			_app = nullptr;
+			_stand.reset();
+			unlink( _file.c_str() );
+			unlink( _csvFile.c_str() );
+			rmdir( _dir.c_str() );
+		}
+
+	protected:
+		/**
+		 * Creates a RRD file with one counter per channel and a single archive
+		 * with a step size of one second
+		 */
+		void createRRD( time_t t0 ) {
+			std::vector< std::string > args;
+			for( LM50Device::ChIdx ch( 0 ); ch != LM50Device::countChannels; ++ch ) {
+				std::ostringstream ds;
+				ds << "DS:ch" << ( ch + 1 ) << ":COUNTER:120:U:U";
+				args.push_back( ds.str() );
+			}
+			args.push_back( "RRA:AVERAGE:0.5:1:1000" );
+			std::vector< const char* > argv;
+			for( size_t i( 0 ); i != args.size(); ++i ) argv.push_back( args[i].c_str() );
+
+			rrd_clear_error();
+			if( rrd_create_r( _file.c_str(), 1, t0, argv.size(), &argv[0] ) ) throw std::runtime_error( rrd_get_error() );
+		}
+
+	protected:
+		const bool _pollOnly;
+		boost::scoped_ptr< LoopbackDevice > _stand;
+		std::string _dir;
+		std::string _file;
+		std::string _csvFile;
+		LM50ClientApp* _app;
+		boost::scoped_ptr< BenchDaemon > _daemon;
+		boost::scoped_ptr< BenchWorkerRrd > _worker;
+};
+
+
+void addDaemonBenchmarks( std::vector< Benchmark* >& list ) {
+	list.push_back( new DaemonBeat( false ) );
+	list.push_back( new DaemonBeat( true ) );
+}
+
+}
+}
@@ -0,0 +1,149 @@
+#include "bench.h"
+
+#include "lib/modbus.h"
+#include "core/lm50device.h"
+
+#include <boost/scoped_ptr.hpp>
+
+namespace LM50 {
+namespace Bench {
+
+using namespace ModBus;
+
+/**
+ * The reply of the LM50TCP+ to a poll of all 50 channels. Used as input for
+ * the parser benchmarks.
+ */
+static void fillChannelReply( std::vector< char >& raw ) {
+	char values[ 200 ];
+	for( size_t i( 0 ); i < sizeof( values ); ++i ) values[i] = static_cast< char >( i * 7 );
+	Datagram::ReadInputRegistersRes res( 42, LM50Device::_unitId, values, sizeof( values ) );
+	raw.assign( res.rawDatagram(), res.rawDatagram() + res.totalLength() );
+}
+
+
+/**
+ * Builds the request that polls all channels
+ */
+class DatagramBuild : public Benchmark {
+	public:
+		DatagramBuild() : Benchmark( "datagram.build" ), _tid( 0 ) {}
+
+		virtual void operation() {
+			Datagram::ReadInputRegistersReq req( ++_tid, LM50Device::_unitId, LM50Device::_hwAddrChannels, LM50Device::_hwLengthChannels );
+			_sink += req.totalLength();
+		}
+
+	protected:
+		Datagram::TransactionID _tid;
+		volatile size_t _sink;
+};
+
+
+/**
+ * Parses the raw reply into a datagram object by the generic factory
+ */
+class DatagramParse : public Benchmark {
+	public:
+		DatagramParse() : Benchmark( "datagram.parse" ), _raw() {}
+
+		virtual void setUp() { fillChannelReply( _raw ); }
+
+		virtual void operation() {
+			boost::scoped_ptr< Datagram::Base > res( Datagram::Base::createObject( &_raw[0], _raw.size() ) );
+			_sink += res->length();
+		}
+
+	protected:
+		std::vector< char > _raw;
+		volatile size_t _sink;
+};
+
+
+/**
+ * Decodes the 50 counters of a parsed reply by the UInt32 interpreter
+ */
+class DatagramUInt32 : public Benchmark {
+	public:
+		DatagramUInt32() : Benchmark( "datagram.uint32" ), _raw(), _res() {}
+
+		virtual void setUp() {
+			fillChannelReply( _raw );
+			_res.reset( new Datagram::ReadInputRegistersRes( &_raw[0], _raw.size() ) );
+		}
+
+		virtual void operation() {
+			Interpreter::UInt32< Datagram::ReadInputRegistersRes > chs( *_res );
+			for( size_t j( 0 ); j < chs.size(); ++j ) _values[j] = chs.value( j );
+		}
+
+		virtual void tearDown() { _res.reset(); }
+
+	protected:
+		std::vector< char > _raw;
+		boost::scoped_ptr< Datagram::ReadInputRegistersRes > _res;
+		volatile u_int32_t _values[ 50 ];
+};
+
+
+/**
+ * Decodes the 50 counters of the raw reply by the Registers view, i.e. the
+ * way LM50Device does it
+ */
+class RegistersUInt32 : public Benchmark {
+	public:
+		RegistersUInt32() : Benchmark( "registers.uint32" ), _raw() {}
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void setUp() { fillChannelReply( _raw ); }
+
+		virtual void operation() {
+			Registers regs( 42, &_raw[9], 100 );
+			regs.uint32Array( _values );
+			_sink += _values[49];
+		}
+
+	protected:
+		std::vector< char > _raw;
+		u_int32_t _values[ 50 ];
+		volatile u_int32_t _sink;
+};
+
+
+/**
+ * Converts the raw reply into a RTU frame and back, i.e. computes and checks
+ * the CRC of 205 bytes twice, the way RtuCommunication does it
+ */
+class RtuFrame : public Benchmark {
+	public:
+		RtuFrame() : Benchmark( "rtu.frame" ), _raw() {}
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void setUp() { fillChannelReply( _raw ); }
+
+		virtual void operation() {
+			const size_t n( Rtu::fromTcp( &_raw[0], _raw.size(), _frame ) );
+			boost::system::error_code ec;
+			_sink += Rtu::toTcp( _frame, n, 42, _datagram, ec );
+		}
+
+	protected:
+		std::vector< char > _raw;
+		char _frame[ Rtu::maxFrameLength ];
+		char _datagram[ Datagram::Base::maxDatagramLength ];
+		volatile size_t _sink;
+};
+
+
+void addDatagramBenchmarks( std::vector< Benchmark* >& list ) {
+	list.push_back( new DatagramBuild() );
+	list.push_back( new DatagramParse() );
+	list.push_back( new DatagramUInt32() );
+	list.push_back( new RegistersUInt32() );
+	list.push_back( new RtuFrame() );
+}
+
+}
+}
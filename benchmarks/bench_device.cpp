@@ -0,0 +1,377 @@
+#include "bench.h"
+#include "bench_standin.h"
+
+#include "lib/modbus.h"
+#include "core/lm50device.h"
+#include "core/lm50energy.h"
+#include "core/lm50anomaly.h"
+#include "core/lm50rollup.h"
+
+#include <boost/scoped_ptr.hpp>
+#include <algorithm>
+
+namespace LM50 {
+namespace Bench {
+
+using namespace ModBus;
+
+/**
+ * One request/reply cycle of TcpRequestAndReply::run() over the loopback
+ * interface, i.e. the poll of all channels without any decoding
+ */
+class TcpRoundTrip : public Benchmark {
+	public:
+		TcpRoundTrip() : Benchmark( "tcp.roundtrip" ), _stand(), _service(), _socket( _service ), _rar(), _tid( 0 ) {}
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void setUp() {
+			_stand.reset( new LoopbackDevice() );
+			boost::asio::ip::tcp::resolver resolver( _service );
+			boost::asio::ip::tcp::resolver::query query( _stand->host(), _stand->port() );
+			boost::asio::connect( _socket, resolver.resolve( query ) );
+			_rar.reset( new TcpRequestAndReply( _service, _socket ) );
+		}
+
+		virtual void operation() {
+			_rar->readRegistersRequest( Function::ReadInputRegisters, ++_tid, LM50Device::_unitId, LM50Device::_hwAddrChannels, LM50Device::_hwLengthChannels );
+			boost::system::error_code ec;
+			_rar->run( ec );
+			if( ec ) throw boost::system::system_error( ec, "Round trip failed" );
+		}
+
+		virtual void tearDown() {
+			_rar.reset();
+			boost::system::error_code ec;
+			_socket.close( ec );
+			_stand.reset();
+		}
+
+	protected:
+		boost::scoped_ptr< LoopbackDevice > _stand;
+		boost::asio::io_service _service;
+		boost::asio::ip::tcp::socket _socket;
+		boost::scoped_ptr< TcpRequestAndReply > _rar;
+		Datagram::TransactionID _tid;
+};
+
+
+/**
+ * The poll of all channels by ModBus::UdpCommunication over the loopback
+ * interface including the decoding of the registers. Compare with
+ * tcp.roundtrip, which does not decode.
+ */
+class UdpRoundTrip : public Benchmark {
+	public:
+		UdpRoundTrip() : Benchmark( "udp.roundtrip" ), _stand(), _udp(), _tid( 0 ) {}
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void setUp() {
+			_stand.reset( new UdpLoopbackDevice() );
+			boost::system::error_code ec;
+			_udp.open( _stand->host(), _stand->port(), ec );
+			if( ec ) throw boost::system::system_error( ec, "Could not open UDP socket" );
+		}
+
+		virtual void operation() {
+			boost::system::error_code ec;
+			_udp.readInputRegisters( ++_tid, LM50Device::_unitId, LM50Device::_hwAddrChannels, LM50Device::_hwLengthChannels, ec );
+			if( ec ) throw boost::system::system_error( ec, "Round trip failed" );
+		}
+
+		virtual void tearDown() {
+			_udp.close();
+			_stand.reset();
+		}
+
+	protected:
+		boost::scoped_ptr< UdpLoopbackDevice > _stand;
+		UdpCommunication _udp;
+		Datagram::TransactionID _tid;
+};
+
+
+/**
+ * A complete update of the device object including the decoding of all
+ * channels
+ */
+class DeviceUpdate : public Benchmark {
+	public:
+		DeviceUpdate() : Benchmark( "device.update" ), _stand(), _dev() {}
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void setUp() {
+			_stand.reset( new LoopbackDevice() );
+			_dev.reset( new LM50Device( _stand->host(), _stand->port() ) );
+			_dev->connect();
+		}
+
+		virtual void operation() {
+			_dev->updateVolatileValues();
+		}
+
+		virtual void tearDown() {
+			_dev->disconnect();
+			_dev.reset();
+			_stand.reset();
+		}
+
+	protected:
+		boost::scoped_ptr< LoopbackDevice > _stand;
+		boost::scoped_ptr< LM50Device > _dev;
+};
+
+
+/**
+ * An update of several devices behind one gateway connection, see
+ * ModBus::TcpGatewaySession. The virtual device answers every unit id. With
+ * more than one request in flight the requests are pipelined.
+ */
+class GatewayPoll : public Benchmark {
+	public:
+		GatewayPoll( const char* name, unsigned int inFlight ) : Benchmark( name ), _stand(), _gateway(), _devs(), _inFlight( inFlight ) {}
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void setUp() {
+			_stand.reset( new LoopbackDevice() );
+			_gateway.reset( new TcpGatewaySession() );
+			_gateway->maxInFlight( _inFlight );
+			_gateway->open( _stand->host(), _stand->port() );
+			for( LM50Device::UnitId unit( 1 ); unit <= countDevices; ++unit ) _devs.push_back( new LM50Device( *_gateway, unit ) );
+		}
+
+		virtual void operation() {
+			for( std::vector< LM50Device* >::iterator d( _devs.begin() ); d != _devs.end(); ++d ) ( *d )->submitUpdate();
+			boost::system::error_code ec;
+			_gateway->run( ec );
+			for( std::vector< LM50Device* >::iterator d( _devs.begin() ); d != _devs.end(); ++d ) {
+				( *d )->completeUpdate( ec );
+				if( ec ) throw boost::system::system_error( ec, "Gateway poll failed" );
+			}
+		}
+
+		virtual void tearDown() {
+			for( std::vector< LM50Device* >::iterator d( _devs.begin() ); d != _devs.end(); ++d ) delete *d;
+			_devs.clear();
+			_gateway.reset();
+			_stand.reset();
+		}
+
+	protected:
+		static const LM50Device::UnitId countDevices = 8;
+
+		boost::scoped_ptr< LoopbackDevice > _stand;
+		boost::scoped_ptr< TcpGatewaySession > _gateway;
+		std::vector< LM50Device* > _devs;
+		const unsigned int _inFlight;
+};
+
+
+/**
+ * The derivation of power and energy of all channels from a new set of
+ * counters, i.e. the stage that follows each device update in the daemon
+ */
+class EnergyUpdate : public Benchmark {
+	public:
+		EnergyUpdate() : Benchmark( "energy.update" ), _energy(), _counters( new LM50Device::ChVal[ LM50Device::countChannels ] ), _time() {
+			for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) _counters[ i ] = static_cast< LM50Device::ChVal >( 1000 + i * 987654 );
+			_time.tv_sec = 1456833600;
+		}
+
+		virtual ~EnergyUpdate() { delete[] _counters; }
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void operation() {
+			// One second and a few pulses per channel from one update to the next
+			++_time.tv_sec;
+			for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) _counters[ i ] += i % 7;
+			_energy.update( _counters, _time );
+		}
+
+	protected:
+		LM50Energy _energy;
+		LM50Device::ChVal* _counters;
+		struct timespec _time;
+};
+
+
+/**
+ * The comparison of two consecutive snapshots, see LM50Device::diff. Every
+ * round a few channels change.
+ */
+class SnapshotDiff : public Benchmark {
+	public:
+		SnapshotDiff() : Benchmark( "snapshot.diff" ), _a( new LM50Device::ChVal[ LM50Device::countChannels ] ), _b( new LM50Device::ChVal[ LM50Device::countChannels ] ), _round( 0 ), _mask( 0 ) {
+			for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) _a[ i ] = _b[ i ] = static_cast< LM50Device::ChVal >( 1000 + i * 987654 );
+		}
+
+		virtual ~SnapshotDiff() { delete[] _a; delete[] _b; }
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void operation() {
+			++_round;
+			std::swap( _a, _b );
+			_a[ _round % LM50Device::countChannels ] += 1;
+			_a[ ( _round * 7 ) % LM50Device::countChannels ] += 1;
+			_mask ^= LM50Device::diff( _a, _b, LM50Device::countChannels );
+		}
+
+	protected:
+		LM50Device::ChVal* _a;
+		LM50Device::ChVal* _b;
+		unsigned int _round;
+		u_int64_t _mask;
+};
+
+
+/**
+ * The anomaly checks of all channels for a new set of counters. Every few
+ * updates a channel jumps, such that the flagged path is measured, too.
+ */
+class AnomalyUpdate : public Benchmark {
+	public:
+		AnomalyUpdate() : Benchmark( "anomaly.update" ), _anomaly(), _counters( new LM50Device::ChVal[ LM50Device::countChannels ] ), _time(), _round( 0 ) {
+			for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) _counters[ i ] = static_cast< LM50Device::ChVal >( 1000 + i * 987654 );
+			_time.tv_sec = 1456833600;
+		}
+
+		virtual ~AnomalyUpdate() { delete[] _counters; }
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void operation() {
+			++_time.tv_sec;
+			++_round;
+			for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) _counters[ i ] += i % 7;
+			_counters[ _round % LM50Device::countChannels ] += ( _round % 16 == 0 ) ? 100000 : 0;
+			_anomaly.update( _counters, _time );
+		}
+
+	protected:
+		LM50Anomaly _anomaly;
+		LM50Device::ChVal* _counters;
+		struct timespec _time;
+		unsigned int _round;
+};
+
+
+/**
+ * The consolidation of the power of all channels into the rings of all
+ * levels, i.e. the stage that follows the energy update in the daemon
+ */
+class RollupUpdate : public Benchmark {
+	public:
+		RollupUpdate() : Benchmark( "rollup.update" ), _rollup(), _power( new double[ LM50Device::countChannels ] ), _time() {
+			for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) _power[ i ] = 100.0 * i;
+			_time.tv_sec = 1456833600;
+		}
+
+		virtual ~RollupUpdate() { delete[] _power; }
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void operation() {
+			++_time.tv_sec;
+			for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) _power[ i ] += ( _time.tv_sec % 3 ) - 1.0;
+			_rollup.update( _power, _time );
+		}
+
+	protected:
+		LM50Rollup _rollup;
+		double* _power;
+		struct timespec _time;
+};
+
+
+/**
+ * A query of the last hour of one channel at a resolution of one second,
+ * i.e. the largest answer of the control socket and the http worker
+ */
+class RollupFetch : public Benchmark {
+	public:
+		RollupFetch() : Benchmark( "rollup.fetch" ), _rollup(), _buckets( new LM50Rollup::Bucket[ LM50Rollup::length( LM50Rollup::SECOND ) ] ), _time( 1456833600 ), _count( 0 ) {
+			std::vector< double > power( LM50Device::countChannels );
+			struct timespec t = { 0, 0 };
+			for( int s( 0 ); s != 2 * 3600; ++s ) {
+				for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) power[ i ] = 100.0 * i + s % 17;
+				t.tv_sec = _time - 2 * 3600 + s + 1;
+				_rollup.update( &power[0], t );
+			}
+		}
+
+		virtual ~RollupFetch() { delete[] _buckets; }
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void operation() {
+			_count += _rollup.fetch( LM50Rollup::SECOND, 20, _time - 3600, _time, _buckets, LM50Rollup::length( LM50Rollup::SECOND ) );
+		}
+
+	protected:
+		LM50Rollup _rollup;
+		LM50Rollup::Bucket* _buckets;
+		time_t _time;
+		size_t _count;
+};
+
+
+/**
+ * A complete update of the device object, but the replies are taken from a
+ * recorded trace. The trace is replayed in a loop. Errors that have been
+ * recorded are part of the traffic and hence are not reported.
+ */
+class ReplayUpdate : public Benchmark {
+	public:
+		ReplayUpdate( const std::string& trace, bool realTime ) : Benchmark( "replay.update" ), _trace( trace ), _realTime( realTime ), _replay(), _dev() {}
+
+		virtual void setUp() {
+			_replay.load( _trace );
+			_replay.loop( true );
+			_replay.realTime( _realTime );
+			_dev.reset( new LM50Device() );
+			_dev->replay( &_replay );
+			_dev->connect();
+		}
+
+		virtual void operation() {
+			boost::system::error_code ec;
+			_dev->updateVolatileValues( ec );
+			if( ec == Error::TraceMismatch ) throw boost::system::system_error( ec, "Replay failed" );
+		}
+
+		virtual void tearDown() {
+			_dev.reset();
+		}
+
+	protected:
+		const std::string _trace;
+		const bool _realTime;
+		TraceReplay _replay;
+		boost::scoped_ptr< LM50Device > _dev;
+};
+
+
+void addDeviceBenchmarks( std::vector< Benchmark* >& list ) {
+	list.push_back( new TcpRoundTrip() );
+	list.push_back( new UdpRoundTrip() );
+	list.push_back( new DeviceUpdate() );
+	list.push_back( new GatewayPoll( "gateway.poll", 1 ) );
+	list.push_back( new GatewayPoll( "gateway.pipelined", 4 ) );
+	list.push_back( new SnapshotDiff() );
+	list.push_back( new EnergyUpdate() );
+	list.push_back( new AnomalyUpdate() );
+	list.push_back( new RollupUpdate() );
+	list.push_back( new RollupFetch() );
+}
+
+void addReplayBenchmarks( std::vector< Benchmark* >& list, const std::string& trace, bool realTime ) {
+	list.push_back( new ReplayUpdate( trace, realTime ) );
+}
+
+}
+}
@@ -0,0 +1,145 @@
+#include "bench.h"
+
+#include "apps/format.h"
+
+#include <iomanip>
+#include <locale>
+#include <sstream>
+
+namespace LM50 {
+namespace Bench {
+
+/**
+ * The number of channels of the formatted records, i.e. all channels of
+ * the LM50TCP+
+ */
+static const size_t channelCount = 50;
+
+/**
+ * Common base of the formatting benchmarks. Provides channel values of
+ * typical magnitude and a fixed time stamp.
+ */
+class FormatBenchmark : public Benchmark {
+	public:
+		FormatBenchmark( const std::string& name ) : Benchmark( name ), _time(), _sink( 0 ) {
+			for( size_t i( 0 ); i != channelCount; ++i ) _values[ i ] = static_cast< unsigned int >( 1000 + i * 987654 );
+			_time.tv_sec = 1456833600;
+			_time.tv_nsec = 123456789;
+		}
+
+	protected:
+		unsigned int _values[ channelCount ];
+		struct timespec _time;
+		volatile size_t _sink;
+};
+
+
+/**
+ * The argument of rrd_update_r as built by WorkerRrd::updateRRD
+ */
+class FormatRrd : public FormatBenchmark {
+	public:
+		FormatRrd() : FormatBenchmark( "format.rrd" ) {}
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void operation() {
+			char* p( Format::appendInt( _buf, _time.tv_sec ) );
+			for( size_t i( 0 ); i != channelCount; ++i ) {
+				*p++ = ':';
+				p = Format::appendUInt( p, _values[ i ] );
+			}
+			*p = '\0';
+			_sink += p - _buf;
+		}
+
+	protected:
+		char _buf[ ( channelCount + 1 ) * ( Format::maxIntLength + 1 ) ];
+};
+
+
+/**
+ * The argument of rrd_update_r as it has been built by an imbued
+ * std::ostringstream before
+ */
+class IostreamRrd : public FormatBenchmark {
+	public:
+		IostreamRrd() : FormatBenchmark( "iostream.rrd" ) {}
+
+		virtual void operation() {
+			std::ostringstream os;
+			os.imbue( std::locale( "C" ) );
+			os << _time.tv_sec;
+			for( size_t i( 0 ); i != channelCount; ++i ) os << ':' << _values[ i ];
+			std::string arg( os.str() );
+			_sink += arg.size();
+		}
+};
+
+
+/**
+ * A CSV record as written by WorkerRrd::logValues
+ */
+class FormatCsv : public FormatBenchmark {
+	public:
+		FormatCsv() : FormatBenchmark( "format.csv" ) {}
+
+		virtual bool allocationFree() const { return true; }
+
+		virtual void operation() {
+			char* p( _buf );
+			*p++ = '"';
+			p = Format::appendTime( p, _time );
+			*p++ = '"';
+			*p++ = ';';
+			for( size_t i( 0 ); i != channelCount; ++i ) {
+				p = Format::appendUInt( p, _values[ i ], 12, ' ' );
+				*p++ = ';';
+			}
+			_sink += p - _buf;
+		}
+
+	protected:
+		char _buf[ Format::timeLength + 3 + channelCount * 13 ];
+};
+
+
+/**
+ * A CSV record as it has been written by the stream operators, which
+ * imbued the C locale on each call
+ */
+class IostreamCsv : public FormatBenchmark {
+	public:
+		IostreamCsv() : FormatBenchmark( "iostream.csv" ) {}
+
+		virtual void operation() {
+			std::ostringstream os;
+			struct tm t;
+			gmtime_r( &(_time.tv_sec), &t );
+			char fc( os.fill( '0' ) );
+			std::locale loc( os.imbue( std::locale( "C" ) ) );
+			os << '"' << (1900 + t.tm_year) << '-';
+			os << std::setw( 2 ) << (1 + t.tm_mon) << '-';
+			os << std::setw( 2 ) << t.tm_mday << 'T';
+			os << std::setw( 2 ) << t.tm_hour << ':';
+			os << std::setw( 2 ) << t.tm_min << ':';
+			os << std::setw( 2 ) << t.tm_sec << '.';
+			os << std::setw( 9 ) << _time.tv_nsec << "Z\";";
+			os.fill( fc );
+			os.imbue( loc );
+			for( size_t i( 0 ); i != channelCount; ++i ) os << std::setw( 12 ) << _values[ i ] << ';';
+			std::string line( os.str() );
+			_sink += line.size();
+		}
+};
+
+
+void addFormatBenchmarks( std::vector< Benchmark* >& list ) {
+	list.push_back( new FormatRrd() );
+	list.push_back( new IostreamRrd() );
+	list.push_back( new FormatCsv() );
+	list.push_back( new IostreamCsv() );
+}
+
+}
+}
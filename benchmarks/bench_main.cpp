@@ -0,0 +1,84 @@
+#include "bench.h"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * lm50bench - Micro and end-to-end benchmarks of the hot paths
+ *
+ * The program runs each benchmark whose name contains the filter string and
+ * writes one JSON object per line to standard output, e.g.
+ *
+ *   {"benchmark":"device.update","iterations":10000,...,"allocs_per_op":4.000}
+ *
+ * Benchmarks that need a device run against a virtual LM50TCP+ on the
+ * loopback interface, hence no hardware is required. Optionally, traffic that
+ * has been recorded from a real device is replayed.
+ *
+ * With --check-allocations the program exits with a non-zero code, if any
+ * benchmark of a path that is supposed to be allocation-free (e.g. the
+ * steady-state poll of the daemon) allocated heap memory after the warm up.
+ */
+
+namespace po = boost::program_options;
+using std::string;
+
+int main( int argc, char* argv[] ) {
+	std::vector< LM50::Bench::Benchmark* > benchmarks;
+	int ret( 0 );
+	try {
+		unsigned long iterations( 10000 );
+		unsigned long warmup( 100 );
+		string filter;
+		string replay;
+
+		po::options_description options( "lm50bench options" );
+		options.add_options()
+			( "help", "Prints this help message and exits." )
+			( "iterations,n", po::value< unsigned long >( &iterations )->default_value( iterations ), "The number of measured iterations per benchmark." )
+			( "warmup,w", po::value< unsigned long >( &warmup )->default_value( warmup ), "The number of iterations before the measurement starts." )
+			( "filter,f", po::value< string >( &filter )->default_value( "" ), "Only runs benchmarks whose name contains the given string." )
+			( "list,l", "Lists the names of all benchmarks and exits." )
+			( "replay", po::value< string >( &replay ), "Additionally runs the replay benchmarks with the given trace file, e.g. recorded by \"lm50client --trace\"." )
+			( "replay-realtime", "Reproduces the response times of the recorded device. By default the trace is replayed as fast as possible." )
+			( "check-allocations", "Fails, if a benchmark of an allocation-free path allocates heap memory after the warm up." );
+
+		po::variables_map vmap;
+		po::store( po::parse_command_line( argc, argv, options ), vmap );
+		po::notify( vmap );
+		if( vmap.count( "help" ) ) {
+			options.print( std::cout );
+			return 0;
+		}
+
+		LM50::Bench::addDatagramBenchmarks( benchmarks );
+		LM50::Bench::addDeviceBenchmarks( benchmarks );
+		LM50::Bench::addDaemonBenchmarks( benchmarks );
+		LM50::Bench::addFormatBenchmarks( benchmarks );
+		if( !replay.empty() ) LM50::Bench::addReplayBenchmarks( benchmarks, replay, vmap.count( "replay-realtime" ) != 0 );
+
+		LM50::Bench::Runner runner( iterations, warmup, std::cout );
+		std::vector< LM50::Bench::Benchmark* >::iterator i( benchmarks.begin() );
+		for( ; i != benchmarks.end(); ++i ) {
+			if( (*i)->name().find( filter ) == string::npos ) continue;
+			if( vmap.count( "list" ) ) {
+				std::cout << (*i)->name() << std::endl;
+				continue;
+			}
+			LM50::Bench::Result res( runner.run( **i ) );
+			if( vmap.count( "check-allocations" ) && (*i)->allocationFree() && res.allocsPerOp != 0.0 ) {
+				std::cerr << "Error: " << res.name << " allocated " << res.allocsPerOp << " times per iteration" << std::endl;
+				ret = 1;
+			}
+		}
+	} catch ( std::exception& e ) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		ret = -1;
+	}
+
+	std::vector< LM50::Bench::Benchmark* >::iterator i( benchmarks.begin() );
+	for( ; i != benchmarks.end(); ++i ) delete *i;
+	return ret;
+}
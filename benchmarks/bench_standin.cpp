@@ -0,0 +1,106 @@
+#include "bench_standin.h"
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace LM50 {
+namespace Bench {
+
+LoopbackDevice::LoopbackDevice() : \
+	_service(), \
+	_work( _service ), \
+	_profile(), \
+	_device( _profile, 4711, 1 ), \
+	_server( _service, boost::asio::ip::tcp::endpoint( boost::asio::ip::address_v4::loopback(), 0 ), _device ), \
+	_host( "127.0.0.1" ), \
+	_port(), \
+	_thread() {
+	std::ostringstream port;
+	port << _server.localEndpoint().port();
+	_port = port.str();
+	if( pthread_create( &_thread, NULL, main, this ) ) throw std::runtime_error( "Could not start device stand-in" );
+}
+
+
+LoopbackDevice::~LoopbackDevice() {
+	_service.stop();
+	pthread_join( _thread, NULL );
+}
+
+
+void* LoopbackDevice::main( void* me ) {
+	static_cast< LoopbackDevice* >( me )->_service.run();
+	return NULL;
+}
+
+
+
+UdpLoopbackDevice::UdpLoopbackDevice() : \
+	_profile(), \
+	_device( _profile, 4711, 1 ), \
+	_socket( socket( AF_INET, SOCK_DGRAM, 0 ) ), \
+	_isStopped( false ), \
+	_host( "127.0.0.1" ), \
+	_port(), \
+	_thread() {
+	struct sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	socklen_t length( sizeof( addr ) );
+	if( _socket < 0 || bind( _socket, reinterpret_cast< struct sockaddr* >( &addr ), length ) < 0 || getsockname( _socket, reinterpret_cast< struct sockaddr* >( &addr ), &length ) < 0 ) {
+		throw std::runtime_error( "Could not bind device stand-in" );
+	}
+	std::ostringstream port;
+	port << ntohs( addr.sin_port );
+	_port = port.str();
+	if( pthread_create( &_thread, NULL, main, this ) ) throw std::runtime_error( "Could not start device stand-in" );
+}
+
+
+UdpLoopbackDevice::~UdpLoopbackDevice() {
+	_isStopped = true;
+	pthread_join( _thread, NULL );
+	close( _socket );
+}
+
+
+void* UdpLoopbackDevice::main( void* me ) {
+	static_cast< UdpLoopbackDevice* >( me )->serve();
+	return NULL;
+}
+
+
+void UdpLoopbackDevice::serve() {
+	char request[ ModBus::Datagram::Base::maxDatagramLength ];
+	char reply[ ModBus::Datagram::Base::maxDatagramLength ];
+	const size_t length( 9 + 2 * LM50Device::_hwLengthChannels );
+	while( !_isStopped ) {
+		struct pollfd pfd = { _socket, POLLIN, 0 };
+		if( poll( &pfd, 1, 100 ) <= 0 ) continue;
+		struct sockaddr_in sender;
+		socklen_t senderLength( sizeof( sender ) );
+		const ssize_t n( recvfrom( _socket, request, sizeof( request ), 0, reinterpret_cast< struct sockaddr* >( &sender ), &senderLength ) );
+		if( n != 12 || request[7] != ModBus::Function::ReadInputRegisters ) continue;
+		// Transaction id, protocol id and unit id are echoed
+		memcpy( reply, request, 7 );
+		reply[4] = 0x00;
+		reply[5] = static_cast< char >( 3 + 2 * LM50Device::_hwLengthChannels );
+		reply[7] = request[7];
+		reply[8] = static_cast< char >( 2 * LM50Device::_hwLengthChannels );
+		for( LM50Device::ChIdx i( 0 ); i != LM50Device::countChannels; ++i ) {
+			const u_int32_t value( htonl( _device.channel( i ) ) );
+			memcpy( reply + 9 + 4 * i, &value, 4 );
+		}
+		sendto( _socket, reply, length, 0, reinterpret_cast< struct sockaddr* >( &sender ), senderLength );
+	}
+}
+
+}
+}
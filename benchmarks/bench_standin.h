@@ -0,0 +1,87 @@
+#ifndef _BENCH_STANDIN_H_
+#define _BENCH_STANDIN_H_
+
+#include <pthread.h>
+#include <string>
+#include <boost/asio.hpp>
+
+#include "sim/sim_device.h"
+#include "sim/sim_profile.h"
+
+namespace LM50 {
+namespace Bench {
+
+/**
+ * A virtual LM50TCP+ on the loopback interface. The device is served by its
+ * own thread and listens on an ephemeral port.
+ */
+class LoopbackDevice {
+	public:
+		LoopbackDevice();
+		virtual ~LoopbackDevice();
+
+	private:
+		LoopbackDevice( const LoopbackDevice& );
+		LoopbackDevice& operator=( const LoopbackDevice& );
+
+	public:
+		const std::string& host() const { return _host; }
+
+		const std::string& port() const { return _port; }
+
+		Sim::FaultProfile& profile() { return _profile; }
+
+	protected:
+		static void* main( void* me );
+
+	protected:
+		boost::asio::io_service _service;
+		boost::asio::io_service::work _work;
+		Sim::FaultProfile _profile;
+		Sim::VirtualDevice _device;
+		ModBus::TcpServer _server;
+		std::string _host;
+		std::string _port;
+		pthread_t _thread;
+};
+
+
+/**
+ * A virtual LM50TCP+ that speaks ModBus/UDP on the loopback interface. Only
+ * requests for the channel counters are answered, the values are taken from
+ * a VirtualDevice. The replies are built in place, hence the stand-in does
+ * not allocate memory while serving.
+ */
+class UdpLoopbackDevice {
+	public:
+		UdpLoopbackDevice();
+		virtual ~UdpLoopbackDevice();
+
+	private:
+		UdpLoopbackDevice( const UdpLoopbackDevice& );
+		UdpLoopbackDevice& operator=( const UdpLoopbackDevice& );
+
+	public:
+		const std::string& host() const { return _host; }
+
+		const std::string& port() const { return _port; }
+
+	protected:
+		static void* main( void* me );
+
+		void serve();
+
+	protected:
+		Sim::FaultProfile _profile;
+		Sim::VirtualDevice _device;
+		int _socket;
+		volatile bool _isStopped;
+		std::string _host;
+		std::string _port;
+		pthread_t _thread;
+};
+
+}
+}
+
+#endif
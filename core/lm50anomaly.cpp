@@ -0,0 +1,112 @@
+#include "lm50anomaly.h"
+
+#include <cassert>
+#include <cmath>
+
+namespace LM50 {
+
+const unsigned int LM50Anomaly::warmUp( 30 );
+
+// See LM50Energy
+static const unsigned int defaultImpPerKWh( 1000 );
+static const double defaultMaxPower( 75600.0 );
+
+LM50Anomaly::LM50Anomaly() : \
+	_counter( new ChVal[ LM50Device::countChannels ] ), \
+	_maxRate( new double[ LM50Device::countChannels ] ), \
+	_mean( new double[ LM50Device::countChannels ] ), \
+	_variance( new double[ LM50Device::countChannels ] ), \
+	_expected( new double[ LM50Device::countChannels ] ), \
+	_samples( new unsigned int[ LM50Device::countChannels ] ), \
+	_flags( new unsigned char[ LM50Device::countChannels ] ), \
+	_validity( ~static_cast< u_int64_t >( 0 ) ), \
+	_count( 0 ), \
+	_time( 0.0 ), \
+	_alpha( 0.05 ), \
+	_zLimit( 8.0 ), \
+	_stuckPulses( 20.0 ) {
+	assert( LM50Device::countChannels <= 64 );
+	for( ChIdx i( 0 ); i < LM50Device::countChannels; ++i ) {
+		_counter[ i ] = 0;
+		_mean[ i ] = _variance[ i ] = _expected[ i ] = 0.0;
+		_samples[ i ] = 0;
+		_flags[ i ] = 0;
+		meter( i, defaultImpPerKWh, defaultMaxPower );
+	}
+}
+
+LM50Anomaly::~LM50Anomaly() {
+	delete[] _counter;
+	delete[] _maxRate;
+	delete[] _mean;
+	delete[] _variance;
+	delete[] _expected;
+	delete[] _samples;
+	delete[] _flags;
+}
+
+void LM50Anomaly::meter( ChIdx ch, unsigned int impPerKWh, double maxPower ) {
+	assert( ch < LM50Device::countChannels && impPerKWh != 0 );
+	_maxRate[ ch ] = maxPower * impPerKWh / 3600000.0;
+}
+
+void LM50Anomaly::limits( double alpha, double zLimit, double stuckPulses ) {
+	assert( alpha > 0.0 && alpha <= 1.0 );
+	_alpha = alpha;
+	_zLimit = zLimit;
+	_stuckPulses = stuckPulses;
+}
+
+void LM50Anomaly::update( const ChVal* counters, const struct timespec& time ) {
+	const ChIdx n( LM50Device::countChannels );
+	const double t( time.tv_sec + time.tv_nsec * 1.0e-9 );
+	if( _time == 0.0 ) {
+		for( ChIdx i( 0 ); i < n; ++i ) _counter[ i ] = counters[ i ];
+		_time = t;
+		return;
+	}
+	const double dt( t - _time );
+	if( dt <= 0.0 ) return;
+	_time = t;
+
+	// A rate is only known up to one pulse per interval, hence the standard
+	// deviation is never taken as smaller than that
+	const double minDeviation( 1.0 / dt );
+	u_int64_t validity( 0 );
+	for( ChIdx i( 0 ); i < n; ++i ) {
+		const u_int32_t delta( counters[ i ] - _counter[ i ] );
+		_counter[ i ] = counters[ i ];
+		unsigned char f( 0 );
+		if( delta > 0x80000000u ) f = BACKWARDS;
+		else if( delta > _maxRate[ i ] * dt + 1.0 ) f = JUMP;
+		if( delta != 0 ) {
+			_expected[ i ] = 0.0;
+		} else {
+			_expected[ i ] += _mean[ i ] * dt;
+			if( _stuckPulses > 0.0 && _samples[ i ] >= warmUp && _expected[ i ] > _stuckPulses ) f = STUCK;
+		}
+
+		// An invalid sample does not enter the statistics. A stuck counter
+		// does, such that the moving average follows a load that has been
+		// switched off.
+		if( !( f & INVALID ) ) {
+			const double rate( delta / dt );
+			const double diff( rate - _mean[ i ] );
+			if( _samples[ i ] == 0 ) {
+				_mean[ i ] = rate;
+			} else {
+				const double deviation( std::sqrt( _variance[ i ] ) );
+				if( _zLimit > 0.0 && _samples[ i ] >= warmUp && std::fabs( diff ) > _zLimit * ( deviation > minDeviation ? deviation : minDeviation ) ) f |= OUTLIER;
+				_mean[ i ] += _alpha * diff;
+				_variance[ i ] = ( 1.0 - _alpha ) * ( _variance[ i ] + _alpha * diff * diff );
+			}
+			if( _samples[ i ] < warmUp ) ++_samples[ i ];
+		}
+		_flags[ i ] = f;
+		_count += ( f != 0 );
+		validity |= static_cast< u_int64_t >( ( f & INVALID ) == 0 ) << i;
+	}
+	_validity = validity;
+}
+
+}
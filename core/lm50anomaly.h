@@ -0,0 +1,122 @@
+#ifndef _LM50ANOMALY_H_
+#define _LM50ANOMALY_H_
+
+#include <ctime>
+#include <sys/types.h>
+
+#include "lm50device.h"
+
+namespace LM50 {
+
+/**
+ * Checks each new sample of the pulse counters of all channels for
+ * anomalies and provides a validity bitmask per sample.
+ *
+ * The following checks are performed per channel:
+ *
+ * (1) Monotonicity: The counter must not go backwards, e.g. after a reset
+ *     of the device. The 32-bit wrap around is not an anomaly.
+ * (2) Rate bound: The pulses since the last sample must not exceed the
+ *     pulses the meter produces at its maximum power (see README.txt for
+ *     the bounds of the RRD data sources) plus one pulse of jitter.
+ * (3) Stuck value: The counter must not stay constant, while the channel
+ *     is expected to produce more than the given number of pulses according
+ *     to its moving average rate.
+ * (4) Z-score: The rate must not deviate by more than the given number of
+ *     standard deviations from its exponentially weighted moving average.
+ *     The moving variance needs some samples to settle, hence the checks (3)
+ *     and (4) start after a warm up.
+ *
+ * The checks (1) and (2) render a sample invalid, i.e. the sample should be
+ * dropped by sinks, and the counter is taken as the new baseline. The checks
+ * (3) and (4) only mark the sample, because a stuck counter cannot be told
+ * apart from a load that has been switched off and an outlier may well be a
+ * legitimate change of the load.
+ *
+ * update() neither allocates memory nor throws.
+ */
+class LM50Anomaly {
+	public:
+		typedef LM50Device::ChIdx ChIdx;
+		typedef LM50Device::ChVal ChVal;
+
+		enum Flag {
+			BACKWARDS = 0x01,
+			JUMP = 0x02,
+			STUCK = 0x04,
+			OUTLIER = 0x08,
+			INVALID = BACKWARDS | JUMP
+		};
+
+	public:
+		LM50Anomaly();
+		virtual ~LM50Anomaly();
+
+	private:
+		LM50Anomaly( const LM50Anomaly& );
+		LM50Anomaly& operator=( const LM50Anomaly& );
+
+	public:
+		/**
+		 * Sets the bound of the rate of a channel
+		 * @param ch The channel index between 0 and LM50Device::countChannels
+		 * @param impPerKWh The number of pulses per kWh
+		 * @param maxPower The maximum power in W the channel is rated for
+		 */
+		void meter( ChIdx ch, unsigned int impPerKWh, double maxPower );
+
+		/**
+		 * Sets the parameters of the statistical checks
+		 * @param alpha The weight of the newest rate in the moving average
+		 * @param zLimit The z-score above which a rate is an outlier, zero
+		 * disables the check
+		 * @param stuckPulses The number of expected pulses after which an
+		 * unchanged counter is stuck, zero disables the check
+		 */
+		void limits( double alpha, double zLimit, double stuckPulses );
+
+		/**
+		 * Checks new counter values of all channels
+		 * @param counters The countChannels raw counter values
+		 * @param time The time the counters have been read
+		 */
+		void update( const ChVal* counters, const struct timespec& time );
+
+		/**
+		 * @return The flags of the channel for the last sample
+		 */
+		unsigned int flags( ChIdx ch ) const { return _flags[ ch ]; }
+
+		/**
+		 * @return The bitmask of the channels whose last sample is valid, bit i
+		 * corresponds to channel index i
+		 */
+		u_int64_t validity() const { return _validity; }
+
+		/**
+		 * @return The number of flagged samples since construction
+		 */
+		u_int64_t count() const { return _count; }
+
+	public:
+		static const unsigned int warmUp;
+
+	protected:
+		ChVal* _counter;
+		double* _maxRate;        // in pulses per second
+		double* _mean;           // moving average of the rate
+		double* _variance;       // moving variance of the rate
+		double* _expected;       // the pulses expected since the counter changed last
+		unsigned int* _samples;
+		unsigned char* _flags;
+		u_int64_t _validity;
+		u_int64_t _count;
+		double _time;
+		double _alpha;
+		double _zLimit;
+		double _stuckPulses;
+};
+
+}
+
+#endif
@@ -1,5 +1,11 @@
 #include "lm50device.h"
 
+#include <cassert>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace LM50 {
 
 using namespace boost::posix_time;
@@ -42,107 +48,128 @@ LM50Device::LM50Device() : \
 	_host(), \
 	_port(), \
 	_lastUpdate(), \
+	_unit( _unitId ), \
+	_transportName( "tcp" ), \
 	_tcpComm(), \
+	_otherTransport(), \
+	_transport( &_tcpComm ), \
+	_gateway( nullptr ), \
+	_gwRequest(), \
 	_lastRequestId(0), \
 	_lastReplyId(0), \
 	_revision(), \
 	_serialNo(0), \
-	_channels( new ChVal[countChannels] ) {
-	for( ChIdx i( 0 ); i < countChannels; ++i ) _channels[ i ] = 0;
+	_channels( new ChVal[countChannels] ), \
+	_previous( new ChVal[countChannels] ), \
+	_changed( 0 ) {
+	for( ChIdx i( 0 ); i < countChannels; ++i ) _channels[ i ] = _previous[ i ] = 0;
 }
 
 LM50Device::LM50Device( const std::string& h, const std::string& p ) : \
 	_host( h ), \
 	_port( p ), \
 	_lastUpdate(), \
+	_unit( _unitId ), \
+	_transportName( "tcp" ), \
 	_tcpComm(), \
+	_otherTransport(), \
+	_transport( &_tcpComm ), \
+	_gateway( nullptr ), \
+	_gwRequest(), \
 	_lastRequestId(0), \
 	_lastReplyId(0), \
 	_revision(), \
 	_serialNo(0), \
-	_channels( new ChVal[countChannels] ) {
-	for( ChIdx i( 0 ); i < countChannels; ++i ) _channels[ i ] = 0;
+	_channels( new ChVal[countChannels] ), \
+	_previous( new ChVal[countChannels] ), \
+	_changed( 0 ) {
+	for( ChIdx i( 0 ); i < countChannels; ++i ) _channels[ i ] = _previous[ i ] = 0;
 }
 
-/**
- * Internal convinience function. It takes a request datagram, binds it to
- * the communication socket, sends it and waits for a respone datagram. The
- * primary purpose is to check for some common error conditions and reduce
- * code duplication
- * 
- * @param req The request datagram. The function assumes that this is either
- * a ReadHoldingRegistersReq or ReadInputRegistersReq object. No check is
- * performed, because this is an internal class function
- * @return Returns the response datagram. The return value is never NULL and
- * either a ReadHoldingRegistersRes or ReadInputRegistersRes object depending
- * on the type of the input parameter. The caller is responsible to free the
- * returned object.
- */
-Datagram::Base* LM50Device::readValue( const Datagram::Base& req ) {
-	TcpRequestAndReply rar( _tcpComm.createRequestAndReply( req ) );
-	rar.run();
-	const Datagram::Base* res = rar.response();
-	if( res == nullptr ) throw runtime_error( "ModBus error: Time out" );
-	const Datagram::ErrorRes* err = dynamic_cast< const Datagram::ErrorRes* >( res );
-	if( err ) {
-		_lastReplyId = err->transactionID();
-		throw runtime_error( string( "ModBus error: " ).append( err->exceptionMessage() ) );
-	}
-	return rar.releaseResponse();
+LM50Device::LM50Device( TcpGatewaySession& gateway, UnitId unit ) : \
+	_host(), \
+	_port(), \
+	_lastUpdate(), \
+	_unit( unit ), \
+	_transportName( "tcp" ), \
+	_tcpComm(), \
+	_otherTransport(), \
+	_transport( &_tcpComm ), \
+	_gateway( &gateway ), \
+	_gwRequest(), \
+	_lastRequestId(0), \
+	_lastReplyId(0), \
+	_revision(), \
+	_serialNo(0), \
+	_channels( new ChVal[countChannels] ), \
+	_previous( new ChVal[countChannels] ), \
+	_changed( 0 ) {
+	for( ChIdx i( 0 ); i < countChannels; ++i ) _channels[ i ] = _previous[ i ] = 0;
+}
+
+void LM50Device::transport( const std::string& name ) {
+	if( name == _transportName ) return;
+	// The current transport is closed before it is destroyed together with
+	// the local pointer, i.e. after _transport has been repointed
+	boost::scoped_ptr< Transport > other( name == "tcp" ? nullptr : Transport::create( name ) );
+	_transport->close();
+	_otherTransport.swap( other );
+	_transport = _otherTransport ? _otherTransport.get() : &_tcpComm;
+	_transportName = name;
+}
+
+void LM50Device::connect() {
+	boost::system::error_code ec;
+	connect( ec );
+	if( ec ) throw boost::system::system_error( ec );
 }
 
 /**
  * Internal convinience function to read the value of a "holding" register from
- * the device. It calls LM50Device::readValue internally.
+ * the device. Common error conditions (time out, error datagrams, foreign
+ * transaction ids and truncated replies) are checked by the communication
+ * object and reported by the error code.
  * @param addr The starting address of the register
  * @param length The length of the register in 16bit blocks
- * @return Returns the response diagram. The return value is never NULL otherwise
- * an exception had been thrown. The caller is responsible to free the
- * returned object.
+ * @return Returns a view on the register values that is valid until the next
+ * request is sent.
  */
-Datagram::ReadHoldingRegistersRes* LM50Device::readHValue( HwAddr addr, HwLength length ) {
-	Datagram::ReadHoldingRegistersReq req( ++_lastRequestId, _unitId, addr, length );
-	// The return value of the next function call is not NULL and not an error
-	// datagram, otherwise an exception had been thrown
-	Datagram::Base* res = readValue( req );
-	Datagram::ReadHoldingRegistersRes* hres = dynamic_cast< Datagram::ReadHoldingRegistersRes* >( res );
-	if( !hres ) {
-		delete res;
-		throw runtime_error( "ModBus error: Unexepected datagram format" );
-	}
-	_lastReplyId = hres->transactionID();
-	if( _lastReplyId != _lastRequestId ) {
-		delete hres;
-		throw runtime_error( "ModBus error: Received a response datagram, but it does not belong to our conversation" );
-	}
-	return hres;
+Registers LM50Device::readHValue( HwAddr addr, HwLength length, boost::system::error_code& ec ) {
+	if( _gateway ) return readGatewayValue( Function::ReadHoldingRegisters, addr, length, ec );
+	Registers res( _transport->readHoldingRegisters( ++_lastRequestId, _unit, addr, length, ec ) );
+	if( !ec ) _lastReplyId = res.transactionID();
+	return res;
 }
 
 /**
  * Internal convinience function to read the value of an "input" register from
- * the device. It calls LM50Device::readValue internally.
+ * the device. See LM50Device::readHValue.
  * @param addr The starting address of the register
  * @param length The length of the register in 16bit blocks
- * @return Returns the response diagram. The return value is never NULL otherwise
- * an exception had been thrown. The caller is responsible to free the
- * returned object.
+ * @return Returns a view on the register values that is valid until the next
+ * request is sent.
  */
-Datagram::ReadInputRegistersRes* LM50Device::readIValue( HwAddr addr, HwLength length ) {
-	Datagram::ReadInputRegistersReq req( ++_lastRequestId, _unitId, addr, length );
-	// The return value of the next function call is not NULL and not an error
-	// datagram, otherwise an exception had been thrown
-	Datagram::Base* res = readValue( req );
-	Datagram::ReadInputRegistersRes* ires = dynamic_cast< Datagram::ReadInputRegistersRes* >( res );
-	if( !ires ) {
-		delete res;
-		throw runtime_error( "ModBus error: Unexepected datagram format" );
-	}
-	_lastReplyId = ires->transactionID();
-	if( _lastReplyId != _lastRequestId ) {
-		delete ires;
-		throw runtime_error( "ModBus error: Received a response datagram, but it does not belong to our conversation" );
-	}
-	return ires;
+Registers LM50Device::readIValue( HwAddr addr, HwLength length, boost::system::error_code& ec ) {
+	if( _gateway ) return readGatewayValue( Function::ReadInputRegisters, addr, length, ec );
+	Registers res( _transport->readInputRegisters( ++_lastRequestId, _unit, addr, length, ec ) );
+	if( !ec ) _lastReplyId = res.transactionID();
+	return res;
+}
+
+/**
+ * Internal convinience function to read registers over the gateway. Other
+ * requests that have been submitted to the gateway are transmitted during
+ * the same run.
+ */
+Registers LM50Device::readGatewayValue( Datagram::FuncCode func, HwAddr addr, HwLength length, boost::system::error_code& ec ) {
+	_gwRequest.readRegistersRequest( func, _unit, addr, length );
+	_gateway->submit( _gwRequest );
+	boost::system::error_code ignored;
+	_gateway->run( ignored );
+	ec = _gwRequest.error();
+	if( ec ) return Registers();
+	_lastReplyId = _gwRequest.transactionID();
+	return _gwRequest.registers();
 }
 
 
@@ -152,19 +179,24 @@ Datagram::ReadInputRegistersRes* LM50Device::readIValue( HwAddr addr, HwLength l
  * This function queries their values and stores them in the respective
  * attributes of this class.
  */
-void LM50Device::readSteadyValues() {
+void LM50Device::readSteadyValues( boost::system::error_code& ec ) {
 	// See comment on constants _hwAddrRevision, _hwLengthRevision,
 	// _hwAddrSerialNo and _hwLengthSerialNo for further information.
 	
-	Datagram::ReadHoldingRegistersRes* hres = readHValue( _hwAddrRevision, _hwLengthRevision  );
-	Interpreter::ASCII< Datagram::ReadHoldingRegistersRes > ascii( *hres );
-	_revision = ascii.string();
-	delete hres;
+	Registers hres( readHValue( _hwAddrRevision, _hwLengthRevision, ec ) );
+	if( ec ) return;
+	std::string revision( hres.ascii() );
 	
-	hres = readHValue( _hwAddrSerialNo, _hwLengthSerialNo  );
-	Interpreter::UInt32< Datagram::ReadHoldingRegistersRes > serial( *hres );
-	_serialNo = serial.value( 0 );
-	delete hres;
+	hres = readHValue( _hwAddrSerialNo, _hwLengthSerialNo, ec );
+	if( ec ) return;
+	_serialNo = hres.uint32( 0 );
+	_revision = revision;
+}
+
+void LM50Device::readSteadyValues() {
+	boost::system::error_code ec;
+	readSteadyValues( ec );
+	throwOnError( ec );
 }
 
 /**
@@ -180,20 +212,103 @@ void LM50Device::readSteadyValues() {
  * very slow in interpreting a datagram, hence two datagrams are always
  * slower than one datagram, even if the latter has 50 times more payload.
  */
-void LM50Device::updateVolatileValues() {
+void LM50Device::updateVolatileValues( boost::system::error_code& ec ) {
 	// See comment on constants _hwAddrChannels and _hwLengthChannels for
 	// further information.
-	Datagram::ReadInputRegistersRes* ires = readIValue( _hwAddrChannels, _hwLengthChannels  );
-	Interpreter::UInt32< Datagram::ReadInputRegistersRes > chs( *ires );
-	if( chs.size() != countChannels ) {
-		delete ires;
-		throw runtime_error( "ModBus error: Received a truncated response datagram" );
-	}
-	for( ChIdx j = 0; j < countChannels; j++ ) _channels[j] = chs.value(j);
-	delete ires;
+	// The communication object has already checked that the reply contains
+	// exactly _hwLengthChannels registers, i.e. countChannels 32-bit values
+	Registers chs( readIValue( _hwAddrChannels, _hwLengthChannels, ec ) );
+	if( ec ) return;
+	applyChannels( chs );
+}
+
+void LM50Device::submitUpdate() {
+	assert( _gateway );
+	_gwRequest.readRegistersRequest( Function::ReadInputRegisters, _unit, _hwAddrChannels, _hwLengthChannels );
+	_gateway->submit( _gwRequest );
+}
+
+void LM50Device::completeUpdate( boost::system::error_code& ec ) {
+	assert( !_gwRequest.isPending() );
+	ec = _gwRequest.error();
+	if( ec ) return;
+	_lastReplyId = _gwRequest.transactionID();
+	applyChannels( _gwRequest.registers() );
+}
+
+/**
+ * Stores the channels of a successful update and compares them to the
+ * channels before
+ */
+void LM50Device::applyChannels( const Registers& chs ) {
+	assert( chs.size32() == countChannels );
+	std::swap( _channels, _previous );
+	chs.uint32Array( _channels );
+	_changed = _lastUpdate.tv_sec == 0 ? ( ~static_cast< u_int64_t >( 0 ) >> ( 64 - countChannels ) ) : diff( _channels, _previous, countChannels );
 	clock_gettime( CLOCK_REALTIME, &_lastUpdate );
 }
 
+/**
+ * The values are compared four at a time by SSE2, if available. Each
+ * comparison yields a 4-bit mask of the equal lanes, which is inverted and
+ * shifted into place. At night most channels of a building do not change
+ * between two updates, hence consumers that only process the changed
+ * channels save most of their work.
+ */
+u_int64_t LM50Device::diff( const ChVal* a, const ChVal* b, ChIdx n ) {
+	assert( n <= 64 );
+	u_int64_t mask( 0 );
+	ChIdx i( 0 );
+#ifdef __SSE2__
+	for( ; i + 4 <= n; i += 4 ) {
+		const __m128i va( _mm_loadu_si128( reinterpret_cast< const __m128i* >( a + i ) ) );
+		const __m128i vb( _mm_loadu_si128( reinterpret_cast< const __m128i* >( b + i ) ) );
+		const int equal( _mm_movemask_ps( _mm_castsi128_ps( _mm_cmpeq_epi32( va, vb ) ) ) );
+		mask |= static_cast< u_int64_t >( ~equal & 0xf ) << i;
+	}
+#endif
+	for( ; i < n; ++i ) mask |= static_cast< u_int64_t >( a[ i ] != b[ i ] ) << i;
+	return mask;
+}
+
+/**
+ * The reply must carry the transaction id of the request, otherwise it is a
+ * late reply to an earlier request that timed out. Over a gateway the
+ * session assigns the replies by their transaction id anyway.
+ */
+const char* LM50Device::transact( Datagram::Base& request, size_t& length, boost::system::error_code& ec ) {
+	length = 0;
+	if( _gateway ) {
+		_gwRequest.request( request );
+		_gateway->submit( _gwRequest );
+		boost::system::error_code ignored;
+		_gateway->run( ignored );
+		ec = _gwRequest.error();
+		if( ec ) return _gwRequest.rawResponse();
+		_lastReplyId = _gwRequest.transactionID();
+		length = _gwRequest.rawResponseLength();
+		return _gwRequest.rawResponse();
+	}
+	request.transactionID( ++_lastRequestId );
+	size_t n( 0 );
+	const char* raw( _transport->transact( request, n, ec ) );
+	if( ec ) return raw;
+	const Datagram::Header* header = reinterpret_cast< const Datagram::Header* >( raw );
+	if( n < sizeof( Datagram::Header ) || ntohs( header->transactionID ) != _lastRequestId ) {
+		ec = Error::TransactionMismatch;
+		return raw;
+	}
+	_lastReplyId = _lastRequestId;
+	length = n;
+	return raw;
+}
+
+void LM50Device::updateVolatileValues() {
+	boost::system::error_code ec;
+	updateVolatileValues( ec );
+	throwOnError( ec );
+}
+
 /**
  * @return The hardware revision of the LM50TCP+
  * @throw runtime_error Thrown, if LM50Device::readSteadyValues has not been
@@ -4,6 +4,7 @@
 #include <cstddef>
 //include <sys/types.h>
 #include <ctime>
+#include <boost/scoped_ptr.hpp>
 
 #include "lib/modbus.h"
 
@@ -24,7 +25,16 @@ class LM50Device {
 	public:
 		LM50Device();
 		LM50Device( const std::string& h, const std::string& p );
-		virtual ~LM50Device() { delete[] _channels; }
+		
+		/**
+		 * Creates a device behind a gateway, which shares the connection of the
+		 * gateway with other devices. The session is not owned by the device
+		 * and must outlive it. See ModBus::TcpGatewaySession.
+		 * @param unit The unit id of the device on the bus of the gateway
+		 */
+		LM50Device( ModBus::TcpGatewaySession& gateway, UnitId unit );
+		
+		virtual ~LM50Device() { delete[] _channels; delete[] _previous; }
 		
 	public:
 		const std::string& host() const { return _host; }
@@ -35,14 +45,105 @@ class LM50Device {
 		
 		void port( std::string p ) { _port = p; }
 		
-		void connect() { _tcpComm.open( _host, _port ); }
-		
-		void disconnect() { _tcpComm.close(); }
+		/**
+		 * @return The unit id the device is addressed by, LM50Device::_unitId
+		 * unless the device is behind a gateway
+		 */
+		UnitId unitId() const { return _unit; }
+		
+		void unitId( UnitId u ) { _unit = u; }
+		
+		/**
+		 * @return The gateway the device is behind or NULL, if the device has
+		 * a connection of its own
+		 */
+		ModBus::TcpGatewaySession* gateway() const { return _gateway; }
+		
+		/**
+		 * @return The name of the transport, see LM50Device::transport
+		 */
+		const std::string& transport() const { return _transportName; }
+		
+		/**
+		 * Selects the transport of the connection to the device, see
+		 * ModBus::Transport::create. The default is "tcp". The current
+		 * connection is closed, if the transport changes. For the transport
+		 * "rtu-serial" the host is the path of the serial port and the port is
+		 * its settings, see ModBus::RtuSerialCommunication::open.
+		 */
+		void transport( const std::string& name );
+		
+		/**
+		 * @return False, if the transport keeps no connection state, see
+		 * ModBus::Transport::isConnectionOriented
+		 */
+		bool isConnectionOriented() const { return _gateway || _transport->isConnectionOriented(); }
+		
+		/**
+		 * Connects to the device. A device behind a gateway does not own the
+		 * connection, hence this function and LM50Device::disconnect do nothing
+		 * for it. The owner of the gateway session opens and closes it.
+		 */
+		void connect();
+		
+		void connect( boost::system::error_code& ec ) { if( !_gateway ) _transport->open( _host, _port, ec ); else ec.clear(); }
+		
+		void disconnect() { if( !_gateway ) _transport->close(); }
+		
+		/**
+		 * Records the traffic with the device, see ModBus::TcpCommunication::record.
+		 * Only the transport "tcp" records and replays traffic and can be
+		 * observed.
+		 */
+		void record( ModBus::TraceRecorder* r ) { _tcpComm.record( r ); }
+		
+		/**
+		 * Replays recorded traffic instead of talking to the device, see
+		 * ModBus::TcpCommunication::replay
+		 */
+		void replay( ModBus::TraceReplay* r ) { _tcpComm.replay( r ); }
+		
+		/**
+		 * Observes the rounds with the device, see
+		 * ModBus::TcpCommunication::observe
+		 */
+		void observe( ModBus::RoundObserver* o ) { _tcpComm.observe( o ); }
 		
 		void readSteadyValues();
 		
+		void readSteadyValues( boost::system::error_code& ec );
+		
 		void updateVolatileValues();
 		
+		void updateVolatileValues( boost::system::error_code& ec );
+		
+		/**
+		 * Queues the request for the channels at the gateway without waiting
+		 * for the reply. This way the devices behind one gateway are updated
+		 * together: Call LM50Device::submitUpdate for each device, then
+		 * ModBus::TcpGatewaySession::run and finally
+		 * LM50Device::completeUpdate for each device. Must only be called for
+		 * a device behind a gateway.
+		 */
+		void submitUpdate();
+		
+		/**
+		 * Takes the channels from the reply to the request of
+		 * LM50Device::submitUpdate, see LM50Device::updateVolatileValues
+		 * @param ec Set to indicate what error occured, if any
+		 */
+		void completeUpdate( boost::system::error_code& ec );
+		
+		/**
+		 * Transmits an arbitrary request over the connection of the device and
+		 * waits for the reply. The transaction id of the request is replaced
+		 * by the next id of the device or the gateway. A ModBus exception reply
+		 * is not reported as an error.
+		 * @param length Set to the number of bytes of the reply
+		 * @return The raw reply, which is valid until the next request
+		 */
+		const char* transact( ModBus::Datagram::Base& request, size_t& length, boost::system::error_code& ec );
+		
 		const std::string& revision() const;
 		
 		unsigned int serialNumber() const;
@@ -53,20 +154,36 @@ class LM50Device {
 		
 		const struct timespec& lastUpdate() const { return _lastUpdate; }
 		
+		/**
+		 * @return The channels that changed by the last successful update, bit i
+		 * corresponds to channel index i. After the first update all bits are
+		 * set.
+		 */
+		u_int64_t changed() const { return _changed; }
+		
+		/**
+		 * Compares two arrays of channel values
+		 * @return The bitmask of the indices at which the values differ
+		 * @param n The number of values, at most 64
+		 */
+		static u_int64_t diff( const ChVal* a, const ChVal* b, ChIdx n );
+		
 	protected:
 		/*static HwAddr hwAddrChannel( ChIdx ch ) {
 			assert( ch >= firstChannel && ch <= lastChannel );
 			return _hwAddrChannel[ch-firstChannel];
 		}*/
-		ModBus::Datagram::Base* readValue( const ModBus::Datagram::Base& req );
-		ModBus::Datagram::ReadHoldingRegistersRes* readHValue( HwAddr addr, HwLength length );
-		ModBus::Datagram::ReadInputRegistersRes* readIValue( HwAddr addr, HwLength length );
+		ModBus::Registers readHValue( HwAddr addr, HwLength length, boost::system::error_code& ec );
+		ModBus::Registers readIValue( HwAddr addr, HwLength length, boost::system::error_code& ec );
+		ModBus::Registers readGatewayValue( ModBus::Datagram::FuncCode func, HwAddr addr, HwLength length, boost::system::error_code& ec );
+		void applyChannels( const ModBus::Registers& chs );
 		
 	public:
 		//static const ChIdx firstChannel;
 		static const ChIdx countChannels;
 		
-	protected:
+		// The register map of the LM50TCP+. It is public such that servers
+		// which mimic the device (e.g. the simulator) use the same addresses.
 		static const UnitId   _unitId;
 		static const HwAddr   _hwAddrRevision;
 		static const HwLength _hwLengthRevision;
@@ -74,15 +191,40 @@ class LM50Device {
 		static const HwLength _hwLengthSerialNo;
 		static const HwAddr   _hwAddrChannels;
 		static const HwLength _hwLengthChannels;
+		
+	protected:
 		std::string _host;
 		std::string _port;
 		struct timespec _lastUpdate;
+		UnitId _unit;
+		
+		/**
+		 * The transport the device is talked to by. This is either _tcpComm or
+		 * _otherTransport, depending on _transportName.
+		 */
+		std::string _transportName;
 		ModBus::TcpCommunication _tcpComm;
+		boost::scoped_ptr< ModBus::Transport > _otherTransport;
+		ModBus::Transport* _transport;
+		
+		/**
+		 * The gateway the device is behind, if any, and the request of the
+		 * device, which is reused for each round over the gateway
+		 */
+		ModBus::TcpGatewaySession* _gateway;
+		ModBus::GatewayRequest _gwRequest;
 		TransactionId _lastRequestId;
 		TransactionId _lastReplyId;
 		std::string _revision;
 		unsigned int _serialNo;
 		ChVal* _channels;
+		
+		/**
+		 * The channel values before the last update. The buffers are swapped on
+		 * each update, such that the comparison does not need a copy.
+		 */
+		ChVal* _previous;
+		u_int64_t _changed;
 };
 
 }
@@ -0,0 +1,89 @@
+#include "lm50energy.h"
+
+#include <cassert>
+
+namespace LM50 {
+
+const double LM50Energy::minPowerWindow( 1.0 );
+
+// The impulse constant of most distribution boxes, see README.txt
+static const unsigned int defaultImpPerKWh( 1000 );
+
+// 3 x 63A x 400V, see README.txt
+static const double defaultMaxPower( 75600.0 );
+
+LM50Energy::LM50Energy() : \
+	_counter( new ChVal[ LM50Device::countChannels ] ), \
+	_pulses( new u_int64_t[ LM50Device::countChannels ] ), \
+	_powerBase( new u_int64_t[ LM50Device::countChannels ] ), \
+	_maxDelta( new u_int32_t[ LM50Device::countChannels ] ), \
+	_kWhPerImp( new double[ LM50Device::countChannels ] ), \
+	_wattPerImpPerS( new double[ LM50Device::countChannels ] ), \
+	_power( new double[ LM50Device::countChannels ] ), \
+	_time( 0.0 ), \
+	_powerTime( 0.0 ), \
+	_hasPower( false ) {
+	for( ChIdx i( 0 ); i < LM50Device::countChannels; ++i ) {
+		_counter[ i ] = 0;
+		_pulses[ i ] = 0;
+		_powerBase[ i ] = 0;
+		_power[ i ] = 0.0;
+		meter( i, defaultImpPerKWh, defaultMaxPower );
+	}
+}
+
+LM50Energy::~LM50Energy() {
+	delete[] _counter;
+	delete[] _pulses;
+	delete[] _powerBase;
+	delete[] _maxDelta;
+	delete[] _kWhPerImp;
+	delete[] _wattPerImpPerS;
+	delete[] _power;
+}
+
+void LM50Energy::meter( ChIdx ch, unsigned int impPerKWh, double maxPower ) {
+	assert( ch < LM50Device::countChannels && impPerKWh != 0 );
+	_kWhPerImp[ ch ] = 1.0 / impPerKWh;
+	_wattPerImpPerS[ ch ] = 3600000.0 / impPerKWh;
+	// Twice the pulses per second at maximum power, but at least one
+	const double maxRate( 2.0 * maxPower / _wattPerImpPerS[ ch ] );
+	_maxDelta[ ch ] = maxRate < 1.0 ? 1 : ( maxRate > 4.0e9 ? 4000000000u : static_cast< u_int32_t >( maxRate ) );
+}
+
+void LM50Energy::update( const ChVal* counters, const struct timespec& time ) {
+	const ChIdx n( LM50Device::countChannels );
+	const double t( time.tv_sec + time.tv_nsec * 1.0e-9 );
+	if( _time == 0.0 ) {
+		for( ChIdx i( 0 ); i < n; ++i ) {
+			_counter[ i ] = counters[ i ];
+			_pulses[ i ] = _powerBase[ i ] = counters[ i ];
+		}
+		_time = _powerTime = t;
+		return;
+	}
+
+	// The elapsed time in whole seconds rounded up, which bounds the number
+	// of pulses that are plausible since the last update
+	const double dt( t > _time ? t - _time : 0.0 );
+	const u_int32_t dtLimit( dt > 1.0e5 ? 100000u : static_cast< u_int32_t >( dt ) + 1 );
+	for( ChIdx i( 0 ); i < n; ++i ) {
+		const u_int32_t delta( counters[ i ] - _counter[ i ] );
+		const bool isReset( delta > static_cast< u_int64_t >( _maxDelta[ i ] ) * dtLimit );
+		_pulses[ i ] += isReset ? counters[ i ] : delta;
+		_counter[ i ] = counters[ i ];
+	}
+	_time = t;
+
+	const double window( t - _powerTime );
+	if( window < minPowerWindow ) return;
+	const double perSecond( 1.0 / window );
+	for( ChIdx i( 0 ); i < n; ++i ) {
+		_power[ i ] = ( _pulses[ i ] - _powerBase[ i ] ) * perSecond * _wattPerImpPerS[ i ];
+		_powerBase[ i ] = _pulses[ i ];
+	}
+	_powerTime = t;
+	_hasPower = true;
+}
+
+}
@@ -0,0 +1,109 @@
+#ifndef _LM50ENERGY_H_
+#define _LM50ENERGY_H_
+
+#include <ctime>
+#include <sys/types.h>
+
+#include "lm50device.h"
+
+namespace LM50 {
+
+/**
+ * Derives the instantaneous power and the cumulative energy of all channels
+ * from the raw pulse counters of the device.
+ *
+ * The counters of the LM50TCP+ are 32-bit values that wrap around. The
+ * engine extends them to 64 bits by adding the difference modulo 2^32 to
+ * the previous value. A difference that exceeds the pulses the channel can
+ * possibly produce at its maximum power is taken as a reset of the device's
+ * counter instead of a wrap around, i.e. the counting restarts at zero.
+ *
+ * The power is computed over a window of at least minPowerWindow seconds,
+ * because different workers may update the device shortly after each other
+ * and a short window would only see zero or one pulse.
+ *
+ * All state is kept in flat arrays (one per quantity), such that update()
+ * processes all channels in a single pass of simple loops the compiler can
+ * vectorize. update() neither allocates memory nor throws.
+ */
+class LM50Energy {
+	public:
+		typedef LM50Device::ChIdx ChIdx;
+		typedef LM50Device::ChVal ChVal;
+
+	public:
+		LM50Energy();
+		virtual ~LM50Energy();
+
+	private:
+		LM50Energy( const LM50Energy& );
+		LM50Energy& operator=( const LM50Energy& );
+
+	public:
+		/**
+		 * Sets the meter constants of a channel
+		 * @param ch The channel index between 0 and LM50Device::countChannels
+		 * @param impPerKWh The number of pulses per kWh
+		 * @param maxPower The maximum power in W the channel is rated for
+		 */
+		void meter( ChIdx ch, unsigned int impPerKWh, double maxPower );
+
+		/**
+		 * Processes new counter values of all channels
+		 * @param counters The countChannels raw counter values
+		 * @param time The time the counters have been read
+		 */
+		void update( const ChVal* counters, const struct timespec& time );
+
+		/**
+		 * False until the first update
+		 */
+		bool isValid() const { return _time != 0.0; }
+
+		/**
+		 * False until the power has been computed over a first window
+		 */
+		bool hasPower() const { return _hasPower; }
+
+		/**
+		 * @return The power in W, zero until two updates have been processed
+		 */
+		double power( ChIdx ch ) const { return _power[ ch ]; }
+
+		/**
+		 * @return The energy in kWh, i.e. the extended counter divided by the
+		 * impulse constant
+		 */
+		double energy( ChIdx ch ) const { return _pulses[ ch ] * _kWhPerImp[ ch ]; }
+
+		/**
+		 * @return The counter extended to 64 bits
+		 */
+		u_int64_t pulses( ChIdx ch ) const { return _pulses[ ch ]; }
+
+		const double* powers() const { return _power; }
+		
+		/**
+		 * @return The reciprocal of the impulse constant of the channel
+		 */
+		double kWhPerImp( ChIdx ch ) const { return _kWhPerImp[ ch ]; }
+
+	public:
+		static const double minPowerWindow;
+
+	protected:
+		ChVal* _counter;          // the last raw counter value
+		u_int64_t* _pulses;       // the extended counter
+		u_int64_t* _powerBase;    // the extended counter at the start of the power window
+		u_int32_t* _maxDelta;     // the pulses at maximum power per second
+		double* _kWhPerImp;
+		double* _wattPerImpPerS;  // pulses per second to W
+		double* _power;
+		double _time;             // in seconds since the epoch
+		double _powerTime;        // the start of the power window
+		bool _hasPower;
+};
+
+}
+
+#endif
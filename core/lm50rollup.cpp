@@ -0,0 +1,123 @@
+#include "lm50rollup.h"
+
+#include <cassert>
+
+namespace LM50 {
+
+const unsigned int LM50Rollup::countLevels;
+
+const unsigned int LM50Rollup::_resolution[ LM50Rollup::countLevels ] = { 1, 60, 900, 3600 };
+
+const size_t LM50Rollup::_length[ LM50Rollup::countLevels ] = { 3600, 1440, 672, 744 };
+
+LM50Rollup::LM50Rollup() {
+	const ChIdx n( LM50Device::countChannels );
+	for( unsigned int l( 0 ); l != countLevels; ++l ) {
+		_min[ l ] = new float[ _length[ l ] * n ];
+		_max[ l ] = new float[ _length[ l ] * n ];
+		_last[ l ] = new float[ _length[ l ] * n ];
+		_sum[ l ] = new double[ _length[ l ] * n ];
+		_key[ l ] = new int64_t[ _length[ l ] ];
+		_count[ l ] = new unsigned int[ _length[ l ] ];
+		for( size_t b( 0 ); b != _length[ l ]; ++b ) {
+			_key[ l ][ b ] = -1;
+			_count[ l ][ b ] = 0;
+		}
+		_newest[ l ] = -1;
+	}
+}
+
+LM50Rollup::~LM50Rollup() {
+	for( unsigned int l( 0 ); l != countLevels; ++l ) {
+		delete[] _min[ l ];
+		delete[] _max[ l ];
+		delete[] _last[ l ];
+		delete[] _sum[ l ];
+		delete[] _key[ l ];
+		delete[] _count[ l ];
+	}
+}
+
+/**
+ * The first sample of a bucket overwrites whatever the bucket held one
+ * revolution of the ring before
+ */
+void LM50Rollup::update( const double* values, const struct timespec& time ) {
+	const ChIdx n( LM50Device::countChannels );
+	for( unsigned int l( 0 ); l != countLevels; ++l ) {
+		int64_t key( time.tv_sec / _resolution[ l ] );
+		if( key < _newest[ l ] ) key = _newest[ l ];
+		_newest[ l ] = key;
+		const size_t b( key % _length[ l ] );
+		float* const mn( _min[ l ] + b * n );
+		float* const mx( _max[ l ] + b * n );
+		float* const last( _last[ l ] + b * n );
+		double* const sum( _sum[ l ] + b * n );
+		if( _key[ l ][ b ] != key ) {
+			_key[ l ][ b ] = key;
+			_count[ l ][ b ] = 1;
+			for( ChIdx i( 0 ); i < n; ++i ) {
+				mn[ i ] = mx[ i ] = last[ i ] = static_cast< float >( values[ i ] );
+				sum[ i ] = values[ i ];
+			}
+			continue;
+		}
+		++_count[ l ][ b ];
+		for( ChIdx i( 0 ); i < n; ++i ) {
+			const float v( static_cast< float >( values[ i ] ) );
+			mn[ i ] = v < mn[ i ] ? v : mn[ i ];
+			mx[ i ] = v > mx[ i ] ? v : mx[ i ];
+			last[ i ] = v;
+			sum[ i ] += values[ i ];
+		}
+	}
+}
+
+size_t LM50Rollup::fetch( Level level, ChIdx ch, time_t from, time_t to, Bucket* buckets, size_t maxCount ) const {
+	assert( level < countLevels && ch < LM50Device::countChannels );
+	const ChIdx n( LM50Device::countChannels );
+	const int64_t res( _resolution[ level ] );
+	const int64_t len( _length[ level ] );
+	if( _newest[ level ] < 0 || to < from || maxCount == 0 ) return 0;
+
+	// The keys of the interval, clipped to the buckets the ring still holds
+	int64_t last( to / res );
+	if( last > _newest[ level ] ) last = _newest[ level ];
+	int64_t first( ( from + res - 1 ) / res );
+	if( first < _newest[ level ] - len + 1 ) first = _newest[ level ] - len + 1;
+	if( first < last - static_cast< int64_t >( maxCount ) + 1 ) first = last - static_cast< int64_t >( maxCount ) + 1;
+
+	size_t count( 0 );
+	for( int64_t key( first ); key <= last; ++key ) {
+		const size_t b( key % len );
+		if( _key[ level ][ b ] != key ) continue;
+		const size_t i( b * n + ch );
+		Bucket& bucket( buckets[ count++ ] );
+		bucket.time = static_cast< time_t >( key * res );
+		bucket.count = _count[ level ][ b ];
+		bucket.min = _min[ level ][ i ];
+		bucket.max = _max[ level ][ i ];
+		bucket.avg = static_cast< float >( _sum[ level ][ i ] / bucket.count );
+		bucket.last = _last[ level ][ i ];
+	}
+	return count;
+}
+
+LM50Rollup::Level LM50Rollup::levelFor( time_t span, size_t maxCount ) {
+	for( unsigned int l( 0 ); l != countLevels; ++l ) {
+		const time_t buckets( span / _resolution[ l ] );
+		if( buckets <= static_cast< time_t >( _length[ l ] ) && buckets <= static_cast< time_t >( maxCount ) ) return static_cast< Level >( l );
+	}
+	return HOUR;
+}
+
+bool LM50Rollup::levelOf( unsigned int resolution, Level& level ) {
+	for( unsigned int l( 0 ); l != countLevels; ++l ) {
+		if( _resolution[ l ] != resolution ) continue;
+		level = static_cast< Level >( l );
+		return true;
+	}
+	return false;
+}
+
+}
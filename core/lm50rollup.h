@@ -0,0 +1,125 @@
+#ifndef _LM50ROLLUP_H_
+#define _LM50ROLLUP_H_
+
+#include <ctime>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "lm50device.h"
+
+namespace LM50 {
+
+/**
+ * Keeps the power of all channels consolidated at several resolutions in
+ * memory, such that the recent history of a channel can be queried without
+ * reading the RRD file.
+ *
+ * There is one ring of buckets per level:
+ *
+ *   Level     Resolution  Buckets  Span
+ *   SECOND    1s          3600     1 hour
+ *   MINUTE    1min        1440     1 day
+ *   QUARTER   15min       672      1 week
+ *   HOUR      1h          744      31 days
+ *
+ * A bucket holds the minimum, maximum, average and last value of each
+ * channel. The buckets are aligned to multiples of their resolution since
+ * the epoch. Each update() adds the sample to the current bucket of every
+ * level, hence no level is derived from another one and the averages are
+ * exact. A bucket no sample fell into is a gap and is skipped by fetch().
+ *
+ * The values are kept in flat arrays per quantity and level with all
+ * channels of a bucket next to each other, such that update() processes all
+ * channels in simple loops the compiler can vectorize. update() and fetch()
+ * neither allocate memory nor throw. The arrays take about 6.5 MB, but the
+ * pages of the buckets are only touched when the rings fill.
+ */
+class LM50Rollup {
+	public:
+		typedef LM50Device::ChIdx ChIdx;
+
+		enum Level {
+			SECOND = 0,
+			MINUTE = 1,
+			QUARTER = 2,
+			HOUR = 3
+		};
+
+		/**
+		 * A consolidated bucket of one channel
+		 */
+		struct Bucket {
+			time_t time;      // the start of the bucket
+			unsigned int count;
+			float min;
+			float max;
+			float avg;
+			float last;
+		};
+
+	public:
+		LM50Rollup();
+		virtual ~LM50Rollup();
+
+	private:
+		LM50Rollup( const LM50Rollup& );
+		LM50Rollup& operator=( const LM50Rollup& );
+
+	public:
+		/**
+		 * Adds a sample of all channels
+		 * @param values The countChannels values, e.g. LM50Energy::powers
+		 * @param time The time the values have been taken. A time before the
+		 * previous sample is taken as the time of the previous sample.
+		 */
+		void update( const double* values, const struct timespec& time );
+
+		/**
+		 * Copies the buckets of a channel that begin in the given interval,
+		 * oldest first. If there are more than maxCount of them, the newest
+		 * maxCount buckets are copied. The cost is linear in the number of
+		 * buckets of the interval, which is bounded by the length of the ring.
+		 * @param from The unix time the interval starts at
+		 * @param to The unix time the interval ends at, inclusive
+		 * @return The number of buckets copied
+		 */
+		size_t fetch( Level level, ChIdx ch, time_t from, time_t to, Bucket* buckets, size_t maxCount ) const;
+
+		/**
+		 * @return The finest level whose ring spans the given number of seconds
+		 * with at most maxCount buckets, HOUR if none does
+		 */
+		static Level levelFor( time_t span, size_t maxCount );
+
+		/**
+		 * @return The level of the given resolution in seconds
+		 */
+		static bool levelOf( unsigned int resolution, Level& level );
+
+		static unsigned int resolution( Level level ) { return _resolution[ level ]; }
+
+		static size_t length( Level level ) { return _length[ level ]; }
+
+	public:
+		static const unsigned int countLevels = 4;
+
+	protected:
+		static const unsigned int _resolution[ countLevels ];
+		static const size_t _length[ countLevels ];
+
+		// Per level, indexed by bucket * countChannels + channel
+		float* _min[ countLevels ];
+		float* _max[ countLevels ];
+		float* _last[ countLevels ];
+		double* _sum[ countLevels ];
+
+		// Per level, indexed by bucket
+		int64_t* _key[ countLevels ];         // the time divided by the resolution, -1 if unused
+		unsigned int* _count[ countLevels ];
+
+		int64_t _newest[ countLevels ];       // the key of the current bucket
+};
+
+}
+
+#endif
@@ -0,0 +1,44 @@
+#include "lib/mb_crc.h"
+
+namespace ModBus {
+
+/**
+ * Table k holds the CRC of a byte followed by k zero bytes. Hence the CRC
+ * of eight bytes is the XOR of eight lookups, one per byte and table.
+ */
+class CrcTables {
+	public:
+		CrcTables() {
+			for( unsigned int i( 0 ); i != 256; ++i ) {
+				u_int16_t crc( i );
+				for( unsigned int bit( 0 ); bit != 8; ++bit ) crc = ( crc & 1 ) ? ( crc >> 1 ) ^ 0xa001 : crc >> 1;
+				table[0][i] = crc;
+			}
+			for( unsigned int i( 0 ); i != 256; ++i ) {
+				for( unsigned int k( 1 ); k != 8; ++k ) table[k][i] = ( table[k - 1][i] >> 8 ) ^ table[0][ table[k - 1][i] & 0xff ];
+			}
+		}
+
+		u_int16_t table[8][256];
+};
+
+static const CrcTables& crcTables() {
+	static const CrcTables instance;
+	return instance;
+}
+
+u_int16_t crc16( const char* data, size_t length ) {
+	const CrcTables& t( crcTables() );
+	const unsigned char* p( reinterpret_cast< const unsigned char* >( data ) );
+	u_int16_t crc( 0xffff );
+	for( ; length >= 8; length -= 8, p += 8 ) {
+		// The first two bytes are combined with the CRC so far, the others
+		// only depend on their position
+		const u_int16_t x( crc ^ ( p[0] | ( p[1] << 8 ) ) );
+		crc = t.table[7][ x & 0xff ] ^ t.table[6][ x >> 8 ] ^ t.table[5][ p[2] ] ^ t.table[4][ p[3] ] ^ t.table[3][ p[4] ] ^ t.table[2][ p[5] ] ^ t.table[1][ p[6] ] ^ t.table[0][ p[7] ];
+	}
+	for( ; length != 0; --length, ++p ) crc = ( crc >> 8 ) ^ t.table[0][ ( crc ^ *p ) & 0xff ];
+	return crc;
+}
+
+}
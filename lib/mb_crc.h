@@ -0,0 +1,24 @@
+#ifndef _MB_CRC_H_
+#define _MB_CRC_H_
+
+#include <cstddef>
+#include <sys/types.h>
+
+namespace ModBus {
+
+/**
+ * Computes the CRC-16 of a ModBus RTU frame (polynomial 0xA001 in reflected
+ * form, initial value 0xFFFF). The CRC is appended to the frame low byte
+ * first.
+ *
+ * The CRC is computed by slicing-by-8, i.e. eight bytes are processed per
+ * step by eight lookup tables of 256 entries each, instead of one byte per
+ * step. The tables take 4 KiB and are computed once.
+ * @param data The bytes of the frame without the CRC
+ * @param length The number of bytes
+ */
+u_int16_t crc16( const char* data, size_t length );
+
+}
+
+#endif
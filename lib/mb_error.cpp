@@ -0,0 +1,60 @@
+#include "lib/mb_error.h"
+#include "lib/mb_errorres.h"
+
+namespace ModBus {
+
+class ErrorCategory : public boost::system::error_category {
+	public:
+		virtual const char* name() const throw() { return "modbus"; }
+
+		virtual std::string message( int ev ) const {
+			switch( ev ) {
+				case Error::TimeOut:
+					return std::string( "Time out" );
+				case Error::NotConnected:
+					return std::string( "Socket is not connected" );
+				case Error::NoRequest:
+					return std::string( "No request given for transmission" );
+				case Error::UnexpectedReply:
+					return std::string( "Unexepected datagram format" );
+				case Error::TransactionMismatch:
+					return std::string( "Received a response datagram, but it does not belong to our conversation" );
+				case Error::TruncatedReply:
+					return std::string( "Received a truncated response datagram" );
+				case Error::MalformedReply:
+					return std::string( "Received data does not seem to be a ModBus datagram" );
+				case Error::TraceExhausted:
+					return std::string( "Reached the end of the replayed trace" );
+				case Error::TraceMismatch:
+					return std::string( "The replayed trace does not contain the request" );
+				case Error::ChecksumMismatch:
+					return std::string( "Received a RTU frame with an invalid CRC" );
+				default:
+					return std::string( "Unknown error" );
+			}
+		}
+};
+
+
+class ExceptionCategory : public boost::system::error_category {
+	public:
+		virtual const char* name() const throw() { return "modbus.exception"; }
+
+		virtual std::string message( int ev ) const {
+			return Datagram::ErrorRes::exceptionMessage( static_cast< Datagram::ExceptionCode >( ev ) );
+		}
+};
+
+
+const boost::system::error_category& errorCategory() {
+	static const ErrorCategory instance;
+	return instance;
+}
+
+
+const boost::system::error_category& exceptionCategory() {
+	static const ExceptionCategory instance;
+	return instance;
+}
+
+}
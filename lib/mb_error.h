@@ -0,0 +1,85 @@
+#ifndef _MB_ERROR_H_
+#define _MB_ERROR_H_
+
+#include <boost/system/error_code.hpp>
+#include <boost/system/system_error.hpp>
+
+#include "lib/mb_constants.h"
+
+namespace ModBus {
+
+/**
+ * Error conditions of a request-and-reply round that are detected by this
+ * library. They are reported as boost::system::error_code of the category
+ * ModBus::errorCategory() such that they can be passed around without
+ * throwing exceptions, just like the I/O errors reported by boost::asio.
+ *
+ * Altogether a failed round is described by one of three categories:
+ *   - boost::system::system_category() (and friends of boost::asio) for
+ *     transport errors, e.g. a connection that has been reset by the peer
+ *   - ModBus::errorCategory() for protocol errors detected by this library
+ *   - ModBus::exceptionCategory() for exception replies sent by the device.
+ *     The value of the error code equals the ModBus exception code (see
+ *     ModBus::Exception)
+ */
+namespace Error {
+	enum Error {
+		TimeOut = 1,
+		NotConnected,
+		NoRequest,
+		UnexpectedReply,
+		TransactionMismatch,
+		TruncatedReply,
+		MalformedReply,
+		TraceExhausted,
+		TraceMismatch,
+		ChecksumMismatch
+	};
+}
+
+const boost::system::error_category& errorCategory();
+
+const boost::system::error_category& exceptionCategory();
+
+namespace Error {
+	// Found by argument dependent lookup, enables implicit conversion of
+	// ModBus::Error::Error into boost::system::error_code
+	inline boost::system::error_code make_error_code( Error e ) {
+		return boost::system::error_code( static_cast< int >( e ), errorCategory() );
+	}
+}
+
+inline boost::system::error_code makeExceptionCode( Datagram::ExceptionCode e ) {
+	return boost::system::error_code( static_cast< int >( e ), exceptionCategory() );
+}
+
+/**
+ * @return True, if the device has answered with an exception reply. In this
+ * case the connection is still intact and does not need to be re-established.
+ */
+inline bool isDeviceException( const boost::system::error_code& ec ) {
+	return ec.category() == exceptionCategory();
+}
+
+/**
+ * Throws a boost::system::system_error (which is a std::runtime_error) if
+ * the given error code indicates an error. This is the thin wrapper that
+ * turns the non-throwing functions of this library into throwing ones.
+ */
+inline void throwOnError( const boost::system::error_code& ec ) {
+	if( ec ) throw boost::system::system_error( ec, "ModBus error" );
+}
+
+}
+
+namespace boost {
+namespace system {
+
+template<> struct is_error_code_enum< ModBus::Error::Error > {
+	static const bool value = true;
+};
+
+}
+}
+
+#endif
@@ -7,6 +7,17 @@ namespace ModBus {
 namespace Datagram {
 
 
+ErrorRes::ErrorRes( TransactionID transaction, UnitID unit, FuncCode func, ExceptionCode code ) : Base() {
+	dgram = new ErrorResDatagram;
+	dgram->structData.header.transactionID = htons( transaction );
+	dgram->structData.header.protocolID = 0x0000;
+	dgram->structData.header.length = htons( 3 );
+	dgram->structData.header.unitID = unit;
+	dgram->structData.header.funcCode = func | Function::Error;
+	dgram->structData.exCode = code;
+}
+
+
 ErrorRes::ErrorRes( const char* rawDatagram, unsigned int length ) : Base() {
 	// An error reply datagram is exactly 9 bytes long. The raw data might
 	// be longer if some additional bogus has been captured at the end
@@ -31,8 +42,8 @@ ErrorRes::~ErrorRes() {
 	if( dgram ) delete dgram;
 }
 
-std::string ErrorRes::exceptionMessage() const {
-	switch( exceptionCode() ) {
+std::string ErrorRes::exceptionMessage( ExceptionCode code ) {
+	switch( code ) {
 		case Exception::IllegalFunction:
 			return std::string( "Illegal function" );
 		case Exception::IllegalAddress:
@@ -30,6 +30,17 @@ class ErrorRes : public Base {
 		};
 		
 	public:
+		/**
+		 * Creates an exception reply. This is used by servers that answer
+		 * requests.
+		 * @param transaction The transaction id of the corresponding request
+		 * @param unit The unit id of the replying device
+		 * @param func The function code of the request. The error bit is set
+		 * automatically.
+		 * @param code The exception code (see ModBus::Exception)
+		 */
+		ErrorRes( TransactionID transaction, UnitID unit, FuncCode func, ExceptionCode code );
+		
 		/**
 		* @param rawDatagram The raw bytes
 		* @param length The length of the char array. I.e. it is NOT the length
@@ -103,7 +114,12 @@ class ErrorRes : public Base {
 			return dgram->structData.exCode;
 		}
 		
-		std::string exceptionMessage() const;
+		std::string exceptionMessage() const { return exceptionMessage( exceptionCode() ); }
+		
+		/**
+		 * @return A human readable description of the given exception code
+		 */
+		static std::string exceptionMessage( ExceptionCode code );
 		
 		virtual const char* rawDatagram() const {
 			assert( dgram != nullptr );
@@ -0,0 +1,131 @@
+#ifndef _MB_HANDLERMEM_H_
+#define _MB_HANDLERMEM_H_
+
+#include <cstddef>
+#include <new>
+
+namespace ModBus {
+
+/**
+ * A small pool of memory blocks for the asynchronous operations of
+ * Boost.Asio. For each pending asynchronous operation (send, receive, wait)
+ * Boost.Asio allocates an operation object that holds the handler. By
+ * default this memory is taken from the heap on each operation. Handlers
+ * wrapped by makeAllocHandler() take the memory from a pool of this class
+ * instead, hence a request-and-reply round does not touch the heap.
+ *
+ * If all blocks are in use or the operation object is too large, the
+ * memory is allocated by operator new as a fall back.
+ *
+ * The pool is not thread-safe. All handlers that share a pool must be run
+ * by the same thread, which is the case for TcpRequestAndReply.
+ */
+class HandlerMemory {
+	public:
+		HandlerMemory() : inUse( 0 ) {}
+
+	private:
+		HandlerMemory( const HandlerMemory& );
+		HandlerMemory& operator=( const HandlerMemory& );
+
+	public:
+		void* allocate( std::size_t size ) {
+			if( size <= blockSize ) {
+				for( unsigned int i( 0 ); i != blockCount; ++i ) {
+					if( inUse & ( 1u << i ) ) continue;
+					inUse |= ( 1u << i );
+					return blocks[i].data;
+				}
+			}
+			return ::operator new( size );
+		}
+
+		void deallocate( void* p ) {
+			for( unsigned int i( 0 ); i != blockCount; ++i ) {
+				if( p != blocks[i].data ) continue;
+				inUse &= ~( 1u << i );
+				return;
+			}
+			::operator delete( p );
+		}
+
+	protected:
+		enum { blockSize = 512, blockCount = 8 };
+
+		union Block {
+			char data[ blockSize ];
+			long double alignDouble;
+			void* alignPointer;
+		};
+
+		Block blocks[ blockCount ];
+		unsigned int inUse;
+};
+
+
+/**
+ * A standard allocator on top of HandlerMemory. Boost.Asio uses the
+ * allocator that is associated with a handler (i.e. returned by its
+ * get_allocator() function) for the operation object.
+ */
+template< typename T > class HandlerAllocator {
+	public:
+		typedef T value_type;
+
+		template< typename U > struct rebind {
+			typedef HandlerAllocator< U > other;
+		};
+
+		explicit HandlerAllocator( HandlerMemory& m ) : memory( m ) {}
+
+		template< typename U > HandlerAllocator( const HandlerAllocator< U >& other ) : memory( other.memory ) {}
+
+		T* allocate( std::size_t n ) const {
+			return static_cast< T* >( memory.allocate( sizeof( T ) * n ) );
+		}
+
+		void deallocate( T* p, std::size_t ) const {
+			memory.deallocate( p );
+		}
+
+		bool operator==( const HandlerAllocator& other ) const { return &memory == &other.memory; }
+
+		bool operator!=( const HandlerAllocator& other ) const { return &memory != &other.memory; }
+
+		HandlerMemory& memory;
+};
+
+
+/**
+ * Wraps a completion handler such that Boost.Asio allocates its operation
+ * object from the given pool
+ */
+template< typename Handler > class AllocHandler {
+	public:
+		typedef HandlerAllocator< Handler > allocator_type;
+
+		AllocHandler( HandlerMemory& m, const Handler& h ) : memory( m ), handler( h ) {}
+
+		allocator_type get_allocator() const { return allocator_type( memory ); }
+
+		template< typename Arg1 > void operator()( const Arg1& arg1 ) {
+			handler( arg1 );
+		}
+
+		template< typename Arg1, typename Arg2 > void operator()( const Arg1& arg1, const Arg2& arg2 ) {
+			handler( arg1, arg2 );
+		}
+
+	protected:
+		HandlerMemory& memory;
+		Handler handler;
+};
+
+
+template< typename Handler > inline AllocHandler< Handler > makeAllocHandler( HandlerMemory& m, const Handler& h ) {
+	return AllocHandler< Handler >( m, h );
+}
+
+}
+
+#endif
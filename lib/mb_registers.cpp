@@ -0,0 +1,64 @@
+#include "lib/mb_registers.h"
+
+namespace ModBus {
+
+/**
+ * The layout of both replies is identical: The header, one byte count and
+ * the register values.
+ */
+Registers Registers::decode( const char* raw, size_t nRaw, Datagram::FuncCode func, Datagram::TransactionID transaction, u_int16_t length, boost::system::error_code& ec ) {
+	const Datagram::Header* header = reinterpret_cast< const Datagram::Header* >( raw );
+	
+	if( nRaw < 9 ) {
+		ec = Error::TruncatedReply;
+		return Registers();
+	}
+	if( header->funcCode & Function::Error ) {
+		ec = makeExceptionCode( raw[8] );
+		return Registers();
+	}
+	if( header->funcCode != func ) {
+		ec = Error::UnexpectedReply;
+		return Registers();
+	}
+	if( ntohs( header->transactionID ) != transaction ) {
+		ec = Error::TransactionMismatch;
+		return Registers();
+	}
+	
+	// The length field and the byte count must be consistent (see
+	// ReadInputRegistersRes) and the reply must contain every requested register
+	const size_t mbLength( ntohs( header->length ) );
+	const size_t byteCount( static_cast< unsigned char >( raw[8] ) );
+	if( mbLength != byteCount + 3 || nRaw < mbLength + 6 ) {
+		ec = Error::MalformedReply;
+		return Registers();
+	}
+	if( byteCount != 2u * length ) {
+		ec = Error::TruncatedReply;
+		return Registers();
+	}
+	
+	ec.clear();
+	return Registers( transaction, raw + 9, length );
+}
+
+
+void Registers::uint32Array( u_int32_t* dest ) const {
+	const size_t n( size32() );
+	for( size_t j = 0; j < n; j++ ) {
+		u_int32_t bigEndian;
+		memcpy( &bigEndian, _values + 4 * j, 4 );
+		dest[j] = ntohl( bigEndian );
+	}
+}
+
+
+std::string Registers::ascii() const {
+	const size_t nBytes( 2 * _count );
+	size_t len( 0 );
+	while( len < nBytes && _values[len] != '\0' ) ++len;
+	return std::string( _values, len );
+}
+
+}
@@ -0,0 +1,113 @@
+#ifndef _MB_REGISTERS_H_
+#define _MB_REGISTERS_H_
+
+#include <netinet/in.h>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "lib/mb_error.h"
+#include "lib/mb_typedefs.h"
+#include "lib/nullptr.h"
+
+namespace ModBus {
+
+/**
+ * A decoded block of 16-bit registers as returned by a ReadHoldingRegisters
+ * or ReadInputRegisters reply.
+ *
+ * An object of this class does not own the register values but is only a view
+ * into the receive buffer of the communication object that produced it. No
+ * bytes are copied and no memory is allocated. As a consequence the view is
+ * only valid until the next request is transmitted by the same communication
+ * object. If the values are needed for longer, the caller must copy them.
+ */
+class Registers {
+	public:
+		Registers() : _transactionID( 0 ), _values( nullptr ), _count( 0 ) {}
+
+		/**
+		 * @param transaction The transaction id of the reply the values belong to
+		 * @param values Pointer to the first byte of the register values in
+		 * network byte order (big endian)
+		 * @param count The number of 16-bit registers, i.e. half the number
+		 * of bytes
+		 */
+		Registers( Datagram::TransactionID transaction, const char* values, size_t count ) : _transactionID( transaction ), _values( values ), _count( count ) {}
+
+	public:
+		/**
+		 * Interprets a raw reply as the reply to a ReadHoldingRegisters or
+		 * ReadInputRegisters request without creating a datagram object and
+		 * checks it for common errors: ModBus exception replies, unexpected
+		 * function codes, transaction mismatch and truncated replies.
+		 * @param raw The raw bytes of the reply
+		 * @param nRaw The number of bytes at raw
+		 * @param func The function code of the request
+		 * @param transaction The transaction id of the request
+		 * @param length The number of requested 16bit registers
+		 * @param ec Set to indicate what error occured, if any
+		 * @return A view into raw or an empty view on error
+		 */
+		static Registers decode( const char* raw, size_t nRaw, Datagram::FuncCode func, Datagram::TransactionID transaction, u_int16_t length, boost::system::error_code& ec );
+
+		Datagram::TransactionID transactionID() const { return _transactionID; }
+
+		/**
+		 * @return The number of 16-bit registers
+		 */
+		size_t size() const { return _count; }
+
+		/**
+		 * @return The number of 32-bit values, i.e. the number of consecutive
+		 * pairs of 16-bit registers
+		 */
+		size_t size32() const { return _count / 2; }
+
+		/**
+		 * @return The raw bytes in network byte order. The number of bytes
+		 * equals twice Registers::size()
+		 */
+		const char* bytes() const { return _values; }
+
+		u_int16_t uint16( size_t index ) const {
+			if( index >= _count ) throw std::out_of_range( "index exceeds size of 16-bit integer array" );
+			u_int16_t bigEndian;
+			memcpy( &bigEndian, _values + 2 * index, 2 );
+			return ntohs( bigEndian );
+		}
+
+		/**
+		 * @return The index-th 32-bit integer. The high order word comes first
+		 * as the LM50TCP+ and most other devices store them this way.
+		 */
+		u_int32_t uint32( size_t index ) const {
+			if( index >= size32() ) throw std::out_of_range( "index exceeds size of 32-bit integer array" );
+			u_int32_t bigEndian;
+			memcpy( &bigEndian, _values + 4 * index, 4 );
+			return ntohl( bigEndian );
+		}
+
+		/**
+		 * Decodes all 32-bit values at once into the given array. This is the
+		 * preferred way to read many values, because the range check is only
+		 * performed once.
+		 * @param dest Array with at least Registers::size32() elements
+		 */
+		void uint32Array( u_int32_t* dest ) const;
+
+		/**
+		 * @return The registers interpreted as a zero terminated ASCII string
+		 */
+		std::string ascii() const;
+
+	protected:
+		Datagram::TransactionID _transactionID;
+		const char* _values;
+		size_t _count;
+};
+
+}
+
+#endif
@@ -6,6 +6,20 @@ namespace ModBus {
 namespace Datagram {
 
 
+ReadHoldingRegistersRes::ReadHoldingRegistersRes( TransactionID transaction, UnitID unit, const char* values, size_t byteCount ): Base() {
+	if( ( byteCount & 1 ) || byteCount == 0 || byteCount > 2 * 0x7d ) throw std::out_of_range( "Number of bytes must be even and between 2 and 0xfa" );
+	
+	dgram = reinterpret_cast< RHRegResDatagram* >( new char[ byteCount + 9 ] );
+	dgram->structData.header.transactionID = htons( transaction );
+	dgram->structData.header.protocolID = 0x0000;
+	dgram->structData.header.length = htons( byteCount + 3 );
+	dgram->structData.header.unitID = unit;
+	dgram->structData.header.funcCode = Function::ReadHoldingRegisters;
+	dgram->structData.byteCount = byteCount;
+	memcpy( dgram->structData.value, values, byteCount );
+}
+
+
 ReadHoldingRegistersRes::ReadHoldingRegistersRes( const char* rawDatagram, unsigned int length ): Base() {
 	// An read holding registers response datagram is at least 9 bytes long.
 	// (8 bytes header and 1 byte counter)
@@ -27,6 +27,17 @@ class ReadInputRegistersRes : public Base {
 		};
 		
 	public:
+		/**
+		 * Creates a reply that carries the given register values. This is used
+		 * by servers that answer requests.
+		 * @param transaction The transaction id of the corresponding request
+		 * @param unit The unit id of the replying device
+		 * @param values The register values in network byte order (big endian)
+		 * @param byteCount The number of bytes at values. Must be even and at
+		 * most 250 (i.e. 0x7d registers)
+		 */
+		ReadInputRegistersRes( TransactionID transaction, UnitID unit, const char* values, size_t byteCount );
+		
 		/**
 		* @param rawDatagram The raw bytes
 		* @param length The length of the char array. I.e. it is NOT the length
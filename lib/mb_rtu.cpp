@@ -0,0 +1,120 @@
+#include "lib/mb_rtu.h"
+#include "lib/mb_crc.h"
+
+#include <cstring>
+#include <netinet/in.h>
+
+namespace ModBus {
+namespace Rtu {
+
+const size_t unknownLength( static_cast< size_t >( -1 ) );
+
+size_t fromTcp( const char* datagram, size_t length, char* frame ) {
+	if( length < 8 || length > Datagram::Base::maxDatagramLength ) return 0;
+	Datagram::Header header;
+	memcpy( &header, datagram, sizeof( header ) );
+	const size_t pduLength( ntohs( header.length ) );
+	if( header.protocolID != 0x00 || pduLength + 6 != length || pduLength + 2 > maxFrameLength ) return 0;
+	// The unit id and the PDU follow the first six bytes of the header
+	memcpy( frame, datagram + 6, pduLength );
+	const u_int16_t crc( crc16( frame, pduLength ) );
+	frame[ pduLength ] = static_cast< char >( crc );
+	frame[ pduLength + 1 ] = static_cast< char >( crc >> 8 );
+	return pduLength + 2;
+}
+
+
+size_t toTcp( const char* frame, size_t length, Datagram::TransactionID transaction, char* datagram, boost::system::error_code& ec ) {
+	if( length < 4 || length > maxFrameLength ) {
+		ec = Error::MalformedReply;
+		return 0;
+	}
+	const u_int16_t crc( crc16( frame, length - 2 ) );
+	if( static_cast< unsigned char >( frame[ length - 2 ] ) != ( crc & 0xff ) || static_cast< unsigned char >( frame[ length - 1 ] ) != ( crc >> 8 ) ) {
+		ec = Error::ChecksumMismatch;
+		return 0;
+	}
+	const size_t pduLength( length - 2 );
+	datagram[0] = static_cast< char >( transaction >> 8 );
+	datagram[1] = static_cast< char >( transaction );
+	datagram[2] = 0x00;
+	datagram[3] = 0x00;
+	datagram[4] = static_cast< char >( pduLength >> 8 );
+	datagram[5] = static_cast< char >( pduLength );
+	memcpy( datagram + 6, frame, pduLength );
+	ec.clear();
+	return pduLength + 6;
+}
+
+
+/**
+ * The lengths include the unit id, the function code and the CRC
+ */
+size_t requestLength( const char* frame, size_t n ) {
+	if( n < 2 ) return 0;
+	const unsigned char* f( reinterpret_cast< const unsigned char* >( frame ) );
+	switch( f[1] ) {
+		case Function::ReadCoils:
+		case Function::ReadDiscreteInputs:
+		case Function::ReadHoldingRegisters:
+		case Function::ReadInputRegisters:
+		case Function::WriteSingleCoil:
+		case Function::WriteSingleRegister:
+			return 8;
+		case Function::WriteMultipleCoils:
+		case Function::WriteMultipleRegisters:
+			// Address, quantity and a byte count precede the values
+			return n < 7 ? 0 : 9 + f[6];
+		case Function::MaskWriteRegister:
+			return 10;
+		case Function::ReadWriteMultipleRegisters:
+			return n < 11 ? 0 : 13 + f[10];
+		case Function::ReadFileRecord:
+		case Function::WriteFileRecord:
+			return n < 3 ? 0 : 5 + f[2];
+		case Function::ReadFIFOQueue:
+			return 6;
+		default:
+			return unknownLength;
+	}
+}
+
+
+size_t replyLength( const char* frame, size_t n ) {
+	if( n < 2 ) return 0;
+	const unsigned char* f( reinterpret_cast< const unsigned char* >( frame ) );
+	// An exception reply only carries the exception code
+	if( f[1] & Function::Error ) return 5;
+	switch( f[1] ) {
+		case Function::ReadCoils:
+		case Function::ReadDiscreteInputs:
+		case Function::ReadHoldingRegisters:
+		case Function::ReadInputRegisters:
+		case Function::ReadWriteMultipleRegisters:
+		case Function::ReadFileRecord:
+		case Function::WriteFileRecord:
+			// A byte count precedes the values
+			return n < 3 ? 0 : 5 + f[2];
+		case Function::ReadFIFOQueue:
+			return n < 4 ? 0 : 6 + ( ( f[2] << 8 ) | f[3] );
+		case Function::WriteSingleCoil:
+		case Function::WriteSingleRegister:
+		case Function::WriteMultipleCoils:
+		case Function::WriteMultipleRegisters:
+			return 8;
+		case Function::MaskWriteRegister:
+			return 10;
+		default:
+			return unknownLength;
+	}
+}
+
+
+boost::posix_time::time_duration interFrameGap( unsigned long baud ) {
+	if( baud == 0 || baud > 19200 ) return boost::posix_time::microseconds( 1750 );
+	// 3.5 characters of 11 bits are 38.5 bit times
+	return boost::posix_time::microseconds( 38500000ul / baud );
+}
+
+}
+}
@@ -0,0 +1,83 @@
+#ifndef _MB_RTU_H_
+#define _MB_RTU_H_
+
+#include <cstddef>
+#include <sys/types.h>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mb_base.h"
+#include "mb_error.h"
+
+namespace ModBus {
+
+/**
+ * The framing of ModBus RTU, i.e. of ModBus on a serial line.
+ *
+ * A RTU frame consists of the unit id, the function code, the data and a
+ * CRC-16 (see ModBus::crc16). In contrast to ModBus/TCP there is neither a
+ * transaction id nor a length field. On the serial line the frames are
+ * separated by a silence of at least 3.5 characters. Where the silence
+ * cannot be observed reliably (e.g. if the frames are tunneled through TCP)
+ * the length of a frame must be derived from its function code.
+ *
+ * The functions convert between RTU frames and the ModBus/TCP framing of
+ * the datagram classes, such that both framings share the same datagram
+ * classes. The PDU (function code and data) is identical in both framings.
+ */
+namespace Rtu {
+	enum {
+		// The unit id, 253 bytes of PDU and the CRC
+		maxFrameLength = 256
+	};
+
+	/**
+	 * Converts a datagram in ModBus/TCP framing into a RTU frame
+	 * @param datagram The raw datagram
+	 * @param length The number of bytes of the datagram
+	 * @param frame Buffer of at least Rtu::maxFrameLength bytes
+	 * @return The length of the frame including the CRC. Zero, if the
+	 * datagram is not a valid ModBus/TCP datagram.
+	 */
+	size_t fromTcp( const char* datagram, size_t length, char* frame );
+
+	/**
+	 * Converts a RTU frame into a datagram in ModBus/TCP framing and checks
+	 * the CRC. Reports ModBus::Error::ChecksumMismatch or
+	 * ModBus::Error::MalformedReply.
+	 * @param frame The frame including the CRC
+	 * @param length The length of the frame
+	 * @param transaction The transaction id of the datagram
+	 * @param datagram Buffer of at least Datagram::Base::maxDatagramLength bytes
+	 * @return The length of the datagram or zero on error
+	 */
+	size_t toTcp( const char* frame, size_t length, Datagram::TransactionID transaction, char* datagram, boost::system::error_code& ec );
+
+	/**
+	 * Determines the length of a request frame from its first bytes. This
+	 * is needed by servers, which receive the requests.
+	 * @param frame The bytes received so far
+	 * @param n The number of bytes at frame
+	 * @return The length of the frame, zero if more bytes are needed to tell
+	 * or Rtu::unknownLength for unknown function codes
+	 */
+	size_t requestLength( const char* frame, size_t n );
+
+	/**
+	 * Determines the length of a reply frame from its first bytes. See
+	 * Rtu::requestLength.
+	 */
+	size_t replyLength( const char* frame, size_t n );
+
+	/**
+	 * @return The silence between two frames on a serial line of the given
+	 * baud rate, i.e. 3.5 characters of 11 bits. Above 19200 baud the
+	 * specification fixes the silence to 1.75 ms.
+	 */
+	boost::posix_time::time_duration interFrameGap( unsigned long baud );
+
+	extern const size_t unknownLength;
+}
+
+}
+
+#endif
@@ -0,0 +1,326 @@
+#include "lib/mb_rtucomm.h"
+#include "lib/mb_crc.h"
+
+#include <algorithm>
+#include <boost/asio/error.hpp>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace ModBus {
+
+static boost::system::error_code lastSystemError() {
+	return boost::system::error_code( errno, boost::system::system_category() );
+}
+
+static long toMs( const struct timespec& ts ) {
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+RtuCommunication::RtuCommunication( const boost::posix_time::time_duration& gap, bool isSpaced ) : fd( -1 ), timeoutDuration( boost::posix_time::seconds( 1 ) ), frameGap( gap ), spaceFrames( isSpaced ), lastActivity(), deadline(), requestLength( 0 ), replyLength( 0 ), responseLength( 0 ) {
+	memset( requestFrame, 0x00, sizeof( requestFrame ) );
+	memset( replyFrame, 0x00, sizeof( replyFrame ) );
+	memset( responseBuffer, 0x00, sizeof( responseBuffer ) );
+}
+
+
+RtuCommunication::~RtuCommunication() {
+	close();
+}
+
+
+void RtuCommunication::close() {
+	if( fd < 0 ) return;
+	::close( fd );
+	fd = -1;
+}
+
+
+const char* RtuCommunication::transact( const Datagram::Base& request, size_t& length, boost::system::error_code& ec ) {
+	length = 0;
+	requestLength = Rtu::fromTcp( request.rawDatagram(), request.totalLength(), requestFrame );
+	if( requestLength == 0 ) {
+		ec = Error::NoRequest;
+		return responseBuffer;
+	}
+	run( request.transactionID(), ec );
+	if( !ec ) length = responseLength;
+	return responseBuffer;
+}
+
+
+Registers RtuCommunication::readHoldingRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec ) {
+	return readRegisters( Function::ReadHoldingRegisters, transaction, unit, addr, length, ec );
+}
+
+
+Registers RtuCommunication::readInputRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec ) {
+	return readRegisters( Function::ReadInputRegisters, transaction, unit, addr, length, ec );
+}
+
+
+/**
+ * Writes the request directly into the frame buffer and decodes the reply
+ * in place, see Registers::decode
+ */
+Registers RtuCommunication::readRegisters( Datagram::FuncCode func, Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec ) {
+	if( length == 0 || length > 0x7d ) throw std::out_of_range( "Number of registers to read must be between 1 and 0x7d" );
+	requestFrame[0] = static_cast< char >( unit );
+	requestFrame[1] = static_cast< char >( func );
+	requestFrame[2] = static_cast< char >( addr >> 8 );
+	requestFrame[3] = static_cast< char >( addr );
+	requestFrame[4] = static_cast< char >( length >> 8 );
+	requestFrame[5] = static_cast< char >( length );
+	const u_int16_t crc( crc16( requestFrame, 6 ) );
+	requestFrame[6] = static_cast< char >( crc );
+	requestFrame[7] = static_cast< char >( crc >> 8 );
+	requestLength = 8;
+	run( transaction, ec );
+	if( ec ) return Registers();
+	return Registers::decode( responseBuffer, responseLength, func, transaction, length, ec );
+}
+
+
+/**
+ * Makes one round with the device and converts the reply into ModBus/TCP
+ * framing. The time out covers the whole round.
+ */
+void RtuCommunication::run( Datagram::TransactionID transaction, boost::system::error_code& ec ) {
+	responseLength = 0;
+	if( fd < 0 ) {
+		ec = Error::NotConnected;
+		return;
+	}
+	clock_gettime( CLOCK_MONOTONIC, &deadline );
+	const long timeout( timeoutDuration.total_microseconds() );
+	deadline.tv_sec += timeout / 1000000;
+	deadline.tv_nsec += ( timeout % 1000000 ) * 1000;
+	if( deadline.tv_nsec >= 1000000000 ) {
+		deadline.tv_nsec -= 1000000000;
+		++deadline.tv_sec;
+	}
+
+	discardInput();
+	if( spaceFrames ) sleepUntilGap();
+	send( ec );
+	if( ec ) return;
+	receive( ec );
+	if( ec ) return;
+	responseLength = Rtu::toTcp( replyFrame, replyLength, transaction, responseBuffer, ec );
+	if( ec ) return;
+	if( replyFrame[0] != requestFrame[0] || ( static_cast< unsigned char >( replyFrame[1] ) & ~Function::Error ) != static_cast< unsigned char >( requestFrame[1] ) ) {
+		responseLength = 0;
+		ec = Error::UnexpectedReply;
+	}
+}
+
+
+void RtuCommunication::send( boost::system::error_code& ec ) {
+	size_t nSent( 0 );
+	while( nSent < requestLength ) {
+		const ssize_t n( ::write( fd, requestFrame + nSent, requestLength - nSent ) );
+		if( n > 0 ) {
+			nSent += n;
+			continue;
+		}
+		if( n < 0 && errno != EAGAIN && errno != EINTR ) {
+			ec = lastSystemError();
+			return;
+		}
+		struct pollfd pfd = { fd, POLLOUT, 0 };
+		const long wait( remainingMs() );
+		if( wait == 0 || ( poll( &pfd, 1, wait ) == 0 ) ) {
+			ec = Error::TimeOut;
+			return;
+		}
+	}
+	touch();
+	ec.clear();
+}
+
+
+/**
+ * Receives bytes until the reply is complete according to its function
+ * code. A reply of unknown length is complete after the inter-frame gap.
+ * Surplus bytes are discarded before the next request.
+ */
+void RtuCommunication::receive( boost::system::error_code& ec ) {
+	replyLength = 0;
+	size_t expected( 0 );
+	const long gap( std::max( 1l, static_cast< long >( ( frameGap.total_microseconds() + 999 ) / 1000 ) ) );
+	while( true ) {
+		const bool byGap( replyLength != 0 && expected == Rtu::unknownLength );
+		long wait( remainingMs() );
+		if( byGap && gap < wait ) wait = gap;
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		const int res( wait == 0 ? 0 : poll( &pfd, 1, wait ) );
+		if( res < 0 && errno == EINTR ) continue;
+		if( res < 0 ) {
+			ec = lastSystemError();
+			return;
+		}
+		if( res == 0 ) {
+			if( byGap ) break;
+			ec = Error::TimeOut;
+			return;
+		}
+
+		const ssize_t n( ::read( fd, replyFrame + replyLength, Rtu::maxFrameLength - replyLength ) );
+		if( n == 0 ) {
+			ec = boost::asio::error::eof;
+			return;
+		}
+		if( n < 0 ) {
+			if( errno == EAGAIN || errno == EINTR ) continue;
+			ec = lastSystemError();
+			return;
+		}
+		touch();
+		replyLength += n;
+		expected = Rtu::replyLength( replyFrame, replyLength );
+		if( expected != 0 && expected != Rtu::unknownLength && replyLength >= expected ) {
+			replyLength = expected;
+			break;
+		}
+		if( replyLength == Rtu::maxFrameLength ) {
+			if( expected == Rtu::unknownLength ) break;
+			ec = Error::MalformedReply;
+			return;
+		}
+	}
+	ec.clear();
+}
+
+
+/**
+ * Reads and drops all bytes that are available without waiting, e.g. the
+ * late reply to a request that timed out or noise on the line
+ */
+void RtuCommunication::discardInput() {
+	char buffer[ Rtu::maxFrameLength ];
+	while( ::read( fd, buffer, sizeof( buffer ) ) > 0 ) touch();
+}
+
+
+/**
+ * Waits until the line has been silent for the inter-frame gap
+ */
+void RtuCommunication::sleepUntilGap() {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	const long elapsed( ( now.tv_sec - lastActivity.tv_sec ) * 1000000 + ( now.tv_nsec - lastActivity.tv_nsec ) / 1000 );
+	const long remaining( frameGap.total_microseconds() - elapsed );
+	if( remaining <= 0 ) return;
+	struct timespec pause = { 0, remaining * 1000 };
+	nanosleep( &pause, NULL );
+}
+
+
+/**
+ * @return The milliseconds until the deadline of the current round or zero,
+ * if the deadline has passed
+ */
+long RtuCommunication::remainingMs() const {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	const long remaining( toMs( deadline ) - toMs( now ) );
+	return remaining > 0 ? remaining : 0;
+}
+
+
+
+RtuTcpCommunication::RtuTcpCommunication() : RtuCommunication( boost::posix_time::milliseconds( 20 ), false ) {
+}
+
+
+void RtuTcpCommunication::open( const std::string& remoteHost, const std::string& port, boost::system::error_code& ec ) {
+	close();
+	struct addrinfo hints;
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo* res( NULL );
+	if( getaddrinfo( remoteHost.c_str(), port.c_str(), &hints, &res ) != 0 ) {
+		ec = boost::asio::error::host_not_found;
+		return;
+	}
+	fd = socket( res->ai_family, res->ai_socktype, res->ai_protocol );
+	if( fd < 0 || connect( fd, res->ai_addr, res->ai_addrlen ) < 0 ) {
+		ec = lastSystemError();
+		freeaddrinfo( res );
+		close();
+		return;
+	}
+	freeaddrinfo( res );
+	const int one( 1 );
+	setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+	fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+	ec.clear();
+}
+
+
+
+RtuSerialCommunication::RtuSerialCommunication() : RtuCommunication( Rtu::interFrameGap( 9600 ), true ) {
+}
+
+
+void RtuSerialCommunication::open( const std::string& device, const std::string& settings, boost::system::error_code& ec ) {
+	close();
+	static const struct { unsigned long baud; speed_t speed; } speeds[] = {
+		{ 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 }, { 19200, B19200 },
+		{ 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 }, { 230400, B230400 }
+	};
+	char* end( NULL );
+	const unsigned long baud( strtoul( settings.c_str(), &end, 10 ) );
+	speed_t speed( B0 );
+	for( size_t i( 0 ); i != sizeof( speeds ) / sizeof( speeds[0] ); ++i ) {
+		if( speeds[i].baud == baud ) speed = speeds[i].speed;
+	}
+	// The optional format, e.g. ":8N1"
+	std::string format( "8E1" );
+	if( *end == ':' ) format.assign( end + 1 );
+	else if( *end != '\0' ) speed = B0;
+	if( speed == B0 || format.size() != 3 || format[0] < '5' || format[0] > '8' || !strchr( "NEO", format[1] ) || ( format[2] != '1' && format[2] != '2' ) ) {
+		ec = boost::system::errc::make_error_code( boost::system::errc::invalid_argument );
+		return;
+	}
+
+	fd = ::open( device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK );
+	struct termios tio;
+	if( fd < 0 || tcgetattr( fd, &tio ) < 0 ) {
+		ec = lastSystemError();
+		close();
+		return;
+	}
+	cfmakeraw( &tio );
+	static const tcflag_t sizes[] = { CS5, CS6, CS7, CS8 };
+	tio.c_cflag &= ~( CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS );
+	tio.c_cflag |= sizes[ format[0] - '5' ] | CLOCAL | CREAD;
+	if( format[1] != 'N' ) tio.c_cflag |= PARENB;
+	if( format[1] == 'O' ) tio.c_cflag |= PARODD;
+	if( format[2] == '2' ) tio.c_cflag |= CSTOPB;
+	tio.c_cc[ VMIN ] = 0;
+	tio.c_cc[ VTIME ] = 0;
+	cfsetispeed( &tio, speed );
+	cfsetospeed( &tio, speed );
+	if( tcsetattr( fd, TCSANOW, &tio ) < 0 ) {
+		ec = lastSystemError();
+		close();
+		return;
+	}
+	tcflush( fd, TCIOFLUSH );
+	interFrameGap( Rtu::interFrameGap( baud ) );
+	ec.clear();
+}
+
+}
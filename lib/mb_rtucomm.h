@@ -0,0 +1,140 @@
+#ifndef _MB_RTUCOMM_H_
+#define _MB_RTUCOMM_H_
+
+#include <ctime>
+#include <string>
+
+#include "mb_rtu.h"
+#include "mb_transport.h"
+
+namespace ModBus {
+
+/**
+ * The common part of the transports that speak ModBus RTU over a file
+ * descriptor, see RtuTcpCommunication and RtuSerialCommunication.
+ *
+ * A round sends one frame and receives one frame. The end of the reply is
+ * derived from its function code (see Rtu::replyLength), only replies of
+ * unknown functions are ended by the inter-frame gap. As RTU has no
+ * transaction ids, bytes that arrive before the request is sent (e.g. a
+ * late reply to a request that timed out) are discarded, and a reply from
+ * another unit or with another function code is reported as
+ * ModBus::Error::UnexpectedReply. The reply is converted into ModBus/TCP
+ * framing with the transaction id of the request.
+ *
+ * Like TcpRequestAndReply the frames are kept in fixed size buffers inside
+ * the object, hence a round does not allocate memory.
+ */
+class RtuCommunication : public Transport {
+	protected:
+		/**
+		 * @param gap The initial inter-frame gap
+		 * @param isSpaced True, if the requests must be preceded by the
+		 * inter-frame gap, i.e. if the line is shared with the replies
+		 */
+		RtuCommunication( const boost::posix_time::time_duration& gap, bool isSpaced );
+
+	private:
+		RtuCommunication( const RtuCommunication& );
+		RtuCommunication& operator=( const RtuCommunication& );
+
+	public:
+		virtual ~RtuCommunication();
+
+	public:
+		virtual void close();
+
+		virtual bool isOpen() const { return fd >= 0; }
+
+		virtual void timeOut( const boost::posix_time::time_duration& timeout ) { timeoutDuration = timeout; }
+
+		/**
+		 * @param gap The silence that separates two frames. A reply of unknown
+		 * length is complete after this silence. On a serial line the next
+		 * request is not sent before this silence either.
+		 */
+		void interFrameGap( const boost::posix_time::time_duration& gap ) { frameGap = gap; }
+
+		virtual const char* transact( const Datagram::Base& request, size_t& length, boost::system::error_code& ec );
+
+		virtual Registers readHoldingRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec );
+
+		virtual Registers readInputRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec );
+
+	protected:
+		Registers readRegisters( Datagram::FuncCode func, Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec );
+		void run( Datagram::TransactionID transaction, boost::system::error_code& ec );
+		void send( boost::system::error_code& ec );
+		void receive( boost::system::error_code& ec );
+		void discardInput();
+		void sleepUntilGap();
+		long remainingMs() const;
+
+		/**
+		 * Records the time of the last byte sent or received, see
+		 * RtuCommunication::sleepUntilGap
+		 */
+		void touch() { clock_gettime( CLOCK_MONOTONIC, &lastActivity ); }
+
+	protected:
+		int fd;
+		boost::posix_time::time_duration timeoutDuration;
+		boost::posix_time::time_duration frameGap;
+		bool spaceFrames;
+		struct timespec lastActivity;
+		struct timespec deadline;
+
+		char requestFrame[ Rtu::maxFrameLength ];
+		char replyFrame[ Rtu::maxFrameLength ];
+		char responseBuffer[ Datagram::Base::maxDatagramLength ];
+		size_t requestLength;
+		size_t replyLength;
+		size_t responseLength;
+};
+
+
+/**
+ * ModBus RTU frames tunneled through a TCP connection, as offered by cheap
+ * serial device servers. In contrast to a ModBus/TCP gateway the server
+ * forwards the frames unchanged.
+ */
+class RtuTcpCommunication : public RtuCommunication {
+	public:
+		/**
+		 * The default inter-frame gap is 20 ms, because the silence on the
+		 * serial line is not preserved by TCP.
+		 */
+		RtuTcpCommunication();
+
+	public:
+		/**
+		 * Connects to the device server. See TcpCommunication::open.
+		 */
+		virtual void open( const std::string& remoteHost, const std::string& port, boost::system::error_code& ec );
+};
+
+
+/**
+ * ModBus RTU on a local serial port, e.g. a RS-485 adapter.
+ */
+class RtuSerialCommunication : public RtuCommunication {
+	public:
+		RtuSerialCommunication();
+
+	public:
+		/**
+		 * Opens and configures the serial port in raw mode. The inter-frame
+		 * gap is set according to the baud rate, see Rtu::interFrameGap.
+		 * @param device The path of the serial port, e.g. /dev/ttyUSB0
+		 * @param settings The baud rate optionally followed by the data bits,
+		 * the parity (N, E or O) and the stop bits, e.g. "9600" or
+		 * "19200:8N1". The default is 8E1 as required by the ModBus
+		 * specification.
+		 * @param ec Set to indicate what error occured, if any
+		 */
+		virtual void open( const std::string& device, const std::string& settings, boost::system::error_code& ec );
+};
+
+}
+
+#endif
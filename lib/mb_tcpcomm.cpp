@@ -1,42 +1,114 @@
 #include "lib/mb_tcpcomm.h"
+#include "lib/mb_errorres.h"
 
 namespace ModBus {
 
-TcpCommunication::TcpCommunication() : ioService(), tcpSocket( ioService ) {
+TcpCommunication::TcpCommunication() : ioService(), tcpSocket( ioService ), rar( ioService, tcpSocket ) {
 
 }
 
 
-TcpCommunication::TcpCommunication( const std::string& remoteHost, const std::string& port ) : ioService(), tcpSocket( ioService )  {
+TcpCommunication::TcpCommunication( const std::string& remoteHost, const std::string& port ) : ioService(), tcpSocket( ioService ), rar( ioService, tcpSocket )  {
 	open( remoteHost, port );
 }
 
 
 void TcpCommunication::open( const std::string& remoteHost, const std::string& port ) {
+	boost::system::error_code ec;
+	open( remoteHost, port, ec );
+	if( ec ) throw boost::system::system_error( ec );
+}
+
+
+void TcpCommunication::open( const std::string& remoteHost, const std::string& port, boost::system::error_code& ec ) {
 	close();
+	ec.clear();
+	if( rar.replay() ) return;
 	
 	boost::asio::ip::tcp::resolver resolver( ioService );
 	boost::asio::ip::tcp::resolver::query query( boost::asio::ip::tcp::v4(), remoteHost, port );
-	boost::asio::ip::tcp::endpoint remote_endpoint = *resolver.resolve( query );
-	tcpSocket.open( boost::asio::ip::tcp::v4() );
-	tcpSocket.connect( remote_endpoint );
+	boost::asio::ip::tcp::resolver::iterator it( resolver.resolve( query, ec ) );
+	if( ec ) return;
+	boost::asio::ip::tcp::endpoint remote_endpoint = *it;
+	tcpSocket.open( boost::asio::ip::tcp::v4(), ec );
+	if( ec ) return;
+	tcpSocket.connect( remote_endpoint, ec );
+	if( ec ) close();
 }
 
 
 void TcpCommunication::close() {
-	tcpSocket.close();
+	boost::system::error_code ignored;
+	tcpSocket.close( ignored );
+}
+
+
+void TcpCommunication::timeOut( const boost::posix_time::time_duration& timeout ) {
+	rar.timeOut( timeout );
+}
+
+
+const TcpRequestAndReply& TcpCommunication::transact( const Datagram::Base& request ) {
+	rar.request( request );
+	rar.run();
+	return rar;
+}
+
+
+const TcpRequestAndReply& TcpCommunication::transact( const Datagram::Base& request, boost::system::error_code& ec ) {
+	rar.request( request );
+	rar.run( ec );
+	return rar;
 }
 
 
-TcpRequestAndReply TcpCommunication::createRequestAndReply( const ModBus::Datagram::Base& request ) {
-	return ModBus::TcpRequestAndReply( tcpSocket, request );
+const char* TcpCommunication::transact( const Datagram::Base& request, size_t& length, boost::system::error_code& ec ) {
+	rar.request( request );
+	rar.run( ec );
+	length = rar.rawResponseLength();
+	return rar.rawResponse();
 }
 
 
-TcpRequestAndReply TcpCommunication::createRequestAndReply( const ModBus::Datagram::Base& request, const boost::posix_time::time_duration& timeout ) {
-	return ModBus::TcpRequestAndReply( tcpSocket, request, timeout );
+Registers TcpCommunication::readHoldingRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length ) {
+	boost::system::error_code ec;
+	Registers res( readHoldingRegisters( transaction, unit, addr, length, ec ) );
+	throwOnError( ec );
+	return res;
 }
 
 
+Registers TcpCommunication::readInputRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length ) {
+	boost::system::error_code ec;
+	Registers res( readInputRegisters( transaction, unit, addr, length, ec ) );
+	throwOnError( ec );
+	return res;
+}
+
+
+Registers TcpCommunication::readHoldingRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec ) {
+	rar.readRegistersRequest( Function::ReadHoldingRegisters, transaction, unit, addr, length );
+	rar.run( ec );
+	if( ec ) return Registers();
+	return decodeRegisters( Function::ReadHoldingRegisters, transaction, length, ec );
+}
+
+
+Registers TcpCommunication::readInputRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec ) {
+	rar.readRegistersRequest( Function::ReadInputRegisters, transaction, unit, addr, length );
+	rar.run( ec );
+	if( ec ) return Registers();
+	return decodeRegisters( Function::ReadInputRegisters, transaction, length, ec );
+}
+
+
+/**
+ * Interprets the raw response of the last round without creating a datagram
+ * object, see Registers::decode
+ */
+Registers TcpCommunication::decodeRegisters( Datagram::FuncCode func, Datagram::TransactionID transaction, u_int16_t length, boost::system::error_code& ec ) const {
+	return Registers::decode( rar.rawResponse(), rar.rawResponseLength(), func, transaction, length, ec );
+}
+
 
 }
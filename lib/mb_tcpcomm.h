@@ -2,6 +2,8 @@
 #define _MB_TCPCOMM_H_
 
 #include "mb_tcprar.h"
+#include "mb_registers.h"
+#include "mb_transport.h"
 
 #include <string>
 #include <sys/types.h>
@@ -10,7 +12,7 @@
 
 namespace ModBus {
 
-class TcpCommunication {
+class TcpCommunication : public Transport {
 	public:
 		/**
 		 * Standard c'tor
@@ -38,31 +40,108 @@ class TcpCommunication {
 		 */
 		void open( const std::string& remoteHost, const std::string& port = std::string( "502" ) );
 		
+		/**
+		 * Non-throwing variant of TcpCommunication::open
+		 * @param ec Set to indicate what error occured, if any
+		 */
+		virtual void open( const std::string& remoteHost, const std::string& port, boost::system::error_code& ec );
+		
 		/**
 		 * Disconnects from the remote host and closes the socket
 		 */
-		void close();
+		virtual void close();
+		
+		virtual bool isOpen() const { return tcpSocket.is_open(); }
+		
+		/**
+		 * @param timeout The time to wait for a response of subsequent requests.
+		 * Default is 1 second.
+		 */
+		virtual void timeOut( const boost::posix_time::time_duration& timeout );
 		
 		/**
-		 * Creates and returns an object of TcpRequestAndReply that is binded
-		 * to the socket managed by this object
-		 * @param request The ModBus request 
+		 * Records the traffic of all subsequent requests. See
+		 * TcpRequestAndReply::recorder.
+		 * @param r The recorder or NULL to stop recording
 		 */
-		TcpRequestAndReply createRequestAndReply( const Datagram::Base& request );
+		void record( TraceRecorder* r ) { rar.recorder( r ); }
 		
 		/**
-		 * Creates and returns an object of TcpRequestAndReply that is binded
-		 * to the socket managed by this object
+		 * Answers all subsequent requests by a recorded trace instead of a
+		 * remote host. While a replay is set, TcpCommunication::open does not
+		 * connect to the remote host. See TcpRequestAndReply::replay.
+		 * @param r The replay or NULL to return to normal operation
+		 */
+		void replay( TraceReplay* r ) { rar.replay( r ); }
+		
+		/**
+		 * Notifies the observer about the progress of all subsequent requests.
+		 * See TcpRequestAndReply::observer.
+		 * @param o The observer or NULL
+		 */
+		void observe( RoundObserver* o ) { rar.observer( o ); }
+		
+		/**
+		 * Transmits an arbitrary request and waits for the reply. The reply is
+		 * kept by the returned object until the next request is transmitted.
+		 * If no reply has been received within the timeout, the returned object
+		 * does not have a response.
 		 * @param request The ModBus request 
-		 * @param timeout The timeout for request
 		 */
-		TcpRequestAndReply createRequestAndReply( const Datagram::Base& request, const boost::posix_time::time_duration& timeout );
+		const TcpRequestAndReply& transact( const Datagram::Base& request );
+		
+		/**
+		 * Non-throwing variant of TcpCommunication::transact. A missing reply is
+		 * reported as ModBus::Error::TimeOut.
+		 * @param ec Set to indicate what error occured, if any
+		 */
+		const TcpRequestAndReply& transact( const Datagram::Base& request, boost::system::error_code& ec );
+		
+		virtual const char* transact( const Datagram::Base& request, size_t& length, boost::system::error_code& ec );
+		
+		/**
+		 * Reads a block of holding registers and checks the reply for common
+		 * errors: time out, ModBus exception replies, unexpected function codes,
+		 * transaction mismatch and truncated replies. In each case a
+		 * boost::system::system_error is thrown. See ModBus::Error.
+		 * @param transaction The transaction id of the request
+		 * @param unit The unit id of the addressed device
+		 * @param addr The starting address of the register
+		 * @param length The number of 16bit registers to read
+		 * @return A view on the register values. The view is valid until the
+		 * next request is transmitted by this object.
+		 */
+		Registers readHoldingRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length );
+		
+		/**
+		 * Reads a block of input registers. See
+		 * TcpCommunication::readHoldingRegisters for details.
+		 */
+		Registers readInputRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length );
+		
+		/**
+		 * Non-throwing variant of TcpCommunication::readHoldingRegisters. If an
+		 * error occurs, an empty view is returned.
+		 * @param ec Set to indicate what error occured, if any
+		 */
+		virtual Registers readHoldingRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec );
+		
+		/**
+		 * Non-throwing variant of TcpCommunication::readInputRegisters. If an
+		 * error occurs, an empty view is returned.
+		 * @param ec Set to indicate what error occured, if any
+		 */
+		virtual Registers readInputRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec );
 		
 		const boost::asio::ip::tcp::socket& socket() const { return tcpSocket; }
 		
+	protected:
+		Registers decodeRegisters( Datagram::FuncCode func, Datagram::TransactionID transaction, u_int16_t length, boost::system::error_code& ec ) const;
+		
 	protected:
 		boost::asio::io_service ioService;
 		boost::asio::ip::tcp::socket tcpSocket;
+		TcpRequestAndReply rar;
 };
 
 }
@@ -0,0 +1,353 @@
+#include "lib/mb_tcpgateway.h"
+
+#include <boost/bind.hpp>
+#include <cassert>
+#include <stdexcept>
+
+
+namespace ModBus {
+
+using boost::posix_time::ptime;
+
+GatewayRequest::GatewayRequest() : requestLength( 0 ), nBytesReceived( 0 ), transaction( 0 ), readFunc( 0 ), readLength( 0 ), lastError(), values(), deadline( boost::posix_time::min_date_time ), next( nullptr ), pending( false ) {
+	memset( requestBuffer, 0x00, Datagram::Base::maxDatagramLength );
+	memset( responseBuffer, 0x00, Datagram::Base::maxDatagramLength );
+}
+
+
+void GatewayRequest::request( const Datagram::Base& req ) {
+	assert( !pending );
+	const size_t l( req.totalLength() );
+	if( l > Datagram::Base::maxDatagramLength ) throw std::length_error( "request exceeds maximum datagram length" );
+	memcpy( requestBuffer, req.rawDatagram(), l );
+	requestLength = l;
+	readFunc = 0;
+	readLength = 0;
+}
+
+
+void GatewayRequest::readRegistersRequest( Datagram::FuncCode func, Datagram::UnitID unit, u_int16_t addr, u_int16_t length ) {
+	assert( !pending );
+	if( length == 0 || length > 0x7d ) throw std::out_of_range( "Number of registers to read must be between 1 and 0x7d" );
+	// Same layout as TcpRequestAndReply::readRegistersRequest, the
+	// transaction id is written by the session
+	requestBuffer[2] = 0x00;
+	requestBuffer[3] = 0x00;
+	requestBuffer[4] = 0x00;
+	requestBuffer[5] = 0x06;
+	requestBuffer[6] = static_cast< char >( unit );
+	requestBuffer[7] = static_cast< char >( func );
+	requestBuffer[8] = static_cast< char >( addr >> 8 );
+	requestBuffer[9] = static_cast< char >( addr );
+	requestBuffer[10] = static_cast< char >( length >> 8 );
+	requestBuffer[11] = static_cast< char >( length );
+	requestLength = 12;
+	readFunc = func;
+	readLength = length;
+}
+
+
+
+TcpGatewaySession::TcpGatewaySession( const boost::posix_time::time_duration& timeout ) : handlerMemory(), ioService(), socket( ioService ), deadlineTimer( ioService ), paceTimer( ioService ), timeoutDuration( timeout ), sendInterval(), inFlightMax( 1 ), lastUnit( 0xff ), nQueued( 0 ), nInFlight( 0 ), lastTransaction( 0 ), sending( nullptr ), nBytesSent( 0 ), nextSendAt( boost::posix_time::min_date_time ), nBytesBuffered( 0 ), isReceiving( false ), isDeadlineArmed( false ), isPacing( false ), lastError() {
+	for( unsigned int i( 0 ); i != 256; ++i ) queueHead[i] = queueTail[i] = nullptr;
+	for( unsigned int i( 0 ); i != inFlightLimit; ++i ) inFlightRequests[i] = nullptr;
+}
+
+
+TcpGatewaySession::~TcpGatewaySession() {
+	close();
+}
+
+
+void TcpGatewaySession::open( const std::string& remoteHost, const std::string& port ) {
+	boost::system::error_code ec;
+	open( remoteHost, port, ec );
+	if( ec ) throw boost::system::system_error( ec );
+}
+
+
+void TcpGatewaySession::open( const std::string& remoteHost, const std::string& port, boost::system::error_code& ec ) {
+	close();
+	ec.clear();
+	boost::asio::ip::tcp::resolver resolver( ioService );
+	boost::asio::ip::tcp::resolver::query query( boost::asio::ip::tcp::v4(), remoteHost, port );
+	boost::asio::ip::tcp::resolver::iterator it( resolver.resolve( query, ec ) );
+	if( ec ) return;
+	boost::asio::ip::tcp::endpoint remote_endpoint = *it;
+	socket.open( boost::asio::ip::tcp::v4(), ec );
+	if( ec ) return;
+	socket.connect( remote_endpoint, ec );
+	if( ec ) {
+		close();
+		return;
+	}
+	// Pipelined requests are small and must not wait for each other
+	boost::system::error_code ignored;
+	socket.set_option( boost::asio::ip::tcp::no_delay( true ), ignored );
+}
+
+
+void TcpGatewaySession::close() {
+	fail( Error::NotConnected );
+	lastError.clear();
+}
+
+
+void TcpGatewaySession::maxInFlight( unsigned int n ) {
+	if( n == 0 || n > inFlightLimit ) throw std::out_of_range( "Number of requests in flight must be between 1 and 16" );
+	inFlightMax = n;
+}
+
+
+void TcpGatewaySession::submit( GatewayRequest& r ) {
+	assert( !r.pending );
+	r.nBytesReceived = 0;
+	r.values = Registers();
+	if( r.requestLength == 0 ) {
+		r.lastError = Error::NoRequest;
+		return;
+	}
+	r.lastError.clear();
+	r.pending = true;
+	r.next = nullptr;
+	const Datagram::UnitID unit( r.unitID() );
+	if( queueTail[ unit ] ) queueTail[ unit ]->next = &r;
+	else queueHead[ unit ] = &r;
+	queueTail[ unit ] = &r;
+	++nQueued;
+}
+
+
+void TcpGatewaySession::run( boost::system::error_code& ec ) {
+	ec.clear();
+	lastError.clear();
+	if( nQueued == 0 && nInFlight == 0 ) return;
+	if( !socket.is_open() ) {
+		fail( Error::NotConnected );
+		ec = lastError;
+		return;
+	}
+
+	// All handlers take the memory of their operations from handlerMemory.
+	// The handlers never throw. The I/O service runs out of work, when every
+	// request has been completed, see TcpGatewaySession::finishIfIdle.
+	ioService.reset();
+	dispatch();
+	ioService.run();
+	ec = lastError;
+}
+
+
+/**
+ * Takes the next request of the unit that follows the unit served last,
+ * i.e. the units are served round robin
+ */
+GatewayRequest* TcpGatewaySession::popRequest() {
+	for( unsigned int i( 1 ); i <= 256; ++i ) {
+		const unsigned int unit( ( lastUnit + i ) & 0xff );
+		GatewayRequest* r( queueHead[ unit ] );
+		if( !r ) continue;
+		queueHead[ unit ] = r->next;
+		if( !queueHead[ unit ] ) queueTail[ unit ] = nullptr;
+		r->next = nullptr;
+		lastUnit = unit;
+		--nQueued;
+		return r;
+	}
+	return nullptr;
+}
+
+
+/**
+ * Transmits the next request, if there is a free slot and the minimum
+ * interval since the last transmission has elapsed. Only one request is
+ * transmitted at a time, the next one follows from TcpGatewaySession::handleSend.
+ */
+void TcpGatewaySession::dispatch() {
+	if( sending || !socket.is_open() ) return;
+	if( nQueued == 0 || nInFlight >= inFlightMax ) {
+		finishIfIdle();
+		return;
+	}
+	const ptime now( boost::posix_time::microsec_clock::universal_time() );
+	if( now < nextSendAt ) {
+		if( !isPacing ) {
+			isPacing = true;
+			paceTimer.expires_at( nextSendAt );
+			paceTimer.async_wait( makeAllocHandler( handlerMemory, boost::bind( &TcpGatewaySession::handlePace, this, boost::asio::placeholders::error ) ) );
+		}
+		return;
+	}
+
+	GatewayRequest* r( popRequest() );
+	r->transaction = ++lastTransaction;
+	r->requestBuffer[0] = static_cast< char >( r->transaction >> 8 );
+	r->requestBuffer[1] = static_cast< char >( r->transaction );
+	r->deadline = now + timeoutDuration;
+	inFlightRequests[ nInFlight++ ] = r;
+	nextSendAt = now + sendInterval;
+
+	sending = r;
+	nBytesSent = 0;
+	socket.async_send( boost::asio::buffer( r->requestBuffer, r->requestLength ), makeAllocHandler( handlerMemory, boost::bind( &TcpGatewaySession::handleSend, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) ) );
+	if( !isDeadlineArmed ) armDeadline( r->deadline );
+	startReceive();
+}
+
+
+/**
+ * Removes the request from the slots and records the outcome. The registers
+ * of a successful read are decoded in place.
+ */
+void TcpGatewaySession::complete( GatewayRequest& r, const boost::system::error_code& error ) {
+	for( unsigned int i( 0 ); i != nInFlight; ++i ) {
+		if( inFlightRequests[i] != &r ) continue;
+		inFlightRequests[i] = inFlightRequests[ --nInFlight ];
+		inFlightRequests[ nInFlight ] = nullptr;
+		break;
+	}
+	r.pending = false;
+	r.lastError = error;
+	if( error ) {
+		r.nBytesReceived = 0;
+		return;
+	}
+	if( r.readFunc != 0 ) r.values = Registers::decode( r.responseBuffer, r.nBytesReceived, r.readFunc, r.transaction, r.readLength, r.lastError );
+}
+
+
+/**
+ * Records the first transport error, fails all pending requests and closes
+ * the connection. Closing the socket aborts the outstanding operations.
+ */
+void TcpGatewaySession::fail( const boost::system::error_code& error ) {
+	if( !lastError ) lastError = error;
+	while( nInFlight != 0 ) complete( *inFlightRequests[ nInFlight - 1 ], error );
+	while( GatewayRequest* r = popRequest() ) complete( *r, error );
+	sending = nullptr;
+	nBytesBuffered = 0;
+	boost::system::error_code ignored;
+	deadlineTimer.cancel( ignored );
+	paceTimer.cancel( ignored );
+	socket.close( ignored );
+}
+
+
+/**
+ * Cancels the outstanding receive and the timers, if there is nothing left
+ * to do. Then TcpGatewaySession::run returns as soon as the aborted handlers
+ * have been called. Bytes that arrive later stay in the socket.
+ */
+void TcpGatewaySession::finishIfIdle() {
+	if( nQueued != 0 || nInFlight != 0 || sending ) return;
+	boost::system::error_code ignored;
+	deadlineTimer.cancel( ignored );
+	paceTimer.cancel( ignored );
+	socket.cancel( ignored );
+}
+
+
+void TcpGatewaySession::startReceive() {
+	if( isReceiving ) return;
+	isReceiving = true;
+	socket.async_receive( boost::asio::buffer( receiveBuffer + nBytesBuffered, sizeof( receiveBuffer ) - nBytesBuffered ), makeAllocHandler( handlerMemory, boost::bind( &TcpGatewaySession::handleReceive, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) ) );
+}
+
+
+void TcpGatewaySession::armDeadline( const ptime& at ) {
+	isDeadlineArmed = true;
+	deadlineTimer.expires_at( at );
+	deadlineTimer.async_wait( makeAllocHandler( handlerMemory, boost::bind( &TcpGatewaySession::handleDeadline, this, boost::asio::placeholders::error ) ) );
+}
+
+
+void TcpGatewaySession::handleSend( const boost::system::error_code& error, size_t nBytes ) {
+	if( error ) {
+		// Aborted operations are the consequence of an error that has already
+		// been recorded or of TcpGatewaySession::finishIfIdle
+		if( error != boost::asio::error::operation_aborted ) fail( error );
+		return;
+	}
+	nBytesSent += nBytes;
+	if( nBytesSent < sending->requestLength ) {
+		socket.async_send( boost::asio::buffer( sending->requestBuffer + nBytesSent, sending->requestLength - nBytesSent ), makeAllocHandler( handlerMemory, boost::bind( &TcpGatewaySession::handleSend, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) ) );
+		return;
+	}
+	sending = nullptr;
+	dispatch();
+}
+
+
+/**
+ * Splits the received bytes into replies and assigns them to the requests
+ * in flight by their transaction id. Replies without a matching request
+ * are late replies to timed out requests and are dropped.
+ */
+void TcpGatewaySession::handleReceive( const boost::system::error_code& error, size_t nBytes ) {
+	isReceiving = false;
+	if( error ) {
+		if( error != boost::asio::error::operation_aborted ) fail( error );
+		return;
+	}
+	nBytesBuffered += nBytes;
+
+	size_t offset( 0 );
+	while( nBytesBuffered - offset >= sizeof( Datagram::Header ) ) {
+		// The replies are not aligned within the buffer
+		Datagram::Header header;
+		memcpy( &header, receiveBuffer + offset, sizeof( header ) );
+		const size_t total( ntohs( header.length ) + 6u );
+		if( header.protocolID != 0x00 || total > Datagram::Base::maxDatagramLength ) {
+			fail( Error::MalformedReply );
+			return;
+		}
+		if( nBytesBuffered - offset < total ) break;
+
+		const Datagram::TransactionID tid( ntohs( header.transactionID ) );
+		for( unsigned int i( 0 ); i != nInFlight; ++i ) {
+			GatewayRequest& r( *inFlightRequests[i] );
+			if( r.transaction != tid ) continue;
+			memcpy( r.responseBuffer, receiveBuffer + offset, total );
+			r.nBytesReceived = total;
+			complete( r, header.unitID == r.unitID() ? boost::system::error_code() : make_error_code( Error::UnexpectedReply ) );
+			break;
+		}
+		offset += total;
+	}
+	nBytesBuffered -= offset;
+	memmove( receiveBuffer, receiveBuffer + offset, nBytesBuffered );
+
+	if( nInFlight != 0 ) startReceive();
+	dispatch();
+}
+
+
+void TcpGatewaySession::handleDeadline( const boost::system::error_code& error ) {
+	isDeadlineArmed = false;
+	if( error == boost::asio::error::operation_aborted ) return;
+	if( error ) {
+		fail( error );
+		return;
+	}
+
+	// The deadlines grow in the order of transmission. The timer is armed for
+	// the oldest request in flight, which may have been answered meanwhile.
+	const ptime now( boost::posix_time::microsec_clock::universal_time() );
+	ptime earliest( boost::posix_time::max_date_time );
+	for( unsigned int i( nInFlight ); i != 0; --i ) {
+		GatewayRequest& r( *inFlightRequests[ i - 1 ] );
+		if( r.deadline <= now ) complete( r, Error::TimeOut );
+		else if( r.deadline < earliest ) earliest = r.deadline;
+	}
+	if( nInFlight != 0 ) armDeadline( earliest );
+	dispatch();
+}
+
+
+void TcpGatewaySession::handlePace( const boost::system::error_code& error ) {
+	isPacing = false;
+	if( error == boost::asio::error::operation_aborted ) return;
+	dispatch();
+}
+
+}
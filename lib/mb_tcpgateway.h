@@ -0,0 +1,264 @@
+#ifndef _MB_TCPGATEWAY_H_
+#define _MB_TCPGATEWAY_H_
+
+#include <string>
+#include <sys/types.h>
+#include <boost/asio.hpp>
+
+#include "mb_base.h"
+#include "mb_error.h"
+#include "mb_handlermem.h"
+#include "mb_registers.h"
+#include "nullptr.h"
+
+
+namespace ModBus {
+
+class TcpGatewaySession;
+
+/**
+ * A request of one logical device behind a gateway, see TcpGatewaySession.
+ *
+ * The object holds the request and the reply in fixed size buffers and is
+ * owned by the caller. It is meant to be long-lived and to be reused for
+ * many rounds, hence a round neither copies datagram objects nor allocates
+ * memory.
+ */
+class GatewayRequest {
+	friend class TcpGatewaySession;
+
+	public:
+		GatewayRequest();
+
+	private:
+		GatewayRequest( const GatewayRequest& );
+		GatewayRequest& operator=( const GatewayRequest& );
+
+	public:
+		/**
+		 * Copies the raw bytes of the given request into the internal send
+		 * buffer. The transaction id is assigned by the session.
+		 */
+		void request( const Datagram::Base& req );
+
+		/**
+		 * Writes a request to read a block of holding or input registers
+		 * directly into the internal send buffer. Throws a std::out_of_range, if
+		 * the number of registers is invalid. See
+		 * TcpRequestAndReply::readRegistersRequest.
+		 */
+		void readRegistersRequest( Datagram::FuncCode func, Datagram::UnitID unit, u_int16_t addr, u_int16_t length );
+
+		Datagram::UnitID unitID() const {
+			return static_cast< Datagram::UnitID >( requestBuffer[6] );
+		}
+
+		/**
+		 * @return The transaction id the session assigned to the last round
+		 */
+		Datagram::TransactionID transactionID() const { return transaction; }
+
+		/**
+		 * @return The outcome of the last round. Besides the errors of
+		 * TcpRequestAndReply::run, a request to read registers reports the
+		 * errors found by Registers::decode.
+		 */
+		const boost::system::error_code& error() const { return lastError; }
+
+		/**
+		 * @return True, if the request is queued or waits for its reply
+		 */
+		bool isPending() const { return pending; }
+
+		/**
+		 * @return A view on the raw bytes of the reply of the last round. The
+		 * length is zero, if the round failed.
+		 */
+		const char* rawResponse() const { return responseBuffer; }
+
+		size_t rawResponseLength() const { return nBytesReceived; }
+
+		/**
+		 * @return A view on the registers of the last round, if the request was
+		 * created by GatewayRequest::readRegistersRequest and the round
+		 * succeeded. Otherwise an empty view is returned. The view is valid
+		 * until the request is submitted again.
+		 */
+		Registers registers() const { return values; }
+
+	protected:
+		char requestBuffer[ Datagram::Base::maxDatagramLength ];
+		char responseBuffer[ Datagram::Base::maxDatagramLength ];
+		size_t requestLength;
+		size_t nBytesReceived;
+		Datagram::TransactionID transaction;
+		Datagram::FuncCode readFunc;     // zero for other requests than reads
+		u_int16_t readLength;
+		boost::system::error_code lastError;
+		Registers values;
+		boost::posix_time::ptime deadline;
+		GatewayRequest* next;            // link of the queue of the unit
+		bool pending;
+};
+
+
+/**
+ * A ModBus/TCP connection to a gateway that multiplexes many logical
+ * devices, e.g. a RS-485 bus with several meters behind one IP address.
+ * The devices are told apart by their unit id, each of them may have its
+ * own register map.
+ *
+ * Gateways commonly accept only a few TCP connections, but many of them
+ * queue several requests per connection and serve them one after another
+ * on the serial bus. The session keeps up to TcpGatewaySession::maxInFlight
+ * requests outstanding, such that the bus does not idle while a reply
+ * travels back and the next request travels to the gateway. The replies are
+ * assigned to their requests by the transaction id, hence replies may
+ * arrive in any order and late replies to timed out requests are dropped.
+ *
+ * The requests are queued per unit and the units take turns, hence a unit
+ * with many requests does not delay the requests of the others by more
+ * than one round. Optionally the requests are spaced by a minimum interval
+ * for gateways or devices that cannot cope with back-to-back requests.
+ *
+ * Usage: Submit the requests of all devices and call TcpGatewaySession::run,
+ * which returns after every request has been answered or has failed. The
+ * requests are owned by the caller, the session only links them into its
+ * queues, hence polling does not allocate memory. Like TcpRequestAndReply
+ * the session is not thread-safe.
+ */
+class TcpGatewaySession {
+	public:
+		/**
+		 * @param timeout The time to wait for the reply to a request, counted
+		 * from its transmission. Default is 1 second.
+		 */
+		TcpGatewaySession( const boost::posix_time::time_duration& timeout = boost::posix_time::seconds( 1 ) );
+
+		virtual ~TcpGatewaySession();
+
+	private:
+		TcpGatewaySession( const TcpGatewaySession& );
+		TcpGatewaySession& operator=( const TcpGatewaySession& );
+
+	public:
+		/**
+		 * Opens the socket (using IPv4) and connects to the gateway. See
+		 * TcpCommunication::open.
+		 */
+		void open( const std::string& remoteHost, const std::string& port = std::string( "502" ) );
+
+		/**
+		 * Non-throwing variant of TcpGatewaySession::open
+		 * @param ec Set to indicate what error occured, if any
+		 */
+		void open( const std::string& remoteHost, const std::string& port, boost::system::error_code& ec );
+
+		/**
+		 * Closes the connection. Pending requests fail with
+		 * ModBus::Error::NotConnected.
+		 */
+		void close();
+
+		bool isOpen() const { return socket.is_open(); }
+
+		void timeOut( const boost::posix_time::time_duration& timeout ) { timeoutDuration = timeout; }
+
+		/**
+		 * @param n The maximum number of requests that wait for their replies
+		 * at the same time, between 1 and TcpGatewaySession::inFlightLimit.
+		 * Default is 1, because not every gateway queues requests. Note that
+		 * the time out of a request includes the time it waits in the queue of
+		 * the gateway.
+		 */
+		void maxInFlight( unsigned int n );
+
+		unsigned int maxInFlight() const { return inFlightMax; }
+
+		/**
+		 * @param interval The minimum time between the transmission of two
+		 * requests. Default is zero, i.e. the requests are only limited by
+		 * TcpGatewaySession::maxInFlight.
+		 */
+		void minInterval( const boost::posix_time::time_duration& interval ) { sendInterval = interval; }
+
+		/**
+		 * Queues the request for the next call of TcpGatewaySession::run. The
+		 * request must not be pending already and must stay alive until it has
+		 * been answered or has failed.
+		 */
+		void submit( GatewayRequest& r );
+
+		/**
+		 * Transmits all queued requests and blocks until each of them has been
+		 * answered or has failed. The outcome of each request is reported by
+		 * GatewayRequest::error. A transport error fails all pending requests
+		 * and closes the connection, it is reported by ec as well.
+		 * @param ec Set to indicate the transport error, if any
+		 */
+		void run( boost::system::error_code& ec );
+
+		/**
+		 * @return The number of requests that have been transmitted but not
+		 * been answered yet
+		 */
+		unsigned int inFlight() const { return nInFlight; }
+
+	public:
+		enum { inFlightLimit = 16 };
+
+	protected:
+		GatewayRequest* popRequest();
+		void dispatch();
+		void complete( GatewayRequest& r, const boost::system::error_code& error );
+		void fail( const boost::system::error_code& error );
+		void finishIfIdle();
+		void startReceive();
+		void armDeadline( const boost::posix_time::ptime& at );
+		void handleSend( const boost::system::error_code& error, std::size_t nBytes );
+		void handleReceive( const boost::system::error_code& error, std::size_t nBytes );
+		void handleDeadline( const boost::system::error_code& error );
+		void handlePace( const boost::system::error_code& error );
+
+	protected:
+		// The pool must outlive the I/O service, which frees the memory of
+		// aborted operations on destruction
+		HandlerMemory handlerMemory;
+		boost::asio::io_service ioService;
+		boost::asio::ip::tcp::socket socket;
+		boost::asio::deadline_timer deadlineTimer;
+		boost::asio::deadline_timer paceTimer;
+		boost::posix_time::time_duration timeoutDuration;
+		boost::posix_time::time_duration sendInterval;
+		unsigned int inFlightMax;
+
+		/**
+		 * The queues of the units as singly linked lists and the unit that has
+		 * been served last
+		 */
+		GatewayRequest* queueHead[ 256 ];
+		GatewayRequest* queueTail[ 256 ];
+		unsigned int lastUnit;
+		unsigned int nQueued;
+
+		GatewayRequest* inFlightRequests[ inFlightLimit ];
+		unsigned int nInFlight;
+		Datagram::TransactionID lastTransaction;
+
+		GatewayRequest* sending;
+		size_t nBytesSent;
+		boost::posix_time::ptime nextSendAt;
+
+		// The received bytes that do not form a complete reply yet
+		char receiveBuffer[ 2 * Datagram::Base::maxDatagramLength ];
+		size_t nBytesBuffered;
+
+		bool isReceiving;
+		bool isDeadlineArmed;
+		bool isPacing;
+		boost::system::error_code lastError;
+};
+
+}
+
+#endif
@@ -1,43 +1,46 @@
 #include "lib/mb_tcprar.h"
+#include "lib/probes.h"
 
 #include <boost/bind.hpp>
 
 
 namespace ModBus {
 
-TcpRequestAndReply::TcpRequestAndReply() : socket( nullptr ), timer( nullptr ), timeoutDuration( boost::posix_time::seconds( 1 ) ), requestDgram( nullptr ), responseDgram( nullptr ), nBytesSent( 0 ), nBytesReceived( 0 ) {
+TcpRequestAndReply::TcpRequestAndReply( boost::asio::io_service& ioService, boost::asio::ip::tcp::socket& tcpSocket, const boost::posix_time::time_duration& duration ) : ioService( ioService ), socket( tcpSocket ), timer( ioService ), timeoutDuration( duration ), requestLength( 0 ), nBytesSent( 0 ), nBytesReceived( 0 ), lastError(), replyComplete( false ), traceRecorder( nullptr ), traceReplay( nullptr ), roundObserver( nullptr ), handlerMemory() {
+	memset( requestBuffer, 0x00, ModBus::Datagram::Base::maxDatagramLength );
 	memset( responseBuffer, 0x00, ModBus::Datagram::Base::maxDatagramLength );
 }
 
 
-TcpRequestAndReply::TcpRequestAndReply( boost::asio::ip::tcp::socket& tcpSocket, const ModBus::Datagram::Base& request, const boost::posix_time::time_duration& duration ) : socket( &tcpSocket ), timer( nullptr ), timeoutDuration( duration ), requestDgram( request.copy() ), responseDgram( nullptr ), nBytesSent( 0 ), nBytesReceived( 0 ) {
-	memset( responseBuffer, 0x00, ModBus::Datagram::Base::maxDatagramLength );
-}
-
-
-TcpRequestAndReply::TcpRequestAndReply( const TcpRequestAndReply& other ) : socket( other.socket ), timer( nullptr ), timeoutDuration( other.timeoutDuration ), requestDgram( nullptr ), responseDgram( nullptr ), nBytesSent( other.nBytesSent ), nBytesReceived( other.nBytesReceived ) {
-	assert( other.timer == nullptr );
-	if( other.requestDgram != nullptr ) requestDgram = other.requestDgram->copy();
-	if( other.responseDgram != nullptr ) responseDgram = other.responseDgram->copy();
-	memcpy( responseBuffer, other.responseBuffer, ModBus::Datagram::Base::maxDatagramLength );
-}
-
-
 TcpRequestAndReply::~TcpRequestAndReply() {
-	if( requestDgram ) delete requestDgram;
-	if( responseDgram ) delete responseDgram;
-	assert( timer == nullptr );
 }
 
 
-void TcpRequestAndReply::bindTo( boost::asio::ip::tcp::socket& tcpSocket ) {
-	socket = &tcpSocket;
+void TcpRequestAndReply::request( const ModBus::Datagram::Base& req ) {
+	const size_t l( req.totalLength() );
+	if( l > ModBus::Datagram::Base::maxDatagramLength ) throw std::length_error( "request exceeds maximum datagram length" );
+	memcpy( requestBuffer, req.rawDatagram(), l );
+	requestLength = l;
 }
 
 
-void TcpRequestAndReply::request( const ModBus::Datagram::Base& req ) {
-	if( requestDgram ) delete requestDgram;
-	requestDgram = req.copy();
+void TcpRequestAndReply::readRegistersRequest( Datagram::FuncCode func, Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length ) {
+	if( length == 0 || length > 0x7d ) throw std::out_of_range( "Number of registers to read must be between 1 and 0x7d" );
+	// Header: transaction id, protocol id (0), length of the remainder (6),
+	// unit id, function code; then address and quantity. All big endian.
+	requestBuffer[0] = static_cast< char >( transaction >> 8 );
+	requestBuffer[1] = static_cast< char >( transaction );
+	requestBuffer[2] = 0x00;
+	requestBuffer[3] = 0x00;
+	requestBuffer[4] = 0x00;
+	requestBuffer[5] = 0x06;
+	requestBuffer[6] = static_cast< char >( unit );
+	requestBuffer[7] = static_cast< char >( func );
+	requestBuffer[8] = static_cast< char >( addr >> 8 );
+	requestBuffer[9] = static_cast< char >( addr );
+	requestBuffer[10] = static_cast< char >( length >> 8 );
+	requestBuffer[11] = static_cast< char >( length );
+	requestLength = 12;
 }
 
 
@@ -46,125 +49,168 @@ void TcpRequestAndReply::timeOut( const boost::posix_time::time_duration& d ) {
 }
 
 
-void TcpRequestAndReply::run() {
-	if( socket == nullptr || !socket->is_open() ) throw std::logic_error( "socket is not connected" );
-	if( !requestDgram ) throw std::logic_error( "no request given for transmission" );
-	assert( timer == nullptr );
+void TcpRequestAndReply::run( boost::system::error_code& ec ) {
+	nBytesReceived = 0;
+	nBytesSent = 0 ;
+	if( requestLength == 0 ) {
+		ec = Error::NoRequest;
+		return;
+	}
+	if( traceReplay ) {
+		traceReplay->transact( requestBuffer, requestLength, responseBuffer, nBytesReceived, ec );
+		return;
+	}
+	if( !socket.is_open() ) {
+		ec = Error::NotConnected;
+		return;
+	}
+	lastError.clear();
+	replyComplete = false;
 	
 	// Reset the service object (in case there were former calls to run() )
-	socket->get_io_service().reset();
+	ioService.reset();
 	
-	// Schedule transmission
-	nBytesSent = 0 ;
-	socket->async_send( boost::asio::buffer( requestDgram->rawDatagram(), requestDgram->totalLength() ), boost::bind( &TcpRequestAndReply::handleSend, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
+	if( traceRecorder ) traceRecorder->request( requestBuffer, requestLength );
+	LM50_PROBE2( request__send, requestTransactionID(), requestLength );
+	if( roundObserver ) roundObserver->roundEvent( RoundObserver::SendStart );
+	
+	// Schedule transmission. All handlers take the memory of their operations
+	// from handlerMemory.
+	socket.async_send( boost::asio::buffer( requestBuffer, requestLength ), makeAllocHandler( handlerMemory, boost::bind( &TcpRequestAndReply::handleSend, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) ) );
 	
 	// Schedule receive
-	memset( responseBuffer, 0x00, ModBus::Datagram::Base::maxDatagramLength );
-	nBytesReceived = 0;
-	socket->async_receive( boost::asio::buffer( responseBuffer, ModBus::Datagram::Base::maxDatagramLength ), boost::bind( &TcpRequestAndReply::handleReceive, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
+	socket.async_receive( boost::asio::buffer( responseBuffer, ModBus::Datagram::Base::maxDatagramLength ), makeAllocHandler( handlerMemory, boost::bind( &TcpRequestAndReply::handleReceive, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) ) );
 	
 	// Schedule time out
-	timer = new boost::asio::deadline_timer( socket->get_io_service() );
-	timer->expires_from_now( timeoutDuration );
-	timer->async_wait( boost::bind( &TcpRequestAndReply::handleDeadline, this, boost::asio::placeholders::error ) );
+	timer.expires_from_now( timeoutDuration );
+	timer.async_wait( makeAllocHandler( handlerMemory, boost::bind( &TcpRequestAndReply::handleDeadline, this, boost::asio::placeholders::error ) ) );
 	
-	try {
-		// Do all three task simultaneously
-		socket->get_io_service().run();
-		
-		// This point can be reached by two ways. Either the timeout occured
-		// or the I/O operation was sucessfull. In the first case nBytesReceived
-		// equals zero, otherwise not. If an error had happened, run() would have
-		// thrown an exception, such that this point would never have been reached.
-		delete timer;
-		timer = nullptr;
-		
-		if( responseDgram ) {
-			delete responseDgram;
-			responseDgram = nullptr;
-		}
-		if( nBytesReceived != 0 ) responseDgram = ModBus::Datagram::Base::createObject( responseBuffer, nBytesReceived );
-		
-	} catch( ... ) {
-		if( timer != nullptr ) {
-			delete timer;
-			timer = nullptr;
-		}
+	// Do all three task simultaneously. The handlers never throw but record
+	// the first error that occurs in lastError and cancel the remaining
+	// operations, hence run() returns as soon as the round is over.
+	ioService.run();
+	
+	ec = lastError;
+	if( ec ) {
 		nBytesReceived = 0;
-		nBytesSent = 0;
-		memset( responseBuffer, 0x00, ModBus::Datagram::Base::maxDatagramLength );
-		if( responseDgram != nullptr ) {
-			delete responseDgram;
-			responseDgram = nullptr;
-		}
-		throw;
+		if( traceRecorder ) traceRecorder->failure( ec );
+		if( roundObserver ) roundObserver->roundEvent( RoundObserver::Failure );
+	}
+}
+
+
+void TcpRequestAndReply::run() {
+	boost::system::error_code ec;
+	run( ec );
+	if( ec != Error::TimeOut ) throwOnError( ec );
+}
+
+
+/**
+ * Records the first error of the current round and cancels all outstanding
+ * operations
+ */
+void TcpRequestAndReply::fail( const boost::system::error_code& error ) {
+	if( !lastError ) lastError = error;
+	nBytesReceived = 0;
+	boost::system::error_code ignored;
+	timer.cancel( ignored );
+	socket.cancel( ignored );
+}
+
+
+/**
+ * Advances the deadline into the future, because some progress has been made.
+ * Changing the expiry time cancels the pending wait, hence it must be
+ * scheduled again. If there was no pending wait, the timer has already
+ * expired and the round is being cancelled anyway.
+ */
+void TcpRequestAndReply::extendDeadline() {
+	if( timer.expires_from_now( timeoutDuration ) > 0 ) {
+		timer.async_wait( makeAllocHandler( handlerMemory, boost::bind( &TcpRequestAndReply::handleDeadline, this, boost::asio::placeholders::error ) ) );
 	}
 }
 
 
 void TcpRequestAndReply::handleDeadline( const boost::system::error_code& error ) {
+	// If error equals boost::asio::error::operation_aborted, then the timer
+	// has been stopped, because the I/O operations have finished successfully
+	// or the deadline has been advanced. In that case the function just returns.
+	// The same holds, if the timer had already expired when the reply was
+	// completed, because the handler cannot be cancelled anymore then.
+	if( error == boost::asio::error::operation_aborted || replyComplete ) return;
 	if( !error ) {
 		// Timer has expired, cancel outstanding I/O operations
-		socket->cancel();
-		return;
+		LM50_PROBE1( request__timeout, requestTransactionID() );
+		fail( Error::TimeOut );
+	} else {
+		fail( error );
 	}
-	// If error equals boost::asio::error::operation_aborted, then the timer
-	// has been stopped, because the I/O operations have finished successfully.
-	// In that case the function just returns. In all other cases, the error
-	// is thrown as an exception
-	if( error != boost::asio::error::operation_aborted ) throw error;
 }
 
 
 void TcpRequestAndReply::handleReceive( const boost::system::error_code& error, size_t nBytes ) {
-	if( !error ) {
-		// No error
-		nBytesReceived += nBytes;
-		
-		// First check if we need more bytes to capture.
-		try {
-			if( nBytesReceived < sizeof( ModBus::Datagram::Header ) || ModBus::Datagram::Base::missingBytes( responseBuffer, nBytesReceived ) > 0 ) {
-				// If more bytes are needed, advance the timer into the future and
-				// start a new receive
-				timer->expires_from_now( timeoutDuration );
-				socket->async_receive( boost::asio::buffer( responseBuffer + nBytesReceived , ModBus::Datagram::Base::maxDatagramLength - nBytesReceived ), boost::bind( &TcpRequestAndReply::handleReceive, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
-			} else {
-				// If enough bytes have been received, cancel the timer
-				timer->cancel();
-			}
-		} catch( ... ) {
-			// If some exception occured, we forget everything we have ever received
-			memset( responseBuffer, 0x00, ModBus::Datagram::Base::maxDatagramLength );
-			nBytesReceived = 0;
-			throw;
-		}
-	} else {
-		// If some error occured, we forget everything we have ever received
-		memset( responseBuffer, 0x00, ModBus::Datagram::Base::maxDatagramLength );
+	if( error ) {
+		// If some error occured, we forget everything we have ever received.
+		// Aborted operations are the consequence of an error that has already
+		// been recorded.
+		if( error != boost::asio::error::operation_aborted ) fail( error );
 		nBytesReceived = 0;
+		return;
+	}
+	
+	if( nBytesReceived == 0 ) {
+		LM50_PROBE2( reply__first, requestTransactionID(), nBytes );
+		if( roundObserver ) roundObserver->roundEvent( RoundObserver::FirstByte );
+	}
+	nBytesReceived += nBytes;
 	
-		
-		if( error != boost::asio::error::operation_aborted ) throw error;
+	// First check if we need more bytes to capture. This is the same check as
+	// ModBus::Datagram::Base::missingBytes, but without throwing exceptions.
+	if( nBytesReceived >= sizeof( ModBus::Datagram::Header ) ) {
+		const ModBus::Datagram::Header* header = reinterpret_cast< const ModBus::Datagram::Header* >( responseBuffer );
+		if( header->protocolID != 0x00 ) {
+			fail( Error::MalformedReply );
+			return;
+		}
+		if( nBytesReceived >= ntohs( header->length ) + 6u ) {
+			// If enough bytes have been received, cancel the timer
+			replyComplete = true;
+			timer.cancel();
+			if( traceRecorder ) traceRecorder->reply( responseBuffer, nBytesReceived );
+			LM50_PROBE2( reply__complete, requestTransactionID(), nBytesReceived );
+			if( roundObserver ) roundObserver->roundEvent( RoundObserver::ReplyComplete );
+			return;
+		}
+	}
+	if( nBytesReceived >= ModBus::Datagram::Base::maxDatagramLength ) {
+		fail( Error::MalformedReply );
+		return;
 	}
+	
+	// If more bytes are needed, advance the timer into the future and
+	// start a new receive
+	extendDeadline();
+	socket.async_receive( boost::asio::buffer( responseBuffer + nBytesReceived , ModBus::Datagram::Base::maxDatagramLength - nBytesReceived ), makeAllocHandler( handlerMemory, boost::bind( &TcpRequestAndReply::handleReceive, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) ) );
 }
 
 
 void TcpRequestAndReply::handleSend( const boost::system::error_code& error, size_t nBytes ) {
-	if( !error ) {
-		// No error
-		nBytesSent += nBytes;
-		if( nBytesSent < requestDgram->totalLength() ) {
-			// If more bytes need to be transmitted, advance the timer into the future
-			// and start a new transmit
-			timer->expires_from_now( timeoutDuration );
-			socket->async_send( boost::asio::buffer( requestDgram->rawDatagram() + nBytesSent, requestDgram->totalLength() - nBytesSent ), boost::bind( &TcpRequestAndReply::handleSend, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
-		}
-	} else {
+	if( error ) {
 		// If error equals boost::asio::error::operation_aborted, then the I/O
-		// operations has been stopped, because the deadline timer has expired.
-		// In that case the function just returns. In all other cases, the error is
-		// thrown as an exception.	
-		if( error != boost::asio::error::operation_aborted ) throw error;
+		// operations has been stopped, because the deadline timer has expired
+		// or another error has been recorded. 
+		if( error != boost::asio::error::operation_aborted ) fail( error );
+		return;
+	}
+	
+	nBytesSent += nBytes;
+	if( nBytesSent == requestLength && roundObserver ) roundObserver->roundEvent( RoundObserver::SendComplete );
+	if( nBytesSent < requestLength ) {
+		// If more bytes need to be transmitted, advance the timer into the future
+		// and start a new transmit
+		extendDeadline();
+		socket.async_send( boost::asio::buffer( requestBuffer + nBytesSent, requestLength - nBytesSent ), makeAllocHandler( handlerMemory, boost::bind( &TcpRequestAndReply::handleSend, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) ) );
 	}
 }
 
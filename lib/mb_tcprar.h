@@ -4,102 +4,203 @@
 #include <boost/asio.hpp>
 
 #include "mb_base.h"
+#include "mb_error.h"
+#include "mb_trace.h"
+#include "mb_handlermem.h"
 #include "nullptr.h"
 
 
 namespace ModBus {
 
+/**
+ * Interface to observe the progress of request-and-reply rounds, e.g. in
+ * order to measure the time spent in each stage. The observer is called
+ * synchronously by the thread that runs the round, hence implementations
+ * must be cheap.
+ */
+class RoundObserver {
+	public:
+		enum Event {
+			SendStart,      // the request is about to be sent
+			SendComplete,   // the last byte of the request has been sent
+			FirstByte,      // the first bytes of the reply have arrived
+			ReplyComplete,  // the reply is complete
+			Failure         // the round failed, e.g. timed out
+		};
+
+		virtual ~RoundObserver() {}
+
+		virtual void roundEvent( Event e ) = 0;
+};
+
+
 /**
  * An object of this class manages a typical request-and-reply round in
  * a ModBus/TCP communication. It uses a TCP socket to transmit the given
  * request and listens for the corresponding reply.
+ *
+ * The object is meant to be long-lived and to be reused for many rounds.
+ * The request and the response are kept in fixed size buffers inside the
+ * object and the asynchronous operations take their memory from a pool
+ * inside the object, hence a round trip neither copies datagram objects nor
+ * allocates memory. For the same reason objects of this class cannot be
+ * copied.
  */
 class TcpRequestAndReply {
 	public:
 		/**
-		 * Standard c'tor
-		 */
-		TcpRequestAndReply();
-		
-		/**
+		 * @param ioService The I/O service the socket belongs to
 		 * @param tcpSocket This socket is used to transmit and receive the
 		 * datagrams. The socket is not needed to be already connected to a remote
 		 * end point. But the socket must be connected before
 		 * TcpRequestAndReply::run() is invoked.
-		 * @param request The request to be sent
 		 * @param duration The time to wait for a response. Default is 1 second.
 		 */
-		TcpRequestAndReply( boost::asio::ip::tcp::socket& tcpSocket, const Datagram::Base& request, const boost::asio::deadline_timer::duration_type& duration = boost::posix_time::seconds( 1 ) );
-		
-		TcpRequestAndReply( const TcpRequestAndReply& other );
-		
+		TcpRequestAndReply( boost::asio::io_service& ioService, boost::asio::ip::tcp::socket& tcpSocket, const boost::asio::deadline_timer::duration_type& duration = boost::posix_time::seconds( 1 ) );
+
 		virtual ~TcpRequestAndReply();
-	
+
+	private:
+		TcpRequestAndReply( const TcpRequestAndReply& );
+		TcpRequestAndReply& operator=( const TcpRequestAndReply& );
+
 	public:
-		//void connect( const std::string& host );
-		/**
-		 * @param tcpSocket This socket is used to transmit and receive the
-		 * datagrams. The socket is not needed to be already connected to a remote
-		 * end point. But the socket must be connected before
-		 * TcpRequestAndReply::run() is invoked.
-		 */
-		void bindTo( boost::asio::ip::tcp::socket& tcpSocket );
-		
 		/**
+		 * Copies the raw bytes of the given request into the internal send
+		 * buffer. The request object is not referenced afterwards.
 		 * @param request The request to be sent
 		 */
 		void request( const Datagram::Base& req );
-		
+
+		/**
+		 * Writes a request to read a block of holding or input registers
+		 * directly into the internal send buffer, i.e. without creating a
+		 * datagram object. Throws a std::out_of_range, if the number of
+		 * registers is invalid.
+		 * @param func Either Function::ReadHoldingRegisters or
+		 * Function::ReadInputRegisters
+		 * @param transaction The transaction id of the request
+		 * @param unit The unit id of the addressed device
+		 * @param addr The starting address of the registers
+		 * @param length The number of 16bit registers to read
+		 */
+		void readRegistersRequest( Datagram::FuncCode func, Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length );
+
 		/**
 		 * @param duration The time to wait for a response.  Default is 1 second.
 		 */
 		void timeOut( const boost::asio::deadline_timer::duration_type& d );
-		
+
+		/**
+		 * @param r If not NULL, every request, reply and failed round is
+		 * appended to the given trace. The recorder is not owned by this object
+		 * and must outlive it or be reset to NULL.
+		 */
+		void recorder( TraceRecorder* r ) { traceRecorder = r; }
+
+		/**
+		 * @param r If not NULL, the socket is not used at all, but each round
+		 * is answered by the given trace. See ModBus::TraceReplay. The replay is
+		 * not owned by this object and must outlive it or be reset to NULL.
+		 */
+		void replay( TraceReplay* r ) { traceReplay = r; }
+
+		TraceReplay* replay() const { return traceReplay; }
+
+		/**
+		 * @param o If not NULL, the observer is notified about the progress of
+		 * each round. The observer is not owned by this object.
+		 */
+		void observer( RoundObserver* o ) { roundObserver = o; }
+
 		/**
 		 * Tries to transmit the given request with the given socket. The socket
-		 * must be connected. If the socket does not exist, is not connected or
-		 * if the request is not valid, an appropriate exception is thrown.
-		 * The function blocks until either the response has arrived or the time
-		 * out duration has expired.
+		 * must be connected. The function blocks until either the response has
+		 * arrived or the time out duration has expired. No exception is thrown,
+		 * but the outcome of the round is reported by the error code:
+		 * ModBus::Error::TimeOut, if no reply has arrived in time,
+		 * ModBus::Error::NotConnected or ModBus::Error::NoRequest if the object
+		 * is not ready, ModBus::Error::MalformedReply if the received bytes
+		 * are not a ModBus datagram, or the I/O error reported by the socket.
+		 * @param ec Set to indicate what error occured, if any
 		 */
-		void run();
+		void run( boost::system::error_code& ec );
 		
 		/**
-		 * @return The response for the request. If TcpRequestAndReply::run()
-		 * has never been invoked or was unsuccessful, NULL is returned
+		 * Same as TcpRequestAndReply::run( boost::system::error_code& ), but
+		 * throws a boost::system::system_error if an error other than a time out
+		 * occurs. After a time out TcpRequestAndReply::hasResponse() is false.
 		 */
-		const Datagram::Base* response() const {
-			return responseDgram;
+		void run();
+
+		/**
+		 * @return True, if the last call of TcpRequestAndReply::run() received
+		 * a complete datagram
+		 */
+		bool hasResponse() const {
+			return nBytesReceived != 0;
 		}
-		
+
 		/**
-		 * @return The response for the request. If TcpRequestAndReply::run()
-		 * has never been invoked or was unsuccessful, NULL is returned
-		 * The caller is responsible to free the returned object, because
-		 * this object gives up the owner ship.
+		 * @return A view on the raw bytes of the response. The bytes remain valid
+		 * until TcpRequestAndReply::run() is invoked the next time. If
+		 * TcpRequestAndReply::run() has never been invoked or was unsuccessful,
+		 * the length of the response is zero.
 		 */
-		Datagram::Base* releaseResponse() {
-			Datagram::Base* tmp( responseDgram );
-			responseDgram = nullptr;
-			return tmp;
+		const char* rawResponse() const {
+			return responseBuffer;
 		}
-		
+
+		/**
+		 * @return The number of valid bytes at TcpRequestAndReply::rawResponse()
+		 */
+		size_t rawResponseLength() const {
+			return nBytesReceived;
+		}
+
+		/**
+		 * @return A new datagram object for the response. If
+		 * TcpRequestAndReply::run() has never been invoked or was unsuccessful,
+		 * NULL is returned. The caller is responsible to free the returned object.
+		 * Only use this for rare or generic requests. The typed functions of
+		 * TcpCommunication decode the response without creating objects.
+		 */
+		Datagram::Base* createResponse() const {
+			if( nBytesReceived == 0 ) return nullptr;
+			return Datagram::Base::createObject( responseBuffer, nBytesReceived );
+		}
+
 	protected:
 		void handleDeadline( const boost::system::error_code& error );
 		void handleReceive( const boost::system::error_code& error, std::size_t nBytes );
 		void handleSend( const boost::system::error_code& error, std::size_t nBytes );
-		
+		void fail( const boost::system::error_code& error );
+		void extendDeadline();
+
+		/**
+		 * @return The transaction id of the current request
+		 */
+		Datagram::TransactionID requestTransactionID() const {
+			return static_cast< Datagram::TransactionID >( ( static_cast< unsigned char >( requestBuffer[0] ) << 8 ) | static_cast< unsigned char >( requestBuffer[1] ) );
+		}
+
 	protected:
-		boost::asio::ip::tcp::socket* socket;
-		boost::asio::deadline_timer* timer;
+		boost::asio::io_service& ioService;
+		boost::asio::ip::tcp::socket& socket;
+		boost::asio::deadline_timer timer;
 		boost::asio::deadline_timer::duration_type timeoutDuration;
-		Datagram::Base* requestDgram;
-		Datagram::Base* responseDgram;
-		
-		
+
+		char requestBuffer[ ModBus::Datagram::Base::maxDatagramLength ];
 		char responseBuffer[ ModBus::Datagram::Base::maxDatagramLength ];
+		size_t requestLength;
 		size_t nBytesSent;
 		size_t nBytesReceived;
+		boost::system::error_code lastError;
+		bool replyComplete;
+		TraceRecorder* traceRecorder;
+		TraceReplay* traceReplay;
+		RoundObserver* roundObserver;
+		HandlerMemory handlerMemory;
 };
 
 }
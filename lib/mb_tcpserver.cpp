@@ -0,0 +1,151 @@
+#include "lib/mb_tcpserver.h"
+#include "lib/mb_typedefs.h"
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <cstring>
+#include <stdexcept>
+#include <netinet/in.h>
+
+
+namespace ModBus {
+
+// The pause in milliseconds after a failed accept, e.g. if the process ran
+// out of file descriptors
+static const long acceptRetryPause( 100 );
+
+TcpServer::TcpServer( boost::asio::io_service& ioService, const boost::asio::ip::tcp::endpoint& endpoint, Handler& handler ) : ioService( ioService ), acceptor( ioService, endpoint ), acceptTimer( ioService ), _handler( handler ) {
+	startAccept();
+}
+
+
+TcpServer::~TcpServer() {
+	close();
+}
+
+
+void TcpServer::close() {
+	boost::system::error_code ignored;
+	acceptor.close( ignored );
+	acceptTimer.cancel( ignored );
+}
+
+
+void TcpServer::startAccept() {
+	boost::shared_ptr< TcpServerSession > session( new TcpServerSession( ioService, _handler ) );
+	acceptor.async_accept( session->socket(), boost::bind( &TcpServer::handleAccept, this, session, boost::asio::placeholders::error ) );
+}
+
+
+void TcpServer::handleAccept( boost::shared_ptr< TcpServerSession > session, const boost::system::error_code& error ) {
+	// The acceptor has been closed, stop accepting
+	if( error == boost::asio::error::operation_aborted ) return;
+	// Other errors (e.g. too many open files) leave the connection pending,
+	// hence accepting again at once would fail at once. Retry after a pause.
+	if( error ) {
+		acceptTimer.expires_from_now( boost::posix_time::milliseconds( acceptRetryPause ) );
+		acceptTimer.async_wait( boost::bind( &TcpServer::retryAccept, this, boost::asio::placeholders::error ) );
+		return;
+	}
+	boost::system::error_code ignored;
+	session->socket().set_option( boost::asio::ip::tcp::no_delay( true ), ignored );
+	session->start();
+	startAccept();
+}
+
+
+void TcpServer::retryAccept( const boost::system::error_code& error ) {
+	if( error == boost::asio::error::operation_aborted || !acceptor.is_open() ) return;
+	startAccept();
+}
+
+
+
+TcpServerSession::TcpServerSession( boost::asio::io_service& ioService, TcpServer::Handler& handler ) : tcpSocket( ioService ), timer( ioService ), handler( handler ), replyLength( 0 ) {
+}
+
+
+TcpServerSession::~TcpServerSession() {
+}
+
+
+void TcpServerSession::start() {
+	readHeader();
+}
+
+
+/**
+ * The first six bytes of a ModBus/TCP datagram are the transaction id, the
+ * protocol id and the length field. The length field tells how many bytes
+ * follow.
+ */
+void TcpServerSession::readHeader() {
+	boost::asio::async_read( tcpSocket, boost::asio::buffer( requestBuffer, 6 ), boost::bind( &TcpServerSession::handleHeader, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
+}
+
+
+void TcpServerSession::handleHeader( const boost::system::error_code& error, std::size_t ) {
+	// Closing the connection is the only sensible reaction to errors, the
+	// session is destroyed as soon as the last handler returns
+	if( error ) return;
+	const Datagram::Header* header = reinterpret_cast< const Datagram::Header* >( requestBuffer );
+	const size_t mbLength( ntohs( header->length ) );
+	if( header->protocolID != 0x00 || mbLength < 2 || mbLength + 6 > Datagram::Base::maxDatagramLength ) {
+		reset();
+		return;
+	}
+	boost::asio::async_read( tcpSocket, boost::asio::buffer( requestBuffer + 6, mbLength ), boost::bind( &TcpServerSession::handleBody, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
+}
+
+
+void TcpServerSession::handleBody( const boost::system::error_code& error, std::size_t nBytes ) {
+	if( error ) return;
+	boost::scoped_ptr< Datagram::Base > request;
+	try {
+		request.reset( Datagram::Base::createObject( requestBuffer, nBytes + 6 ) );
+	} catch( std::exception& ) {
+		reset();
+		return;
+	}
+	handler.request( *this, *request );
+}
+
+
+void TcpServerSession::reply( const Datagram::Base& response, const boost::posix_time::time_duration& delay ) {
+	replyLength = response.totalLength();
+	assert( replyLength <= Datagram::Base::maxDatagramLength );
+	memcpy( replyBuffer, response.rawDatagram(), replyLength );
+	if( delay <= boost::posix_time::time_duration() ) {
+		boost::asio::async_write( tcpSocket, boost::asio::buffer( replyBuffer, replyLength ), boost::bind( &TcpServerSession::handleWrite, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
+		return;
+	}
+	timer.expires_from_now( delay );
+	timer.async_wait( boost::bind( &TcpServerSession::handleDelay, shared_from_this(), boost::asio::placeholders::error ) );
+}
+
+
+void TcpServerSession::ignore() {
+	readHeader();
+}
+
+
+void TcpServerSession::reset() {
+	// A linger time of zero makes close() send a RST instead of a FIN
+	boost::system::error_code ignored;
+	tcpSocket.set_option( boost::asio::socket_base::linger( true, 0 ), ignored );
+	tcpSocket.close( ignored );
+}
+
+
+void TcpServerSession::handleDelay( const boost::system::error_code& error ) {
+	if( error ) return;
+	boost::asio::async_write( tcpSocket, boost::asio::buffer( replyBuffer, replyLength ), boost::bind( &TcpServerSession::handleWrite, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred ) );
+}
+
+
+void TcpServerSession::handleWrite( const boost::system::error_code& error, std::size_t ) {
+	if( error ) return;
+	readHeader();
+}
+
+}
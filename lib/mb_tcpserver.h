@@ -0,0 +1,143 @@
+#ifndef _MB_TCPSERVER_H_
+#define _MB_TCPSERVER_H_
+
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "mb_base.h"
+#include "nullptr.h"
+
+
+namespace ModBus {
+
+class TcpServerSession;
+
+/**
+ * An asynchronous ModBus/TCP server. The server accepts connections on one
+ * endpoint and passes every complete request datagram to a handler object.
+ * The server itself does not interpret the requests. Many servers can share
+ * one I/O service and are then driven by the thread(s) that run it.
+ */
+class TcpServer {
+	public:
+		/**
+		 * The interface of the object that answers the requests.
+		 */
+		class Handler {
+			public:
+				virtual ~Handler() {}
+
+				/**
+				 * Called for every request that has been received. The handler must
+				 * call exactly one of TcpServerSession::reply,
+				 * TcpServerSession::ignore or TcpServerSession::reset. It may do
+				 * so later, but then it must keep the session alive by holding
+				 * TcpServerSession::shared_from_this(). The session does not read
+				 * the next request before.
+				 * @param session The session that has received the request
+				 * @param request The request
+				 */
+				virtual void request( TcpServerSession& session, const Datagram::Base& request ) = 0;
+		};
+
+	public:
+		/**
+		 * Opens the acceptor and starts accepting connections. The function
+		 * returns immediately, the work is done by the I/O service.
+		 * @param ioService The I/O service to use
+		 * @param endpoint The local address and port to listen on
+		 * @param handler The handler that answers the requests. The handler must
+		 * outlive the server.
+		 */
+		TcpServer( boost::asio::io_service& ioService, const boost::asio::ip::tcp::endpoint& endpoint, Handler& handler );
+
+		virtual ~TcpServer();
+
+	private:
+		TcpServer( const TcpServer& );
+		TcpServer& operator=( const TcpServer& );
+
+	public:
+		/**
+		 * Stops accepting new connections. Established sessions are not
+		 * affected.
+		 */
+		void close();
+
+		const boost::asio::ip::tcp::endpoint localEndpoint() const { return acceptor.local_endpoint(); }
+
+		Handler& handler() const { return _handler; }
+
+	protected:
+		void startAccept();
+		void handleAccept( boost::shared_ptr< TcpServerSession > session, const boost::system::error_code& error );
+		void retryAccept( const boost::system::error_code& error );
+
+	protected:
+		boost::asio::io_service& ioService;
+		boost::asio::ip::tcp::acceptor acceptor;
+		boost::asio::deadline_timer acceptTimer;
+		Handler& _handler;
+};
+
+
+/**
+ * One connection of a TcpServer. Objects of this class are created by the
+ * server and manage their own life time, i.e. the object is destroyed as soon
+ * as the connection is closed and no handler refers to it anymore.
+ */
+class TcpServerSession : public boost::enable_shared_from_this< TcpServerSession > {
+	public:
+		TcpServerSession( boost::asio::io_service& ioService, TcpServer::Handler& handler );
+
+		virtual ~TcpServerSession();
+
+	private:
+		TcpServerSession( const TcpServerSession& );
+		TcpServerSession& operator=( const TcpServerSession& );
+
+	public:
+		boost::asio::ip::tcp::socket& socket() { return tcpSocket; }
+
+		/**
+		 * Starts reading the first request
+		 */
+		void start();
+
+		/**
+		 * Sends the reply and continues with the next request afterwards
+		 * @param response The reply. Its raw bytes are copied immediately.
+		 * @param delay The time to wait before the reply is sent
+		 */
+		void reply( const Datagram::Base& response, const boost::posix_time::time_duration& delay = boost::posix_time::time_duration() );
+
+		/**
+		 * Does not answer the request but continues with the next request
+		 */
+		void ignore();
+
+		/**
+		 * Aborts the connection. The peer sees a connection reset.
+		 */
+		void reset();
+
+	protected:
+		void readHeader();
+		void handleHeader( const boost::system::error_code& error, std::size_t nBytes );
+		void handleBody( const boost::system::error_code& error, std::size_t nBytes );
+		void handleDelay( const boost::system::error_code& error );
+		void handleWrite( const boost::system::error_code& error, std::size_t nBytes );
+
+	protected:
+		boost::asio::ip::tcp::socket tcpSocket;
+		boost::asio::deadline_timer timer;
+		TcpServer::Handler& handler;
+		char requestBuffer[ Datagram::Base::maxDatagramLength ];
+		char replyBuffer[ Datagram::Base::maxDatagramLength ];
+		size_t replyLength;
+};
+
+}
+
+#endif
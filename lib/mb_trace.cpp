@@ -0,0 +1,226 @@
+#include "lib/mb_trace.h"
+#include "lib/mb_base.h"
+
+#include <boost/asio/error.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace ModBus {
+
+static const char traceMagic[ 8 ] = { 'M', 'B', 'T', 'R', 'A', 'C', 'E', 0x01 };
+static const size_t recordHeaderLength( 11 );
+
+
+static u_int64_t monotonicTime() {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return static_cast< u_int64_t >( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
+}
+
+
+static void putUInt( char* dest, u_int64_t value, size_t n ) {
+	for( size_t i( n ); i != 0; --i ) {
+		dest[ i - 1 ] = static_cast< char >( value & 0xff );
+		value >>= 8;
+	}
+}
+
+
+static u_int64_t getUInt( const char* src, size_t n ) {
+	u_int64_t value( 0 );
+	for( size_t i( 0 ); i != n; ++i ) value = ( value << 8 ) | static_cast< unsigned char >( src[ i ] );
+	return value;
+}
+
+
+TraceRecorder::TraceRecorder() : _file( NULL ) {
+}
+
+
+TraceRecorder::TraceRecorder( const std::string& path ) : _file( NULL ) {
+	open( path );
+}
+
+
+TraceRecorder::~TraceRecorder() {
+	close();
+}
+
+
+void TraceRecorder::open( const std::string& path ) {
+	close();
+	_file = fopen( path.c_str(), "ab" );
+	if( !_file ) throw std::runtime_error( std::string( "Could not open trace file: " ).append( strerror( errno ) ) );
+	if( ftell( _file ) == 0 ) fwrite( traceMagic, sizeof( traceMagic ), 1, _file );
+	fflush( _file );
+}
+
+
+void TraceRecorder::close() {
+	if( !_file ) return;
+	fclose( _file );
+	_file = NULL;
+}
+
+
+void TraceRecorder::request( const char* adu, size_t length ) {
+	write( Trace::Request, adu, length );
+}
+
+
+void TraceRecorder::reply( const char* adu, size_t length ) {
+	write( Trace::Reply, adu, length );
+	fflush( _file );
+}
+
+
+void TraceRecorder::failure( const boost::system::error_code& ec ) {
+	char payload[ 64 ];
+	const char* name( ec.category().name() );
+	size_t nameLength( std::min( strlen( name ), sizeof( payload ) - 4 ) );
+	putUInt( payload, static_cast< u_int32_t >( ec.value() ), 4 );
+	memcpy( payload + 4, name, nameLength );
+	write( Trace::Failure, payload, 4 + nameLength );
+	fflush( _file );
+}
+
+
+void TraceRecorder::write( Trace::Kind kind, const char* payload, size_t length ) {
+	if( !_file ) return;
+	char header[ recordHeaderLength ];
+	putUInt( header, monotonicTime(), 8 );
+	header[ 8 ] = static_cast< char >( kind );
+	putUInt( header + 9, length, 2 );
+	fwrite( header, sizeof( header ), 1, _file );
+	fwrite( payload, length, 1, _file );
+}
+
+
+TraceReplay::TraceReplay() : _data(), _records(), _position( 0 ), _realTime( false ), _loop( false ) {
+}
+
+
+TraceReplay::TraceReplay( const std::string& path ) : _data(), _records(), _position( 0 ), _realTime( false ), _loop( false ) {
+	load( path );
+}
+
+
+void TraceReplay::load( const std::string& path ) {
+	std::ifstream file( path.c_str(), std::ios::in | std::ios::binary );
+	if( !file ) throw std::runtime_error( "Could not open trace file" );
+	_data.assign( std::istreambuf_iterator< char >( file ), std::istreambuf_iterator< char >() );
+	_records.clear();
+	_position = 0;
+
+	if( _data.size() < sizeof( traceMagic ) || memcmp( &_data[0], traceMagic, sizeof( traceMagic ) ) != 0 ) throw std::runtime_error( "File is not a ModBus trace" );
+
+	// Index the records. A truncated record at the end (e.g. if the recording
+	// program has been killed) is silently dropped.
+	size_t offset( sizeof( traceMagic ) );
+	while( offset + recordHeaderLength <= _data.size() ) {
+		Record rec;
+		rec.time = getUInt( &_data[ offset ], 8 );
+		rec.kind = static_cast< Trace::Kind >( _data[ offset + 8 ] );
+		rec.length = getUInt( &_data[ offset + 9 ], 2 );
+		rec.offset = offset + recordHeaderLength;
+		if( rec.offset + rec.length > _data.size() ) break;
+		if( rec.kind != Trace::Request && rec.kind != Trace::Reply && rec.kind != Trace::Failure ) throw std::runtime_error( "Trace contains an unknown record" );
+		_records.push_back( rec );
+		offset = rec.offset + rec.length;
+	}
+}
+
+
+size_t TraceReplay::countRequests() const {
+	size_t n( 0 );
+	for( size_t i( 0 ); i != _records.size(); ++i ) if( _records[ i ].kind == Trace::Request ) ++n;
+	return n;
+}
+
+
+void TraceReplay::transact( const char* request, size_t requestLength, char* response, size_t& responseLength, boost::system::error_code& ec ) {
+	responseLength = 0;
+	ec.clear();
+
+	// Search the next matching request. If looping is enabled, the search
+	// wraps around once.
+	size_t i( _position );
+	size_t searched( 0 );
+	while( searched != _records.size() ) {
+		if( i == _records.size() ) {
+			if( !_loop ) break;
+			i = 0;
+		}
+		if( matches( _records[ i ], request, requestLength ) ) break;
+		++i;
+		++searched;
+	}
+	if( i == _records.size() || searched == _records.size() ) {
+		_position = _records.size();
+		ec = ( searched == _records.size() && _loop ) ? Error::TraceMismatch : Error::TraceExhausted;
+		return;
+	}
+
+	const Record& req( _records[ i ] );
+	_position = i + 1;
+
+	// The recorder writes an outcome for each request. If it is missing, the
+	// recording was interrupted while the request was pending.
+	if( _position == _records.size() || _records[ _position ].kind == Trace::Request ) {
+		ec = Error::TimeOut;
+		return;
+	}
+	const Record& res( _records[ _position++ ] );
+
+	if( _realTime && res.time > req.time ) {
+		const u_int64_t delay( res.time - req.time );
+		struct timespec ts;
+		ts.tv_sec = delay / 1000000000;
+		ts.tv_nsec = delay % 1000000000;
+		while( nanosleep( &ts, &ts ) != 0 && errno == EINTR );
+	}
+
+	if( res.kind == Trace::Failure ) {
+		ec = decodeFailure( res );
+		return;
+	}
+
+	if( res.length > Datagram::Base::maxDatagramLength ) {
+		ec = Error::MalformedReply;
+		return;
+	}
+	memcpy( response, &_data[ res.offset ], res.length );
+	// Patch the transaction id, such that the reply belongs to the current
+	// conversation
+	if( res.length >= 2 && requestLength >= 2 ) memcpy( response, request, 2 );
+	responseLength = res.length;
+}
+
+
+/**
+ * @return True, if the record is a request that equals the given one apart
+ * from the transaction id (the first two bytes)
+ */
+bool TraceReplay::matches( const Record& rec, const char* request, size_t requestLength ) const {
+	if( rec.kind != Trace::Request || rec.length != requestLength || requestLength < 2 ) return false;
+	return memcmp( &_data[ rec.offset + 2 ], request + 2, requestLength - 2 ) == 0;
+}
+
+
+boost::system::error_code TraceReplay::decodeFailure( const Record& rec ) const {
+	if( rec.length < 4 ) return Error::MalformedReply;
+	const int value( static_cast< int >( getUInt( &_data[ rec.offset ], 4 ) ) );
+	const std::string name( &_data[ rec.offset + 4 ], rec.length - 4 );
+	if( name == errorCategory().name() ) return boost::system::error_code( value, errorCategory() );
+	if( name == exceptionCategory().name() ) return boost::system::error_code( value, exceptionCategory() );
+	if( name == boost::asio::error::get_misc_category().name() ) return boost::system::error_code( value, boost::asio::error::get_misc_category() );
+	if( name == boost::system::generic_category().name() ) return boost::system::error_code( value, boost::system::generic_category() );
+	return boost::system::error_code( value, boost::system::system_category() );
+}
+
+}
@@ -0,0 +1,172 @@
+#ifndef _MB_TRACE_H_
+#define _MB_TRACE_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "lib/mb_error.h"
+
+namespace ModBus {
+
+/**
+ * Traces are compact binary files of the raw ModBus/TCP traffic between this
+ * library and a device. A trace starts with the 8 byte magic "MBTRACE" plus
+ * the format version 0x01, followed by a sequence of records. Each record
+ * consists of
+ *
+ *   - 8 bytes: the CLOCK_MONOTONIC time stamp in nanoseconds
+ *   - 1 byte:  the kind of the record (see Trace::Kind)
+ *   - 2 bytes: the length N of the payload
+ *   - N bytes: the payload
+ *
+ * All integers are stored in network byte order. The payload of a request or
+ * reply record is the complete ADU as sent or received. The payload of a
+ * failure record is the 4 byte value of the error code followed by the name
+ * of its category.
+ */
+namespace Trace {
+	enum Kind {
+		Request = 1,
+		Reply = 2,
+		Failure = 3
+	};
+}
+
+
+/**
+ * Appends the traffic of a TcpRequestAndReply object to a trace file. See
+ * TcpRequestAndReply::recorder.
+ *
+ * The records are written by the buffered stdio functions. The buffer is
+ * flushed at the end of each round, hence a trace is complete up to the last
+ * round even if the program is killed.
+ */
+class TraceRecorder {
+	public:
+		TraceRecorder();
+
+		/**
+		 * Creates a new object and calls TraceRecorder::open
+		 */
+		TraceRecorder( const std::string& path );
+
+		virtual ~TraceRecorder();
+
+	private:
+		TraceRecorder( const TraceRecorder& );
+		TraceRecorder& operator=( const TraceRecorder& );
+
+	public:
+		/**
+		 * Opens the file for writing. If the file is empty the header is written,
+		 * otherwise new records are appended to the existing trace. Throws a
+		 * std::runtime_error, if the file cannot be opened.
+		 */
+		void open( const std::string& path );
+
+		void close();
+
+		bool isOpen() const { return _file != NULL; }
+
+		void request( const char* adu, size_t length );
+
+		void reply( const char* adu, size_t length );
+
+		void failure( const boost::system::error_code& ec );
+
+	protected:
+		void write( Trace::Kind kind, const char* payload, size_t length );
+
+	protected:
+		FILE* _file;
+};
+
+
+/**
+ * Replays a trace in place of a real device. The whole trace is loaded into
+ * memory up front, such that the replay itself does not perform any I/O.
+ * See TcpRequestAndReply::replay.
+ *
+ * For each request the replay searches the next recorded request that equals
+ * the given one apart from the transaction id, skipping all other records.
+ * The outcome that was recorded for that request is returned, i.e. either
+ * the reply (with the transaction id of the current request) or the error.
+ * If real time is enabled, the replay sleeps as long as the recorded device
+ * took to respond. Otherwise the outcome is returned as fast as possible.
+ */
+class TraceReplay {
+	public:
+		TraceReplay();
+
+		/**
+		 * Creates a new object and calls TraceReplay::load
+		 */
+		TraceReplay( const std::string& path );
+
+		virtual ~TraceReplay() {}
+
+	public:
+		/**
+		 * Loads the trace and rewinds to the first record. Throws a
+		 * std::runtime_error, if the file cannot be read or is not a trace.
+		 */
+		void load( const std::string& path );
+
+		/**
+		 * @param enable If true, the replay reproduces the recorded response
+		 * times. Default is false.
+		 */
+		void realTime( bool enable ) { _realTime = enable; }
+
+		/**
+		 * @param enable If true, the replay starts over again at the end of the
+		 * trace. Default is false.
+		 */
+		void loop( bool enable ) { _loop = enable; }
+
+		void rewind() { _position = 0; }
+
+		/**
+		 * @return The number of request records in the trace
+		 */
+		size_t countRequests() const;
+
+		/**
+		 * Replays one round.
+		 * @param request The raw request
+		 * @param requestLength The length of the request
+		 * @param response The buffer to copy the recorded response to. The buffer
+		 * must be at least Datagram::Base::maxDatagramLength bytes long.
+		 * @param responseLength Set to the length of the response, zero if an
+		 * error is reported
+		 * @param ec Set to the recorded error, ModBus::Error::TraceExhausted if
+		 * the end of the trace has been reached or ModBus::Error::TraceMismatch
+		 * if the trace does not contain the request at all
+		 */
+		void transact( const char* request, size_t requestLength, char* response, size_t& responseLength, boost::system::error_code& ec );
+
+	protected:
+		struct Record {
+			u_int64_t time;
+			Trace::Kind kind;
+			size_t offset;
+			size_t length;
+		};
+
+		bool matches( const Record& rec, const char* request, size_t requestLength ) const;
+
+		boost::system::error_code decodeFailure( const Record& rec ) const;
+
+	protected:
+		std::vector< char > _data;
+		std::vector< Record > _records;
+		size_t _position;
+		bool _realTime;
+		bool _loop;
+};
+
+}
+
+#endif
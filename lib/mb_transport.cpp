@@ -0,0 +1,18 @@
+#include "lib/mb_transport.h"
+#include "lib/mb_rtucomm.h"
+#include "lib/mb_tcpcomm.h"
+#include "lib/mb_udpcomm.h"
+
+#include <stdexcept>
+
+namespace ModBus {
+
+Transport* Transport::create( const std::string& name ) {
+	if( name == "tcp" ) return new TcpCommunication();
+	if( name == "rtu-tcp" ) return new RtuTcpCommunication();
+	if( name == "rtu-serial" ) return new RtuSerialCommunication();
+	if( name == "udp" ) return new UdpCommunication();
+	throw std::invalid_argument( "Unknown transport \"" + name + "\"" );
+}
+
+}
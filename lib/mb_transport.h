@@ -0,0 +1,83 @@
+#ifndef _MB_TRANSPORT_H_
+#define _MB_TRANSPORT_H_
+
+#include <string>
+#include <sys/types.h>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mb_base.h"
+#include "mb_error.h"
+#include "mb_registers.h"
+
+namespace ModBus {
+
+/**
+ * The interface of a connection to a single ModBus device, independent of
+ * the framing on the wire. The requests and replies are always given in
+ * ModBus/TCP framing, i.e. as the datagram classes of this library. A
+ * transport with another framing (e.g. RTU) converts them.
+ *
+ * All functions report errors by error codes like TcpCommunication.
+ */
+class Transport {
+	public:
+		virtual ~Transport() {}
+
+		/**
+		 * Creates a transport by its name: "tcp" (see TcpCommunication),
+		 * "rtu-tcp" (see RtuTcpCommunication), "rtu-serial" (see
+		 * RtuSerialCommunication) or "udp" (see UdpCommunication). Throws a
+		 * std::invalid_argument for other names. The caller is responsible to free the returned object.
+		 */
+		static Transport* create( const std::string& name );
+
+	public:
+		/**
+		 * Connects to the device. The meaning of the arguments depends on the
+		 * transport, e.g. a serial port takes the path of the device and its
+		 * settings.
+		 * @param ec Set to indicate what error occured, if any
+		 */
+		virtual void open( const std::string& remoteHost, const std::string& port, boost::system::error_code& ec ) = 0;
+
+		virtual void close() = 0;
+
+		virtual bool isOpen() const = 0;
+
+		/**
+		 * @return False, if the transport keeps no connection state, i.e. if a
+		 * failed request leaves nothing behind that must be re-established
+		 */
+		virtual bool isConnectionOriented() const { return true; }
+
+		/**
+		 * @param timeout The time to wait for a response of subsequent requests
+		 */
+		virtual void timeOut( const boost::posix_time::time_duration& timeout ) = 0;
+
+		/**
+		 * Transmits an arbitrary request and waits for the reply. A ModBus
+		 * exception reply is not reported as an error.
+		 * @param length Set to the number of bytes of the reply
+		 * @param ec Set to indicate what error occured, if any
+		 * @return The raw reply in ModBus/TCP framing with the transaction id
+		 * of the request, valid until the next request
+		 */
+		virtual const char* transact( const Datagram::Base& request, size_t& length, boost::system::error_code& ec ) = 0;
+
+		/**
+		 * Reads a block of holding registers. See
+		 * TcpCommunication::readHoldingRegisters.
+		 */
+		virtual Registers readHoldingRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec ) = 0;
+
+		/**
+		 * Reads a block of input registers. See
+		 * TcpCommunication::readInputRegisters.
+		 */
+		virtual Registers readInputRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec ) = 0;
+};
+
+}
+
+#endif
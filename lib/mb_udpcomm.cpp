@@ -0,0 +1,207 @@
+#include "lib/mb_udpcomm.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <boost/asio/error.hpp>
+
+namespace ModBus {
+
+static boost::system::error_code lastSystemError() {
+	return boost::system::error_code( errno, boost::system::system_category() );
+}
+
+/**
+ * Adds the given number of microseconds to the time
+ */
+static void advance( struct timespec& t, long us ) {
+	t.tv_sec += us / 1000000;
+	t.tv_nsec += ( us % 1000000 ) * 1000;
+	if( t.tv_nsec >= 1000000000 ) {
+		t.tv_nsec -= 1000000000;
+		++t.tv_sec;
+	}
+}
+
+
+UdpCommunication::UdpCommunication() : fd( -1 ), timeoutDuration( boost::posix_time::seconds( 1 ) ), retryCount( 2 ), retransmissionCount( 0 ), requestLength( 0 ), responseLength( 0 ) {
+	memset( requestBuffer, 0x00, sizeof( requestBuffer ) );
+	memset( responseBuffer, 0x00, sizeof( responseBuffer ) );
+}
+
+
+UdpCommunication::~UdpCommunication() {
+	close();
+}
+
+
+/**
+ * The socket is connected, such that the kernel drops datagrams of other
+ * senders
+ */
+void UdpCommunication::open( const std::string& remoteHost, const std::string& port, boost::system::error_code& ec ) {
+	close();
+	struct addrinfo hints;
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	struct addrinfo* res( NULL );
+	if( getaddrinfo( remoteHost.c_str(), port.c_str(), &hints, &res ) != 0 ) {
+		ec = boost::asio::error::host_not_found;
+		return;
+	}
+	fd = socket( res->ai_family, res->ai_socktype, res->ai_protocol );
+	if( fd < 0 || connect( fd, res->ai_addr, res->ai_addrlen ) < 0 ) {
+		ec = lastSystemError();
+		freeaddrinfo( res );
+		close();
+		return;
+	}
+	freeaddrinfo( res );
+	fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+	ec.clear();
+}
+
+
+void UdpCommunication::close() {
+	if( fd < 0 ) return;
+	::close( fd );
+	fd = -1;
+}
+
+
+const char* UdpCommunication::transact( const Datagram::Base& request, size_t& length, boost::system::error_code& ec ) {
+	length = 0;
+	requestLength = request.totalLength();
+	if( requestLength < 8 || requestLength > sizeof( requestBuffer ) ) {
+		ec = Error::NoRequest;
+		return responseBuffer;
+	}
+	memcpy( requestBuffer, request.rawDatagram(), requestLength );
+	run( ec );
+	if( !ec ) length = responseLength;
+	return responseBuffer;
+}
+
+
+Registers UdpCommunication::readHoldingRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec ) {
+	return readRegisters( Function::ReadHoldingRegisters, transaction, unit, addr, length, ec );
+}
+
+
+Registers UdpCommunication::readInputRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec ) {
+	return readRegisters( Function::ReadInputRegisters, transaction, unit, addr, length, ec );
+}
+
+
+/**
+ * Writes the request directly into the send buffer and decodes the reply in
+ * place, see Registers::decode
+ */
+Registers UdpCommunication::readRegisters( Datagram::FuncCode func, Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec ) {
+	if( length == 0 || length > 0x7d ) throw std::out_of_range( "Number of registers to read must be between 1 and 0x7d" );
+	requestBuffer[0] = static_cast< char >( transaction >> 8 );
+	requestBuffer[1] = static_cast< char >( transaction );
+	requestBuffer[2] = 0x00;
+	requestBuffer[3] = 0x00;
+	requestBuffer[4] = 0x00;
+	requestBuffer[5] = 0x06;
+	requestBuffer[6] = static_cast< char >( unit );
+	requestBuffer[7] = static_cast< char >( func );
+	requestBuffer[8] = static_cast< char >( addr >> 8 );
+	requestBuffer[9] = static_cast< char >( addr );
+	requestBuffer[10] = static_cast< char >( length >> 8 );
+	requestBuffer[11] = static_cast< char >( length );
+	requestLength = 12;
+	run( ec );
+	if( ec ) return Registers();
+	return Registers::decode( responseBuffer, responseLength, func, transaction, length, ec );
+}
+
+
+/**
+ * Sends the request and waits for the matching reply. If no reply arrives
+ * within the share of the time out of an attempt, the unchanged request is
+ * sent again. A reply to an earlier attempt is as good as one to the last.
+ */
+void UdpCommunication::run( boost::system::error_code& ec ) {
+	responseLength = 0;
+	if( fd < 0 ) {
+		ec = Error::NotConnected;
+		return;
+	}
+	const long attemptUs( timeoutDuration.total_microseconds() / ( retryCount + 1 ) );
+	struct timespec until;
+	clock_gettime( CLOCK_MONOTONIC, &until );
+	for( unsigned int attempt( 0 ); attempt <= retryCount; ++attempt ) {
+		if( attempt != 0 ) ++retransmissionCount;
+		send( ec );
+		if( ec ) return;
+		advance( until, attemptUs );
+		if( receive( until, ec ) || ec ) return;
+	}
+	ec = Error::TimeOut;
+}
+
+
+void UdpCommunication::send( boost::system::error_code& ec ) {
+	while( ::send( fd, requestBuffer, requestLength, MSG_NOSIGNAL ) < 0 ) {
+		// A pending ICMP port unreachable of an earlier datagram is reported
+		// and cleared by this call
+		if( errno == EINTR || errno == ECONNREFUSED ) continue;
+		// The socket buffer is full, the datagram is lost like on the wire
+		if( errno == EAGAIN || errno == EWOULDBLOCK ) break;
+		ec = lastSystemError();
+		return;
+	}
+	ec.clear();
+}
+
+
+/**
+ * Receives datagrams until the reply to the request arrives or the given
+ * time has passed. Datagrams with another transaction id or unit id, a
+ * protocol id other than zero or a length field that does not match the
+ * size of the datagram are dropped.
+ * @return True, if the reply has been received
+ */
+bool UdpCommunication::receive( const struct timespec& until, boost::system::error_code& ec ) {
+	while( true ) {
+		struct timespec now;
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		const long remaining( ( until.tv_sec - now.tv_sec ) * 1000000 + ( until.tv_nsec - now.tv_nsec ) / 1000 );
+		if( remaining <= 0 ) return false;
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		const int res( poll( &pfd, 1, ( remaining + 999 ) / 1000 ) );
+		if( res < 0 && errno == EINTR ) continue;
+		if( res < 0 ) {
+			ec = lastSystemError();
+			return false;
+		}
+		if( res == 0 ) return false;
+
+		const ssize_t n( ::recv( fd, responseBuffer, sizeof( responseBuffer ), 0 ) );
+		if( n < 0 ) {
+			// An ICMP port unreachable is as temporary as a lost datagram
+			if( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNREFUSED ) continue;
+			ec = lastSystemError();
+			return false;
+		}
+		if( n < 8 ) continue;
+		const unsigned char* r( reinterpret_cast< const unsigned char* >( responseBuffer ) );
+		const size_t pduLength( ( r[4] << 8 ) | r[5] );
+		if( r[2] != 0x00 || r[3] != 0x00 || pduLength + 6 != static_cast< size_t >( n ) ) continue;
+		if( memcmp( responseBuffer, requestBuffer, 2 ) != 0 || responseBuffer[6] != requestBuffer[6] ) continue;
+		responseLength = n;
+		ec.clear();
+		return true;
+	}
+}
+
+}
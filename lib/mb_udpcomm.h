@@ -0,0 +1,90 @@
+#ifndef _MB_UDPCOMM_H_
+#define _MB_UDPCOMM_H_
+
+#include <ctime>
+#include <string>
+
+#include "mb_transport.h"
+
+namespace ModBus {
+
+/**
+ * ModBus/UDP, i.e. the ModBus/TCP framing with one datagram per request and
+ * one datagram per reply.
+ *
+ * There is no connection, hence there is nothing to re-establish after the
+ * device or the network failed; UdpCommunication::open only resolves the
+ * address and creates the socket. Replies are matched by their transaction
+ * id and unit id, datagrams that do not match (e.g. the late reply to an
+ * earlier attempt) are dropped. A lost request or reply is recovered by
+ * retransmitting the same datagram. The time out covers all attempts of a
+ * request and is split evenly among them.
+ *
+ * Like TcpRequestAndReply the datagrams are kept in fixed size buffers inside
+ * the object, hence a round does not allocate memory.
+ */
+class UdpCommunication : public Transport {
+	public:
+		UdpCommunication();
+
+	private:
+		UdpCommunication( const UdpCommunication& );
+		UdpCommunication& operator=( const UdpCommunication& );
+
+	public:
+		virtual ~UdpCommunication();
+
+	public:
+		/**
+		 * Resolves the device and creates the socket. No datagram is sent.
+		 */
+		virtual void open( const std::string& remoteHost, const std::string& port, boost::system::error_code& ec );
+
+		virtual void close();
+
+		virtual bool isOpen() const { return fd >= 0; }
+
+		virtual bool isConnectionOriented() const { return false; }
+
+		virtual void timeOut( const boost::posix_time::time_duration& timeout ) { timeoutDuration = timeout; }
+
+		/**
+		 * @param n The number of retransmissions of a request, whose reply is
+		 * missing. The default is 2.
+		 */
+		void retries( unsigned int n ) { retryCount = n; }
+
+		unsigned int retries() const { return retryCount; }
+
+		/**
+		 * @return The number of retransmissions since the object was created
+		 */
+		unsigned long retransmissions() const { return retransmissionCount; }
+
+		virtual const char* transact( const Datagram::Base& request, size_t& length, boost::system::error_code& ec );
+
+		virtual Registers readHoldingRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec );
+
+		virtual Registers readInputRegisters( Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec );
+
+	protected:
+		Registers readRegisters( Datagram::FuncCode func, Datagram::TransactionID transaction, Datagram::UnitID unit, u_int16_t addr, u_int16_t length, boost::system::error_code& ec );
+		void run( boost::system::error_code& ec );
+		void send( boost::system::error_code& ec );
+		bool receive( const struct timespec& until, boost::system::error_code& ec );
+
+	protected:
+		int fd;
+		boost::posix_time::time_duration timeoutDuration;
+		unsigned int retryCount;
+		unsigned long retransmissionCount;
+
+		char requestBuffer[ Datagram::Base::maxDatagramLength ];
+		char responseBuffer[ Datagram::Base::maxDatagramLength ];
+		size_t requestLength;
+		size_t responseLength;
+};
+
+}
+
+#endif
@@ -2,14 +2,24 @@
 #define _MODBUS_H_
 
 #include "lib/mb_ascii.h"
+#include "lib/mb_crc.h"
+#include "lib/mb_error.h"
 #include "lib/mb_errorres.h"
 #include "lib/mb_generic.h"
+#include "lib/mb_registers.h"
 #include "lib/mb_rhregreq.h"
 #include "lib/mb_rhregres.h"
 #include "lib/mb_riregreq.h"
 #include "lib/mb_riregres.h"
+#include "lib/mb_rtu.h"
+#include "lib/mb_rtucomm.h"
 #include "lib/mb_tcpcomm.h"
+#include "lib/mb_tcpgateway.h"
 #include "lib/mb_tcprar.h"
+#include "lib/mb_tcpserver.h"
+#include "lib/mb_trace.h"
+#include "lib/mb_transport.h"
+#include "lib/mb_udpcomm.h"
 #include "lib/mb_uint16.h"
 #include "lib/mb_uint32.h"
 
@@ -0,0 +1,43 @@
+#ifndef _PROBES_H_
+#define _PROBES_H_
+
+/**
+ * Static user space probes (USDT) of the provider "lm50".
+ *
+ * If the build option WITH_USDT is enabled and sys/sdt.h (SystemTap) is
+ * available, LM50_USDT is defined and each probe expands to a single nop
+ * instruction plus a note in the ELF file. Tools like perf or bpftrace can
+ * attach to the probes of a running release build, e.g.
+ *
+ *   bpftrace -e 'usdt:./lm50client:lm50:reply__complete { ... }'
+ *
+ * Otherwise the probes are compiled out entirely. Available probes:
+ *
+ *   request__send(tid, length)    TcpRequestAndReply::run() sends a request
+ *   reply__first(tid, bytes)      the first bytes of the reply have arrived
+ *   reply__complete(tid, length)  the reply is complete
+ *   request__timeout(tid)         no (complete) reply within the time out
+ *   reconnect__start()            ModeDaemon::deviceUpdate() lost the device
+ *   reconnect__end(success)       a reconnect attempt has finished
+ *   snapshot__publish(sec, nsec)  new values are available to the workers
+ *   sink__write__start(count)     WorkerRrd::updateRRD() writes count values
+ *   sink__write__end(result)      the write has finished, 0 on success
+ */
+
+#ifdef LM50_USDT
+
+#include <sys/sdt.h>
+
+#define LM50_PROBE0( name )          DTRACE_PROBE( lm50, name )
+#define LM50_PROBE1( name, a )       DTRACE_PROBE1( lm50, name, a )
+#define LM50_PROBE2( name, a, b )    DTRACE_PROBE2( lm50, name, a, b )
+
+#else
+
+#define LM50_PROBE0( name )          do {} while( 0 )
+#define LM50_PROBE1( name, a )       do {} while( 0 )
+#define LM50_PROBE2( name, a, b )    do {} while( 0 )
+
+#endif
+
+#endif
@@ -0,0 +1,215 @@
+#include <boost/program_options.hpp>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * lm50broker - A local stand-in for a MQTT broker
+ *
+ * The stand-in implements just enough of MQTT 3.1.1 to test the MQTT worker
+ * of the daemon without a real broker: It accepts any CONNECT, acknowledges
+ * PUBLISH packets of QoS 1, answers PINGREQ and keeps the retained message
+ * of each topic. Each received message is written to standard output as
+ * "<topic> <payload>". Subscriptions are not supported. The program runs
+ * until SIGINT or SIGTERM is received and then writes the retained messages
+ * to standard error.
+ */
+
+namespace po = boost::program_options;
+using std::string;
+
+static volatile sig_atomic_t isTerminated( 0 );
+
+static void handleSignal( int ) {
+	isTerminated = 1;
+}
+
+struct Client {
+	int fd;
+	std::vector< unsigned char > in;
+	string will;       // the topic of the last will
+	string willPayload;
+	bool willRetain;
+};
+
+static void sendPacket( int fd, unsigned char type, const unsigned char* body, size_t length ) {
+	unsigned char packet[ 8 ];
+	packet[0] = type;
+	packet[1] = static_cast< unsigned char >( length );
+	if( length ) memcpy( packet + 2, body, length );
+	send( fd, packet, 2 + length, MSG_NOSIGNAL );
+}
+
+static size_t readString( const unsigned char* p, size_t length, size_t pos, string& s ) {
+	if( pos + 2 > length ) throw std::runtime_error( "Truncated string" );
+	const size_t n( p[pos] << 8 | p[pos + 1] );
+	if( pos + 2 + n > length ) throw std::runtime_error( "Truncated string" );
+	s.assign( reinterpret_cast< const char* >( p + pos + 2 ), n );
+	return pos + 2 + n;
+}
+
+/**
+ * Processes one packet
+ * @return False, if the connection is to be closed
+ */
+static bool process( Client& c, unsigned char header, const unsigned char* body, size_t length, std::map< string, string >& retained, unsigned long& count, bool quiet ) {
+	switch( header & 0xf0 ) {
+		case 0x10: { // CONNECT
+			string protocol, clientId;
+			size_t pos( readString( body, length, 0, protocol ) );
+			if( pos + 4 > length ) return false;
+			const unsigned char flags( body[pos + 1] );
+			pos = readString( body, length, pos + 4, clientId );
+			if( flags & 0x04 ) {
+				pos = readString( body, length, pos, c.will );
+				pos = readString( body, length, pos, c.willPayload );
+				c.willRetain = flags & 0x20;
+			}
+			const unsigned char ack[2] = { 0, 0 };
+			sendPacket( c.fd, 0x20, ack, 2 );
+			std::cerr << "Client \"" << clientId << "\" connected" << std::endl;
+			return true;
+		}
+		case 0x30: { // PUBLISH
+			const unsigned int qos( ( header >> 1 ) & 0x03 );
+			string topic;
+			size_t pos( readString( body, length, 0, topic ) );
+			if( qos ) {
+				if( pos + 2 > length ) return false;
+				sendPacket( c.fd, 0x40, body + pos, 2 );
+				pos += 2;
+			}
+			const string payload( reinterpret_cast< const char* >( body + pos ), length - pos );
+			if( header & 0x01 ) retained[ topic ] = payload;
+			if( !quiet ) std::cout << topic << ' ' << payload << '\n';
+			++count;
+			return true;
+		}
+		case 0xc0: // PINGREQ
+			sendPacket( c.fd, 0xd0, NULL, 0 );
+			return true;
+		case 0xe0: // DISCONNECT
+			c.will.clear();
+			return false;
+		default:
+			return false;
+	}
+}
+
+int main( int argc, char* argv[] ) {
+	try {
+		string listen;
+		unsigned int port( 1883 );
+		bool quiet( false );
+
+		po::options_description options( "lm50broker options" );
+		options.add_options()
+			( "help", "Prints this help message and exits." )
+			( "listen,l", po::value< string >( &listen )->default_value( "127.0.0.1" ), "The local address to listen on." )
+			( "port,p", po::value< unsigned int >( &port )->default_value( port ), "The port to listen on." )
+			( "quiet,q", po::bool_switch( &quiet ), "Do not write the received messages, only count them." );
+
+		po::variables_map vmap;
+		po::store( po::parse_command_line( argc, argv, options ), vmap );
+		po::notify( vmap );
+		if( vmap.count( "help" ) ) {
+			options.print( std::cout );
+			return 0;
+		}
+
+		struct sockaddr_in addr;
+		memset( &addr, 0, sizeof( addr ) );
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons( port );
+		if( inet_pton( AF_INET, listen.c_str(), &addr.sin_addr ) != 1 ) throw std::invalid_argument( "Invalid listen address" );
+		const int server( socket( AF_INET, SOCK_STREAM, 0 ) );
+		const int one( 1 );
+		setsockopt( server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+		if( server < 0 || bind( server, reinterpret_cast< struct sockaddr* >( &addr ), sizeof( addr ) ) < 0 || ::listen( server, 16 ) < 0 ) {
+			throw std::runtime_error( string( "Could not listen: " ).append( strerror( errno ) ) );
+		}
+		signal( SIGINT, handleSignal );
+		signal( SIGTERM, handleSignal );
+		std::cerr << "Broker listening on " << listen << ':' << port << std::endl;
+
+		std::vector< Client > clients;
+		std::map< string, string > retained;
+		unsigned long count( 0 );
+		while( !isTerminated ) {
+			std::vector< struct pollfd > pfds( clients.size() + 1 );
+			pfds[0].fd = server;
+			pfds[0].events = POLLIN;
+			for( size_t i( 0 ); i != clients.size(); ++i ) {
+				pfds[i + 1].fd = clients[i].fd;
+				pfds[i + 1].events = POLLIN;
+			}
+			if( poll( &pfds[0], pfds.size(), 200 ) <= 0 ) continue;
+			if( pfds[0].revents & POLLIN ) {
+				Client c;
+				c.fd = accept( server, NULL, NULL );
+				c.willRetain = false;
+				if( c.fd >= 0 ) clients.push_back( c );
+			}
+			for( size_t i( pfds.size() - 1 ); i != 0; --i ) {
+				if( !pfds[i].revents ) continue;
+				Client& c( clients[i - 1] );
+				unsigned char buf[ 4096 ];
+				ssize_t n( recv( c.fd, buf, sizeof( buf ), 0 ) );
+				bool isOpen( n > 0 );
+				if( isOpen ) c.in.insert( c.in.end(), buf, buf + n );
+				size_t pos( 0 );
+				while( isOpen && c.in.size() - pos >= 2 ) {
+					size_t length( 0 ), shift( 0 ), j( pos + 1 );
+					bool complete( false );
+					for( ; j != c.in.size() && shift <= 21; ++j, shift += 7 ) {
+						length |= static_cast< size_t >( c.in[j] & 0x7f ) << shift;
+						if( !( c.in[j] & 0x80 ) ) {
+							complete = true;
+							++j;
+							break;
+						}
+					}
+					if( !complete || c.in.size() - j < length ) break;
+					try {
+						isOpen = process( c, c.in[pos], length ? &c.in[j] : NULL, length, retained, count, quiet );
+					} catch( std::runtime_error& ) {
+						isOpen = false;
+					}
+					pos = j + length;
+				}
+				c.in.erase( c.in.begin(), c.in.begin() + pos );
+				if( isOpen ) continue;
+				if( !c.will.empty() ) {
+					if( c.willRetain ) retained[ c.will ] = c.willPayload;
+					if( !quiet ) std::cout << c.will << ' ' << c.willPayload << '\n';
+				}
+				close( c.fd );
+				clients.erase( clients.begin() + ( i - 1 ) );
+				std::cerr << "Client disconnected" << std::endl;
+			}
+			std::cout.flush();
+		}
+
+		for( size_t i( 0 ); i != clients.size(); ++i ) close( clients[i].fd );
+		close( server );
+		std::cerr << "Received " << count << " message(s), retained:" << std::endl;
+		for( std::map< string, string >::const_iterator it( retained.begin() ); it != retained.end(); ++it ) {
+			std::cerr << it->first << ' ' << it->second << std::endl;
+		}
+	} catch ( std::exception& e ) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
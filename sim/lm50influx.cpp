@@ -0,0 +1,198 @@
+#include <boost/program_options.hpp>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+/**
+ * lm50influx - A local stand-in for the write endpoint of an InfluxDB
+ *
+ * The stand-in accepts POST requests to /write over HTTP/1.1 with
+ * keep-alive, decompresses gzip encoded bodies and writes the received
+ * lines to standard output. It answers 204 like InfluxDB. For testing the
+ * retry buffer of the daemon, every n-th request can be answered with 503
+ * instead. The program runs until SIGINT or SIGTERM is received and then
+ * writes the number of requests and lines to standard error.
+ */
+
+namespace po = boost::program_options;
+using std::string;
+
+static volatile sig_atomic_t isTerminated( 0 );
+
+static void handleSignal( int ) {
+	isTerminated = 1;
+}
+
+struct Client {
+	int fd;
+	string in;
+};
+
+static void sendResponse( int fd, const char* status, const string& body ) {
+	string response( "HTTP/1.1 " );
+	response.append( status ).append( "\r\n" );
+	if( !body.empty() ) {
+		char length[ 32 ];
+		snprintf( length, sizeof( length ), "%lu", static_cast< unsigned long >( body.size() ) );
+		response.append( "Content-Type: application/json\r\nContent-Length: " ).append( length ).append( "\r\n" );
+	}
+	response.append( "\r\n" ).append( body );
+	send( fd, response.data(), response.size(), MSG_NOSIGNAL );
+}
+
+static string gunzip( const string& data ) {
+	z_stream z;
+	memset( &z, 0, sizeof( z ) );
+	if( inflateInit2( &z, 15 + 16 ) != Z_OK ) throw std::runtime_error( "Could not initialize zlib" );
+	z.next_in = reinterpret_cast< Bytef* >( const_cast< char* >( data.data() ) );
+	z.avail_in = data.size();
+	string result;
+	int res( Z_OK );
+	while( res == Z_OK ) {
+		char buf[ 16384 ];
+		z.next_out = reinterpret_cast< Bytef* >( buf );
+		z.avail_out = sizeof( buf );
+		res = inflate( &z, Z_NO_FLUSH );
+		result.append( buf, sizeof( buf ) - z.avail_out );
+	}
+	inflateEnd( &z );
+	if( res != Z_STREAM_END ) throw std::runtime_error( "Invalid gzip body" );
+	return result;
+}
+
+/**
+ * Processes all complete requests in the input buffer of the client
+ * @return False, if the connection is to be closed
+ */
+static bool process( Client& c, unsigned long& requests, unsigned long& lines, unsigned long errors, bool quiet ) {
+	while( true ) {
+		const size_t headerEnd( c.in.find( "\r\n\r\n" ) );
+		if( headerEnd == string::npos ) return c.in.size() < 16384;
+		string header( c.in, 0, headerEnd + 2 );
+		for( size_t i( 0 ); i != header.size(); ++i ) header[i] = tolower( header[i] );
+		size_t length( 0 );
+		const size_t pos( header.find( "\r\ncontent-length:" ) );
+		if( pos != string::npos ) length = strtoul( header.c_str() + pos + 17, NULL, 10 );
+		if( c.in.size() < headerEnd + 4 + length ) return true;
+		string body( c.in, headerEnd + 4, length );
+		c.in.erase( 0, headerEnd + 4 + length );
+
+		++requests;
+		if( header.compare( 0, 12, "post /write?" ) != 0 ) {
+			sendResponse( c.fd, "404 Not Found", "{\"error\":\"unknown endpoint\"}" );
+			continue;
+		}
+		if( errors != 0 && requests % errors == 0 ) {
+			sendResponse( c.fd, "503 Service Unavailable", "{\"error\":\"stand-in error\"}" );
+			continue;
+		}
+		if( header.find( "\r\ncontent-encoding: gzip" ) != string::npos ) {
+			try {
+				body = gunzip( body );
+			} catch( std::runtime_error& e ) {
+				sendResponse( c.fd, "400 Bad Request", string( "{\"error\":\"" ).append( e.what() ).append( "\"}" ) );
+				continue;
+			}
+		}
+		for( size_t i( 0 ); i != body.size(); ++i ) {
+			if( body[i] == '\n' ) ++lines;
+		}
+		if( !quiet ) std::cout << body;
+		sendResponse( c.fd, "204 No Content", string() );
+	}
+}
+
+int main( int argc, char* argv[] ) {
+	try {
+		string listen;
+		unsigned int port( 8086 );
+		unsigned long errors( 0 );
+		bool quiet( false );
+
+		po::options_description options( "lm50influx options" );
+		options.add_options()
+			( "help", "Prints this help message and exits." )
+			( "listen,l", po::value< string >( &listen )->default_value( "127.0.0.1" ), "The local address to listen on." )
+			( "port,p", po::value< unsigned int >( &port )->default_value( port ), "The port to listen on." )
+			( "errors,e", po::value< unsigned long >( &errors )->default_value( errors ), "Answers every n-th request with 503. Zero disables errors." )
+			( "quiet,q", po::bool_switch( &quiet ), "Do not write the received lines, only count them." );
+
+		po::variables_map vmap;
+		po::store( po::parse_command_line( argc, argv, options ), vmap );
+		po::notify( vmap );
+		if( vmap.count( "help" ) ) {
+			options.print( std::cout );
+			return 0;
+		}
+
+		struct sockaddr_in addr;
+		memset( &addr, 0, sizeof( addr ) );
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons( port );
+		if( inet_pton( AF_INET, listen.c_str(), &addr.sin_addr ) != 1 ) throw std::invalid_argument( "Invalid listen address" );
+		const int server( socket( AF_INET, SOCK_STREAM, 0 ) );
+		const int one( 1 );
+		setsockopt( server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+		if( server < 0 || bind( server, reinterpret_cast< struct sockaddr* >( &addr ), sizeof( addr ) ) < 0 || ::listen( server, 16 ) < 0 ) {
+			throw std::runtime_error( string( "Could not listen: " ).append( strerror( errno ) ) );
+		}
+		signal( SIGINT, handleSignal );
+		signal( SIGTERM, handleSignal );
+		std::cerr << "InfluxDB stand-in listening on " << listen << ':' << port << std::endl;
+
+		std::vector< Client > clients;
+		unsigned long requests( 0 ), lines( 0 );
+		while( !isTerminated ) {
+			std::vector< struct pollfd > pfds( clients.size() + 1 );
+			pfds[0].fd = server;
+			pfds[0].events = POLLIN;
+			for( size_t i( 0 ); i != clients.size(); ++i ) {
+				pfds[i + 1].fd = clients[i].fd;
+				pfds[i + 1].events = POLLIN;
+			}
+			if( poll( &pfds[0], pfds.size(), 200 ) <= 0 ) continue;
+			if( pfds[0].revents & POLLIN ) {
+				Client c;
+				c.fd = accept( server, NULL, NULL );
+				if( c.fd >= 0 ) clients.push_back( c );
+			}
+			for( size_t i( pfds.size() - 1 ); i != 0; --i ) {
+				if( !pfds[i].revents ) continue;
+				Client& c( clients[i - 1] );
+				char buf[ 65536 ];
+				ssize_t n( recv( c.fd, buf, sizeof( buf ), 0 ) );
+				bool isOpen( n > 0 );
+				if( isOpen ) {
+					c.in.append( buf, n );
+					isOpen = process( c, requests, lines, errors, quiet );
+				}
+				if( isOpen ) continue;
+				close( c.fd );
+				clients.erase( clients.begin() + ( i - 1 ) );
+			}
+			std::cout.flush();
+		}
+
+		for( size_t i( 0 ); i != clients.size(); ++i ) close( clients[i].fd );
+		close( server );
+		std::cerr << "Received " << requests << " request(s) with " << lines << " line(s)" << std::endl;
+	} catch ( std::exception& e ) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
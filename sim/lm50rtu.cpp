@@ -0,0 +1,197 @@
+#include <boost/program_options.hpp>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "lib/modbus.h"
+
+/**
+ * lm50rtu - A local stand-in for a ModBus RTU meter
+ *
+ * The stand-in receives RTU frames either on a pseudo terminal or on a TCP
+ * port (like a serial device server), checks their CRC and forwards them as
+ * ModBus/TCP requests to a device, e.g. to lm50sim. The replies are sent
+ * back as RTU frames. Hence the RTU transports of lm50client can be tested
+ * without a serial line: the path of the pseudo terminal is written to
+ * standard output and can be passed as host with --transport rtu-serial.
+ * For testing the error handling every n-th reply can be sent with a
+ * corrupted CRC. The program runs until SIGINT or SIGTERM is received and
+ * then writes the number of frames to standard error.
+ */
+
+namespace po = boost::program_options;
+using std::string;
+
+static volatile sig_atomic_t isTerminated( 0 );
+
+static void handleSignal( int ) {
+	isTerminated = 1;
+}
+
+/**
+ * Opens a pseudo terminal in raw mode. The slave side is kept open, such
+ * that the master does not see a hang up if a client closes the slave.
+ */
+static int openPty( string& name, int& slave ) {
+	const int master( posix_openpt( O_RDWR | O_NOCTTY ) );
+	if( master < 0 || grantpt( master ) < 0 || unlockpt( master ) < 0 ) throw std::runtime_error( string( "Could not open a pseudo terminal: " ).append( strerror( errno ) ) );
+	name = ptsname( master );
+	slave = open( name.c_str(), O_RDWR | O_NOCTTY );
+	if( slave < 0 ) throw std::runtime_error( string( "Could not open " ).append( name ) );
+	struct termios tio;
+	tcgetattr( slave, &tio );
+	cfmakeraw( &tio );
+	tcsetattr( slave, TCSANOW, &tio );
+	return master;
+}
+
+static int listenTcp( const string& address, unsigned int port ) {
+	struct sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( port );
+	if( inet_pton( AF_INET, address.c_str(), &addr.sin_addr ) != 1 ) throw std::invalid_argument( "Invalid listen address" );
+	const int server( socket( AF_INET, SOCK_STREAM, 0 ) );
+	const int one( 1 );
+	setsockopt( server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+	if( server < 0 || bind( server, reinterpret_cast< struct sockaddr* >( &addr ), sizeof( addr ) ) < 0 || ::listen( server, 4 ) < 0 ) {
+		throw std::runtime_error( string( "Could not listen: " ).append( strerror( errno ) ) );
+	}
+	return server;
+}
+
+/**
+ * Forwards one RTU request frame to the device and writes the reply frame
+ * @return False, if the frame has been dropped
+ */
+static bool forward( int fd, const char* frame, size_t length, ModBus::TcpCommunication& device, unsigned long& tid, bool corrupt ) {
+	char request[ ModBus::Datagram::Base::maxDatagramLength ];
+	boost::system::error_code ec;
+	const size_t n( ModBus::Rtu::toTcp( frame, length, static_cast< ModBus::Datagram::TransactionID >( ++tid ), request, ec ) );
+	if( ec ) {
+		std::cerr << "Dropped request: " << ec.message() << std::endl;
+		return false;
+	}
+	ModBus::Datagram::Generic datagram( request, n );
+	size_t replyLength( 0 );
+	const char* reply( device.transact( datagram, replyLength, ec ) );
+	if( ec ) {
+		// A RTU meter stays silent, if it cannot answer
+		std::cerr << "Device failed: " << ec.message() << std::endl;
+		return false;
+	}
+	char out[ ModBus::Rtu::maxFrameLength ];
+	const size_t m( ModBus::Rtu::fromTcp( reply, replyLength, out ) );
+	if( m == 0 ) return false;
+	if( corrupt ) out[ m - 1 ] ^= 0x5a;
+	for( size_t sent( 0 ); sent != m; ) {
+		const ssize_t k( write( fd, out + sent, m - sent ) );
+		if( k < 0 ) return false;
+		sent += k;
+	}
+	return true;
+}
+
+int main( int argc, char* argv[] ) {
+	try {
+		string deviceHost, devicePort, listen;
+		unsigned int port( 0 );
+		unsigned long crcErrors( 0 );
+
+		po::options_description options( "lm50rtu options" );
+		options.add_options()
+			( "help", "Prints this help message and exits." )
+			( "device-host,H", po::value< string >( &deviceHost )->default_value( "127.0.0.1" ), "The ModBus/TCP device the frames are forwarded to, e.g. lm50sim." )
+			( "device-port,P", po::value< string >( &devicePort )->default_value( "502" ), "The port of the ModBus/TCP device." )
+			( "listen,l", po::value< string >( &listen )->default_value( "127.0.0.1" ), "The local address to listen on, if a port is given." )
+			( "port,p", po::value< unsigned int >( &port )->default_value( port ), "Receives the frames on this TCP port instead of a pseudo terminal, like a serial device server." )
+			( "crc-errors,e", po::value< unsigned long >( &crcErrors )->default_value( crcErrors ), "Sends every n-th reply with a corrupted CRC. Zero disables errors." );
+
+		po::variables_map vmap;
+		po::store( po::parse_command_line( argc, argv, options ), vmap );
+		po::notify( vmap );
+		if( vmap.count( "help" ) ) {
+			options.print( std::cout );
+			return 0;
+		}
+
+		ModBus::TcpCommunication device;
+		device.open( deviceHost, devicePort );
+
+		int server( -1 ), client( -1 ), slave( -1 );
+		if( port != 0 ) {
+			server = listenTcp( listen, port );
+			std::cerr << "RTU stand-in listening on " << listen << ':' << port << std::endl;
+		} else {
+			string name;
+			client = openPty( name, slave );
+			std::cout << name << std::endl;
+		}
+		signal( SIGINT, handleSignal );
+		signal( SIGTERM, handleSignal );
+
+		char frame[ ModBus::Rtu::maxFrameLength ];
+		size_t n( 0 );
+		unsigned long tid( 0 ), frames( 0 ), dropped( 0 );
+		while( !isTerminated ) {
+			struct pollfd pfd;
+			pfd.fd = client >= 0 ? client : server;
+			pfd.events = POLLIN;
+			// A frame of unknown length ends with the inter-frame gap
+			const int ready( poll( &pfd, 1, n != 0 ? 20 : 200 ) );
+			if( ready < 0 ) continue;
+			if( ready == 0 ) {
+				if( n != 0 ) {
+					++frames;
+					if( !forward( client, frame, n, device, tid, crcErrors != 0 && frames % crcErrors == 0 ) ) ++dropped;
+					n = 0;
+				}
+				continue;
+			}
+			if( client < 0 ) {
+				client = accept( server, NULL, NULL );
+				continue;
+			}
+			const ssize_t k( read( client, frame + n, sizeof( frame ) - n ) );
+			if( k <= 0 ) {
+				if( server < 0 ) continue;
+				close( client );
+				client = -1;
+				n = 0;
+				continue;
+			}
+			n += k;
+			size_t length( ModBus::Rtu::requestLength( frame, n ) );
+			if( length == ModBus::Rtu::unknownLength ) continue;
+			if( length > sizeof( frame ) ) length = n;
+			if( length == 0 || n < length ) continue;
+			++frames;
+			if( !forward( client, frame, length, device, tid, crcErrors != 0 && frames % crcErrors == 0 ) ) ++dropped;
+			// Bytes beyond the frame belong to the next request
+			memmove( frame, frame + length, n - length );
+			n -= length;
+		}
+
+		if( client >= 0 ) close( client );
+		if( slave >= 0 ) close( slave );
+		if( server >= 0 ) close( server );
+		std::cerr << "Received " << frames << " frame(s), dropped " << dropped << std::endl;
+	} catch ( std::exception& e ) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include "sim_device.h"
+#include "sim_profile.h"
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <pthread.h>
+#include <vector>
+
+/**
+ * lm50sim - A local stand-in for a fleet of LM50TCP+ devices
+ *
+ * The simulator starts a number of virtual devices. Each device listens on
+ * its own port, starting with the given base port, and answers requests
+ * as described by LM50::Sim::VirtualDevice. All devices are driven
+ * asynchronously by one I/O service, hence thousands of devices can be
+ * simulated on the loopback interface. The program runs until SIGINT or
+ * SIGTERM is received.
+ */
+
+namespace po = boost::program_options;
+using std::string;
+
+static void* runService( void* service ) {
+	static_cast< boost::asio::io_service* >( service )->run();
+	return NULL;
+}
+
+static void handleSignal( boost::asio::io_service* service, const boost::system::error_code& error, int ) {
+	if( !error ) service->stop();
+}
+
+int main( int argc, char* argv[] ) {
+	try {
+		string listen;
+		unsigned int port( 5020 );
+		unsigned int devices( 1 );
+		unsigned int threads( 1 );
+		unsigned int seed( 1 );
+		unsigned int serial( 100000 );
+		double rate( 1.0 );
+		LM50::LM50Device::ChVal start( 0 );
+		string distribution;
+		double latencyMean( 0.0 );
+		double jitter( 0.0 );
+		double dropRate( 0.0 );
+		double resetRate( 0.0 );
+		double exceptionRate( 0.0 );
+		unsigned int exceptionCode( ModBus::Exception::DeviceBusy );
+
+		po::options_description options( "lm50sim options" );
+		options.add_options()
+			( "help", "Prints this help message and exits." )
+			( "listen,l", po::value< string >( &listen )->default_value( "127.0.0.1" ), "The local address to listen on." )
+			( "port,p", po::value< unsigned int >( &port )->default_value( port ), "The port of the first device. Device i listens on port + i." )
+			( "devices,n", po::value< unsigned int >( &devices )->default_value( devices ), "The number of virtual devices." )
+			( "threads,t", po::value< unsigned int >( &threads )->default_value( threads ), "The number of threads that serve the devices." )
+			( "seed", po::value< unsigned int >( &seed )->default_value( seed ), "Seed of the random number generators. Device i uses seed + i." )
+			( "serial", po::value< unsigned int >( &serial )->default_value( serial ), "The serial number of the first device. Device i reports serial + i." )
+			( "rate", po::value< double >( &rate )->default_value( rate ), "Impulses per second that each counter increments." )
+			( "start", po::value< LM50::LM50Device::ChVal >( &start )->default_value( start ), "Initial value of the counters. Use a value close to 4294967295 to test the wrap around." )
+			( "latency", po::value< string >( &distribution )->default_value( "constant" ), "The distribution of the processing time per request. Must be one out of constant, uniform, normal or exponential." )
+			( "latency-mean", po::value< double >( &latencyMean )->default_value( latencyMean ), "Mean processing time per request in milliseconds." )
+			( "jitter", po::value< double >( &jitter )->default_value( jitter ), "Jitter of the processing time in milliseconds. Half width for \"uniform\", standard deviation for \"normal\"." )
+			( "drop", po::value< double >( &dropRate )->default_value( dropRate ), "Probability that a request is not answered at all." )
+			( "reset", po::value< double >( &resetRate )->default_value( resetRate ), "Probability that the connection is reset instead of answering a request." )
+			( "exception", po::value< double >( &exceptionRate )->default_value( exceptionRate ), "Probability that a request is answered by a ModBus exception." )
+			( "exception-code", po::value< unsigned int >( &exceptionCode )->default_value( exceptionCode ), "The ModBus exception code to send (default 6, slave device busy)." );
+
+		po::variables_map vmap;
+		po::store( po::parse_command_line( argc, argv, options ), vmap );
+		po::notify( vmap );
+		if( vmap.count( "help" ) ) {
+			options.print( std::cout );
+			return 0;
+		}
+		if( devices == 0 || port + devices - 1 > 0xffff ) throw std::invalid_argument( "The ports of the devices exceed the valid range" );
+		if( threads == 0 ) threads = 1;
+
+		LM50::Sim::FaultProfile profile;
+		profile.distribution( distribution );
+		profile.latencyMean( latencyMean );
+		profile.jitter( jitter );
+		profile.dropRate( dropRate );
+		profile.resetRate( resetRate );
+		profile.exceptionRate( exceptionRate );
+		profile.exceptionCode( static_cast< ModBus::Datagram::ExceptionCode >( exceptionCode ) );
+
+		boost::asio::io_service service;
+		const boost::asio::ip::address address( boost::asio::ip::address::from_string( listen ) );
+		std::vector< LM50::Sim::VirtualDevice* > devs;
+		std::vector< ModBus::TcpServer* > servers;
+		devs.reserve( devices );
+		servers.reserve( devices );
+		for( unsigned int i( 0 ); i < devices; ++i ) {
+			devs.push_back( new LM50::Sim::VirtualDevice( profile, serial + i, seed + i, rate, start ) );
+			servers.push_back( new ModBus::TcpServer( service, boost::asio::ip::tcp::endpoint( address, port + i ), *devs.back() ) );
+		}
+		std::cerr << "Simulating " << devices << " device(s) on " << listen << ':' << port << '-' << ( port + devices - 1 ) << std::endl;
+
+		boost::asio::signal_set signals( service, SIGINT, SIGTERM );
+		signals.async_wait( boost::bind( &handleSignal, &service, boost::asio::placeholders::error, boost::asio::placeholders::signal_number ) );
+
+		std::vector< pthread_t > pool( threads - 1 );
+		for( unsigned int i( 0 ); i + 1 < threads; ++i ) {
+			if( pthread_create( &pool[i], NULL, runService, &service ) ) throw std::runtime_error( "Could not start thread" );
+		}
+		service.run();
+		for( unsigned int i( 0 ); i + 1 < threads; ++i ) pthread_join( pool[i], NULL );
+
+		unsigned long requests( 0 );
+		for( unsigned int i( 0 ); i < devices; ++i ) {
+			requests += devs[i]->requestCount();
+			delete servers[i];
+			delete devs[i];
+		}
+		std::cerr << "Served " << requests << " request(s)" << std::endl;
+	} catch ( std::exception& e ) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
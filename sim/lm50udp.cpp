@@ -0,0 +1,114 @@
+#include <boost/program_options.hpp>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "lib/modbus.h"
+
+/**
+ * lm50udp - A local stand-in for a ModBus/UDP gateway
+ *
+ * The stand-in receives ModBus/UDP requests and forwards them to a ModBus/TCP
+ * device, e.g. to lm50sim. The replies are sent back as datagrams to the
+ * sender of the request. For testing the retransmissions of the client a
+ * fraction of the requests can be dropped. The program runs until SIGINT or
+ * SIGTERM is received and then writes the number of datagrams to standard
+ * error.
+ */
+
+namespace po = boost::program_options;
+using std::string;
+
+static volatile sig_atomic_t isTerminated( 0 );
+
+static void handleSignal( int ) {
+	isTerminated = 1;
+}
+
+int main( int argc, char* argv[] ) {
+	try {
+		string deviceHost, devicePort, listen;
+		unsigned int port( 5020 );
+		double dropRate( 0.0 );
+		unsigned int seed( 1 );
+
+		po::options_description options( "lm50udp options" );
+		options.add_options()
+			( "help", "Prints this help message and exits." )
+			( "device-host,H", po::value< string >( &deviceHost )->default_value( "127.0.0.1" ), "The ModBus/TCP device the requests are forwarded to, e.g. lm50sim." )
+			( "device-port,P", po::value< string >( &devicePort )->default_value( "502" ), "The port of the ModBus/TCP device." )
+			( "listen,l", po::value< string >( &listen )->default_value( "127.0.0.1" ), "The local address to listen on." )
+			( "port,p", po::value< unsigned int >( &port )->default_value( port ), "The UDP port to listen on." )
+			( "drop", po::value< double >( &dropRate )->default_value( dropRate ), "Probability that a request is dropped." )
+			( "seed", po::value< unsigned int >( &seed )->default_value( seed ), "Seed of the random number generator." );
+
+		po::variables_map vmap;
+		po::store( po::parse_command_line( argc, argv, options ), vmap );
+		po::notify( vmap );
+		if( vmap.count( "help" ) ) {
+			options.print( std::cout );
+			return 0;
+		}
+
+		ModBus::TcpCommunication device;
+		device.open( deviceHost, devicePort );
+
+		struct sockaddr_in addr;
+		memset( &addr, 0, sizeof( addr ) );
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons( port );
+		if( inet_pton( AF_INET, listen.c_str(), &addr.sin_addr ) != 1 ) throw std::invalid_argument( "Invalid listen address" );
+		const int server( socket( AF_INET, SOCK_DGRAM, 0 ) );
+		if( server < 0 || bind( server, reinterpret_cast< struct sockaddr* >( &addr ), sizeof( addr ) ) < 0 ) {
+			throw std::runtime_error( string( "Could not listen: " ).append( strerror( errno ) ) );
+		}
+		signal( SIGINT, handleSignal );
+		signal( SIGTERM, handleSignal );
+		srand( seed );
+		std::cerr << "ModBus/UDP stand-in listening on " << listen << ':' << port << std::endl;
+
+		unsigned long requests( 0 ), dropped( 0 );
+		while( !isTerminated ) {
+			struct pollfd pfd = { server, POLLIN, 0 };
+			if( poll( &pfd, 1, 200 ) <= 0 ) continue;
+			char request[ ModBus::Datagram::Base::maxDatagramLength ];
+			struct sockaddr_in sender;
+			socklen_t senderLength( sizeof( sender ) );
+			const ssize_t n( recvfrom( server, request, sizeof( request ), 0, reinterpret_cast< struct sockaddr* >( &sender ), &senderLength ) );
+			if( n < 8 ) continue;
+			++requests;
+			if( rand() < dropRate * RAND_MAX ) {
+				++dropped;
+				continue;
+			}
+			ModBus::Datagram::Generic datagram( request, n );
+			size_t length( 0 );
+			boost::system::error_code ec;
+			const char* reply( device.transact( datagram, length, ec ) );
+			if( ec ) {
+				// A gateway stays silent, if the device does not answer
+				std::cerr << "Device failed: " << ec.message() << std::endl;
+				++dropped;
+				continue;
+			}
+			sendto( server, reply, length, 0, reinterpret_cast< struct sockaddr* >( &sender ), senderLength );
+		}
+
+		close( server );
+		std::cerr << "Received " << requests << " request(s), dropped " << dropped << std::endl;
+	} catch ( std::exception& e ) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
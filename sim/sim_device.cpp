@@ -0,0 +1,144 @@
+#include "sim_device.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+namespace LM50 {
+namespace Sim {
+
+using namespace ModBus;
+
+VirtualDevice::VirtualDevice( const FaultProfile& profile, unsigned int serialNo, unsigned int seed, double rate, LM50Device::ChVal start ) : \
+	_profile( profile ), \
+	_revision( "SIM01" ), \
+	_serialNo( serialNo ), \
+	_rate( rate ), \
+	_start( start ), \
+	_startTime(), \
+	_requestCount( 0 ), \
+	_mutex(), \
+	_rng( seed ) {
+	clock_gettime( CLOCK_MONOTONIC, &_startTime );
+	pthread_mutex_init( &_mutex, NULL );
+}
+
+
+VirtualDevice::~VirtualDevice() {
+	pthread_mutex_destroy( &_mutex );
+}
+
+
+/**
+ * The counters increase by _rate impulses per second. Each channel starts at
+ * a different offset, such that mixed up channels are noticed by the client.
+ */
+LM50Device::ChVal VirtualDevice::channel( LM50Device::ChIdx ch ) const {
+	return channel( ch, impulses() );
+}
+
+
+/**
+ * @return The number of impulses each counter has incremented since start
+ */
+u_int64_t VirtualDevice::impulses() const {
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	const double elapsed( ( now.tv_sec - _startTime.tv_sec ) + ( now.tv_nsec - _startTime.tv_nsec ) * 1e-9 );
+	return static_cast< u_int64_t >( _rate * elapsed );
+}
+
+
+LM50Device::ChVal VirtualDevice::channel( LM50Device::ChIdx ch, u_int64_t impulses ) const {
+	// Unsigned arithmetic wraps around at 2^32 just like the real counters
+	return static_cast< LM50Device::ChVal >( _start + 1000u * ch + impulses );
+}
+
+
+void VirtualDevice::request( TcpServerSession& session, const Datagram::Base& req ) {
+	pthread_mutex_lock( &_mutex );
+	++_requestCount;
+	const FaultProfile::Action action( _profile.drawAction( _rng ) );
+	const boost::posix_time::time_duration latency( _profile.drawLatency( _rng ) );
+	pthread_mutex_unlock( &_mutex );
+
+	switch( action ) {
+		case FaultProfile::DROP:
+			session.ignore();
+			return;
+		case FaultProfile::RESET:
+			session.reset();
+			return;
+		case FaultProfile::EXCEPTION:
+			session.reply( Datagram::ErrorRes( req.transactionID(), req.unitID(), req.funcCode(), _profile.exceptionCode() ), latency );
+			return;
+		case FaultProfile::REPLY:
+			break;
+	}
+
+	char values[ 2 * 0x7d ];
+	const Datagram::ReadHoldingRegistersReq* hreq( dynamic_cast< const Datagram::ReadHoldingRegistersReq* >( &req ) );
+	if( hreq ) {
+		if( holdingRegisters( hreq->address(), hreq->quantity(), values ) ) {
+			session.reply( Datagram::ReadHoldingRegistersRes( req.transactionID(), req.unitID(), values, 2 * hreq->quantity() ), latency );
+		} else {
+			session.reply( Datagram::ErrorRes( req.transactionID(), req.unitID(), req.funcCode(), Exception::IllegalAddress ), latency );
+		}
+		return;
+	}
+	const Datagram::ReadInputRegistersReq* ireq( dynamic_cast< const Datagram::ReadInputRegistersReq* >( &req ) );
+	if( ireq ) {
+		if( inputRegisters( ireq->address(), ireq->quantity(), values ) ) {
+			session.reply( Datagram::ReadInputRegistersRes( req.transactionID(), req.unitID(), values, 2 * ireq->quantity() ), latency );
+		} else {
+			session.reply( Datagram::ErrorRes( req.transactionID(), req.unitID(), req.funcCode(), Exception::IllegalAddress ), latency );
+		}
+		return;
+	}
+	session.reply( Datagram::ErrorRes( req.transactionID(), req.unitID(), req.funcCode(), Exception::IllegalFunction ), latency );
+}
+
+
+/**
+ * The holding registers contain the revision as ASCII string padded with
+ * zeros and the serial number as 32-bit integer (high word first).
+ */
+bool VirtualDevice::holdingRegisters( u_int16_t addr, u_int16_t quantity, char* buffer ) const {
+	const u_int32_t first( addr ), last( static_cast< u_int32_t >( addr ) + quantity );
+	if( first >= LM50Device::_hwAddrRevision && last <= static_cast< u_int32_t >( LM50Device::_hwAddrRevision ) + LM50Device::_hwLengthRevision ) {
+		char rev[ 2 * 3 ];
+		memset( rev, 0x00, sizeof( rev ) );
+		memcpy( rev, _revision.c_str(), std::min< size_t >( _revision.size(), sizeof( rev ) - 1 ) );
+		memcpy( buffer, rev + 2 * ( first - LM50Device::_hwAddrRevision ), 2 * quantity );
+		return true;
+	}
+	if( first >= LM50Device::_hwAddrSerialNo && last <= static_cast< u_int32_t >( LM50Device::_hwAddrSerialNo ) + LM50Device::_hwLengthSerialNo ) {
+		const u_int32_t serial( htonl( _serialNo ) );
+		memcpy( buffer, reinterpret_cast< const char* >( &serial ) + 2 * ( first - LM50Device::_hwAddrSerialNo ), 2 * quantity );
+		return true;
+	}
+	return false;
+}
+
+
+/**
+ * The input registers contain the 50 counters as 32-bit integers (high word
+ * first). Reading only one half of a counter is allowed as with the real
+ * device. All counters of a request are taken at the same time, such that
+ * the high and the low word of a counter always match.
+ */
+bool VirtualDevice::inputRegisters( u_int16_t addr, u_int16_t quantity, char* buffer ) const {
+	const u_int32_t first( addr ), last( static_cast< u_int32_t >( addr ) + quantity );
+	if( first < LM50Device::_hwAddrChannels || last > static_cast< u_int32_t >( LM50Device::_hwAddrChannels ) + LM50Device::_hwLengthChannels ) return false;
+	const u_int64_t now( impulses() );
+	for( u_int32_t reg( first ); reg < last; ++reg, buffer += 2 ) {
+		const u_int32_t offset( reg - LM50Device::_hwAddrChannels );
+		const u_int32_t value( channel( offset / 2, now ) );
+		const u_int16_t word( htons( static_cast< u_int16_t >( offset & 1 ? value & 0xffff : value >> 16 ) ) );
+		memcpy( buffer, &word, 2 );
+	}
+	return true;
+}
+
+}
+}
@@ -0,0 +1,91 @@
+#ifndef _SIM_DEVICE_H_
+#define _SIM_DEVICE_H_
+
+#include <pthread.h>
+#include <string>
+#include <boost/random/mersenne_twister.hpp>
+
+#include "lib/modbus.h"
+#include "core/lm50device.h"
+#include "sim_profile.h"
+
+namespace LM50 {
+namespace Sim {
+
+/**
+ * A virtual LM50TCP+. The device answers ReadHoldingRegisters requests for the
+ * revision and the serial number and ReadInputRegisters requests for the 50
+ * channel counters. Every counter increments steadily with time. Other
+ * function codes are answered by an "illegal function" exception, addresses
+ * outside of the register map by an "illegal data address" exception.
+ *
+ * How long the device takes to answer and whether it drops a request, resets
+ * the connection or sends an exception instead is determined by the
+ * FaultProfile.
+ */
+class VirtualDevice : public ModBus::TcpServer::Handler {
+	public:
+		/**
+		 * @param profile The fault profile. Must outlive the device.
+		 * @param serialNo The serial number the device reports
+		 * @param seed Seed of the device's random number generator
+		 * @param rate Number of impulses per second that each counter increments
+		 * @param start Initial value of all counters. Values close to 2^32 can be
+		 * used to exercise the counter wrap around.
+		 */
+		VirtualDevice( const FaultProfile& profile, unsigned int serialNo, unsigned int seed, double rate = 1.0, LM50Device::ChVal start = 0 );
+		virtual ~VirtualDevice();
+
+	private:
+		VirtualDevice( const VirtualDevice& );
+		VirtualDevice& operator=( const VirtualDevice& );
+
+	public:
+		virtual void request( ModBus::TcpServerSession& session, const ModBus::Datagram::Base& request );
+
+		/**
+		 * @return The current value of the channel's counter
+		 */
+		LM50Device::ChVal channel( LM50Device::ChIdx ch ) const;
+
+		const std::string& revision() const { return _revision; }
+
+		unsigned int serialNumber() const { return _serialNo; }
+
+		/**
+		 * @return The number of requests received so far
+		 */
+		unsigned long requestCount() const { return _requestCount; }
+
+	protected:
+		/**
+		 * Writes the values of the registers addr ... addr+quantity-1 into the
+		 * buffer in network byte order.
+		 * @return False, if any of the registers does not exist
+		 */
+		bool holdingRegisters( u_int16_t addr, u_int16_t quantity, char* buffer ) const;
+		bool inputRegisters( u_int16_t addr, u_int16_t quantity, char* buffer ) const;
+		u_int64_t impulses() const;
+		LM50Device::ChVal channel( LM50Device::ChIdx ch, u_int64_t impulses ) const;
+
+	protected:
+		const FaultProfile& _profile;
+		const std::string _revision;
+		const unsigned int _serialNo;
+		const double _rate;
+		const LM50Device::ChVal _start;
+		struct timespec _startTime;
+		unsigned long _requestCount;
+
+		/**
+		 * Protects the random number generator, if the I/O service is run by
+		 * more than one thread
+		 */
+		mutable pthread_mutex_t _mutex;
+		boost::random::mt19937 _rng;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,62 @@
+#include "sim_profile.h"
+
+#include <boost/random/exponential_distribution.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_01.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <stdexcept>
+
+namespace LM50 {
+namespace Sim {
+
+FaultProfile::FaultProfile() : \
+	_distribution( CONSTANT ), \
+	_latencyMean( 0.0 ), \
+	_jitter( 0.0 ), \
+	_dropRate( 0.0 ), \
+	_resetRate( 0.0 ), \
+	_exceptionRate( 0.0 ), \
+	_exceptionCode( ModBus::Exception::DeviceBusy ) {
+}
+
+
+void FaultProfile::distribution( const std::string& name ) {
+	if( name.compare( "constant" ) == 0 ) _distribution = CONSTANT;
+	else if( name.compare( "uniform" ) == 0 ) _distribution = UNIFORM;
+	else if( name.compare( "normal" ) == 0 ) _distribution = NORMAL;
+	else if( name.compare( "exponential" ) == 0 ) _distribution = EXPONENTIAL;
+	else throw std::invalid_argument( std::string( "Unknown latency distribution \"" ).append( name ).append( "\"" ) );
+}
+
+
+FaultProfile::Action FaultProfile::drawAction( boost::random::mt19937& rng ) const {
+	if( _dropRate <= 0.0 && _resetRate <= 0.0 && _exceptionRate <= 0.0 ) return REPLY;
+	const double p( boost::random::uniform_01< double >()( rng ) );
+	if( p < _dropRate ) return DROP;
+	if( p < _dropRate + _resetRate ) return RESET;
+	if( p < _dropRate + _resetRate + _exceptionRate ) return EXCEPTION;
+	return REPLY;
+}
+
+
+boost::posix_time::time_duration FaultProfile::drawLatency( boost::random::mt19937& rng ) const {
+	double ms( _latencyMean );
+	switch( _distribution ) {
+		case CONSTANT:
+			break;
+		case UNIFORM:
+			if( _jitter > 0.0 ) ms = boost::random::uniform_real_distribution< double >( _latencyMean - _jitter, _latencyMean + _jitter )( rng );
+			break;
+		case NORMAL:
+			if( _jitter > 0.0 ) ms = boost::random::normal_distribution< double >( _latencyMean, _jitter )( rng );
+			break;
+		case EXPONENTIAL:
+			if( _latencyMean > 0.0 ) ms = boost::random::exponential_distribution< double >( 1.0 / _latencyMean )( rng );
+			break;
+	}
+	if( ms <= 0.0 ) return boost::posix_time::time_duration();
+	return boost::posix_time::microseconds( static_cast< long >( ms * 1000.0 ) );
+}
+
+}
+}
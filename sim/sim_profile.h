@@ -0,0 +1,87 @@
+#ifndef _SIM_PROFILE_H_
+#define _SIM_PROFILE_H_
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <string>
+
+#include "lib/mb_constants.h"
+
+namespace LM50 {
+namespace Sim {
+
+/**
+ * Describes how a simulated device misbehaves. The profile is shared by all
+ * virtual devices, but each device draws its own random numbers.
+ */
+class FaultProfile {
+	public:
+		enum Distribution { CONSTANT, UNIFORM, NORMAL, EXPONENTIAL };
+
+		/**
+		 * What the device does with a single request
+		 */
+		enum Action { REPLY, EXCEPTION, DROP, RESET };
+
+	public:
+		FaultProfile();
+		virtual ~FaultProfile() {}
+
+	public:
+		/**
+		 * @param name One out of "constant", "uniform", "normal" or "exponential"
+		 * @throw std::invalid_argument If the name is unknown
+		 */
+		void distribution( const std::string& name );
+
+		Distribution distribution() const { return _distribution; }
+
+		/**
+		 * @param ms Mean processing time of the device in milliseconds
+		 */
+		void latencyMean( double ms ) { _latencyMean = ms; }
+
+		/**
+		 * @param ms Jitter in milliseconds. For the uniform distribution this is
+		 * half the width of the interval, for the normal distribution it is the
+		 * standard deviation. The constant and the exponential distribution
+		 * ignore the value.
+		 */
+		void jitter( double ms ) { _jitter = ms; }
+
+		/**
+		 * The probabilities of the actions, the remainder up to 1 is the
+		 * probability of a regular reply.
+		 */
+		void dropRate( double p ) { _dropRate = p; }
+		void resetRate( double p ) { _resetRate = p; }
+		void exceptionRate( double p ) { _exceptionRate = p; }
+
+		void exceptionCode( ModBus::Datagram::ExceptionCode code ) { _exceptionCode = code; }
+
+		ModBus::Datagram::ExceptionCode exceptionCode() const { return _exceptionCode; }
+
+		/**
+		 * Draws the action for the next request
+		 */
+		Action drawAction( boost::random::mt19937& rng ) const;
+
+		/**
+		 * Draws the time the device needs to answer the next request
+		 */
+		boost::posix_time::time_duration drawLatency( boost::random::mt19937& rng ) const;
+
+	protected:
+		Distribution _distribution;
+		double _latencyMean;
+		double _jitter;
+		double _dropRate;
+		double _resetRate;
+		double _exceptionRate;
+		ModBus::Datagram::ExceptionCode _exceptionCode;
+};
+
+}
+}
+
+#endif
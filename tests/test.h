@@ -0,0 +1,30 @@
+#ifndef _TEST_H_
+#define _TEST_H_
+
+namespace LM50 {
+namespace Test {
+
+/**
+ * Writes a failed check to standard error and counts it. See LM50_CHECK.
+ */
+void check( bool condition, const char* expression, const char* file, int line );
+
+/**
+ * @return The number of failed checks so far
+ */
+unsigned long failures();
+
+/**
+ * The test suites. Each function runs its checks and returns, i.e. a failed
+ * check does not stop the suite.
+ */
+void testModbus();
+void testCore();
+void testMqtt();
+
+}
+}
+
+#define LM50_CHECK( expression ) LM50::Test::check( ( expression ), #expression, __FILE__, __LINE__ )
+
+#endif
@@ -0,0 +1,93 @@
+#include "test.h"
+
+#include "core/lm50device.h"
+#include "core/lm50energy.h"
+#include "core/lm50rollup.h"
+
+#include <vector>
+
+namespace LM50 {
+namespace Test {
+
+static struct timespec at( time_t seconds ) {
+	struct timespec t;
+	t.tv_sec = seconds;
+	t.tv_nsec = 0;
+	return t;
+}
+
+static void testEnergyWrapAround() {
+	// Default meter: 1000 pulses per kWh, i.e. one pulse per second is 3600 W
+	LM50Energy energy;
+	std::vector< LM50Device::ChVal > counters( LM50Device::countChannels, 0xFFFFFFF0u );
+	energy.update( &counters[0], at( 1000 ) );
+	LM50_CHECK( energy.isValid() && !energy.hasPower() );
+	LM50_CHECK( energy.pulses( 0 ) == 0xFFFFFFF0u );
+
+	// 32 pulses across the wrap around of the 32-bit counter
+	counters.assign( LM50Device::countChannels, 0x10u );
+	energy.update( &counters[0], at( 1001 ) );
+	LM50_CHECK( energy.pulses( 0 ) == ( static_cast< u_int64_t >( 1 ) << 32 ) + 0x10 );
+	LM50_CHECK( energy.hasPower() && energy.power( 0 ) == 32 * 3600.0 );
+}
+
+static void testEnergyReset() {
+	LM50Energy energy;
+	std::vector< LM50Device::ChVal > counters( LM50Device::countChannels, 500000u );
+	energy.update( &counters[0], at( 1000 ) );
+
+	// The counter dropped, i.e. a difference of almost 2^32 pulses within one
+	// second, which no meter can produce. The counting restarts at zero.
+	counters.assign( LM50Device::countChannels, 5u );
+	energy.update( &counters[0], at( 1001 ) );
+	LM50_CHECK( energy.pulses( 0 ) == 500005u );
+	LM50_CHECK( energy.power( 0 ) == 5 * 3600.0 );
+
+	counters.assign( LM50Device::countChannels, 7u );
+	energy.update( &counters[0], at( 1002 ) );
+	LM50_CHECK( energy.pulses( 0 ) == 500007u );
+}
+
+static void testRollupFetch() {
+	LM50Rollup rollup;
+	LM50Rollup::Bucket buckets[ 8 ];
+	std::vector< double > values( LM50Device::countChannels, 0.0 );
+	LM50_CHECK( rollup.fetch( LM50Rollup::SECOND, 0, 0, 5000, buckets, 8 ) == 0 );
+
+	for( time_t t( 1000 ); t != 1010; ++t ) {
+		values.assign( LM50Device::countChannels, static_cast< double >( t ) );
+		rollup.update( &values[0], at( t ) );
+	}
+
+	// Clipped to the interval
+	LM50_CHECK( rollup.fetch( LM50Rollup::SECOND, 0, 1002, 1004, buckets, 8 ) == 3 );
+	LM50_CHECK( buckets[0].time == 1002 && buckets[2].time == 1004 && buckets[0].avg == 1002.0f );
+	LM50_CHECK( rollup.fetch( LM50Rollup::SECOND, 0, 1004, 1002, buckets, 8 ) == 0 );
+
+	// Clipped to the newest maxCount buckets
+	LM50_CHECK( rollup.fetch( LM50Rollup::SECOND, 0, 0, 5000, buckets, 3 ) == 3 );
+	LM50_CHECK( buckets[0].time == 1007 && buckets[2].time == 1009 && buckets[2].last == 1009.0f );
+
+	// Clipped to the buckets the ring still holds: the bucket of 1005 has
+	// been overwritten one revolution later, the older ones lie outside the
+	// span of the ring
+	const time_t later( 1005 + static_cast< time_t >( LM50Rollup::length( LM50Rollup::SECOND ) ) );
+	values.assign( LM50Device::countChannels, 1.0 );
+	rollup.update( &values[0], at( later ) );
+	std::vector< LM50Rollup::Bucket > ring( LM50Rollup::length( LM50Rollup::SECOND ) );
+	LM50_CHECK( rollup.fetch( LM50Rollup::SECOND, 0, 0, later, &ring[0], ring.size() ) == 5 );
+	LM50_CHECK( ring[0].time == 1006 && ring[3].time == 1009 && ring[4].time == later );
+
+	// The minute level aggregates all samples of 960 to 1019
+	LM50_CHECK( rollup.fetch( LM50Rollup::MINUTE, 0, 0, 1019, buckets, 8 ) == 1 );
+	LM50_CHECK( buckets[0].time == 960 && buckets[0].count == 10 && buckets[0].min == 1000.0f && buckets[0].max == 1009.0f );
+}
+
+void testCore() {
+	testEnergyWrapAround();
+	testEnergyReset();
+	testRollupFetch();
+}
+
+}
+}
@@ -0,0 +1,61 @@
+#include "test.h"
+
+#include <cstring>
+#include <iostream>
+
+/**
+ * lm50test - Unit tests of the parts whose mistakes do not show up at once
+ *
+ * The program runs the suite given as the only argument (e.g. "modbus") or
+ * all suites, if there is no argument, and exits with a non-zero code, if
+ * any check failed.
+ */
+
+namespace LM50 {
+namespace Test {
+
+static unsigned long countFailures( 0 );
+
+void check( bool condition, const char* expression, const char* file, int line ) {
+	if( condition ) return;
+	std::cerr << file << ":" << line << ": Check failed: " << expression << std::endl;
+	++countFailures;
+}
+
+unsigned long failures() {
+	return countFailures;
+}
+
+}
+}
+
+struct Suite {
+	const char* name;
+	void ( *run )();
+};
+
+static const Suite suites[] = {
+	{ "modbus", &LM50::Test::testModbus },
+	{ "core", &LM50::Test::testCore },
+	{ "mqtt", &LM50::Test::testMqtt }
+};
+
+int main( int argc, char* argv[] ) {
+	if( argc > 2 ) {
+		std::cerr << "Usage: " << argv[0] << " [suite]" << std::endl;
+		return -1;
+	}
+	bool isFound( false );
+	for( size_t i( 0 ); i != sizeof( suites ) / sizeof( suites[0] ); ++i ) {
+		if( argc == 2 && std::strcmp( argv[1], suites[i].name ) != 0 ) continue;
+		isFound = true;
+		suites[i].run();
+	}
+	if( !isFound ) {
+		std::cerr << "Error: Unknown suite " << argv[1] << std::endl;
+		return -1;
+	}
+	if( LM50::Test::failures() == 0 ) return 0;
+	std::cerr << LM50::Test::failures() << " checks failed" << std::endl;
+	return 1;
+}
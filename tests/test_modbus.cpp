@@ -0,0 +1,65 @@
+#include "test.h"
+
+#include "lib/modbus.h"
+
+namespace LM50 {
+namespace Test {
+
+using namespace ModBus;
+
+static void testCrc() {
+	// The check value of CRC-16/MODBUS
+	LM50_CHECK( crc16( "123456789", 9 ) == 0x4B37 );
+	LM50_CHECK( crc16( "", 0 ) == 0xFFFF );
+
+	// The tables process eight bytes per step, hence all lengths of the
+	// remainder must agree with the bitwise computation
+	char data[ 37 ];
+	for( size_t i( 0 ); i != sizeof( data ); ++i ) data[ i ] = static_cast< char >( i * 37 + 11 );
+	for( size_t n( 0 ); n <= sizeof( data ); ++n ) {
+		u_int16_t crc( 0xFFFF );
+		for( size_t i( 0 ); i != n; ++i ) {
+			crc ^= static_cast< unsigned char >( data[ i ] );
+			for( int b( 0 ); b != 8; ++b ) crc = ( crc & 1 ) ? ( crc >> 1 ) ^ 0xA001 : crc >> 1;
+		}
+		LM50_CHECK( crc16( data, n ) == crc );
+	}
+}
+
+static void testInterFrameGap() {
+	// 3.5 characters of 11 bits
+	LM50_CHECK( Rtu::interFrameGap( 9600 ) == boost::posix_time::microseconds( 4010 ) );
+	LM50_CHECK( Rtu::interFrameGap( 19200 ) == boost::posix_time::microseconds( 2005 ) );
+	// Fixed above 19200 baud
+	LM50_CHECK( Rtu::interFrameGap( 38400 ) == boost::posix_time::microseconds( 1750 ) );
+	LM50_CHECK( Rtu::interFrameGap( 115200 ) == boost::posix_time::microseconds( 1750 ) );
+}
+
+static void testReplyLength() {
+	const char readInput[] = { 0x01, Function::ReadInputRegisters, 0x04 };
+	LM50_CHECK( Rtu::replyLength( readInput, 1 ) == 0 );
+	LM50_CHECK( Rtu::replyLength( readInput, 2 ) == 0 );
+	LM50_CHECK( Rtu::replyLength( readInput, 3 ) == 9 );
+
+	const char readFifo[] = { 0x01, Function::ReadFIFOQueue, 0x01, 0x02 };
+	LM50_CHECK( Rtu::replyLength( readFifo, 3 ) == 0 );
+	LM50_CHECK( Rtu::replyLength( readFifo, 4 ) == 6 + 0x0102 );
+
+	const char writeSingle[] = { 0x01, Function::WriteSingleRegister };
+	LM50_CHECK( Rtu::replyLength( writeSingle, 2 ) == 8 );
+
+	const char exception[] = { 0x01, static_cast< char >( Function::ReadInputRegisters | Function::Error ) };
+	LM50_CHECK( Rtu::replyLength( exception, 2 ) == 5 );
+
+	const char unknown[] = { 0x01, 0x55 };
+	LM50_CHECK( Rtu::replyLength( unknown, 2 ) == Rtu::unknownLength );
+}
+
+void testModbus() {
+	testCrc();
+	testInterFrameGap();
+	testReplyLength();
+}
+
+}
+}
@@ -0,0 +1,33 @@
+#include "test.h"
+
+#include "apps/mqtt_client.h"
+
+#include <string>
+
+namespace LM50 {
+namespace Test {
+
+/**
+ * Makes the encoding of the packet length accessible
+ */
+class MqttClientProbe : public MqttClient {
+	public:
+		static std::string length( size_t length ) {
+			std::string dest;
+			appendLength( dest, length );
+			return dest;
+		}
+};
+
+void testMqtt() {
+	// The remaining length takes one byte up to 127, two bytes up to 16383
+	// and so on, the low seven bits first
+	LM50_CHECK( MqttClientProbe::length( 0 ) == std::string( 1, '\x00' ) );
+	LM50_CHECK( MqttClientProbe::length( 127 ) == "\x7f" );
+	LM50_CHECK( MqttClientProbe::length( 128 ) == "\x80\x01" );
+	LM50_CHECK( MqttClientProbe::length( 16383 ) == "\xff\x7f" );
+	LM50_CHECK( MqttClientProbe::length( 16384 ) == std::string( "\x80\x80\x01" ) );
+}
+
+}
+}